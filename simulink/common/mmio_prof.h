@@ -0,0 +1,309 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for profiling of memory mapped register accesses.
+
+  The instrumentation is compiled in only when MMIO_PROF is defined
+  for all sources of the model. The register accessors of the blocks
+  (mem_address_reg_rd/wr and the batched transfers) then count reads
+  and writes per block and per register and measure time spent in
+  them. When MMIO_PROF_TRACE is defined as well, each access is
+  recorded into the ring buffer of MMIO_PROF_TRACE_SIZE records.
+
+  The collected data are written at process exit to the file named
+  by MMIO_PROF_FILE environment variable (mmio_prof.dat by default)
+  and can be summarized by tools/mmio_prof_report.
+
+  The block slot is released when its map is freed and reused by the
+  next registration, so repeated start and stop in one process does
+  not fill the table. The dump holds the profile of the last block
+  of each slot, trace records of its earlier users are reported
+  under its name.
+
+  The state is defined as weak symbols, so all translation units
+  linked into one executable share it. The counters are updated by
+  relaxed atomic adds, the accesses can come from the Simulink step
+  and from the inner loop thread (zynq_3pmdrv1_rtloop.h) at once.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MMIO_PROF_H
+#define MMIO_PROF_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MMIO_PROF_MAGIC           "MMIOPRF1"
+#define MMIO_PROF_FILE_ENV        "MMIO_PROF_FILE"
+#define MMIO_PROF_FILE_DEFAULT    "mmio_prof.dat"
+
+#define MMIO_PROF_BLOCK_MAX       32
+#define MMIO_PROF_NAME_SIZE       64
+/* Registers are counted in 32-bit words from the start of the block */
+#define MMIO_PROF_REG_MAX         64
+
+#ifndef MMIO_PROF_TRACE_SIZE
+#define MMIO_PROF_TRACE_SIZE      65536 /* has to be power of 2 */
+#endif
+
+#define MMIO_PROF_KIND_RD         0
+#define MMIO_PROF_KIND_WR         1
+#define MMIO_PROF_KIND_STEP       2
+
+/*
+ * The file layout uses only fixed size types with natural alignment,
+ * so dumps taken on the 32-bit ARM target can be read on the host.
+ */
+typedef struct mmio_prof_file_hdr_t {
+  char     magic[8];
+  uint32_t block_count;
+  uint32_t reg_max;
+  uint32_t trace_size;
+  uint32_t clock_overhead_ns;
+  uint64_t trace_total;
+} mmio_prof_file_hdr_t;
+
+typedef struct mmio_prof_block_t {
+  char     name[MMIO_PROF_NAME_SIZE];
+  uint64_t regs_base_phys;
+  uint64_t steps;
+  uint64_t rd_count[MMIO_PROF_REG_MAX];
+  uint64_t wr_count[MMIO_PROF_REG_MAX];
+  uint64_t rd_ns[MMIO_PROF_REG_MAX];
+  uint64_t wr_ns[MMIO_PROF_REG_MAX];
+} mmio_prof_block_t;
+
+typedef struct mmio_prof_trace_rec_t {
+  uint64_t t_ns;
+  uint32_t value;
+  uint32_t dur_ns;
+  uint16_t block;
+  uint16_t reg_offs;
+  uint8_t  kind;
+  uint8_t  reserved[7];
+} mmio_prof_trace_rec_t;
+
+typedef struct mmio_prof_state_t {
+  unsigned block_count;     /* slots ever used, dumped */
+  unsigned clock_overhead_ns;
+  int      atexit_registered;
+  uint64_t trace_total;
+  mmio_prof_block_t block[MMIO_PROF_BLOCK_MAX];
+  uint8_t  block_used[MMIO_PROF_BLOCK_MAX]; /* registered and not released */
+} mmio_prof_state_t;
+
+#ifdef MMIO_PROF
+
+__attribute__((weak))
+mmio_prof_state_t mmio_prof_state;
+
+#ifdef MMIO_PROF_TRACE
+__attribute__((weak))
+mmio_prof_trace_rec_t mmio_prof_trace[MMIO_PROF_TRACE_SIZE];
+#endif /*MMIO_PROF_TRACE*/
+
+static inline
+uint64_t mmio_prof_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline
+void mmio_prof_dump(void)
+{
+	mmio_prof_state_t *st = &mmio_prof_state;
+	mmio_prof_file_hdr_t hdr;
+	const char *fname;
+	FILE *f;
+
+	fname = getenv(MMIO_PROF_FILE_ENV);
+	if ((fname == NULL) || (*fname == 0))
+		fname = MMIO_PROF_FILE_DEFAULT;
+
+	f = fopen(fname, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "mmio_prof: cannot create %s\n", fname);
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MMIO_PROF_MAGIC, sizeof(hdr.magic));
+	hdr.block_count = st->block_count;
+	hdr.reg_max = MMIO_PROF_REG_MAX;
+	hdr.clock_overhead_ns = st->clock_overhead_ns;
+  #ifdef MMIO_PROF_TRACE
+	hdr.trace_size = MMIO_PROF_TRACE_SIZE;
+	hdr.trace_total = st->trace_total;
+  #endif /*MMIO_PROF_TRACE*/
+
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	fwrite(st->block, sizeof(*st->block), st->block_count, f);
+
+  #ifdef MMIO_PROF_TRACE
+	/* Store the ring in chronological order */
+	if (st->trace_total > MMIO_PROF_TRACE_SIZE) {
+		unsigned head = st->trace_total & (MMIO_PROF_TRACE_SIZE - 1);
+		fwrite(mmio_prof_trace + head, sizeof(*mmio_prof_trace),
+		       MMIO_PROF_TRACE_SIZE - head, f);
+		fwrite(mmio_prof_trace, sizeof(*mmio_prof_trace), head, f);
+	} else {
+		fwrite(mmio_prof_trace, sizeof(*mmio_prof_trace),
+		       st->trace_total, f);
+	}
+  #endif /*MMIO_PROF_TRACE*/
+
+	fclose(f);
+}
+
+static inline
+void mmio_prof_block_rename(int id, const char *name)
+{
+	mmio_prof_block_t *blk;
+	size_t len;
+
+	if ((id < 0) || (name == NULL))
+		return;
+	blk = &mmio_prof_state.block[id];
+	/* Keep the tail of long block paths */
+	len = strlen(name);
+	if (len >= MMIO_PROF_NAME_SIZE)
+		name += len - MMIO_PROF_NAME_SIZE + 1;
+	memset(blk->name, 0, sizeof(blk->name));
+	strncpy(blk->name, name, MMIO_PROF_NAME_SIZE - 1);
+}
+
+/*
+ * Register profiled block, returns its identifier used
+ * by accessors or -1 when all slots are in use. Released
+ * slot is taken before a new one.
+ */
+static inline
+int mmio_prof_block_register(const char *name, uintptr_t regs_base_phys)
+{
+	mmio_prof_state_t *st = &mmio_prof_state;
+	mmio_prof_block_t *blk;
+	int i;
+
+	if (!st->atexit_registered) {
+		uint64_t t0, t1;
+
+		/* Cost of the timestamp pair is subtracted by the report */
+		t0 = mmio_prof_time_ns();
+		for (i = 0; i < 64; i++)
+			t1 = mmio_prof_time_ns();
+		st->clock_overhead_ns = (t1 - t0) / 64;
+
+		atexit(mmio_prof_dump);
+		st->atexit_registered = 1;
+	}
+
+	for (i = 0; i < (int)st->block_count; i++)
+		if (!st->block_used[i])
+			break;
+	if (i >= MMIO_PROF_BLOCK_MAX)
+		return -1;
+	if (i == (int)st->block_count)
+		st->block_count++;
+
+	blk = &st->block[i];
+	memset(blk, 0, sizeof(*blk));
+	blk->regs_base_phys = regs_base_phys;
+	mmio_prof_block_rename(i, name);
+	st->block_used[i] = 1;
+
+	return i;
+}
+
+/* Release the slot of the block, its profile stays until reused */
+static inline
+void mmio_prof_block_unregister(int id)
+{
+	if ((id < 0) || (id >= MMIO_PROF_BLOCK_MAX))
+		return;
+	mmio_prof_state.block_used[id] = 0;
+}
+
+static inline
+void mmio_prof_record(int id, unsigned kind, unsigned reg_offs,
+		uint32_t value, uint64_t t_ns, uint32_t dur_ns)
+{
+	mmio_prof_state_t *st = &mmio_prof_state;
+	mmio_prof_block_t *blk;
+	unsigned reg = reg_offs / 4;
+  #ifdef MMIO_PROF_TRACE
+	mmio_prof_trace_rec_t *rec;
+	uint64_t pos;
+  #endif /*MMIO_PROF_TRACE*/
+
+	if (id < 0)
+		return;
+	blk = &st->block[id];
+
+	/* The inner loop thread and the block step can share the map */
+	if (kind == MMIO_PROF_KIND_STEP) {
+		__atomic_fetch_add(&blk->steps, 1, __ATOMIC_RELAXED);
+	} else if (reg < MMIO_PROF_REG_MAX) {
+		if (kind == MMIO_PROF_KIND_RD) {
+			__atomic_fetch_add(&blk->rd_count[reg], 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&blk->rd_ns[reg], dur_ns, __ATOMIC_RELAXED);
+		} else {
+			__atomic_fetch_add(&blk->wr_count[reg], 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&blk->wr_ns[reg], dur_ns, __ATOMIC_RELAXED);
+		}
+	}
+
+  #ifdef MMIO_PROF_TRACE
+	pos = __atomic_fetch_add(&st->trace_total, 1, __ATOMIC_RELAXED);
+	rec = &mmio_prof_trace[pos & (MMIO_PROF_TRACE_SIZE - 1)];
+	rec->t_ns = t_ns;
+	rec->value = value;
+	rec->dur_ns = dur_ns;
+	rec->block = id;
+	rec->reg_offs = reg_offs;
+	rec->kind = kind;
+  #endif /*MMIO_PROF_TRACE*/
+}
+
+/* Mark start of the control step of given block */
+static inline
+void mmio_prof_step(int id)
+{
+	mmio_prof_record(id, MMIO_PROF_KIND_STEP, 0, 0, mmio_prof_time_ns(), 0);
+}
+
+static inline
+uint32_t mmio_prof_rd32(int id, void *regs_base_virt, unsigned reg_offs)
+{
+	uint64_t t0, t1;
+	uint32_t val;
+
+	t0 = mmio_prof_time_ns();
+	val = *(volatile uint32_t*)((char*)regs_base_virt + reg_offs);
+	t1 = mmio_prof_time_ns();
+	mmio_prof_record(id, MMIO_PROF_KIND_RD, reg_offs, val, t0, t1 - t0);
+
+	return val;
+}
+
+static inline
+void mmio_prof_wr32(int id, void *regs_base_virt, unsigned reg_offs,
+		uint32_t val)
+{
+	uint64_t t0, t1;
+
+	t0 = mmio_prof_time_ns();
+	*(volatile uint32_t*)((char*)regs_base_virt + reg_offs) = val;
+	t1 = mmio_prof_time_ns();
+	mmio_prof_record(id, MMIO_PROF_KIND_WR, reg_offs, val, t0, t1 - t0);
+}
+
+#endif /*MMIO_PROF*/
+
+#endif /*MMIO_PROF_H*/
@@ -0,0 +1,193 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for small binary cache of calibration results keyed by identity
+  of the board the calibration has been measured on.
+
+  The identity string is formed from the device tree serial number
+  when the platform provides it, otherwise from MAC address of the
+  first Ethernet interface (MZ_APO boards carry unique one) or from
+  the host name. The physical base of the peripheral and the memory
+  device (the MZAPO_MEMDEV stand-in differs from the board) are
+  appended, so each driver instance has its own entry.
+
+  Each entry is stored in its own file named by 64-bit FNV-1a hash
+  of the identity, placed in current directory or the directory
+  selected by MZAPO_CALDIR. The file holds header with the complete
+  identity string, payload size and checksum; entry which does not
+  match in any of them is treated as missing. The file is written
+  to temporary name and renamed, so interrupted write never leaves
+  partial entry behind.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_CALCACHE_H
+#define MZAPO_CALCACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MZAPO_CALCACHE_MAGIC      0x4d5a4343
+#define MZAPO_CALCACHE_VERSION    1
+#define MZAPO_CALCACHE_IDENT_LEN  96
+#define MZAPO_CALCACHE_DIR_ENV    "MZAPO_CALDIR"
+
+typedef struct mzapo_calcache_hdr_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;            /* payload bytes following the header */
+  uint32_t reserved;
+  uint64_t sum;             /* FNV-1a of the payload */
+  char     ident[MZAPO_CALCACHE_IDENT_LEN];
+} mzapo_calcache_hdr_t;
+
+static inline
+uint64_t mzapo_calcache_fnv(const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (size--) {
+		h ^= *(p++);
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* Read first line of small text file, trailing whitespace removed */
+static inline
+int mzapo_calcache_read_line(const char *fname, char *buf, size_t size)
+{
+	FILE *f = fopen(fname, "r");
+	size_t len;
+
+	if (f == NULL)
+		return -1;
+	len = fread(buf, 1, size - 1, f);
+	fclose(f);
+	buf[len] = 0;
+	/* Device tree strings are NUL terminated, text files end by newline */
+	len = strcspn(buf, "\n");
+	while ((len > 0) && ((unsigned char)buf[len - 1] <= ' '))
+		len--;
+	buf[len] = 0;
+	return len? 0: -1;
+}
+
+/*
+ * Fill identity of the board and peripheral instance, memdev is the
+ * device the registers are mapped from.
+ */
+static inline
+void mzapo_calcache_ident(char *ident, uintptr_t regs_base_phys,
+			  const char *memdev)
+{
+	char board[48];
+
+	if ((mzapo_calcache_read_line("/sys/firmware/devicetree/base/serial-number",
+				      board + 3, sizeof(board) - 3) == 0) ||
+	    (mzapo_calcache_read_line("/proc/device-tree/serial-number",
+				      board + 3, sizeof(board) - 3) == 0)) {
+		memcpy(board, "sn:", 3);
+	} else if (mzapo_calcache_read_line("/sys/class/net/eth0/address",
+					    board + 4, sizeof(board) - 4) == 0) {
+		memcpy(board, "mac:", 4);
+	} else {
+		memcpy(board, "host:", 5);
+		if (gethostname(board + 5, sizeof(board) - 5) < 0)
+			board[5] = 0;
+		board[sizeof(board) - 1] = 0;
+	}
+
+	/* Long stand-in path is cut, the ident is compared up to its length */
+	if (snprintf(ident, MZAPO_CALCACHE_IDENT_LEN, "%s@%08lx:%s", board,
+		     (unsigned long)regs_base_phys, memdev) >= MZAPO_CALCACHE_IDENT_LEN)
+		ident[MZAPO_CALCACHE_IDENT_LEN - 1] = 0;
+}
+
+static inline
+void mzapo_calcache_fname(char *fname, size_t size, const char *prefix,
+			  const char *ident)
+{
+	const char *dir = getenv(MZAPO_CALCACHE_DIR_ENV);
+
+	if ((dir == NULL) || (*dir == 0))
+		dir = ".";
+	snprintf(fname, size, "%s/%s_%016llx.bin", dir, prefix,
+		 (unsigned long long)mzapo_calcache_fnv(ident, strlen(ident)));
+}
+
+/*
+ * Load the payload stored for given identity. Returns 0 on success
+ * and -1 when there is no valid entry, data are untouched then.
+ */
+static inline
+int mzapo_calcache_load(const char *prefix, const char *ident,
+			void *data, size_t size)
+{
+	mzapo_calcache_hdr_t hdr;
+	char fname[256];
+	char *buf;
+	FILE *f;
+	int res = -1;
+
+	mzapo_calcache_fname(fname, sizeof(fname), prefix, ident);
+	f = fopen(fname, "rb");
+	if (f == NULL)
+		return -1;
+
+	buf = malloc(size);
+	if ((buf != NULL) &&
+	    (fread(&hdr, sizeof(hdr), 1, f) == 1) &&
+	    (hdr.magic == MZAPO_CALCACHE_MAGIC) &&
+	    (hdr.version == MZAPO_CALCACHE_VERSION) &&
+	    (hdr.size == size) &&
+	    !strncmp(hdr.ident, ident, MZAPO_CALCACHE_IDENT_LEN) &&
+	    (fread(buf, size, 1, f) == 1) &&
+	    (hdr.sum == mzapo_calcache_fnv(buf, size))) {
+		memcpy(data, buf, size);
+		res = 0;
+	}
+
+	free(buf);
+	fclose(f);
+	return res;
+}
+
+static inline
+int mzapo_calcache_save(const char *prefix, const char *ident,
+			const void *data, size_t size)
+{
+	mzapo_calcache_hdr_t hdr;
+	char fname[256];
+	char tmpname[264];
+	FILE *f;
+	int ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = MZAPO_CALCACHE_MAGIC;
+	hdr.version = MZAPO_CALCACHE_VERSION;
+	hdr.size = size;
+	hdr.sum = mzapo_calcache_fnv(data, size);
+	snprintf(hdr.ident, sizeof(hdr.ident), "%s", ident);
+
+	mzapo_calcache_fname(fname, sizeof(fname), prefix, ident);
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", fname);
+	f = fopen(tmpname, "wb");
+	if (f == NULL)
+		return -1;
+	ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1) &&
+	     (fwrite(data, size, 1, f) == 1);
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || (rename(tmpname, fname) < 0)) {
+		unlink(tmpname);
+		return -1;
+	}
+	return 0;
+}
+
+#endif /*MZAPO_CALCACHE_H*/
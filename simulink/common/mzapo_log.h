@@ -0,0 +1,621 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for compressed full-rate log of the driver block signals stored
+  in preallocated memory mapped file ring.
+
+  The log of the block is enabled by MZAPO_LOGDIR environment
+  variable, the file <dir>/<name>.mzlog is then created with size
+  MZAPO_LOGSIZE MiB (MZAPO_LOG_FILE_SIZE by default) and allocated
+  before the control loop starts. The log of the previous run is
+  not overwritten, the existing files are renamed to <name>.1.mzlog
+  (the previous run), <name>.2.mzlog and so on up to
+  MZAPO_LOG_KEEP, the oldest one is removed, and the new file is
+  created exclusively. Each record is vector of int32
+  channels (PWM words, ADC averages, IRC counts) named in the file
+  header and the number of the step it has been taken in.
+
+  The control step only copies the record into single-producer/
+  single-consumer staging ring in locked memory. When the ring is
+  full the record is dropped and counted, the step never blocks.
+  The flush thread runs with SCHED_IDLE policy, encodes the records
+  and stores them into the file through small window mapping which
+  slides over the file, so only the window is resident (and locked
+  by mlockall of ../common/mzapo_rtmem.h) and the page cache writes
+  the rest back.
+
+  The file is ring of fixed size blocks. Each block starts by its
+  sequence number and step number of its first record and can be
+  decoded on its own, the oldest blocks are overwritten when the
+  ring wraps. The records are encoded as difference to the previous
+  record of the block, the step number difference minus one and the
+  zigzag mapped channel differences are stored as LEB128 varints.
+  Slowly changing IRC positions, Hall sectors and constant PWM words
+  take one byte per channel.
+
+  The reader is tools/mzapo_log_read, it decodes the blocks into
+  column arrays and stores them as MATLAB level 4 MAT-file (loaded
+  by MATLAB load and scipy.io.loadmat) or text.
+
+  The log is also the trace format of the replay (mzapo_replay.h).
+  When MZAPO_REPLAYDIR is set, the block log is always created as
+  <name>.replay.mzlog in MZAPO_LOGDIR (or in the replay directory),
+  at least as large as the replayed trace, and the records are
+  encoded directly by the step, so none is dropped however fast
+  the replay runs.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_LOG_H
+#define MZAPO_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mzapo_rtmem.h"
+
+#define MZAPO_LOG_MAGIC           0x4d5a4c47
+#define MZAPO_LOG_BLK_MAGIC       0x4d5a4c42
+#define MZAPO_LOG_VERSION         2
+#define MZAPO_LOG_DIR_ENV         "MZAPO_LOGDIR"
+#define MZAPO_LOG_SIZE_ENV        "MZAPO_LOGSIZE"
+#define MZAPO_LOG_REPLAY_DIR_ENV  "MZAPO_REPLAYDIR"
+
+#ifndef MZAPO_LOG_FILE_SIZE
+#define MZAPO_LOG_FILE_SIZE       (256 << 20)
+#endif
+
+/* Logs of previous runs kept as <name>.<n>.mzlog */
+#ifndef MZAPO_LOG_KEEP
+#define MZAPO_LOG_KEEP            3
+#endif
+
+/* Staging ring records, has to be power of 2 */
+#ifndef MZAPO_LOG_STAGE_RECS
+#define MZAPO_LOG_STAGE_RECS      16384
+#endif
+
+#define MZAPO_LOG_HDR_SIZE        4096
+#define MZAPO_LOG_BLK_SIZE        (64 * 1024)
+#define MZAPO_LOG_WINDOW_BLKS     16
+#define MZAPO_LOG_CHAN_MAX        16
+#define MZAPO_LOG_NAME_LEN        16
+#define MZAPO_LOG_IDENT_LEN       96
+#define MZAPO_LOG_FLUSH_NS        10000000
+#define MZAPO_LOG_THREAD_STACK    (128 * 1024)
+
+/* Encoded record size limit, step difference and channels */
+#define MZAPO_LOG_REC_MAX(chan_count)  (10 + 5 * (chan_count))
+
+/* Linux value, not exported by <sched.h> without _GNU_SOURCE */
+#ifndef SCHED_IDLE
+#define SCHED_IDLE                5
+#endif
+
+typedef struct mzapo_log_hdr_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chan_count;
+  uint32_t blk_size;        /* bytes, block header included */
+  uint64_t blk_count;       /* blocks in the ring */
+  uint64_t period_ns;       /* nominal step period, 0 when not known */
+  uint64_t start_ns;        /* CLOCK_REALTIME at creation */
+  uint64_t blocks;          /* blocks written, updated by the flush thread */
+  uint64_t records;         /* records written */
+  uint64_t dropped;         /* records lost on full staging ring */
+  char     chan_name[MZAPO_LOG_CHAN_MAX][MZAPO_LOG_NAME_LEN];
+  char     ident[MZAPO_LOG_IDENT_LEN]; /* board the log is taken on, may be empty */
+} mzapo_log_hdr_t;
+
+typedef struct mzapo_log_blk_t {
+  uint32_t magic;           /* written last, 0 while the slot is rewritten */
+  uint32_t bytes;           /* encoded records following the header */
+  uint64_t seq;             /* block number, stored in slot seq % blk_count */
+  uint64_t n_first;         /* step number of the first record */
+  uint32_t rec_count;
+  uint32_t reserved;
+} mzapo_log_blk_t;
+
+typedef struct mzapo_log_t {
+  /* Control step */
+  struct {
+    uint64_t head;            /* records published to the staging ring */
+    uint64_t tail_seen;       /* consumer position read last */
+    uint64_t n;               /* step number of the next record */
+    uint64_t dropped;
+  } __attribute__((aligned(MZAPO_RTMEM_ALIGN)));
+  /* Flush thread */
+  struct {
+    uint64_t tail;            /* records taken from the staging ring */
+    uint64_t tail_pub;        /* tail seen by the control step */
+    mzapo_log_blk_t *blk;     /* block being filled, NULL if none */
+    uint8_t  *wp;
+    uint8_t  *blk_end;
+    uint64_t seq;
+    uint64_t prev_n;
+    int32_t  prev[MZAPO_LOG_CHAN_MAX];
+    uint8_t  *win;            /* mapped window of the block ring */
+    uint64_t win_idx;
+  } __attribute__((aligned(MZAPO_RTMEM_ALIGN)));
+  /* Configuration */
+  unsigned char *stage;
+  size_t   stage_size;
+  size_t   slot_size;
+  unsigned chan_count;
+  mzapo_log_hdr_t *hdr;
+  int      fd;
+  int      sync;              /* encoded by the step, no staging ring (replay) */
+  int      stop;
+  int      running;
+  pthread_t thread;
+} mzapo_log_t;
+
+static inline
+size_t mzapo_log_slot_size(unsigned chan_count)
+{
+	return (sizeof(uint64_t) + sizeof(int32_t) * chan_count + 7) &
+	       ~(size_t)7;
+}
+
+static inline
+uint8_t *mzapo_log_put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*(p++) = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*(p++) = (uint8_t)v;
+	return p;
+}
+
+/* Returns pointer after the varint, NULL when it does not end before end */
+static inline
+const uint8_t *mzapo_log_get_varint(const uint8_t *p, const uint8_t *end,
+				    uint64_t *v)
+{
+	uint64_t val = 0;
+	unsigned shift = 0;
+
+	while (p < end) {
+		uint8_t b = *(p++);
+
+		val |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = val;
+			return p;
+		}
+		shift += 7;
+		if (shift >= 64)
+			break;
+	}
+	return NULL;
+}
+
+static inline
+uint32_t mzapo_log_zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline
+int32_t mzapo_log_unzigzag(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/*
+ * Decode block into columns, n[] receives step numbers and col[ch][]
+ * the channel values, both with room for blk->rec_count records.
+ * The blk points to blk_size bytes. Returns number of records decoded
+ * or -1 when the block is damaged.
+ */
+static inline
+int mzapo_log_blk_decode(const mzapo_log_blk_t *blk, size_t blk_size,
+			 unsigned chan_count, uint64_t *n, int32_t *const *col)
+{
+	const uint8_t *p = (const uint8_t *)(blk + 1);
+	const uint8_t *end = p + blk->bytes;
+	int32_t prev[MZAPO_LOG_CHAN_MAX];
+	uint64_t prev_n = blk->n_first - 1;
+	uint64_t v;
+	uint32_t i;
+	unsigned ch;
+
+	if ((blk->bytes > blk_size - sizeof(*blk)) ||
+	    (chan_count > MZAPO_LOG_CHAN_MAX))
+		return -1;
+
+	memset(prev, 0, sizeof(prev));
+	for (i = 0; i < blk->rec_count; i++) {
+		if ((p = mzapo_log_get_varint(p, end, &v)) == NULL)
+			return -1;
+		prev_n += v + 1;
+		n[i] = prev_n;
+		for (ch = 0; ch < chan_count; ch++) {
+			if ((p = mzapo_log_get_varint(p, end, &v)) == NULL)
+				return -1;
+			prev[ch] = (int32_t)((uint32_t)prev[ch] +
+					     (uint32_t)mzapo_log_unzigzag(v));
+			col[ch][i] = prev[ch];
+		}
+	}
+	return i;
+}
+
+/* Pointer to the block slot, maps the window holding it */
+static inline
+mzapo_log_blk_t *mzapo_log_slot_map(mzapo_log_t *log, uint64_t seq)
+{
+	uint64_t slot = seq % log->hdr->blk_count;
+	uint64_t win_idx = slot / MZAPO_LOG_WINDOW_BLKS;
+	size_t win_size = (size_t)MZAPO_LOG_WINDOW_BLKS * MZAPO_LOG_BLK_SIZE;
+	void *win;
+
+	if ((log->win == NULL) || (log->win_idx != win_idx)) {
+		if (log->win != NULL) {
+			msync(log->win, win_size, MS_ASYNC);
+			munmap(log->win, win_size);
+			log->win = NULL;
+		}
+		win = mmap(NULL, win_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   log->fd, MZAPO_LOG_HDR_SIZE + (off_t)win_idx * win_size);
+		if (win == MAP_FAILED)
+			return NULL;
+		log->win = win;
+		log->win_idx = win_idx;
+	}
+	return (mzapo_log_blk_t *)(log->win + (slot % MZAPO_LOG_WINDOW_BLKS) *
+				   MZAPO_LOG_BLK_SIZE);
+}
+
+/* Publish the block being filled, empty block is left unused */
+static inline
+void mzapo_log_blk_close(mzapo_log_t *log)
+{
+	mzapo_log_blk_t *blk = log->blk;
+	mzapo_log_hdr_t *hdr = log->hdr;
+
+	if (blk == NULL)
+		return;
+	log->blk = NULL;
+	if (!blk->rec_count)
+		return;
+
+	blk->bytes = log->wp - (uint8_t *)(blk + 1);
+	blk->seq = log->seq;
+	__atomic_store_n(&blk->magic, MZAPO_LOG_BLK_MAGIC, __ATOMIC_RELEASE);
+
+	hdr->records += blk->rec_count;
+	hdr->dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+	__atomic_store_n(&hdr->blocks, ++log->seq, __ATOMIC_RELEASE);
+}
+
+static inline
+int mzapo_log_blk_open(mzapo_log_t *log, uint64_t n)
+{
+	mzapo_log_blk_t *blk = mzapo_log_slot_map(log, log->seq);
+
+	if (blk == NULL)
+		return -1;
+	/* The reader skips the slot until it is complete again */
+	__atomic_store_n(&blk->magic, 0, __ATOMIC_RELEASE);
+	blk->n_first = n;
+	blk->rec_count = 0;
+	blk->bytes = 0;
+	log->blk = blk;
+	log->wp = (uint8_t *)(blk + 1);
+	log->blk_end = (uint8_t *)blk + MZAPO_LOG_BLK_SIZE;
+	log->prev_n = n - 1;
+	memset(log->prev, 0, sizeof(log->prev));
+	return 0;
+}
+
+static inline
+int mzapo_log_encode(mzapo_log_t *log, uint64_t n, const int32_t *val)
+{
+	uint8_t *p;
+	unsigned ch;
+
+	if ((log->blk == NULL) || (log->blk_end - log->wp <
+				   MZAPO_LOG_REC_MAX(log->chan_count))) {
+		mzapo_log_blk_close(log);
+		if (mzapo_log_blk_open(log, n) < 0)
+			return -1;
+	}
+
+	p = mzapo_log_put_varint(log->wp, n - log->prev_n - 1);
+	for (ch = 0; ch < log->chan_count; ch++) {
+		p = mzapo_log_put_varint(p, mzapo_log_zigzag((int32_t)
+				((uint32_t)val[ch] - (uint32_t)log->prev[ch])));
+		log->prev[ch] = val[ch];
+	}
+	log->prev_n = n;
+	log->wp = p;
+	log->blk->rec_count++;
+	return 0;
+}
+
+/* Encode all records published so far */
+static inline
+void mzapo_log_drain(mzapo_log_t *log)
+{
+	uint64_t head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+	const unsigned char *slot;
+
+	while (log->tail != head) {
+		slot = log->stage + (size_t)(log->tail & (MZAPO_LOG_STAGE_RECS - 1)) *
+		       log->slot_size;
+		if (mzapo_log_encode(log, *(const uint64_t *)slot,
+				     (const int32_t *)(slot + sizeof(uint64_t))) < 0)
+			break;
+		log->tail++;
+		if (!(log->tail & 255))
+			__atomic_store_n(&log->tail_pub, log->tail, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&log->tail_pub, log->tail, __ATOMIC_RELEASE);
+}
+
+/* Publish the last block and write the window back */
+static inline
+void mzapo_log_finish(mzapo_log_t *log)
+{
+	mzapo_log_blk_close(log);
+	if (log->win != NULL) {
+		msync(log->win, (size_t)MZAPO_LOG_WINDOW_BLKS *
+		      MZAPO_LOG_BLK_SIZE, MS_SYNC);
+		munmap(log->win, (size_t)MZAPO_LOG_WINDOW_BLKS *
+		       MZAPO_LOG_BLK_SIZE);
+		log->win = NULL;
+	}
+}
+
+static inline
+void *mzapo_log_thread(void *arg)
+{
+	mzapo_log_t *log = (mzapo_log_t *)arg;
+	struct timespec ts = {0, MZAPO_LOG_FLUSH_NS};
+	int stop;
+
+	do {
+		stop = __atomic_load_n(&log->stop, __ATOMIC_ACQUIRE);
+		mzapo_log_drain(log);
+		if (!stop)
+			nanosleep(&ts, NULL);
+	} while (!stop);
+
+	mzapo_log_finish(log);
+	return NULL;
+}
+
+static inline
+void mzapo_log_destroy(mzapo_log_t *log)
+{
+	if (log == NULL)
+		return;
+	if (log->running) {
+		__atomic_store_n(&log->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(log->thread, NULL);
+	} else if (log->hdr != NULL) {
+		mzapo_log_finish(log);
+	}
+	if (log->hdr != NULL) {
+		log->hdr->dropped = log->dropped;
+		msync(log->hdr, MZAPO_LOG_HDR_SIZE, MS_SYNC);
+		munmap(log->hdr, MZAPO_LOG_HDR_SIZE);
+	}
+	if (log->stage != NULL)
+		munmap(log->stage, log->stage_size);
+	if (log->fd >= 0)
+		close(log->fd);
+	mzapo_rtmem_free(log);
+}
+
+/*
+ * Create the log named by the block, chan_name holds chan_count
+ * channel names, ident identifies the board (NULL if not needed).
+ * Returns NULL when logging is not enabled or the file cannot be
+ * prepared, the block then runs without it.
+ */
+/*
+ * Create <dir>/<name><suffix>.mzlog exclusively, the logs of the
+ * previous runs are shifted to <name><suffix>.<n>.mzlog first.
+ * Returns the file descriptor or -1.
+ */
+static inline
+int mzapo_log_open_rotated(const char *dir, const char *name,
+			   const char *suffix)
+{
+	char from[256], to[256];
+	int fd, n, retry;
+
+	for (retry = 0; retry < 3; retry++) {
+		snprintf(to, sizeof(to), "%s/%s%s.%d.mzlog", dir, name, suffix,
+			 MZAPO_LOG_KEEP);
+		unlink(to);
+		for (n = MZAPO_LOG_KEEP; n > 0; n--) {
+			if (n > 1)
+				snprintf(from, sizeof(from), "%s/%s%s.%d.mzlog",
+					 dir, name, suffix, n - 1);
+			else
+				snprintf(from, sizeof(from), "%s/%s%s.mzlog",
+					 dir, name, suffix);
+			snprintf(to, sizeof(to), "%s/%s%s.%d.mzlog", dir, name,
+				 suffix, n);
+			rename(from, to);
+		}
+		/* Another block of the same name may have created it since */
+		fd = open(from, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if ((fd >= 0) || (errno != EEXIST))
+			return fd;
+	}
+	return -1;
+}
+
+static inline
+mzapo_log_t *mzapo_log_create(const char *name, unsigned chan_count,
+			      const char *const *chan_name, double period_s,
+			      const char *ident)
+{
+	const char *dir = getenv(MZAPO_LOG_DIR_ENV);
+	const char *size_env = getenv(MZAPO_LOG_SIZE_ENV);
+	const char *replay_dir = getenv(MZAPO_LOG_REPLAY_DIR_ENV);
+	size_t win_size = (size_t)MZAPO_LOG_WINDOW_BLKS * MZAPO_LOG_BLK_SIZE;
+	struct sched_param schp = {.sched_priority = 0};
+	const char *suffix = "";
+	pthread_attr_t attr;
+	struct timespec ts;
+	struct stat st;
+	mzapo_log_t *log;
+	char fname[256];
+	off_t size;
+	unsigned ch;
+	int res;
+
+	if ((replay_dir != NULL) && *replay_dir) {
+		/* Output of the replay, sized to hold the whole trace */
+		if ((dir == NULL) || (*dir == 0))
+			dir = replay_dir;
+		suffix = ".replay";
+	}
+	if ((dir == NULL) || (*dir == 0) || (chan_count > MZAPO_LOG_CHAN_MAX))
+		return NULL;
+
+	size = MZAPO_LOG_FILE_SIZE;
+	if ((size_env != NULL) && (atol(size_env) > 0))
+		size = (off_t)atol(size_env) << 20;
+	if (*suffix) {
+		snprintf(fname, sizeof(fname), "%s/%s.mzlog", replay_dir, name);
+		if ((stat(fname, &st) == 0) && (st.st_size > size))
+			size = st.st_size + win_size;
+	}
+	size = (size - MZAPO_LOG_HDR_SIZE) / win_size * win_size;
+	if (size <= 0)
+		size = win_size;
+
+	log = mzapo_rtmem_alloc(sizeof(*log));
+	if (log == NULL)
+		return NULL;
+	log->fd = -1;
+	log->chan_count = chan_count;
+	log->slot_size = mzapo_log_slot_size(chan_count);
+	log->sync = *suffix != 0;
+
+	/* Staging ring is touched by the control step, keep it resident */
+	if (!log->sync) {
+		log->stage_size = log->slot_size * MZAPO_LOG_STAGE_RECS;
+		log->stage = mmap(NULL, log->stage_size, PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (log->stage == MAP_FAILED) {
+			log->stage = NULL;
+			goto error;
+		}
+		mzapo_rtmem_prefault(log->stage, log->stage_size);
+	}
+
+	log->fd = mzapo_log_open_rotated(dir, name, suffix);
+	if (log->fd < 0)
+		goto error;
+	/* Allocate the whole ring now, fall back to sparse file */
+	if ((posix_fallocate(log->fd, 0, MZAPO_LOG_HDR_SIZE + size) != 0) &&
+	    (ftruncate(log->fd, MZAPO_LOG_HDR_SIZE + size) < 0))
+		goto error;
+
+	log->hdr = mmap(NULL, MZAPO_LOG_HDR_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, log->fd, 0);
+	if (log->hdr == MAP_FAILED) {
+		log->hdr = NULL;
+		goto error;
+	}
+	memset(log->hdr, 0, MZAPO_LOG_HDR_SIZE);
+	log->hdr->version = MZAPO_LOG_VERSION;
+	log->hdr->chan_count = chan_count;
+	log->hdr->blk_size = MZAPO_LOG_BLK_SIZE;
+	log->hdr->blk_count = size / MZAPO_LOG_BLK_SIZE;
+	log->hdr->period_ns = period_s > 0? period_s * 1e9: 0;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	log->hdr->start_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	for (ch = 0; ch < chan_count; ch++)
+		strncpy(log->hdr->chan_name[ch], chan_name[ch],
+			MZAPO_LOG_NAME_LEN - 1);
+	if (ident != NULL)
+		snprintf(log->hdr->ident, MZAPO_LOG_IDENT_LEN, "%s", ident);
+	__atomic_store_n(&log->hdr->magic, MZAPO_LOG_MAGIC, __ATOMIC_RELEASE);
+
+	/* The first window is mapped before the control loop starts */
+	if (mzapo_log_slot_map(log, 0) == NULL)
+		goto error;
+	if (log->sync)
+		return log;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, MZAPO_LOG_THREAD_STACK);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_IDLE);
+	pthread_attr_setschedparam(&attr, &schp);
+	res = pthread_create(&log->thread, &attr, mzapo_log_thread, log);
+	if (res != 0) {
+		pthread_attr_destroy(&attr);
+		pthread_attr_init(&attr);
+		pthread_attr_setstacksize(&attr, MZAPO_LOG_THREAD_STACK);
+		res = pthread_create(&log->thread, &attr, mzapo_log_thread, log);
+	}
+	pthread_attr_destroy(&attr);
+	if (res != 0)
+		goto error;
+	log->running = 1;
+
+	return log;
+
+error:
+	fprintf(stderr, "%s: log %s/%s%s.mzlog cannot be created\n", name, dir,
+		name, suffix);
+	mzapo_log_destroy(log);
+	return NULL;
+}
+
+/*
+ * Queue record of the step, wait-free. The step number is counted
+ * by the log, dropped records leave gaps in it.
+ */
+static inline
+void mzapo_log_write(mzapo_log_t *log, const int32_t *val)
+{
+	unsigned char *slot;
+	uint64_t head;
+
+	if (log == NULL)
+		return;
+	if (log->sync) {
+		if (mzapo_log_encode(log, log->n++, val) < 0)
+			log->dropped++;
+		return;
+	}
+	head = log->head;
+	if (head - log->tail_seen >= MZAPO_LOG_STAGE_RECS) {
+		log->tail_seen = __atomic_load_n(&log->tail_pub, __ATOMIC_ACQUIRE);
+		if (head - log->tail_seen >= MZAPO_LOG_STAGE_RECS) {
+			log->n++;
+			__atomic_store_n(&log->dropped, log->dropped + 1,
+					 __ATOMIC_RELAXED);
+			return;
+		}
+	}
+	slot = log->stage + (size_t)(head & (MZAPO_LOG_STAGE_RECS - 1)) *
+	       log->slot_size;
+	*(uint64_t *)slot = log->n++;
+	memcpy(slot + sizeof(uint64_t), val, sizeof(int32_t) * log->chan_count);
+	__atomic_store_n(&log->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif /*MZAPO_LOG_H*/
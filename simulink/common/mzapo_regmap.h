@@ -0,0 +1,227 @@
+/*******************************************************************
+  Typed access to the MZ_APO design and 3-phase motor driver
+  registers generated from the description in mzapo_regs.def
+
+  mzapo_regmap.h     - header only register layer for C and C++
+
+  C consumers get for each block, register and field
+
+    <BLK>_BASE_PHYS, <BLK>_SIZE, <BLK>_BASE_PHYS_<idx>
+    <BLK>_regs_t         typed handle of mapped block
+    <BLK>_regs(virt)     handle from virtual address of the block
+    <BLK>_<REG>_OFFS     offset of the register in bytes
+    <BLK>_<REG>_rd(h)    read, not generated for write only registers
+    <BLK>_<REG>_wr(h, v) write, not generated for read only registers
+    <BLK>_<REG>_<FLD>_SHIFT, <BLK>_<REG>_<FLD>_WIDTH
+    <BLK>_<REG>_<FLD>_get(v)  extract field from register value
+    <BLK>_<REG>_<FLD>_val(x)  field value placed and masked
+
+  and the constant expression macros
+
+    MZAPO_REGMAP_MASK(BLK_REG_FLD)
+    MZAPO_REGMAP_VAL(BLK_REG_FLD, x)  constant x, the build fails
+                                      when x does not fit the field
+
+  C++ consumers get the same description as types in namespace
+  mzapo_regmap::<BLK>, the handle regs<BLK::block> checks at compile
+  time that the register belongs to the block and allows the access
+  direction, val<FLD, x>() checks the field width:
+
+    mzapo_regmap::regs<Z3PMDRV1::block> h(virt);
+    h.wr<Z3PMDRV1::PWM1>(val<Z3PMDRV1::PWM1_EN, 1>() |
+                         val<Z3PMDRV1::PWM1_VAL>(duty));
+
+  The handle holds only the volatile pointer, each access is single
+  load or store with the register offset as immediate, so the layer
+  compiles to the same code as hand-written offset arithmetic
+  (tools/mzapo_regmap_cmp compares both).
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_REGMAP_H
+#define MZAPO_REGMAP_H
+
+#include <stdint.h>
+#ifdef __cplusplus
+#include <type_traits>
+#endif /*__cplusplus*/
+
+#define MZAPO_REGMAP_ACC_RO  1
+#define MZAPO_REGMAP_ACC_WO  2
+#define MZAPO_REGMAP_ACC_RW  3
+
+#define MZAPO_REGMAP_MASK(fld) \
+	((uint32_t)(((1ULL << fld##_WIDTH) - 1) << fld##_SHIFT))
+
+#ifndef __cplusplus
+#define MZAPO_REGMAP_VAL(fld, x) \
+	((uint32_t)(0 * sizeof(struct { \
+		int mzapo_regmap_fits: ((uint64_t)(x) >> fld##_WIDTH)? -1: 1; \
+	})) | ((uint32_t)(x) << fld##_SHIFT))
+#else /*__cplusplus*/
+#define MZAPO_REGMAP_VAL(fld, x) \
+	(mzapo_regmap::val_check<((uint64_t)(x) >> fld##_WIDTH) == 0>::ok * \
+	 ((uint32_t)(x) << fld##_SHIFT))
+#endif /*__cplusplus*/
+
+/* C layer */
+
+#define MZAPO_REGMAP_BLOCK(blk, base_phys, size) \
+	enum { blk##_BASE_PHYS = base_phys, blk##_SIZE = size }; \
+	typedef struct blk##_regs_t { \
+		volatile uint32_t *base; \
+	} blk##_regs_t; \
+	static inline blk##_regs_t blk##_regs(void *base_virt) \
+	{ \
+		blk##_regs_t h = {(volatile uint32_t *)base_virt}; \
+		return h; \
+	}
+
+#define MZAPO_REGMAP_INSTANCE(blk, idx, base_phys) \
+	enum { blk##_BASE_PHYS_##idx = base_phys };
+
+#define MZAPO_REGMAP_RD_RO(blk, reg) \
+	static inline uint32_t blk##_##reg##_rd(blk##_regs_t h) \
+	{ \
+		return h.base[blk##_##reg##_OFFS / 4]; \
+	}
+#define MZAPO_REGMAP_RD_WO(blk, reg)
+#define MZAPO_REGMAP_RD_RW(blk, reg) MZAPO_REGMAP_RD_RO(blk, reg)
+
+#define MZAPO_REGMAP_WR_WO(blk, reg) \
+	static inline void blk##_##reg##_wr(blk##_regs_t h, uint32_t v) \
+	{ \
+		h.base[blk##_##reg##_OFFS / 4] = v; \
+	}
+#define MZAPO_REGMAP_WR_RO(blk, reg)
+#define MZAPO_REGMAP_WR_RW(blk, reg) MZAPO_REGMAP_WR_WO(blk, reg)
+
+#define MZAPO_REGMAP_REG(blk, reg, offs, access) \
+	enum { blk##_##reg##_OFFS = offs, \
+	       blk##_##reg##_ACCESS = MZAPO_REGMAP_ACC_##access }; \
+	MZAPO_REGMAP_RD_##access(blk, reg) \
+	MZAPO_REGMAP_WR_##access(blk, reg)
+
+#define MZAPO_REGMAP_FIELD(blk, reg, fld, shift, width) \
+	enum { blk##_##reg##_##fld##_SHIFT = shift, \
+	       blk##_##reg##_##fld##_WIDTH = width }; \
+	static inline uint32_t blk##_##reg##_##fld##_get(uint32_t v) \
+	{ \
+		return (v & MZAPO_REGMAP_MASK(blk##_##reg##_##fld)) >> shift; \
+	} \
+	static inline uint32_t blk##_##reg##_##fld##_val(uint32_t x) \
+	{ \
+		return (x << shift) & MZAPO_REGMAP_MASK(blk##_##reg##_##fld); \
+	}
+
+#include "mzapo_regs.def"
+
+#undef MZAPO_REGMAP_RD_RO
+#undef MZAPO_REGMAP_RD_WO
+#undef MZAPO_REGMAP_RD_RW
+#undef MZAPO_REGMAP_WR_RO
+#undef MZAPO_REGMAP_WR_WO
+#undef MZAPO_REGMAP_WR_RW
+
+/* C++ layer */
+
+#ifdef __cplusplus
+
+namespace mzapo_regmap {
+
+template<bool fits> struct val_check;
+template<> struct val_check<true> { enum { ok = 1 }; };
+
+template<class Blk>
+class regs {
+public:
+	explicit regs(void *base_virt): base((volatile uint32_t *)base_virt) {}
+
+	template<class Reg>
+	uint32_t rd() const
+	{
+		static_assert(std::is_same<typename Reg::block_t, Blk>::value,
+			      "register of another block");
+		static_assert(Reg::access & MZAPO_REGMAP_ACC_RO,
+			      "register is write only");
+		return base[Reg::offs / 4];
+	}
+
+	template<class Reg>
+	void wr(uint32_t v) const
+	{
+		static_assert(std::is_same<typename Reg::block_t, Blk>::value,
+			      "register of another block");
+		static_assert(Reg::access & MZAPO_REGMAP_ACC_WO,
+			      "register is read only");
+		base[Reg::offs / 4] = v;
+	}
+
+private:
+	volatile uint32_t *base;
+};
+
+template<class Fld>
+constexpr uint32_t mask()
+{
+	return (uint32_t)(((1ULL << Fld::width) - 1) << Fld::shift);
+}
+
+template<class Fld, uint32_t x>
+constexpr uint32_t val()
+{
+	static_assert(((uint64_t)x >> Fld::width) == 0,
+		      "value does not fit the field");
+	return x << Fld::shift;
+}
+
+template<class Fld>
+constexpr uint32_t val(uint32_t x)
+{
+	return (x << Fld::shift) & mask<Fld>();
+}
+
+template<class Fld>
+constexpr uint32_t get(uint32_t v)
+{
+	return (v & mask<Fld>()) >> Fld::shift;
+}
+
+} /*namespace mzapo_regmap*/
+
+#define MZAPO_REGMAP_BLOCK(blk, base_phys_, size_) \
+	namespace mzapo_regmap { namespace blk { \
+		struct block { \
+			enum : uintptr_t { base_phys = base_phys_, size = size_ }; \
+		}; \
+	} }
+
+#define MZAPO_REGMAP_INSTANCE(blk, idx, addr) \
+	namespace mzapo_regmap { namespace blk { \
+		enum : uintptr_t { base_phys_##idx = addr }; \
+	} }
+
+#define MZAPO_REGMAP_REG(blk, reg, offs_, access_) \
+	namespace mzapo_regmap { namespace blk { \
+		struct reg { \
+			typedef block block_t; \
+			enum : unsigned { offs = offs_, \
+					  access = MZAPO_REGMAP_ACC_##access_ }; \
+		}; \
+	} }
+
+#define MZAPO_REGMAP_FIELD(blk, reg, fld, shift_, width_) \
+	namespace mzapo_regmap { namespace blk { \
+		struct reg##_##fld { \
+			typedef reg reg_t; \
+			enum : unsigned { shift = shift_, width = width_ }; \
+		}; \
+	} }
+
+#include "mzapo_regs.def"
+
+#endif /*__cplusplus*/
+
+#endif /*MZAPO_REGMAP_H*/
@@ -0,0 +1,97 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for write elision through shadow copy of peripheral registers.
+
+  Each register write is uncached AXI transaction which stalls the
+  CPU and occupies the interconnect shared by all driver blocks.
+  The commands written every step are often equal to the previous
+  ones (idle, saturated or shut down output), so the driver keeps
+  the last value written to each register and skips the write when
+  the new value matches.
+
+  The shadow values are kept by the driver next to its other state,
+  indexed by the register word offset from the base of the shadowed
+  range, at most MZAPO_REGSHADOW_REGS words. This control structure
+  holds mask of words known to match the register content, count of
+  writes elided in the current step and countdown to the forced
+  refresh. Every MZAPO_REGSHADOW_REFRESH steps the whole shadow is
+  invalidated and all registers are rewritten, so value lost by the
+  peripheral (reset, other bus master) is restored in bounded time.
+  The value 0 disables the elision.
+
+  Writes done outside of the shadow have to invalidate the word,
+  the driver invalidates the whole shadow when it needs all writes
+  issued (shutdown at the end of the run).
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_REGSHADOW_H
+#define MZAPO_REGSHADOW_H
+
+#include <stdint.h>
+
+/* Steps between forced rewrites of all shadowed registers, 0 .. no elision */
+#ifndef MZAPO_REGSHADOW_REFRESH
+#define MZAPO_REGSHADOW_REFRESH   1000
+#endif
+
+#define MZAPO_REGSHADOW_REGS      8
+
+typedef struct mzapo_regshadow_t {
+  uint8_t  valid;           /* mask of shadow words matching the registers */
+  uint8_t  elided;          /* writes skipped since the step start */
+  uint16_t refresh_cnt;     /* steps left to the forced refresh */
+} mzapo_regshadow_t;
+
+typedef char mzapo_regshadow_refresh_check[
+	(MZAPO_REGSHADOW_REFRESH >= 0) && (MZAPO_REGSHADOW_REFRESH <= 65536)? 1: -1];
+
+static inline
+void mzapo_regshadow_invalidate(mzapo_regshadow_t *sh)
+{
+	sh->valid = 0;
+}
+
+/* The register of the word has been written outside of the shadow */
+static inline
+void mzapo_regshadow_forget(mzapo_regshadow_t *sh, unsigned idx)
+{
+	if (idx < MZAPO_REGSHADOW_REGS)
+		sh->valid &= ~(1u << idx);
+}
+
+/* Start of the step, clears the elided count and counts down the refresh */
+static inline
+void mzapo_regshadow_step(mzapo_regshadow_t *sh)
+{
+	sh->elided = 0;
+	if (sh->refresh_cnt) {
+		sh->refresh_cnt--;
+		return;
+	}
+	sh->refresh_cnt = MZAPO_REGSHADOW_REFRESH? MZAPO_REGSHADOW_REFRESH - 1: 0;
+	sh->valid = 0;
+}
+
+/*
+ * Returns nonzero when the val has to be written to the register
+ * of the word idx, the shadow is updated as if the write is done.
+ */
+static inline
+int mzapo_regshadow_wr(mzapo_regshadow_t *sh, uint32_t *shadow,
+		       unsigned idx, uint32_t val)
+{
+  #if MZAPO_REGSHADOW_REFRESH
+	if ((sh->valid & (1u << idx)) && (shadow[idx] == val)) {
+		sh->elided++;
+		return 0;
+	}
+	shadow[idx] = val;
+	sh->valid |= 1u << idx;
+  #endif /*MZAPO_REGSHADOW_REFRESH*/
+	return 1;
+}
+
+#endif /*MZAPO_REGSHADOW_H*/
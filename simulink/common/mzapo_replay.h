@@ -0,0 +1,295 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for replay of recorded sensor traces through the driver blocks.
+
+  The replay is enabled by MZAPO_REPLAYDIR environment variable
+  pointing to directory with logs recorded on the rig with
+  MZAPO_LOGDIR (see mzapo_log.h). Each block then takes the values
+  which it would read from its registers (ADC cumulative sums and
+  sequence number, IRC position and index, Hall code, knob word)
+  from the next record of its trace <dir>/<name>.mzlog, one record
+  per transfer, in the order the records have been taken. The
+  commanded values are captured by the block log, which is written
+  to <name>.replay.mzlog without drops in replay mode, so the run
+  can be compared to the recording by tools/mzapo_log_read.
+
+  The replay never drives the hardware. The register mapping
+  (phys_address_access.h) checks the replay mode itself and maps
+  the stand-in file in the replay directory instead of the device
+  selected by MZAPO_MEMDEV, the 3-phase driver does not open the
+  interrupt source, so the step runs as fast as the model is
+  executed. The process environment is not changed, so the result
+  does not depend on the order in which the blocks are started.
+  The block requests simulation stop when its trace ends.
+
+  The trace is read block by block by pread(), only the decoded
+  block is held in memory, so the replay of the full size log does
+  not pin it by mlockall of mzapo_rtmem.h.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_REPLAY_H
+#define MZAPO_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mzapo_log.h"
+
+#define MZAPO_REPLAY_DIR_ENV      MZAPO_LOG_REPLAY_DIR_ENV
+#define MZAPO_REPLAY_MEMDEV_FILE  "mzapo_replay.mem"
+
+typedef struct mzapo_replay_blk_ref_t {
+  uint64_t seq;
+  uint64_t slot;
+} mzapo_replay_blk_ref_t;
+
+typedef struct mzapo_replay_t {
+  int      fd;
+  mzapo_log_hdr_t hdr;
+  mzapo_replay_blk_ref_t *blk_ref;  /* closed blocks in sequence order */
+  size_t   blk_count;
+  size_t   blk_next;
+  mzapo_log_blk_t *blk;             /* block being replayed */
+  size_t   rec_max;
+  size_t   rec_count;
+  size_t   rec_idx;
+  uint64_t *n;
+  int32_t  *col[MZAPO_LOG_CHAN_MAX];
+  unsigned chan_count;
+  unsigned chan_idx[MZAPO_LOG_CHAN_MAX]; /* trace channel of requested one */
+  int32_t  val[MZAPO_LOG_CHAN_MAX];      /* last replayed values */
+  uint64_t n_last;
+  uint64_t records;
+  uint64_t gaps;                    /* records dropped during recording */
+  int      done;
+  char     name[MZAPO_LOG_NAME_LEN];
+} mzapo_replay_t;
+
+static inline
+int mzapo_replay_enabled(void)
+{
+	const char *dir = getenv(MZAPO_REPLAY_DIR_ENV);
+
+	return (dir != NULL) && (*dir != 0);
+}
+
+/*
+ * Stand-in file mapped instead of the registers in replay mode.
+ * Returns 0 when replay is not enabled, 1 with fname filled when
+ * it is.
+ */
+static inline
+int mzapo_replay_memdev(char *fname, size_t size)
+{
+	const char *dir = getenv(MZAPO_REPLAY_DIR_ENV);
+
+	if ((dir == NULL) || (*dir == 0))
+		return 0;
+
+	snprintf(fname, size, "%s/%s", dir, MZAPO_REPLAY_MEMDEV_FILE);
+	return 1;
+}
+
+static inline
+int mzapo_replay_blk_ref_cmp(const void *a, const void *b)
+{
+	uint64_t sa = ((const mzapo_replay_blk_ref_t *)a)->seq;
+	uint64_t sb = ((const mzapo_replay_blk_ref_t *)b)->seq;
+
+	return sa < sb? -1: sa > sb;
+}
+
+static inline
+void mzapo_replay_close(mzapo_replay_t *rp)
+{
+	unsigned ch;
+
+	if (rp == NULL)
+		return;
+	if (rp->records)
+		fprintf(stderr, "%s: replayed %llu records, %llu lost in recording%s\n",
+			rp->name, (unsigned long long)rp->records,
+			(unsigned long long)rp->gaps, rp->done? ", trace end": "");
+	if (rp->fd >= 0)
+		close(rp->fd);
+	for (ch = 0; ch < MZAPO_LOG_CHAN_MAX; ch++)
+		free(rp->col[ch]);
+	free(rp->n);
+	free(rp->blk);
+	free(rp->blk_ref);
+	free(rp);
+}
+
+/*
+ * Open trace of the block and select its channels by name, the
+ * values are then returned in the chan_name order. Returns NULL
+ * with the reason reported when the trace is missing, damaged or
+ * does not contain some of the channels.
+ */
+static inline
+mzapo_replay_t *mzapo_replay_open(const char *name, unsigned chan_count,
+				  const char *const *chan_name)
+{
+	const char *dir = getenv(MZAPO_REPLAY_DIR_ENV);
+	mzapo_log_blk_t blk;
+	mzapo_replay_t *rp;
+	char fname[256];
+	uint64_t slot;
+	unsigned ch, i;
+
+	if ((dir == NULL) || (*dir == 0) || (chan_count > MZAPO_LOG_CHAN_MAX))
+		return NULL;
+
+	rp = calloc(1, sizeof(*rp));
+	if (rp == NULL)
+		return NULL;
+	strncpy(rp->name, name, MZAPO_LOG_NAME_LEN - 1);
+	rp->chan_count = chan_count;
+
+	snprintf(fname, sizeof(fname), "%s/%s.mzlog", dir, name);
+	rp->fd = open(fname, O_RDONLY);
+	if (rp->fd < 0) {
+		fprintf(stderr, "%s: replay trace %s cannot be opened\n", name, fname);
+		goto error;
+	}
+	fprintf(stderr, "%s: replay from %s\n", name, fname);
+	if ((pread(rp->fd, &rp->hdr, sizeof(rp->hdr), 0) != sizeof(rp->hdr)) ||
+	    (rp->hdr.magic != MZAPO_LOG_MAGIC) ||
+	    (rp->hdr.version != MZAPO_LOG_VERSION) ||
+	    (rp->hdr.chan_count > MZAPO_LOG_CHAN_MAX) ||
+	    (rp->hdr.blk_size <= sizeof(mzapo_log_blk_t))) {
+		fprintf(stderr, "%s: %s is not compatible trace\n", name, fname);
+		goto error;
+	}
+
+	for (ch = 0; ch < chan_count; ch++) {
+		for (i = 0; i < rp->hdr.chan_count; i++)
+			if (!strncmp(rp->hdr.chan_name[i], chan_name[ch],
+				     MZAPO_LOG_NAME_LEN))
+				break;
+		if (i == rp->hdr.chan_count) {
+			fprintf(stderr, "%s: trace %s has no channel %s\n", name,
+				fname, chan_name[ch]);
+			goto error;
+		}
+		rp->chan_idx[ch] = i;
+	}
+
+	/* Closed blocks in order, the slot has to match the sequence number */
+	rp->blk_ref = malloc(sizeof(*rp->blk_ref) * (rp->hdr.blk_count + 1));
+	if (rp->blk_ref == NULL)
+		goto error;
+	for (slot = 0; slot < rp->hdr.blk_count; slot++) {
+		if ((pread(rp->fd, &blk, sizeof(blk), MZAPO_LOG_HDR_SIZE +
+			   (off_t)slot * rp->hdr.blk_size) != sizeof(blk)) ||
+		    (blk.magic != MZAPO_LOG_BLK_MAGIC) || !blk.rec_count ||
+		    (blk.seq % rp->hdr.blk_count != slot))
+			continue;
+		rp->blk_ref[rp->blk_count].seq = blk.seq;
+		rp->blk_ref[rp->blk_count].slot = slot;
+		rp->blk_count++;
+	}
+	qsort(rp->blk_ref, rp->blk_count, sizeof(*rp->blk_ref),
+	      mzapo_replay_blk_ref_cmp);
+
+	/* Each record takes at least one byte per channel and step */
+	rp->rec_max = (rp->hdr.blk_size - sizeof(blk)) /
+		      (1 + rp->hdr.chan_count) + 1;
+	rp->blk = malloc(rp->hdr.blk_size);
+	rp->n = malloc(sizeof(*rp->n) * rp->rec_max);
+	if ((rp->blk == NULL) || (rp->n == NULL))
+		goto error;
+	for (ch = 0; ch < rp->hdr.chan_count; ch++)
+		if ((rp->col[ch] = malloc(sizeof(int32_t) * rp->rec_max)) == NULL)
+			goto error;
+
+	return rp;
+
+error:
+	mzapo_replay_close(rp);
+	return NULL;
+}
+
+/* Decode the next block of the trace, returns -1 at the trace end */
+static inline
+int mzapo_replay_blk_load(mzapo_replay_t *rp)
+{
+	int res;
+
+	while (rp->blk_next < rp->blk_count) {
+		uint64_t slot = rp->blk_ref[rp->blk_next++].slot;
+
+		if (pread(rp->fd, rp->blk, rp->hdr.blk_size, MZAPO_LOG_HDR_SIZE +
+			  (off_t)slot * rp->hdr.blk_size) != rp->hdr.blk_size)
+			continue;
+		if (rp->blk->rec_count > rp->rec_max)
+			continue;
+		res = mzapo_log_blk_decode(rp->blk, rp->hdr.blk_size,
+					   rp->hdr.chan_count, rp->n, rp->col);
+		if (res <= 0)
+			continue;
+		rp->rec_count = res;
+		rp->rec_idx = 0;
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * Values of the current record in the requested channel order,
+ * the record stays current. Returns -1 at the trace end, val then
+ * holds the last values.
+ */
+static inline
+int mzapo_replay_peek(mzapo_replay_t *rp, int32_t *val)
+{
+	unsigned ch;
+
+	if (!rp->done && (rp->rec_idx >= rp->rec_count) &&
+	    (mzapo_replay_blk_load(rp) < 0))
+		rp->done = 1;
+	if (!rp->done)
+		for (ch = 0; ch < rp->chan_count; ch++)
+			rp->val[ch] = rp->col[rp->chan_idx[ch]][rp->rec_idx];
+	memcpy(val, rp->val, sizeof(int32_t) * rp->chan_count);
+	return rp->done? -1: 0;
+}
+
+/* Values of the current record, advances to the next one */
+static inline
+int mzapo_replay_next(mzapo_replay_t *rp, int32_t *val)
+{
+	uint64_t n;
+
+	if (mzapo_replay_peek(rp, val) < 0)
+		return -1;
+	n = rp->n[rp->rec_idx++];
+	if (rp->records && (n != rp->n_last + 1))
+		rp->gaps += n - rp->n_last - 1;
+	rp->n_last = n;
+	rp->records++;
+	return 0;
+}
+
+/* Trace exhausted, the block should request simulation stop */
+static inline
+int mzapo_replay_done(const mzapo_replay_t *rp)
+{
+	return rp->done;
+}
+
+/* Identity of the board the trace has been recorded on */
+static inline
+const char *mzapo_replay_ident(const mzapo_replay_t *rp)
+{
+	return rp->hdr.ident;
+}
+
+#endif /*MZAPO_REPLAY_H*/
@@ -0,0 +1,286 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  preparing the process memory for the real-time control loop.
+
+  The driver blocks call mzapo_rtmem_prepare() first in mdlStart and
+  mzapo_rtmem_release() in mdlTerminate. The first prepare
+
+    - reports page faults of the process so far,
+    - stops glibc from returning freed memory to the kernel and from
+      serving allocations by separate mmap,
+    - locks current and future mappings (mlockall), so thread stacks,
+      shared memory rings and register windows created later are
+      populated when mapped,
+    - touches MZAPO_RTMEM_STACK_SIZE of the calling thread stack.
+
+  The state used by the step functions is taken from one preallocated
+  cache-line-aligned arena by mzapo_rtmem_alloc() instead of malloc,
+  so the blocks of the model share few locked pages and no state
+  shares a cache line with unrelated heap data. The arena is reset
+  when all its blocks are freed, which keeps repeated simulation runs
+  in one process bounded. Requests which do not fit fall back to
+  aligned heap allocation, touched before return.
+
+  Register windows are prefaulted by mzapo_rtmem_prefault() right
+  after mmap, without reading the registers.
+
+  mzapo_rtmem_started() at the end of mdlStart reports page faults
+  taken during the start and sets the baseline, the last release
+  reports the faults taken after the control loop started, which
+  should be zero for properly prepared model.
+
+  munlockall() of the last release unlocks the whole process, so it
+  is called only when the process had no locked memory before the
+  first prepare (VmLck of /proc/self/status). When the application
+  or the target main locks memory itself, the lock is left as it is.
+  The allocator settings of the first prepare are undone by the last
+  release as well. glibc cannot report the previous values, so they
+  are reset to the ones the process started with, MALLOC_TRIM_THRESHOLD_
+  and MALLOC_MMAP_MAX_ environment variables or the glibc defaults.
+
+  Locking fails without CAP_IPC_LOCK or sufficient RLIMIT_MEMLOCK,
+  the blocks then run as before and warning is printed.
+
+  The state is defined as weak symbol, so all translation units
+  (S-functions) linked into one executable share the arena, all of
+  them have to be compiled with the same MZAPO_RTMEM_ARENA_SIZE.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_RTMEM_H
+#define MZAPO_RTMEM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifndef MZAPO_RTMEM_ARENA_SIZE
+#define MZAPO_RTMEM_ARENA_SIZE    (64 * 1024)
+#endif
+
+#ifndef MZAPO_RTMEM_STACK_SIZE
+#define MZAPO_RTMEM_STACK_SIZE    (128 * 1024)
+#endif
+
+#define MZAPO_RTMEM_ALIGN         64
+
+/* glibc defaults restored by the last release */
+#define MZAPO_RTMEM_TRIM_THRESHOLD (128 * 1024)
+#define MZAPO_RTMEM_MMAP_MAX      65536
+
+typedef struct mzapo_rtmem_t {
+  pthread_mutex_t mutex;
+  unsigned users;           /* blocks between prepare and release */
+  unsigned live;            /* arena allocations not freed yet */
+  size_t   used;
+  int      locked;          /* mlockall of prepare to be undone by release */
+  int      tuned;           /* mallopt of prepare to be undone by release */
+  long     minflt_base;
+  long     majflt_base;
+  unsigned char arena[MZAPO_RTMEM_ARENA_SIZE]
+                __attribute__((aligned(MZAPO_RTMEM_ALIGN)));
+} mzapo_rtmem_t;
+
+__attribute__((weak))
+mzapo_rtmem_t mzapo_rtmem = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline
+void mzapo_rtmem_faults(long *minflt, long *majflt)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0) {
+		*minflt = *majflt = 0;
+		return;
+	}
+	*minflt = ru.ru_minflt;
+	*majflt = ru.ru_majflt;
+}
+
+/* Page faults since the last baseline, the baseline is moved */
+static inline
+void mzapo_rtmem_report(const char *who, const char *phase)
+{
+	long minflt, majflt;
+
+	mzapo_rtmem_faults(&minflt, &majflt);
+	fprintf(stderr, "%s: page faults %s: minor %ld, major %ld\n", who,
+		phase, minflt - mzapo_rtmem.minflt_base,
+		majflt - mzapo_rtmem.majflt_base);
+	mzapo_rtmem.minflt_base = minflt;
+	mzapo_rtmem.majflt_base = majflt;
+}
+
+/* Locked memory of the process in kB, -1 when not known */
+static inline
+long mzapo_rtmem_locked_kb(void)
+{
+	char line[128];
+	long kb = -1;
+	FILE *f;
+
+	f = fopen("/proc/self/status", "r");
+	if (f == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (sscanf(line, "VmLck: %ld", &kb) == 1)
+			break;
+	fclose(f);
+	return kb;
+}
+
+/* Allocator setting the process started with, env or glibc default */
+static inline
+int mzapo_rtmem_malloc_initial(const char *env, int def)
+{
+	const char *val = getenv(env);
+
+	return (val != NULL) && (*val != 0)? atoi(val): def;
+}
+
+static __attribute__((noinline, unused))
+void mzapo_rtmem_prefault_stack(void)
+{
+	volatile unsigned char stack[MZAPO_RTMEM_STACK_SIZE];
+	unsigned long pagesize = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += pagesize)
+		stack[i] = 0;
+}
+
+/*
+ * Populate page tables of the mapped range without accessing it,
+ * the device mappings of /dev/mem are populated already by mmap and
+ * are skipped by mlock.
+ */
+static inline
+int mzapo_rtmem_prefault(void *addr, size_t size)
+{
+	unsigned long pagesize = sysconf(_SC_PAGESIZE);
+	uintptr_t beg = (uintptr_t)addr & ~(pagesize - 1);
+	size_t len = ((uintptr_t)addr + size - beg + pagesize - 1) &
+		     ~(pagesize - 1);
+
+  #ifdef MADV_POPULATE_WRITE
+	if (madvise((void *)beg, len, MADV_POPULATE_WRITE) == 0)
+		return 0;
+  #endif /*MADV_POPULATE_WRITE*/
+	return mlock((void *)beg, len);
+}
+
+static inline
+int mzapo_rtmem_prepare(const char *who)
+{
+	mzapo_rtmem_t *rtm = &mzapo_rtmem;
+
+	pthread_mutex_lock(&rtm->mutex);
+	if (rtm->users++) {
+		pthread_mutex_unlock(&rtm->mutex);
+		return 0;
+	}
+
+	rtm->minflt_base = rtm->majflt_base = 0;
+	mzapo_rtmem_report(who, "before RT preparation");
+
+	rtm->tuned = mallopt(M_TRIM_THRESHOLD, -1) | mallopt(M_MMAP_MAX, 0);
+
+	/* Memory locked by someone else stays locked after release */
+	rtm->locked = mzapo_rtmem_locked_kb() == 0;
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		fprintf(stderr, "%s: mlockall failed, memory is not locked\n", who);
+		rtm->locked = 0;
+	}
+
+	mzapo_rtmem_prefault_stack();
+	if (!rtm->live)
+		memset(rtm->arena, 0, sizeof(rtm->arena));
+
+	pthread_mutex_unlock(&rtm->mutex);
+	return 0;
+}
+
+/* End of the block start, the control loop follows */
+static inline
+void mzapo_rtmem_started(const char *who)
+{
+	pthread_mutex_lock(&mzapo_rtmem.mutex);
+	mzapo_rtmem_report(who, "during start");
+	pthread_mutex_unlock(&mzapo_rtmem.mutex);
+}
+
+static inline
+void mzapo_rtmem_release(const char *who)
+{
+	mzapo_rtmem_t *rtm = &mzapo_rtmem;
+
+	pthread_mutex_lock(&rtm->mutex);
+	if (rtm->users && !--rtm->users) {
+		mzapo_rtmem_report(who, "after control loop start");
+		if (rtm->locked)
+			munlockall();
+		rtm->locked = 0;
+		if (rtm->tuned) {
+			mallopt(M_TRIM_THRESHOLD, mzapo_rtmem_malloc_initial(
+				"MALLOC_TRIM_THRESHOLD_", MZAPO_RTMEM_TRIM_THRESHOLD));
+			mallopt(M_MMAP_MAX, mzapo_rtmem_malloc_initial(
+				"MALLOC_MMAP_MAX_", MZAPO_RTMEM_MMAP_MAX));
+		}
+		rtm->tuned = 0;
+	}
+	pthread_mutex_unlock(&rtm->mutex);
+}
+
+/* Zeroed, MZAPO_RTMEM_ALIGN aligned block, NULL when out of memory */
+static inline
+void *mzapo_rtmem_alloc(size_t size)
+{
+	mzapo_rtmem_t *rtm = &mzapo_rtmem;
+	void *p = NULL;
+
+	size = (size + MZAPO_RTMEM_ALIGN - 1) & ~(size_t)(MZAPO_RTMEM_ALIGN - 1);
+
+	pthread_mutex_lock(&rtm->mutex);
+	if (size <= sizeof(rtm->arena) - rtm->used) {
+		p = rtm->arena + rtm->used;
+		rtm->used += size;
+		rtm->live++;
+	}
+	pthread_mutex_unlock(&rtm->mutex);
+
+	if ((p == NULL) && (posix_memalign(&p, MZAPO_RTMEM_ALIGN, size) != 0))
+		return NULL;
+	memset(p, 0, size);
+	return p;
+}
+
+static inline
+void mzapo_rtmem_free(void *p)
+{
+	mzapo_rtmem_t *rtm = &mzapo_rtmem;
+
+	if (p == NULL)
+		return;
+	if (((unsigned char *)p < rtm->arena) ||
+	    ((unsigned char *)p >= rtm->arena + sizeof(rtm->arena))) {
+		free(p);
+		return;
+	}
+
+	pthread_mutex_lock(&rtm->mutex);
+	if (!--rtm->live)
+		rtm->used = 0;
+	pthread_mutex_unlock(&rtm->mutex);
+}
+
+#endif /*MZAPO_RTMEM_H*/
@@ -0,0 +1,91 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for sigma-delta dithering of PWM duty cycles.
+
+  The duty cycle command is quantized to integer PWM counts per
+  step. Plain truncation (order 0) keeps the residual below one
+  count forever, which causes limit cycles at low torque. The first
+  order stage carries the residual to the next step, the second order
+  one shapes the quantization noise by (1 - z^-1)^2. Average of the
+  written counts then follows the command with sub-count resolution
+  and the noise is pushed to the PWM step rate where the motor
+  inductance filters it out.
+
+  When the output is clamped to the range limit, the residuals are
+  dropped so the stage does not wind up.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_SDM_H
+#define MZAPO_SDM_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define MZAPO_SDM_ORDER_MAX   2
+
+typedef struct mzapo_sdm_t {
+  int      order;           /* 0 .. truncation, 1 or 2 .. dither */
+  float    e1;              /* residual of the previous step */
+  float    e2;              /* residual of the step before */
+} mzapo_sdm_t;
+
+static inline
+void mzapo_sdm_reset(mzapo_sdm_t *sdm)
+{
+	sdm->e1 = 0;
+	sdm->e2 = 0;
+}
+
+static inline
+void mzapo_sdm_init(mzapo_sdm_t *sdm, int order)
+{
+	if (order < 0)
+		order = 0;
+	if (order > MZAPO_SDM_ORDER_MAX)
+		order = MZAPO_SDM_ORDER_MAX;
+	sdm->order = order;
+	mzapo_sdm_reset(sdm);
+}
+
+/*
+ * Quantize x (in PWM counts) to integer within lo..hi. Order 0
+ * truncates toward zero as the plain (int32_t) conversion does.
+ */
+static inline
+int32_t mzapo_sdm_quantize(mzapo_sdm_t *sdm, float x, int32_t lo, int32_t hi)
+{
+	float v;
+	int32_t y;
+
+	switch (sdm->order) {
+	case 0:
+		v = x;
+		if (v > hi)
+			v = hi;
+		if (v < lo)
+			v = lo;
+		return (int32_t)v;
+	case 1:
+		v = x + sdm->e1;
+		break;
+	default:
+		v = x + 2 * sdm->e1 - sdm->e2;
+		break;
+	}
+
+	y = (int32_t)floorf(v + 0.5f);
+	if ((y > hi) || (y < lo)) {
+		y = y > hi? hi: lo;
+		mzapo_sdm_reset(sdm);
+		return y;
+	}
+	sdm->e2 = sdm->e1;
+	sdm->e1 = v - y;
+
+	return y;
+}
+
+#endif /*MZAPO_SDM_H*/
@@ -0,0 +1,203 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for live signal stream of the driver blocks published through
+  single-producer/multi-consumer ring in POSIX shared memory.
+
+  Each block owns its ring and writes one fixed layout record per
+  step. The write is wait-free, it does not call the kernel or
+  allocate memory. Every slot carries sequence number of the record
+  stored in it. The writer invalidates the slot before copying
+  the payload and publishes the new number after it, so consumers
+  attached read-only detect both torn reads and overruns by
+  comparing the slot number with the expected one.
+
+  The reference consumer is tools/mzapo_stream_tail.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_STREAM_H
+#define MZAPO_STREAM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MZAPO_STREAM_MAGIC        0x4d5a5354
+#define MZAPO_STREAM_VERSION      2
+#define MZAPO_STREAM_REC_COUNT    4096  /* has to be power of 2 */
+
+#define MZAPO_STREAM_TYPE_PMSM    1
+#define MZAPO_STREAM_TYPE_DC      2
+
+/* Record of sfPMSMonZynq3pmdrv1 */
+typedef struct mzapo_stream_pmsm_rec_t {
+  double   t;
+  double   cur_adc[3];
+  int32_t  irc_pos;
+  int32_t  irc_idx;
+  int32_t  irc_idx_occ;
+  int32_t  hal_sec;
+  uint32_t wr_elided;       /* register writes skipped by the last transfer */
+} mzapo_stream_pmsm_rec_t;
+
+/* Record of sfDCMotorOnZynq */
+typedef struct mzapo_stream_dc_rec_t {
+  double   t;
+  double   pwm;
+  int32_t  irc_pos;
+  uint32_t duty_reg;
+  uint32_t wr_elided;       /* register writes skipped in the step */
+} mzapo_stream_dc_rec_t;
+
+typedef struct mzapo_stream_hdr_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t rec_type;
+  uint32_t rec_size;        /* payload bytes */
+  uint32_t slot_size;       /* sequence number and payload, 8 bytes aligned */
+  uint32_t rec_count;
+  uint64_t head;            /* number of records published */
+} mzapo_stream_hdr_t;
+
+typedef struct mzapo_stream_t {
+  mzapo_stream_hdr_t *hdr;
+  size_t   map_size;
+  uint64_t head;            /* producer private copy of hdr->head */
+} mzapo_stream_t;
+
+static inline
+size_t mzapo_stream_slot_size(size_t rec_size)
+{
+	return (sizeof(uint64_t) + rec_size + 7) & ~(size_t)7;
+}
+
+static inline
+size_t mzapo_stream_map_size(size_t rec_size, unsigned rec_count)
+{
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+
+	return (sizeof(mzapo_stream_hdr_t) +
+		mzapo_stream_slot_size(rec_size) * rec_count +
+		pagesize - 1) & ~(pagesize - 1);
+}
+
+static inline
+uint64_t *mzapo_stream_slot(const mzapo_stream_hdr_t *hdr, uint64_t n)
+{
+	return (uint64_t *)((char *)(hdr + 1) +
+		(size_t)(n & (hdr->rec_count - 1)) * hdr->slot_size);
+}
+
+/*
+ * Create producer side of the stream. The name is POSIX shared
+ * memory object name ("/name"). Returns NULL when shared memory
+ * cannot be created, the block then runs without the stream.
+ */
+static inline
+mzapo_stream_t *mzapo_stream_create(const char *name, uint32_t rec_type,
+				    size_t rec_size)
+{
+	mzapo_stream_t *stream;
+	mzapo_stream_hdr_t *hdr;
+	size_t size;
+	int fd;
+
+	size = mzapo_stream_map_size(rec_size, MZAPO_STREAM_REC_COUNT);
+
+	fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		return NULL;
+	}
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED)
+		return NULL;
+
+	stream = malloc(sizeof(*stream));
+	if (stream == NULL) {
+		munmap(hdr, size);
+		return NULL;
+	}
+
+	/* Invalidate the header first, consumers attached to previous run retry */
+	__atomic_store_n(&hdr->magic, 0, __ATOMIC_RELEASE);
+	memset((char *)hdr + sizeof(hdr->magic), 0, size - sizeof(hdr->magic));
+	hdr->version = MZAPO_STREAM_VERSION;
+	hdr->rec_type = rec_type;
+	hdr->rec_size = rec_size;
+	hdr->slot_size = mzapo_stream_slot_size(rec_size);
+	hdr->rec_count = MZAPO_STREAM_REC_COUNT;
+	__atomic_store_n(&hdr->magic, MZAPO_STREAM_MAGIC, __ATOMIC_RELEASE);
+
+	stream->hdr = hdr;
+	stream->map_size = size;
+	stream->head = 0;
+
+	return stream;
+}
+
+static inline
+void mzapo_stream_destroy(mzapo_stream_t *stream)
+{
+	if (stream == NULL)
+		return;
+	munmap(stream->hdr, stream->map_size);
+	free(stream);
+}
+
+/* Publish one record, wait-free */
+static inline
+void mzapo_stream_write(mzapo_stream_t *stream, const void *rec)
+{
+	mzapo_stream_hdr_t *hdr;
+	uint64_t *slot;
+	uint64_t n;
+
+	if (stream == NULL)
+		return;
+	hdr = stream->hdr;
+	n = stream->head;
+	slot = mzapo_stream_slot(hdr, n);
+
+	/* Slot number 0 marks slot being rewritten */
+	__atomic_store_n(slot, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(slot + 1, rec, hdr->rec_size);
+	__atomic_store_n(slot, n + 1, __ATOMIC_RELEASE);
+
+	stream->head = n + 1;
+	__atomic_store_n(&hdr->head, n + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Consumer side read of record n (counted from 0). Returns 1 when
+ * record has been copied, 0 when it has not been published yet
+ * and -1 when it has been already overwritten.
+ */
+static inline
+int mzapo_stream_read(const mzapo_stream_hdr_t *hdr, uint64_t n, void *rec)
+{
+	const uint64_t *slot = mzapo_stream_slot(hdr, n);
+	uint64_t seq;
+
+	seq = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (seq != n + 1)
+		return (seq > n + 1) ||
+		       (__atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) > n + 1)? -1: 0;
+	memcpy(rec, slot + 1, hdr->rec_size);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(slot, __ATOMIC_RELAXED) != n + 1)
+		return -1;
+	return 1;
+}
+
+#endif /*MZAPO_STREAM_H*/
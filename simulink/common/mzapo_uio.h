@@ -0,0 +1,278 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for the UIO (Userspace I/O) backend of the register access and
+  for waiting on the peripheral interrupt.
+
+  When the device selected for mapping (MZAPO_MEMDEV) is UIO device
+  (/dev/uioN), the physical window is located in its maps listed
+  in /sys/class/uio/uioN/maps and mapped at offset N * pagesize as
+  required by UIO instead of the physical address.
+
+  The interrupt source is selected by MZAPO_IRQDEV environment
+  variable. It can be UIO device, then the wait unmasks interrupt
+  by writing 1 and blocks in read of the 32-bit event count. The
+  value "eventfd:<period_us>" selects software stand-in, thread
+  which behaves like level masked interrupt firing with given
+  period, raised through eventfd. Periods when the interrupt is
+  masked (not acknowledged yet) are counted as missed, the same
+  way as the UIO event count reveals them, so the wait and
+  acknowledge logic can be exercised on host.
+
+  The wait gives up after MZAPO_IRQ_TIMEOUT_PERIODS nominal periods
+  (rounded up to whole milliseconds), so the caller can shut the
+  outputs down when the interrupt stops firing instead of blocking
+  forever.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_UIO_H
+#define MZAPO_UIO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define MZAPO_UIO_MAPS_MAX        5
+#define MZAPO_IRQDEV_ENV          "MZAPO_IRQDEV"
+#define MZAPO_IRQDEV_EVENTFD      "eventfd:"
+#define MZAPO_IRQ_TIMEOUT_PERIODS 4
+
+static inline
+const char *mzapo_uio_name(const char *dev)
+{
+	const char *name = strrchr(dev, '/');
+
+	name = name != NULL? name + 1: dev;
+	if (strncmp(name, "uio", 3) || (name[3] < '0') || (name[3] > '9'))
+		return NULL;
+	return name;
+}
+
+static inline
+int mzapo_uio_read_sysfs(const char *name, int map, const char *attr,
+			 unsigned long long *val)
+{
+	char path[320];
+	FILE *f;
+	int res;
+
+	snprintf(path, sizeof(path), "/sys/class/uio/%s/maps/map%d/%s",
+		 name, map, attr);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	res = fscanf(f, "%llx", val);
+	fclose(f);
+	return res == 1? 0: -1;
+}
+
+/*
+ * Translate page aligned physical window into UIO map. The window
+ * is extended to the whole map, the page_base, window_size and
+ * mmap offset are updated. Returns 0 when the dev is not UIO device,
+ * 1 when the window has been translated and -1 when no map of the
+ * UIO device covers the window.
+ */
+static inline
+int mzapo_uio_translate(const char *dev, uintptr_t *page_base,
+			size_t *window_size, off_t *mmap_offs)
+{
+	const char *name = mzapo_uio_name(dev);
+	unsigned long pagesize = sysconf(_SC_PAGESIZE);
+	unsigned long long addr, size;
+	int map;
+
+	if (name == NULL)
+		return 0;
+
+	for (map = 0; map < MZAPO_UIO_MAPS_MAX; map++) {
+		if ((mzapo_uio_read_sysfs(name, map, "addr", &addr) < 0) ||
+		    (mzapo_uio_read_sysfs(name, map, "size", &size) < 0))
+			break;
+		if ((addr <= *page_base) &&
+		    (addr + size >= *page_base + *window_size)) {
+			*page_base = addr;
+			*window_size = (size + pagesize - 1) & ~(pagesize - 1);
+			*mmap_offs = (off_t)map * pagesize;
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "%s: no UIO map covers 0x%08lx\n", dev,
+		(unsigned long)*page_base);
+	return -1;
+}
+
+typedef struct mzapo_irq_t {
+  int      fd;
+  int      is_eventfd;
+  uint32_t count_last;      /* UIO event count seen by the last wait */
+  uint32_t waits;
+  uint32_t missed;          /* interrupts not seen by any wait */
+  long     period_ns;       /* nominal period, 0 waits without timeout */
+  /* Software stand-in */
+  int      enabled;
+  int      stop;
+  uint32_t raised;
+  pthread_t thread;
+} mzapo_irq_t;
+
+static inline
+void *mzapo_irq_standin_thread(void *arg)
+{
+	mzapo_irq_t *irq = (mzapo_irq_t *)arg;
+	struct timespec next;
+	uint64_t one = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&irq->stop, __ATOMIC_ACQUIRE)) {
+		next.tv_nsec += irq->period_ns;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &next, NULL) == EINTR);
+
+		/* Interrupt is masked after delivery until the next wait */
+		__atomic_add_fetch(&irq->raised, 1, __ATOMIC_RELAXED);
+		if (__atomic_exchange_n(&irq->enabled, 0, __ATOMIC_ACQ_REL))
+			if (write(irq->fd, &one, sizeof(one)) < 0)
+				break;
+	}
+	return NULL;
+}
+
+/*
+ * Open interrupt source, dev NULL selects MZAPO_IRQDEV environment
+ * variable. The period_ns is the nominal interrupt period of the
+ * hardware, the stand-in uses its own one. Returns NULL when no
+ * source is configured or it cannot be opened, the caller then runs
+ * free running.
+ */
+static inline
+mzapo_irq_t *mzapo_irq_open(const char *dev, long period_ns)
+{
+	mzapo_irq_t *irq;
+
+	if (dev == NULL)
+		dev = getenv(MZAPO_IRQDEV_ENV);
+	if ((dev == NULL) || (*dev == 0))
+		return NULL;
+
+	irq = malloc(sizeof(*irq));
+	if (irq == NULL)
+		return NULL;
+	memset(irq, 0, sizeof(*irq));
+
+	if (!strncmp(dev, MZAPO_IRQDEV_EVENTFD, strlen(MZAPO_IRQDEV_EVENTFD))) {
+		irq->is_eventfd = 1;
+		irq->period_ns = atol(dev + strlen(MZAPO_IRQDEV_EVENTFD)) * 1000;
+		if (irq->period_ns <= 0)
+			irq->period_ns = 50000;
+		irq->fd = eventfd(0, EFD_CLOEXEC);
+		if (irq->fd < 0) {
+			free(irq);
+			return NULL;
+		}
+		if (pthread_create(&irq->thread, NULL, mzapo_irq_standin_thread,
+				   irq) != 0) {
+			close(irq->fd);
+			free(irq);
+			return NULL;
+		}
+		return irq;
+	}
+
+	irq->fd = open(dev, O_RDWR | O_CLOEXEC);
+	if (irq->fd < 0) {
+		fprintf(stderr, "cannot open %s\n", dev);
+		free(irq);
+		return NULL;
+	}
+	irq->period_ns = period_ns;
+	return irq;
+}
+
+static inline
+void mzapo_irq_close(mzapo_irq_t *irq)
+{
+	if (irq == NULL)
+		return;
+	if (irq->is_eventfd) {
+		__atomic_store_n(&irq->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(irq->thread, NULL);
+	}
+	close(irq->fd);
+	free(irq);
+}
+
+/* Block until the source is readable, -1 with ETIMEDOUT when it stays silent */
+static inline
+int mzapo_irq_poll(mzapo_irq_t *irq)
+{
+	struct pollfd pfd = {.fd = irq->fd, .events = POLLIN};
+	int timeout_ms = -1;
+	int res;
+
+	if (irq->period_ns > 0)
+		timeout_ms = (MZAPO_IRQ_TIMEOUT_PERIODS * irq->period_ns +
+			      999999) / 1000000;
+	res = poll(&pfd, 1, timeout_ms);
+	if (res == 0)
+		errno = ETIMEDOUT;
+	return res > 0? 0: -1;
+}
+
+/*
+ * Acknowledge (unmask) the interrupt and block until it fires.
+ * Returns number of interrupts since the previous wait (1 when
+ * none has been missed) or -1 on error, errno is ETIMEDOUT when
+ * the interrupt has not fired within the timeout.
+ */
+static inline
+int mzapo_irq_wait(mzapo_irq_t *irq)
+{
+	uint32_t count, n;
+	uint32_t unmask = 1;
+	uint64_t ev;
+
+	if (irq->is_eventfd) {
+		uint32_t raised;
+
+		__atomic_store_n(&irq->enabled, 1, __ATOMIC_RELEASE);
+		if (mzapo_irq_poll(irq) < 0)
+			return -1;
+		if (read(irq->fd, &ev, sizeof(ev)) != sizeof(ev))
+			return -1;
+		/* Ticks raised while masked are missed interrupts */
+		raised = __atomic_load_n(&irq->raised, __ATOMIC_RELAXED);
+		n = irq->waits? raised - irq->count_last: 1;
+		irq->count_last = raised;
+	} else {
+		if (write(irq->fd, &unmask, sizeof(unmask)) != sizeof(unmask))
+			return -1;
+		if (mzapo_irq_poll(irq) < 0)
+			return -1;
+		if (read(irq->fd, &count, sizeof(count)) != sizeof(count))
+			return -1;
+		n = irq->waits? count - irq->count_last: 1;
+		irq->count_last = count;
+	}
+	irq->waits++;
+	if (n > 1)
+		irq->missed += n - 1;
+	return n;
+}
+
+#endif /*MZAPO_UIO_H*/
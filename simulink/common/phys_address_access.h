@@ -0,0 +1,620 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for mapping physical address to virtual address and reading from and
+  writing to it.
+
+  The mappings are shared through process-wide registry. Blocks which
+  request the same physical page(s) with the same caching mode receive
+  the same virtual mapping and the last mem_address_unmap_and_free()
+  tears it down. The registry state is defined as weak symbol, so all
+  translation units (S-functions) linked into one executable share it.
+  The header is common to the DC motor and knob blocks and the 3-phase
+  driver (../mz_apo-3pmdrv/zynq_3pmdrv1_mc.c).
+
+  The device used for mapping can be overridden by MZAPO_MEMDEV
+  environment variable. When it points to regular file, the file is
+  created and extended (sparse) to cover the requested physical
+  window, which allows to exercise the code on plain Linux host
+  without hardware. When it points to UIO device (/dev/uioN), the
+  windows are located in the UIO maps and mapped through it, see
+  mzapo_uio.h, which provides also the wait for the peripheral
+  interrupt. In replay mode (MZAPO_REPLAYDIR, see mzapo_replay.h)
+  the stand-in file in the replay directory is mapped, whatever
+  MZAPO_MEMDEV holds.
+
+  Each map keeps shadow of the first MZAPO_REGSHADOW_REGS registers
+  written through MEM_ADDRESS_XFER(WRS, ...) descriptors, the write
+  is skipped when the value equals the last written one, see
+  mzapo_regshadow.h. Plain mem_address_reg_wr() always
+  writes and invalidates the shadowed word.
+
+  (C) Copyright 2017 by Pavel Pisa
+      e-mail:   pisa@cmp.felk.cvut.cz
+      homepage: http://cmp.felk.cvut.cz/~pisa
+      company:  http://www.pikron.com/
+      license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef PHYS_ADDRESS_ACCESS_H
+#define PHYS_ADDRESS_ACCESS_H
+
+
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#include "mzapo_uio.h"
+#include "mzapo_replay.h"
+#include "mzapo_rtmem.h"
+#include "mzapo_regshadow.h"
+
+#ifdef MMIO_PROF
+#include "mmio_prof.h"
+#endif /*MMIO_PROF*/
+
+#ifndef PHYS_ADDRESS_MEMDEV_DEFAULT
+#define PHYS_ADDRESS_MEMDEV_DEFAULT "/dev/mem"
+#endif
+
+#define PHYS_ADDRESS_MEMDEV_ENV     "MZAPO_MEMDEV"
+
+/*
+ * One page aligned window mapped into the process. The window is
+ * shared by all mem_address_map_t handles which fall into it.
+ */
+typedef struct mem_address_region_t {
+  struct mem_address_region_t *next;
+  uintptr_t page_base_phys;
+  size_t    window_size;
+  int       opt_cached;
+  void     *mm;
+  unsigned  refcnt;
+} mem_address_region_t;
+
+typedef struct mem_address_map_t {
+  uintptr_t regs_base_phys;
+  void     *regs_base_virt;
+  size_t    region_size;
+  mem_address_region_t *region;
+  int       prof_id;
+  uint32_t  shadow_val[MZAPO_REGSHADOW_REGS];
+  mzapo_regshadow_t shadow;
+} mem_address_map_t;
+
+/*
+ * Process-wide registry of mapped windows. The device is opened
+ * once for each caching mode and kept open while some window
+ * mapped through it exists.
+ */
+typedef struct mem_address_registry_t {
+  pthread_mutex_t       mutex;
+  mem_address_region_t *regions;
+  int                   fd[2];
+  unsigned              fd_users[2];
+} mem_address_registry_t;
+
+__attribute__((weak))
+mem_address_registry_t mem_address_registry = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .regions = NULL,
+  .fd = {-1, -1},
+  .fd_users = {0, 0},
+};
+
+
+static inline
+const char *mem_address_memdev(void)
+{
+	static char replay_memdev[256];
+	const char *memdev = getenv(PHYS_ADDRESS_MEMDEV_ENV);
+
+	/* Replay never maps the hardware, independent of the environment */
+	if (mzapo_replay_memdev(replay_memdev, sizeof(replay_memdev)))
+		return replay_memdev;
+	if ((memdev == NULL) || (*memdev == 0))
+		memdev = PHYS_ADDRESS_MEMDEV_DEFAULT;
+	return memdev;
+}
+
+/*
+ * If a regular file is used as stand-in for the device,
+ * extend it to cover mapped window.
+ */
+static inline
+int mem_address_memdev_cover(int fd, off_t window_end)
+{
+	struct stat st;
+
+	if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+	    (st.st_size < window_end)) {
+		if (ftruncate(fd, window_end) < 0) {
+			fprintf(stderr, "cannot extend %s\n", mem_address_memdev());
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Open a device ("/dev/mem") representing physical address space
+ * in POSIX systems.
+ */
+static inline
+int mem_address_memdev_open(int opt_cached, off_t window_end)
+{
+	const char *memdev = mem_address_memdev();
+	int fd;
+
+	/* Stand-in file selected by environment is created on demand */
+	fd = open(memdev, O_RDWR | (!opt_cached? O_SYNC: 0) |
+		  (strcmp(memdev, PHYS_ADDRESS_MEMDEV_DEFAULT)? O_CREAT: 0), 0644);
+	if (fd < 0) {
+		fprintf(stderr, "cannot open %s\n", memdev);
+		return -1;
+	}
+
+	if (mem_address_memdev_cover(fd, window_end) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Extend physical region start address and size to page size boundaries
+ * to cover complete requested region.
+ */
+static inline
+size_t mem_address_window_size(off_t region_base, size_t region_size,
+				unsigned long pagesize)
+{
+	return ((region_base & (pagesize-1)) +
+		region_size + pagesize-1) & ~(pagesize-1);
+}
+
+/*
+ * The support function which returns pointer to the virtual
+ * address at which starts remapped physical region in the
+ * process virtual memory space.
+ *
+ * The mapping is private to the caller and is not registered
+ * in the shared registry, use mem_address_map_create() to share it.
+ */
+static inline
+void *map_phys_address(off_t region_base, size_t region_size, int opt_cached)
+{
+	unsigned long pagesize;
+	uintptr_t page_base;
+	size_t mem_window_size;
+	off_t mmap_offs;
+	unsigned char *mm;
+	unsigned char *mem;
+	int fd;
+
+	/*
+	 * The virtual to physical address mapping translation granularity
+	 * corresponds to memory page size. This call obtains the page
+	 * size used by running operating system at given CPU architecture.
+	 * 4kB are used by Linux running on ARM, ARM64, x86 and x86_64 systems.
+	 */
+	pagesize=sysconf(_SC_PAGESIZE);
+
+	page_base = region_base & ~(pagesize-1);
+	mem_window_size = mem_address_window_size(region_base, region_size,
+						  pagesize);
+	mmap_offs = page_base;
+
+	/* UIO device maps whole its map N at offset N * pagesize */
+	if (mzapo_uio_translate(mem_address_memdev(), &page_base,
+				&mem_window_size, &mmap_offs) < 0)
+		return NULL;
+
+	fd = mem_address_memdev_open(opt_cached, mmap_offs + mem_window_size);
+	if (fd < 0)
+		return NULL;
+
+	/*
+	 * Map file (in our case physical memory) range at specified offset
+	 * to virtual memory ragion/area (see VMA Linux kernel structures)
+	 * of the process.
+	 */
+	mm = mmap(NULL, mem_window_size, PROT_WRITE|PROT_READ,
+		MAP_SHARED, fd, mmap_offs);
+
+	/* The mapping holds its own reference to the device */
+	close(fd);
+
+	/* Report failure if the mmap is not allowed for given file or its region */
+	if (mm == MAP_FAILED) {
+		return NULL;
+	}
+
+	/*
+	 * Add offset in the page to the returned pointer for non-page-aligned
+	 * requests.
+	 */
+	mem = mm + (region_base - page_base);
+
+	return mem;
+}
+
+/*
+ * Find registered window covering requested range or map new one.
+ * Has to be called with registry mutex held.
+ */
+static inline
+mem_address_region_t *mem_address_region_get(off_t region_base,
+			size_t region_size, int opt_cached)
+{
+	mem_address_registry_t *reg = &mem_address_registry;
+	mem_address_region_t *region;
+	unsigned long pagesize;
+	uintptr_t page_base;
+	size_t window_size;
+	off_t mmap_offs;
+	int fdi = opt_cached? 1: 0;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	page_base = region_base & ~(pagesize-1);
+	window_size = mem_address_window_size(region_base, region_size, pagesize);
+	mmap_offs = page_base;
+
+	for (region = reg->regions; region != NULL; region = region->next) {
+		if ((region->opt_cached == opt_cached) &&
+		    (region->page_base_phys <= page_base) &&
+		    (region->page_base_phys + region->window_size >=
+		     page_base + window_size)) {
+			region->refcnt++;
+			return region;
+		}
+	}
+
+	/* UIO device maps whole its map N at offset N * pagesize */
+	if (mzapo_uio_translate(mem_address_memdev(), &page_base,
+				&window_size, &mmap_offs) < 0)
+		return NULL;
+
+	region = mzapo_rtmem_alloc(sizeof(*region));
+	if (region == NULL)
+		return NULL;
+
+	if (reg->fd[fdi] < 0) {
+		reg->fd[fdi] = mem_address_memdev_open(opt_cached,
+						mmap_offs + window_size);
+		if (reg->fd[fdi] < 0) {
+			mzapo_rtmem_free(region);
+			return NULL;
+		}
+	} else if (mem_address_memdev_cover(reg->fd[fdi],
+					mmap_offs + window_size) < 0) {
+		mzapo_rtmem_free(region);
+		return NULL;
+	}
+
+	region->mm = mmap(NULL, window_size, PROT_WRITE|PROT_READ,
+			  MAP_SHARED, reg->fd[fdi], mmap_offs);
+	if (region->mm == MAP_FAILED) {
+		if (!reg->fd_users[fdi]) {
+			close(reg->fd[fdi]);
+			reg->fd[fdi] = -1;
+		}
+		mzapo_rtmem_free(region);
+		return NULL;
+	}
+
+	/* No page fault on the first register access in the control loop */
+	mzapo_rtmem_prefault(region->mm, window_size);
+
+	reg->fd_users[fdi]++;
+	region->page_base_phys = page_base;
+	region->window_size = window_size;
+	region->opt_cached = opt_cached;
+	region->refcnt = 1;
+	region->next = reg->regions;
+	reg->regions = region;
+
+	return region;
+}
+
+/*
+ * Release window reference, the last one unmaps the window and
+ * closes the device when no other window uses it.
+ * Has to be called with registry mutex held.
+ */
+static inline
+void mem_address_region_put(mem_address_region_t *region)
+{
+	mem_address_registry_t *reg = &mem_address_registry;
+	mem_address_region_t **prev;
+	int fdi = region->opt_cached? 1: 0;
+
+	if (--region->refcnt)
+		return;
+
+	for (prev = &reg->regions; *prev != NULL; prev = &(*prev)->next) {
+		if (*prev == region) {
+			*prev = region->next;
+			break;
+		}
+	}
+
+	munmap(region->mm, region->window_size);
+	mzapo_rtmem_free(region);
+
+	if (!--reg->fd_users[fdi]) {
+		close(reg->fd[fdi]);
+		reg->fd[fdi] = -1;
+	}
+}
+
+static inline
+mem_address_map_t *mem_address_map_create(off_t region_base, size_t region_size, int opt_cached)
+{
+	mem_address_map_t *memadrs;
+	mem_address_region_t *region;
+
+	memadrs = mzapo_rtmem_alloc(sizeof(*memadrs));
+	if (memadrs == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mem_address_registry.mutex);
+	region = mem_address_region_get(region_base, region_size, opt_cached);
+	pthread_mutex_unlock(&mem_address_registry.mutex);
+
+	if (region == NULL) {
+		mzapo_rtmem_free(memadrs);
+		return NULL;
+	}
+
+	memadrs->regs_base_phys = region_base;
+	memadrs->region_size = region_size;
+	memadrs->region = region;
+	memadrs->regs_base_virt = (char *)region->mm +
+				  (region_base - region->page_base_phys);
+  #ifdef MMIO_PROF
+	memadrs->prof_id = mmio_prof_block_register("mem_address_map",
+						     region_base);
+  #else /*MMIO_PROF*/
+	memadrs->prof_id = -1;
+  #endif /*MMIO_PROF*/
+	return memadrs;
+}
+
+static inline
+void mem_address_unmap_and_free(mem_address_map_t *memadrs)
+{
+	if (memadrs == NULL)
+	    return;
+
+	pthread_mutex_lock(&mem_address_registry.mutex);
+	mem_address_region_put(memadrs->region);
+	pthread_mutex_unlock(&mem_address_registry.mutex);
+
+	memadrs->regs_base_virt = NULL;
+	memadrs->region = NULL;
+  #ifdef MMIO_PROF
+	mmio_prof_block_unregister(memadrs->prof_id);
+	memadrs->prof_id = -1;
+  #endif /*MMIO_PROF*/
+	mzapo_rtmem_free(memadrs);
+}
+
+/*
+ * Number of handles sharing the window of given map,
+ * it allows to check sharing in host test setups.
+ */
+static inline
+unsigned mem_address_map_shared_count(mem_address_map_t *memadrs)
+{
+	unsigned count;
+
+	pthread_mutex_lock(&mem_address_registry.mutex);
+	count = memadrs->region->refcnt;
+	pthread_mutex_unlock(&mem_address_registry.mutex);
+
+	return count;
+}
+
+/* Number of windows currently mapped through the registry */
+static inline
+unsigned mem_address_region_count(void)
+{
+	mem_address_region_t *region;
+	unsigned count = 0;
+
+	pthread_mutex_lock(&mem_address_registry.mutex);
+	for (region = mem_address_registry.regions; region != NULL;
+	     region = region->next)
+		count++;
+	pthread_mutex_unlock(&mem_address_registry.mutex);
+
+	return count;
+}
+
+/*
+ * Name the map in MMIO access profile (usually by the block path),
+ * no-op when MMIO_PROF is not defined.
+ */
+static inline
+void mem_address_map_prof_name(mem_address_map_t *memadrs, const char *name)
+{
+  #ifdef MMIO_PROF
+	mmio_prof_block_rename(memadrs->prof_id, name);
+  #endif /*MMIO_PROF*/
+}
+
+/* Mark start of control step in MMIO access profile */
+static inline
+void mem_address_map_prof_step(mem_address_map_t *memadrs)
+{
+  #ifdef MMIO_PROF
+	mmio_prof_step(memadrs->prof_id);
+  #endif /*MMIO_PROF*/
+}
+
+/*
+ * Mark start of control step for the write shadow, counts down the
+ * forced refresh and clears the count of elided writes
+ */
+static inline
+void mem_address_map_shadow_step(mem_address_map_t *memadrs)
+{
+	mzapo_regshadow_step(&memadrs->shadow);
+}
+
+/* Writes skipped by the shadow since mem_address_map_shadow_step() */
+static inline
+unsigned mem_address_map_shadow_elided(const mem_address_map_t *memadrs)
+{
+	return memadrs->shadow.elided;
+}
+
+static inline
+uint32_t mem_address_reg_rd(mem_address_map_t *memadrs, unsigned reg_offs)
+{
+  #ifdef MMIO_PROF
+	return mmio_prof_rd32(memadrs->prof_id, memadrs->regs_base_virt, reg_offs);
+  #else /*MMIO_PROF*/
+	return *(volatile uint32_t*)((char*)memadrs->regs_base_virt + reg_offs);
+  #endif /*MMIO_PROF*/
+}
+
+static inline
+void mem_address_reg_wr(mem_address_map_t *memadrs, unsigned reg_offs, uint32_t val)
+{
+	mzapo_regshadow_forget(&memadrs->shadow, reg_offs / 4);
+  #ifdef MMIO_PROF
+	mmio_prof_wr32(memadrs->prof_id, memadrs->regs_base_virt, reg_offs, val);
+  #else /*MMIO_PROF*/
+	*(volatile uint32_t*)((char*)memadrs->regs_base_virt + reg_offs) = val;
+  #endif /*MMIO_PROF*/
+}
+
+/*
+ * Batched register transactions. The list of descriptors is usually
+ * static const table known at compile time. Each descriptor covers
+ * run of consecutive 32-bit registers which are read to or written
+ * from consecutive words of the data buffer starting at buf_idx.
+ * The executor is forced inline and unrolled, so for constant table
+ * it compiles into straight sequence of accesses issued back to back
+ * without any computation between them. When MEM_ADDRESS_XFER_64BIT
+ * is defined, read runs starting at 8-byte aligned offset are read by
+ * 64-bit accesses. It requires the peripheral and interconnect to
+ * accept them, check the hardware design before enabling it.
+ * It serves the DC motor, knob and 3-phase driver transfers.
+ */
+
+#define MEM_ADDRESS_XFER_RD   0
+#define MEM_ADDRESS_XFER_WR   1
+#define MEM_ADDRESS_XFER_WRS  2   /* write through the map shadow */
+
+typedef struct mem_address_xfer_t {
+  uint16_t reg_offs;
+  uint8_t  count;
+  uint8_t  dir;
+  uint16_t buf_idx;
+} mem_address_xfer_t;
+
+#define MEM_ADDRESS_XFER(dir, reg_offs, count, buf_idx) \
+	{(reg_offs), (count), MEM_ADDRESS_XFER_##dir, (buf_idx)}
+
+/* Nonzero when the shadowed write of the word has to be issued */
+static inline
+int mem_address_shadow_wr(mem_address_map_t *memadrs, unsigned reg_offs,
+			  uint32_t val)
+{
+	if (reg_offs / 4 >= MZAPO_REGSHADOW_REGS)
+		return 1;
+	return mzapo_regshadow_wr(&memadrs->shadow, memadrs->shadow_val,
+				  reg_offs / 4, val);
+}
+
+static inline __attribute__((always_inline))
+void mem_address_xfer_exec(mem_address_map_t *memadrs,
+		const mem_address_xfer_t *xfer, unsigned xfer_count,
+		uint32_t *buf)
+{
+	#pragma GCC unroll 8
+	for (; xfer_count--; xfer++) {
+		volatile uint32_t *reg;
+		uint32_t *p = buf + xfer->buf_idx;
+		unsigned cnt = xfer->count;
+		unsigned offs = xfer->reg_offs;
+
+		reg = (volatile uint32_t *)((char *)memadrs->regs_base_virt +
+					    xfer->reg_offs);
+
+		if (xfer->dir == MEM_ADDRESS_XFER_WR) {
+			#pragma GCC unroll 8
+			while (cnt--)
+				*(reg++) = *(p++);
+			continue;
+		}
+
+		if (xfer->dir == MEM_ADDRESS_XFER_WRS) {
+			#pragma GCC unroll 8
+			for (; cnt--; reg++, p++, offs += 4)
+				if (mem_address_shadow_wr(memadrs, offs, *p))
+					*reg = *p;
+			continue;
+		}
+
+	      #ifdef MEM_ADDRESS_XFER_64BIT
+		if (!(xfer->reg_offs & 7)) {
+			for (; cnt >= 2; cnt -= 2, reg += 2, p += 2) {
+				uint64_t val = *(volatile uint64_t *)reg;
+				p[0] = (uint32_t)val;
+				p[1] = (uint32_t)(val >> 32);
+			}
+		}
+	      #endif /*MEM_ADDRESS_XFER_64BIT*/
+
+		#pragma GCC unroll 8
+		while (cnt--)
+			*(p++) = *(reg++);
+	}
+}
+
+static inline
+void mem_address_xfer(mem_address_map_t *memadrs,
+		const mem_address_xfer_t *xfer, unsigned xfer_count,
+		uint32_t *buf)
+{
+  #ifdef MMIO_PROF
+	/* Profile each register access of the batch separately */
+	for (; xfer_count--; xfer++) {
+		unsigned i;
+		for (i = 0; i < xfer->count; i++) {
+			if (xfer->dir == MEM_ADDRESS_XFER_RD)
+				buf[xfer->buf_idx + i] = mem_address_reg_rd(memadrs,
+						   xfer->reg_offs + 4 * i);
+			else if (xfer->dir == MEM_ADDRESS_XFER_WR)
+				mem_address_reg_wr(memadrs, xfer->reg_offs + 4 * i,
+						   buf[xfer->buf_idx + i]);
+			else if (mem_address_shadow_wr(memadrs, xfer->reg_offs + 4 * i,
+						       buf[xfer->buf_idx + i]))
+				mmio_prof_wr32(memadrs->prof_id, memadrs->regs_base_virt,
+					       xfer->reg_offs + 4 * i,
+					       buf[xfer->buf_idx + i]);
+		}
+	}
+  #else /*MMIO_PROF*/
+	mem_address_xfer_exec(memadrs, xfer, xfer_count, buf);
+  #endif /*MMIO_PROF*/
+}
+
+
+#endif /*PHYS_ADDRESS_ACCESS_H*/
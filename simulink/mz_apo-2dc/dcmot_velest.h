@@ -0,0 +1,155 @@
+/*
+  Velocity and acceleration estimator for the DC motor IRC counter.
+
+  The estimator is third order tracking observer (position, velocity
+  and acceleration) with all three discrete poles placed at
+  exp(-2 pi bandwidth Ts). These are the gains of the critically
+  damped fading memory filter, steady state equivalent of Kalman
+  filter for constant acceleration model. The observer tracks the
+  position relative to integer reference which moves with the counter,
+  the innovation is computed by 32-bit wrapping difference, so the
+  counter overflow has no effect and the double precision position
+  does not lose resolution with distance.
+
+  At low speed, the counter changes less than once per period and
+  the observer velocity ripples with each count. The edge timing
+  estimate divides the counts by the time between the periods in
+  which the counter changed and decays as 1/t while no edge comes.
+  The DCSPDRV peripheral does not capture edge times, so the edge
+  instants have period resolution. When the edge_blend is nonzero,
+  the edge estimate is blended into the velocity output with weight
+  falling linearly from 1 at standstill to 0 at edge_blend counts
+  per period.
+
+  Velocity is in IRC counts per second, acceleration in counts per
+  second squared. The header does not depend on the S-function, so
+  the estimator can be checked on host (tools/dcmot_velest_bench).
+*/
+
+#ifndef _DCMOT_VELEST_H
+#define _DCMOT_VELEST_H
+
+#include <stdint.h>
+#include <math.h>
+
+typedef struct dcmot_velest_t {
+  /* Configuration */
+  double   ts;
+  double   g;               /* position gain */
+  double   h;               /* velocity gain, multiplied by 1/Ts */
+  double   k;               /* acceleration gain, multiplied by 1/Ts^2 */
+  double   edge_blend;      /* counts per period where blend ends, 0 disables */
+  /* Observer state, position relative to pos_ref in counts */
+  int32_t  pos_ref;
+  double   pos;
+  double   vel;
+  double   acc;
+  /* Edge timing */
+  int32_t  edge_pos;        /* counter value at the last edge */
+  uint32_t edge_steps;      /* periods since the last edge */
+  double   edge_vel;
+  int      started;
+  /* Outputs */
+  double   vel_out;
+  double   acc_out;
+} dcmot_velest_t;
+
+/*
+ * Configure for sample period ts [s] and observer bandwidth [Hz],
+ * the state is initialized by the first update.
+ */
+static inline
+void dcmot_velest_init(dcmot_velest_t *est, double ts, double bandwidth,
+		       double edge_blend)
+{
+	double th = exp(-2 * M_PI * bandwidth * ts);
+
+	est->ts = ts;
+	est->g = 1 - th * th * th;
+	est->h = 1.5 * (1 - th) * (1 - th) * (1 + th) / ts;
+	est->k = (1 - th) * (1 - th) * (1 - th) / (ts * ts);
+	est->edge_blend = edge_blend > 0? edge_blend: 0;
+	est->started = 0;
+	est->vel_out = 0;
+	est->acc_out = 0;
+}
+
+static inline
+void dcmot_velest_reset(dcmot_velest_t *est, int32_t irc_pos)
+{
+	est->pos_ref = irc_pos;
+	est->pos = 0;
+	est->vel = 0;
+	est->acc = 0;
+	est->edge_pos = irc_pos;
+	est->edge_steps = 0;
+	est->edge_vel = 0;
+	est->vel_out = 0;
+	est->acc_out = 0;
+	est->started = 1;
+}
+
+/* Speed from the time between counter changes, period resolution */
+static inline
+void dcmot_velest_edge(dcmot_velest_t *est, int32_t irc_pos)
+{
+	int32_t d = (int32_t)((uint32_t)irc_pos - (uint32_t)est->edge_pos);
+	double vmax;
+
+	if (est->edge_steps < UINT32_MAX)
+		est->edge_steps++;
+
+	if (d != 0) {
+		est->edge_vel = d / (est->edge_steps * est->ts);
+		est->edge_pos = irc_pos;
+		est->edge_steps = 0;
+		return;
+	}
+
+	/* No edge for edge_steps periods bounds the speed magnitude */
+	vmax = 1 / (est->edge_steps * est->ts);
+	if (est->edge_vel > vmax)
+		est->edge_vel = vmax;
+	else if (est->edge_vel < -vmax)
+		est->edge_vel = -vmax;
+}
+
+static inline
+void dcmot_velest_update(dcmot_velest_t *est, int32_t irc_pos)
+{
+	double ts = est->ts;
+	double e, w;
+	int32_t ip;
+
+	if (!est->started) {
+		dcmot_velest_reset(est, irc_pos);
+		return;
+	}
+
+	/* Prediction */
+	est->pos += est->vel * ts + 0.5 * est->acc * ts * ts;
+	est->vel += est->acc * ts;
+
+	/* Innovation over wrapping counter difference */
+	e = (int32_t)((uint32_t)irc_pos - (uint32_t)est->pos_ref) - est->pos;
+	est->pos += est->g * e;
+	est->vel += est->h * e;
+	est->acc += est->k * e;
+
+	/* Move the reference with the position to keep it small */
+	ip = (int32_t)floor(est->pos);
+	est->pos_ref = (int32_t)((uint32_t)est->pos_ref + (uint32_t)ip);
+	est->pos -= ip;
+
+	est->vel_out = est->vel;
+	est->acc_out = est->acc;
+
+	if (est->edge_blend > 0) {
+		dcmot_velest_edge(est, irc_pos);
+		w = 1 - fabs(est->vel) * ts / est->edge_blend;
+		if (w > 0)
+			est->vel_out = w * est->edge_vel + (1 - w) * est->vel;
+	}
+}
+
+#endif /*_DCMOT_VELEST_H*/
@@ -0,0 +1,235 @@
+/*******************************************************************
+  This header file contains definition of static inline functions
+  for coherent per-step snapshot of MZ_APO SPI connected knobs
+  and keyboard registers.
+
+  All knob blocks running in the same sample hit decode their
+  channels and push-buttons from the single register read. The
+  shared state is defined as weak symbol, so it is shared by all
+  S-functions linked into one executable.
+
+  Blocks of different rates run in different tasks, the shared
+  state is published by sequence number (seqlock) the same way as
+  the telemetry of ../mz_apo-3pmdrv/zynq_3pmdrv1_tlm.h, odd while
+  it is written, readers copy the values and retry when they see
+  odd or changed number. Only one task reads the registers at a
+  time, the one which has taken the writer flag. The other ones do
+  not wait for it, they take the previous published values, so a
+  faster task is never held by preempted slower one.
+
+  The register reads are logged as trace "knobs" when MZAPO_LOGDIR
+  is set (../common/mzapo_log.h) and taken from the trace instead
+  of the hardware in replay (MZAPO_REPLAYDIR, ../common/mzapo_replay.h).
+  The blocks attach to the snapshot before they map the registers
+  and detach at termination, the last one closes the trace files.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef MZAPO_KNOBS_SNAPSHOT_H
+#define MZAPO_KNOBS_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "../common/mzapo_regmap.h"
+#include "../common/phys_address_access.h"
+#include "../common/mzapo_log.h"
+#include "../common/mzapo_replay.h"
+
+#define MZAPO_KNOBS_CHAN_COUNT  3
+
+#define MZAPO_KNOBS_TRACE_NAME  "knobs"
+
+/* Values of one sample hit, copied to the caller */
+typedef struct mzapo_knobs_snapshot_t {
+  uint32_t knobs_8bit;
+} mzapo_knobs_snapshot_t;
+
+typedef struct mzapo_knobs_shared_t {
+  volatile uint32_t seq;    /* odd while the values are written */
+  int      busy;            /* writer flag, registers are being read */
+  /* Published values, protected by seq */
+  double   stamp;
+  int      valid;
+  uint32_t knobs_8bit;
+  /* Set up and torn down from mdlStart/mdlTerminate only */
+  unsigned users;
+  mzapo_log_t *log;
+  mzapo_replay_t *replay;
+} mzapo_knobs_shared_t;
+
+__attribute__((weak))
+mzapo_knobs_shared_t mzapo_knobs_snapshot_shared;
+
+/* Trace channel, older traces with kbdrd_direct channel replay as well */
+static const char *const mzapo_knobs_trace_chan_name[1] = {
+	"knobs_8bit"
+};
+
+/*
+ * Register block as user of the snapshot, the first one opens the
+ * log and the replayed trace. Returns -1 when the replay is enabled
+ * and the trace cannot be used.
+ */
+static inline
+int mzapo_knobs_snapshot_attach(const char *who, double period_s)
+{
+	mzapo_knobs_shared_t *snap = &mzapo_knobs_snapshot_shared;
+
+	if (snap->users++)
+		return 0;
+	if (mzapo_replay_enabled()) {
+		snap->replay = mzapo_replay_open(MZAPO_KNOBS_TRACE_NAME, 1,
+						 mzapo_knobs_trace_chan_name);
+		if (snap->replay == NULL) {
+			snap->users--;
+			return -1;
+		}
+	}
+	snap->log = mzapo_log_create(MZAPO_KNOBS_TRACE_NAME, 1,
+				     mzapo_knobs_trace_chan_name, period_s, NULL);
+	return 0;
+}
+
+static inline
+void mzapo_knobs_snapshot_detach(void)
+{
+	mzapo_knobs_shared_t *snap = &mzapo_knobs_snapshot_shared;
+
+	if (!snap->users || --snap->users)
+		return;
+	mzapo_log_destroy(snap->log);
+	snap->log = NULL;
+	mzapo_replay_close(snap->replay);
+	snap->replay = NULL;
+}
+
+/* The replayed trace has ended, the blocks should request stop */
+static inline
+int mzapo_knobs_snapshot_replay_done(void)
+{
+	mzapo_knobs_shared_t *snap = &mzapo_knobs_snapshot_shared;
+
+	return (snap->replay != NULL) && mzapo_replay_done(snap->replay);
+}
+
+/*
+ * Force next mzapo_knobs_snapshot_update() to read hardware
+ * regardless of the stamp.
+ */
+static inline
+void mzapo_knobs_snapshot_invalidate(void)
+{
+	mzapo_knobs_shared_t *sh = &mzapo_knobs_snapshot_shared;
+
+	__atomic_store_n(&sh->seq, sh->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sh->valid = 0;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&sh->seq, sh->seq + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Copy consistent published values, returns 0 on success and -1
+ * when the writer kept updating during all attempts.
+ */
+static inline
+int mzapo_knobs_snapshot_read(double *stamp, int *valid,
+			mzapo_knobs_snapshot_t *val)
+{
+	const mzapo_knobs_shared_t *sh = &mzapo_knobs_snapshot_shared;
+	uint32_t seq;
+	int retry;
+
+	for (retry = 0; retry < 1000; retry++) {
+		seq = __atomic_load_n(&sh->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		*stamp = sh->stamp;
+		*valid = sh->valid;
+		val->knobs_8bit = sh->knobs_8bit;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&sh->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	return -1;
+}
+
+/*
+ * Fill the values for given stamp (simulation time of the sample
+ * hit). Registers are read only by the first caller with new stamp,
+ * the others reuse the values. Caller which finds another task
+ * reading the registers gets the previous values.
+ */
+static inline
+void mzapo_knobs_snapshot_update(mem_address_map_t *memadrs, double stamp,
+			mzapo_knobs_snapshot_t *val)
+{
+	mzapo_knobs_shared_t *sh = &mzapo_knobs_snapshot_shared;
+	double last;
+	uint32_t buf;
+	int valid;
+
+	if (mzapo_knobs_snapshot_read(&last, &valid, val) < 0) {
+		/* Single register, whole word is always some read value */
+		val->knobs_8bit = __atomic_load_n(&sh->knobs_8bit, __ATOMIC_RELAXED);
+		return;
+	}
+	if (valid && (last == stamp))
+		return;
+	if (__atomic_exchange_n(&sh->busy, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	/* Writers are excluded, the published values can be read directly */
+	if (sh->valid && (sh->stamp == stamp)) {
+		val->knobs_8bit = sh->knobs_8bit;
+		__atomic_store_n(&sh->busy, 0, __ATOMIC_RELEASE);
+		return;
+	}
+
+	if (sh->replay != NULL)
+		mzapo_replay_next(sh->replay, (int32_t *)&buf);
+	else
+		buf = mem_address_reg_rd(memadrs, SPILED_KNOBS_8BIT_OFFS);
+	mzapo_log_write(sh->log, (const int32_t *)&buf);
+	val->knobs_8bit = buf;
+
+	__atomic_store_n(&sh->seq, sh->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sh->knobs_8bit = buf;
+	sh->stamp = stamp;
+	sh->valid = 1;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&sh->seq, sh->seq + 1, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&sh->busy, 0, __ATOMIC_RELEASE);
+}
+
+/* 8-bit position of knob channel 0 (blue) to 2 (red) */
+static inline
+uint8_t mzapo_knobs_snapshot_value(const mzapo_knobs_snapshot_t *snap,
+			unsigned chan)
+{
+	return SPILED_KNOBS_8BIT_VALUE_BLUE_get(snap->knobs_8bit >> (8 * chan));
+}
+
+static inline
+int mzapo_knobs_snapshot_button(const mzapo_knobs_snapshot_t *snap,
+			unsigned chan)
+{
+	return (snap->knobs_8bit &
+		(MZAPO_REGMAP_MASK(SPILED_KNOBS_8BIT_BUTTON_BLUE) << chan))? 1: 0;
+}
+
+/*
+ * Extend 8-bit knob position to wrapped int32 position
+ * accumulated in *pos_raw.
+ */
+static inline
+void mzapo_knobs_accumulate(int32_t *pos_raw, uint8_t value)
+{
+	*pos_raw += (int8_t)(value - *pos_raw);
+}
+
+#endif /*MZAPO_KNOBS_SNAPSHOT_H*/
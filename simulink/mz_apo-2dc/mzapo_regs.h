@@ -29,6 +29,12 @@
 
     https://gitlab.com/pikron/projects/mz_apo/microzed_apo
 
+  The blocks of this repository take the registers from the typed
+  layer ../common/mzapo_regmap.h generated from ../common/mzapo_regs.def,
+  which is the description to extend. This header is kept as it is
+  for the programs written against it, the tools/mzapo_regmap_cmp
+  build checks that it agrees with the description.
+
 */
 
 /* SPI connected knobs and LEDs registers and keyboard */
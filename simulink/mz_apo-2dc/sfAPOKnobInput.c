@@ -86,8 +86,9 @@
 #include <stdint.h>
 #include <unistd.h>
 
-#include "mzapo_regs.h"
-#include "phys_address_access.h"
+#include "../common/mzapo_regmap.h"
+#include "../common/phys_address_access.h"
+#include "mzapo_knobs_snapshot.h"
 
 #endif /*WITHOUT_HW*/
 
@@ -241,34 +242,43 @@ static void mdlStart(SimStruct *S)
 {
   #ifndef WITHOUT_HW
 	int initial_value;
-	int knob_value;
+	mzapo_knobs_snapshot_t snap;
 
     /* ----- Init PWORK_KNOBMEM_STATE(S) ----- */
     mem_address_map_t *memadrs_knob;
     PWORK_KNOBMEM_STATE(S) = NULL;
+
+    /* Shared snapshot, its log and replay are set up before the mapping */
+    if (mzapo_knobs_snapshot_attach(ssGetPath(S), PRM_TS(S)) < 0) {
+        ssSetErrorStatus(S, "knobs replay trace cannot be used");
+        return;
+    }
     
     /* Map physical address of knobs to virtual address */
-    memadrs_knob = mem_address_map_create(SPILED_REG_BASE_PHYS, SPILED_REG_SIZE, 0);
+    memadrs_knob = mem_address_map_create(SPILED_BASE_PHYS, SPILED_SIZE, 0);
     
     /* Check for errors */
 	if (memadrs_knob == NULL) {
+        mzapo_knobs_snapshot_detach();
         ssSetErrorStatus(S, "Error when accessing physical address.");
         return;
 	}
     
+    /* Name accesses of this block in MMIO profile (when enabled) */
+    mem_address_map_prof_name(memadrs_knob, ssGetPath(S));
+
     /* Save memory map structure to PWORK_KNOBMEM_STATE(S) */
     PWORK_KNOBMEM_STATE(S) = memadrs_knob;
 
     /* Read actual knobs position value from hardware */
-    knob_value = mem_address_reg_rd(memadrs_knob, SPILED_REG_KNOBS_8BIT_o);
+    mzapo_knobs_snapshot_invalidate();
+    mzapo_knobs_snapshot_update(memadrs_knob, ssGetT(S), &snap);
 
     IWORK_CHANNEL(S) = PRM_CHANNEL(S);
     initial_value = PRM_INITIAL_VALUE(S);
 
-    knob_value >>= 8 * IWORK_CHANNEL(S);
-
-    IWORK_VALUE_RAW(S) = (int8_t)knob_value;
-    IWORK_VALUE_OFFS(S) = initial_value - knob_value;
+    IWORK_VALUE_RAW(S) = (int8_t)mzapo_knobs_snapshot_value(&snap, IWORK_CHANNEL(S));
+    IWORK_VALUE_OFFS(S) = initial_value - IWORK_VALUE_RAW(S);
 
   #endif /*WITHOUT_HW*/
 
@@ -308,17 +318,20 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 static void mdlUpdate(SimStruct *S, int_T tid)
 {
   #ifndef WITHOUT_HW
-	int knob_value;
+    mzapo_knobs_snapshot_t snap;
 
     mem_address_map_t *memadrs_knob = (mem_address_map_t *)PWORK_KNOBMEM_STATE(S);
 
-    /* Read actual knobs position value from hardware */
-    knob_value = mem_address_reg_rd(memadrs_knob, SPILED_REG_KNOBS_8BIT_o);
+    mem_address_map_prof_step(memadrs_knob);
 
-    knob_value >>= 8 * IWORK_CHANNEL(S);
-    knob_value &= 0xff;
+    /* Knobs value read once per sample hit and shared by all knob blocks */
+    mzapo_knobs_snapshot_update(memadrs_knob, ssGetT(S), &snap);
 
-    IWORK_VALUE_RAW(S) += (int8_t)(knob_value - IWORK_VALUE_RAW(S));
+    mzapo_knobs_accumulate(&IWORK_VALUE_RAW(S),
+                           mzapo_knobs_snapshot_value(&snap, IWORK_CHANNEL(S)));
+
+    if (mzapo_knobs_snapshot_replay_done())
+        ssSetStopRequested(S, 1);
 
   #endif /*WITHOUT_HW*/
 }
@@ -354,6 +367,9 @@ static void mdlTerminate(SimStruct *S)
     mem_address_unmap_and_free(memadrs_knob);
     
     PWORK_KNOBMEM_STATE(S) = NULL;
+
+    if (memadrs_knob != NULL)
+        mzapo_knobs_snapshot_detach();
   #endif /*WITHOUT_HW*/
 }
 
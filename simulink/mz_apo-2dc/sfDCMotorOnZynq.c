@@ -45,6 +45,16 @@
  * The S-function has next parameters
  *
  * Sample time     - sample time value or -1 for inherited
+ * Motor ID        - 0 or 1, selects DC motor driver peripheral
+ * Estimator       - optional, empty or [bandwidth_hz edge_blend] adds
+ *                   velocity [counts/s] and acceleration [counts/s^2]
+ *                   outputs estimated by tracking observer, edge_blend
+ *                   (counts per period, 0 disables) blends in the speed
+ *                   from time between counter changes at low speed,
+ *                   explicit sample time is required
+ * PWM dither      - optional, sigma-delta dither order of the duty
+ *                   quantization, 0 truncates (default), 1 or 2 carry
+ *                   the sub-count residual across steps
  * Counter Mode    -
  * Counter Gating
  * Reset Control
@@ -54,16 +64,36 @@
 #define PRM_TS(S)               (mxGetScalar(ssGetSFcnParam(S, 0)))
 #define PRM_MOT_ID(S)           (mxGetScalar(ssGetSFcnParam(S, 1)))
 
-#define PRM_COUNT                   2
+#define PRM_EST(S)              (ssGetSFcnParam(S, 2))
+#define PRM_EST_MODE(S)         (ssGetSFcnParamsCount(S) > 2 && \
+                                 mxGetNumberOfElements(PRM_EST(S)) > 0)
+
+#define PRM_DITHER(S)           (ssGetSFcnParamsCount(S) > 3? \
+                                 (int)mxGetScalar(ssGetSFcnParam(S, 3)): 0)
+
+#define PRM_EST_LEN                 2
+
+#define PRM_COUNT_MIN               2
+#define PRM_COUNT                   4
 
 
 #define PWORK_IDX_ZYNQDCMOTMEM_STATE       0
 #define PWORK_IDX_ZYNQDCMOTPOS_STATE       1
+#define PWORK_IDX_ZYNQDCMOT_STREAM         2
+#define PWORK_IDX_ZYNQDCMOT_VELEST         3
+#define PWORK_IDX_ZYNQDCMOT_DITHER         4
+#define PWORK_IDX_ZYNQDCMOT_LOG            5
+#define PWORK_IDX_ZYNQDCMOT_REPLAY         6
 
-#define PWORK_COUNT                 2
+#define PWORK_COUNT                 7
 
 #define PWORK_ZYNQDCMOTMEM_STATE(S)        (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOTMEM_STATE])
 #define PWORK_ZYNQDCMOTPOS_STATE(S)        (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOTPOS_STATE])
+#define PWORK_ZYNQDCMOT_STREAM(S)          (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOT_STREAM])
+#define PWORK_ZYNQDCMOT_VELEST(S)          (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOT_VELEST])
+#define PWORK_ZYNQDCMOT_DITHER(S)          (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOT_DITHER])
+#define PWORK_ZYNQDCMOT_LOG(S)             (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOT_LOG])
+#define PWORK_ZYNQDCMOT_REPLAY(S)          (ssGetPWork(S)[PWORK_IDX_ZYNQDCMOT_REPLAY])
 
 enum {
     sIn_N_MOT_PWM = 0,  /* PWM value from interval [-1, 1], dimensions: [1 x 1]  */
@@ -73,6 +103,8 @@ enum {
 /* Enumerated constants for output ports ******************************************** */
 enum {
     sOut_N_IRC_POS,       /* IRC position [1 x 1] */
+    sOut_N_IRC_VEL,       /* Estimated velocity [1 x 1], estimator only */
+    sOut_N_IRC_ACC,       /* Estimated acceleration [1 x 1], estimator only */
     sOut_N_NUM
 };
 
@@ -82,6 +114,8 @@ enum {
  */
 #include "simstruc.h"
 
+#include "dcmot_velest.h"
+
 #ifndef WITHOUT_HW
 
 #include <sys/types.h>
@@ -90,9 +124,47 @@ enum {
 #include <stdint.h>
 #include <unistd.h>
 
-#include "mzapo_regs.h"
-#include "phys_address_access.h"
+#include "../common/mzapo_regmap.h"
+#include "../common/phys_address_access.h"
+#include "../common/mzapo_stream.h"
+#include "../common/mzapo_log.h"
+#include "../common/mzapo_replay.h"
+#include "../common/mzapo_sdm.h"
 
+/* Live signal streams, read by tools/mzapo_stream_tail */
+#define DCMOT_STREAM_SHM_NAME_0  "/dcmot0_stream"
+#define DCMOT_STREAM_SHM_NAME_1  "/dcmot1_stream"
+
+/*
+ * Full-rate compressed logs, enabled by MZAPO_LOGDIR, read by tools/mzapo_log_read,
+ * the IRC position is taken from them in replay (MZAPO_REPLAYDIR)
+ */
+#define DCMOT_LOG_NAME_0         "dcmot0"
+#define DCMOT_LOG_NAME_1         "dcmot1"
+#define DCMOT_LOG_CHAN_COUNT     2
+
+static const char *const dcmot_log_chan_name[DCMOT_LOG_CHAN_COUNT] = {
+    "duty", "irc_pos"
+};
+
+static const char *const dcmot_replay_chan_name[1] = {
+    "irc_pos"
+};
+
+/*
+ * Per step register transaction, IRC is sampled before PWM update,
+ * the duty write is skipped when it equals the last written one
+ */
+enum {
+    DCMOT_XFER_BUF_IRC = 0,
+    DCMOT_XFER_BUF_DUTY,
+    DCMOT_XFER_BUF_NUM
+};
+
+static const mem_address_xfer_t dcmot_step_xfer[] = {
+    MEM_ADDRESS_XFER(RD, DCSPDRV_IRC_OFFS, 1, DCMOT_XFER_BUF_IRC),
+    MEM_ADDRESS_XFER(WRS, DCSPDRV_DUTY_OFFS, 1, DCMOT_XFER_BUF_DUTY),
+};
 
 #endif /*WITHOUT_HW*/
 
@@ -141,6 +213,16 @@ static void mdlCheckParameters(SimStruct *S)
         printf("Motor ID parameter: %d\n", PRM_MOT_ID(S));
         ssSetErrorStatus(S, "Motor ID has to be 0 or 1");
     }
+    if ((ssGetSFcnParamsCount(S) > 2) &&
+        (mxGetNumberOfElements(PRM_EST(S)) != 0) &&
+        ((mxGetNumberOfElements(PRM_EST(S)) != PRM_EST_LEN) ||
+         (mxGetPr(PRM_EST(S))[0] <= 0)))
+        ssSetErrorStatus(S, "Estimator has to be empty or [bandwidth_hz edge_blend]"
+                            " with positive bandwidth");
+    else if (PRM_EST_MODE(S) && (PRM_TS(S) <= 0))
+        ssSetErrorStatus(S, "Estimator requires positive Ts");
+    if ((PRM_DITHER(S) < 0) || (PRM_DITHER(S) > 2))
+        ssSetErrorStatus(S, "PWM dither order has to be 0, 1 or 2");
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -152,10 +234,11 @@ static void mdlCheckParameters(SimStruct *S)
  */
 static void mdlInitializeSizes(SimStruct *S)
 {
-    ssSetNumSFcnParams(S, PRM_COUNT);  /* Number of expected parameters */
-    if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
-        /* Return if number of expected != number of actual parameters */
-        ssSetErrorStatus(S, "2-parameters required: Ts, MOT_ID");
+    /* Estimator is optional to keep existing models working */
+    ssSetNumSFcnParams(S, -1);
+    if ((ssGetSFcnParamsCount(S) < PRM_COUNT_MIN) ||
+        (ssGetSFcnParamsCount(S) > PRM_COUNT)) {
+        ssSetErrorStatus(S, "2 to 4 parameters required: Ts, MOT_ID, [Estimator], [PWM dither]");
         return;
     }
 
@@ -179,9 +262,13 @@ static void mdlInitializeSizes(SimStruct *S)
      * See matlabroot/simulink/src/sfuntmpl_directfeed.txt.
      */
 
-    if (!ssSetNumOutputPorts(S, sOut_N_NUM)) return;
+    if (!ssSetNumOutputPorts(S, PRM_EST_MODE(S)? sOut_N_NUM: sOut_N_IRC_POS + 1)) return;
     ssSetOutputPortWidth(S, sOut_N_IRC_POS, 1);
     ssSetOutputPortDataType(S, sOut_N_IRC_POS, SS_INT32);
+    if (PRM_EST_MODE(S)) {
+        ssSetOutputPortWidth(S, sOut_N_IRC_VEL, 1);
+        ssSetOutputPortWidth(S, sOut_N_IRC_ACC, 1);
+    }
 
     ssSetNumSampleTimes(S, 1);
     ssSetNumRWork(S, 0);
@@ -235,21 +322,29 @@ static void mdlInitializeConditions(SimStruct *S)
   #ifndef WITHOUT_HW
     mem_address_map_t *memadrs_dcmot1 = (mem_address_map_t *)PWORK_ZYNQDCMOTMEM_STATE(S);
     int32_T *irc_pos = (int32_T *)PWORK_ZYNQDCMOTPOS_STATE(S);
+    dcmot_velest_t *est = (dcmot_velest_t *)PWORK_ZYNQDCMOT_VELEST(S);
     
     /* Reset IRC variable */
     *irc_pos = 0;
+
+    /* Estimator restarts from the first sampled position */
+    if (est != NULL)
+        est->started = 0;
     
     /* Reset IRC counter (and disable DC motor PWM) */
-	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_CR_o, DCSPDRV_REG_CR_IRC_RESET_m);
+	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_CR_OFFS,
+			   MZAPO_REGMAP_VAL(DCSPDRV_CR_IRC_RESET, 1));
 	
 	/* Set frequency of DC motor PWM to 20 kHz (period is given in multiples of 10 ns) */
-	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_PERIOD_o, 5000 & DCSPDRV_REG_PERIOD_MASK_m);
+	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_PERIOD_OFFS,
+			   MZAPO_REGMAP_VAL(DCSPDRV_PERIOD_VALUE, 5000));
 	
 	/* Set DC motor PWM duty cycle to 0 (given in multiples of 10 ns, hence it should be less than 5000) */
-	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_DUTY_o, 0);
+	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_DUTY_OFFS, 0);
 	
 	/* Enable DC motor PWM */
-	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_CR_o, DCSPDRV_REG_CR_PWM_ENABLE_m);
+	mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_CR_OFFS,
+			   MZAPO_REGMAP_VAL(DCSPDRV_CR_PWM_ENABLE, 1));
 
   #endif /*WITHOUT_HW*/
 }
@@ -272,12 +367,30 @@ static void mdlStart(SimStruct *S)
     /* ----- Init PWORK_ZYNQDCMOTMEM_STATE(S) ----- */
     mem_address_map_t *memadrs_dcmot1;
     PWORK_ZYNQDCMOTMEM_STATE(S) = NULL;
+    PWORK_ZYNQDCMOT_STREAM(S) = NULL;
+    PWORK_ZYNQDCMOT_VELEST(S) = NULL;
+    PWORK_ZYNQDCMOT_DITHER(S) = NULL;
+    PWORK_ZYNQDCMOT_LOG(S) = NULL;
+    PWORK_ZYNQDCMOT_REPLAY(S) = NULL;
+
+    /* Recorded IRC position, the registers are mapped from the replay stand-in */
+    if (mzapo_replay_enabled()) {
+        PWORK_ZYNQDCMOT_REPLAY(S) = mzapo_replay_open(PRM_MOT_ID(S) == 0?
+                        DCMOT_LOG_NAME_0: DCMOT_LOG_NAME_1, 1, dcmot_replay_chan_name);
+        if (PWORK_ZYNQDCMOT_REPLAY(S) == NULL) {
+            ssSetErrorStatus(S, "DC motor replay trace cannot be used");
+            return;
+        }
+    }
+
+    /* Lock memory before the state and mappings are created */
+    mzapo_rtmem_prepare(ssGetPath(S));
     
     /* Map physical address of DC motor interface to virtual address */
     if (PRM_MOT_ID(S) == 0) {
-        memadrs_dcmot1 = mem_address_map_create(DCSPDRV_REG_BASE_PHYS_0, DCSPDRV_REG_SIZE, 0);
+        memadrs_dcmot1 = mem_address_map_create(DCSPDRV_BASE_PHYS_0, DCSPDRV_SIZE, 0);
     } else {
-        memadrs_dcmot1 = mem_address_map_create(DCSPDRV_REG_BASE_PHYS_1, DCSPDRV_REG_SIZE, 0);
+        memadrs_dcmot1 = mem_address_map_create(DCSPDRV_BASE_PHYS_1, DCSPDRV_SIZE, 0);
     }
     
     /* Check for errors */
@@ -286,6 +399,9 @@ static void mdlStart(SimStruct *S)
         return;
 	}
     
+    /* Name accesses of this block in MMIO profile (when enabled) */
+    mem_address_map_prof_name(memadrs_dcmot1, ssGetPath(S));
+
     /* Save memory map structure to PWORK_ZYNQDCMOTMEM_STATE(S) */
     PWORK_ZYNQDCMOTMEM_STATE(S) = memadrs_dcmot1;
     
@@ -294,7 +410,7 @@ static void mdlStart(SimStruct *S)
     PWORK_ZYNQDCMOTPOS_STATE(S) = NULL;
     
     /* Alloc memory for position state */
-    irc_pos_state = malloc(sizeof(*irc_pos_state));
+    irc_pos_state = mzapo_rtmem_alloc(sizeof(*irc_pos_state));
     
     /* Check for errors */
     if (irc_pos_state == NULL) {
@@ -308,9 +424,48 @@ static void mdlStart(SimStruct *S)
     /* Save position to PWORK_ZYNQDCMOTPOS_STATE(S) */
     PWORK_ZYNQDCMOTPOS_STATE(S) = irc_pos_state;
 
+    /* ----- Init PWORK_ZYNQDCMOT_STREAM(S), the block runs without it on failure ----- */
+    PWORK_ZYNQDCMOT_STREAM(S) = mzapo_stream_create(PRM_MOT_ID(S) == 0?
+                        DCMOT_STREAM_SHM_NAME_0: DCMOT_STREAM_SHM_NAME_1,
+                        MZAPO_STREAM_TYPE_DC, sizeof(mzapo_stream_dc_rec_t));
+
+    /* ----- Init PWORK_ZYNQDCMOT_LOG(S), only when logging is enabled ----- */
+    PWORK_ZYNQDCMOT_LOG(S) = mzapo_log_create(PRM_MOT_ID(S) == 0?
+                        DCMOT_LOG_NAME_0: DCMOT_LOG_NAME_1,
+                        DCMOT_LOG_CHAN_COUNT, dcmot_log_chan_name, PRM_TS(S), NULL);
+
+    /* ----- Init PWORK_ZYNQDCMOT_DITHER(S), order 0 truncates ----- */
+    {
+        mzapo_sdm_t *sdm = mzapo_rtmem_alloc(sizeof(*sdm));
+
+        if (sdm == NULL) {
+            ssSetErrorStatus(S, "Error when calling malloc.");
+            return;
+        }
+        mzapo_sdm_init(sdm, PRM_DITHER(S));
+        PWORK_ZYNQDCMOT_DITHER(S) = sdm;
+    }
+
+    /* ----- Init PWORK_ZYNQDCMOT_VELEST(S) ----- */
+    if (PRM_EST_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_EST(S));
+        dcmot_velest_t *est = mzapo_rtmem_alloc(sizeof(*est));
+
+        if (est == NULL) {
+            ssSetErrorStatus(S, "Error when calling malloc.");
+            return;
+        }
+        dcmot_velest_init(est, PRM_TS(S), prm[0], prm[1]);
+        PWORK_ZYNQDCMOT_VELEST(S) = est;
+    }
+
   #endif /*WITHOUT_HW*/
 
     mdlInitializeConditions(S);
+
+  #ifndef WITHOUT_HW
+    mzapo_rtmem_started(ssGetPath(S));
+  #endif /*WITHOUT_HW*/
 }
 #endif /*  MDL_START */
 
@@ -326,9 +481,18 @@ static void mdlOutputs(SimStruct *S, int_T tid)
  
   #ifndef WITHOUT_HW
     int32_T *irc_pos_state = (int32_T *)PWORK_ZYNQDCMOTPOS_STATE(S);
+    dcmot_velest_t *est = (dcmot_velest_t *)PWORK_ZYNQDCMOT_VELEST(S);
     *irc_pos_output = *irc_pos_state;
+    if (est != NULL) {
+        *(real_T *)ssGetOutputPortSignal(S, sOut_N_IRC_VEL) = est->vel_out;
+        *(real_T *)ssGetOutputPortSignal(S, sOut_N_IRC_ACC) = est->acc_out;
+    }
   #else /*WITHOUT_HW*/
     *irc_pos_output = 0;
+    if (PRM_EST_MODE(S)) {
+        *(real_T *)ssGetOutputPortSignal(S, sOut_N_IRC_VEL) = 0;
+        *(real_T *)ssGetOutputPortSignal(S, sOut_N_IRC_ACC) = 0;
+    }
   #endif /*WITHOUT_HW*/
 }
 
@@ -351,20 +515,59 @@ static void mdlUpdate(SimStruct *S, int_T tid)
     
     mem_address_map_t *memadrs_dcmot1 = (mem_address_map_t *)PWORK_ZYNQDCMOTMEM_STATE(S);
     int32_T *irc_pos = (int32_T *)PWORK_ZYNQDCMOTPOS_STATE(S);
+    uint32_t xfer_buf[DCMOT_XFER_BUF_NUM];
+    mzapo_stream_dc_rec_t rec;
+    int32_t duty;
     
-    /* Get IRC position */
-    *irc_pos = mem_address_reg_rd(memadrs_dcmot1, DCSPDRV_REG_IRC_o);
+    mem_address_map_prof_step(memadrs_dcmot1);
+    mem_address_map_shadow_step(memadrs_dcmot1);
     
-    /* Set PWM */
+    /* Prepare PWM */
     real_T pwm;
     pwm = **(pwm_input) * 5000;
     if (pwm > 5000) pwm = 5000;
     if (pwm < -5000) pwm = -5000;
     
-    if (pwm > 0) {
-        mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_DUTY_o, (uint32_t)  pwm | DCSPDRV_REG_DUTY_DIR_A_m);
+    /* Integer duty, the dither stage carries the sub-count residual */
+    duty = mzapo_sdm_quantize((mzapo_sdm_t *)PWORK_ZYNQDCMOT_DITHER(S), pwm, -5000, 5000);
+
+    if ((duty > 0) || ((duty == 0) && (pwm > 0))) {
+        xfer_buf[DCMOT_XFER_BUF_DUTY] = (uint32_t)  duty | MZAPO_REGMAP_MASK(DCSPDRV_DUTY_DIR_A);
     } else {
-        mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_DUTY_o, (uint32_t) -pwm | DCSPDRV_REG_DUTY_DIR_B_m);
+        xfer_buf[DCMOT_XFER_BUF_DUTY] = (uint32_t) -duty | MZAPO_REGMAP_MASK(DCSPDRV_DUTY_DIR_B);
+    }
+    
+    /* Get IRC position and set PWM */
+    mem_address_xfer(memadrs_dcmot1, dcmot_step_xfer,
+                     sizeof(dcmot_step_xfer) / sizeof(*dcmot_step_xfer), xfer_buf);
+
+    /* Recorded position instead of the register, stop at the trace end */
+    if (PWORK_ZYNQDCMOT_REPLAY(S) != NULL) {
+        int32_t val;
+
+        if (mzapo_replay_next((mzapo_replay_t *)PWORK_ZYNQDCMOT_REPLAY(S), &val) < 0)
+            ssSetStopRequested(S, 1);
+        xfer_buf[DCMOT_XFER_BUF_IRC] = val;
+    }
+    *irc_pos = xfer_buf[DCMOT_XFER_BUF_IRC];
+
+    if (PWORK_ZYNQDCMOT_VELEST(S) != NULL)
+        dcmot_velest_update((dcmot_velest_t *)PWORK_ZYNQDCMOT_VELEST(S), *irc_pos);
+    
+    /* Publish sampled position together with applied PWM */
+    if (PWORK_ZYNQDCMOT_STREAM(S) != NULL) {
+        rec.t = ssGetT(S);
+        rec.pwm = pwm / 5000;
+        rec.irc_pos = *irc_pos;
+        rec.duty_reg = xfer_buf[DCMOT_XFER_BUF_DUTY];
+        rec.wr_elided = mem_address_map_shadow_elided(memadrs_dcmot1);
+        mzapo_stream_write((mzapo_stream_t *)PWORK_ZYNQDCMOT_STREAM(S), &rec);
+    }
+
+    if (PWORK_ZYNQDCMOT_LOG(S) != NULL) {
+        int32_t val[DCMOT_LOG_CHAN_COUNT] = {duty, *irc_pos};
+
+        mzapo_log_write((mzapo_log_t *)PWORK_ZYNQDCMOT_LOG(S), val);
     }
     
   #endif /*WITHOUT_HW*/
@@ -398,23 +601,45 @@ static void mdlTerminate(SimStruct *S)
   #ifndef WITHOUT_HW
     
     mem_address_map_t *memadrs_dcmot1 = (mem_address_map_t *)PWORK_ZYNQDCMOTMEM_STATE(S);
-    
-    /* Set PWM to 0 */
-    mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_DUTY_o, 0);
-    
-    /* Disable PWM */
-    mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_REG_CR_o, 0);
-    
+
     int32_T *irc_pos = (int32_T *)PWORK_ZYNQDCMOTPOS_STATE(S);
     if (memadrs_dcmot1 != NULL) {
+        /* Set PWM to 0 */
+        mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_DUTY_OFFS, 0);
+
+        /* Disable PWM */
+        mem_address_reg_wr(memadrs_dcmot1, DCSPDRV_CR_OFFS, 0);
+
         PWORK_ZYNQDCMOTMEM_STATE(S) = NULL;
-        free(memadrs_dcmot1);
+        /* Release reference to the shared mapping */
+        mem_address_unmap_and_free(memadrs_dcmot1);
     }
     
     if (irc_pos != NULL) {
         PWORK_ZYNQDCMOTPOS_STATE(S) = NULL;
-        free(irc_pos);
+        mzapo_rtmem_free(irc_pos);
+    }
+
+    mzapo_stream_destroy((mzapo_stream_t *)PWORK_ZYNQDCMOT_STREAM(S));
+    PWORK_ZYNQDCMOT_STREAM(S) = NULL;
+
+    mzapo_log_destroy((mzapo_log_t *)PWORK_ZYNQDCMOT_LOG(S));
+    PWORK_ZYNQDCMOT_LOG(S) = NULL;
+
+    mzapo_replay_close((mzapo_replay_t *)PWORK_ZYNQDCMOT_REPLAY(S));
+    PWORK_ZYNQDCMOT_REPLAY(S) = NULL;
+
+    if (PWORK_ZYNQDCMOT_VELEST(S) != NULL) {
+        mzapo_rtmem_free(PWORK_ZYNQDCMOT_VELEST(S));
+        PWORK_ZYNQDCMOT_VELEST(S) = NULL;
     }
+
+    if (PWORK_ZYNQDCMOT_DITHER(S) != NULL) {
+        mzapo_rtmem_free(PWORK_ZYNQDCMOT_DITHER(S));
+        PWORK_ZYNQDCMOT_DITHER(S) = NULL;
+    }
+
+    mzapo_rtmem_release(ssGetPath(S));
   #endif /*WITHOUT_HW*/
 }
 
@@ -0,0 +1,636 @@
+/*
+ * S-function to support both DC Driver Board FPGA Peripherals
+ * by single block with simultaneous update of the axes
+ *
+ * Copyright (C) 2020 Lukas Cerny <cernylu6@fel.cvut.cz>
+ * Copyright (C) 2015-2017 Pavel Pisa <pisa@cmp.felk.cvut.cz>
+ *
+ * Department of Control Engineering
+ * Faculty of Electrical Engineering
+ * Czech Technical University in Prague (CTU)
+ *
+ * The S-Function for ERT Linux can be distributed in compliance
+ * with GNU General Public License (GPL) version 2 or later.
+ * Other licence can negotiated with CTU.
+ *
+ * Next exception is granted in addition to GPL.
+ * Instantiating or linking compiled version of this code
+ * to produce an application image/executable, does not
+ * by itself cause the resulting application image/executable
+ * to be covered by the GNU General Public License.
+ * This exception does not however invalidate any other reasons
+ * why the executable file might be covered by the GNU Public License.
+ * Publication of enhanced or derived S-function files is required
+ * although.
+ *
+ * The documenation for MZ_APO boards peripherals and board use
+ * for Computer Architectures course
+ *   https://cw.fel.cvut.cz/wiki/courses/b35apo/documentation/mz_apo/start
+ * The VHDL sources of SPI connected LEDs and knobs peripheral
+ *   https://gitlab.fel.cvut.cz/canbus/zynq/zynq-can-sja1000-top/tree/master/system/ip/dcsimpledrv_1.0/hdl
+ *
+ * Linux ERT code is available from
+ *    https://github.com/aa4cc/ert_linux
+ * More CTU Linux target for Simulink components are available at
+ *    http://lintarget.sourceforge.net/
+ *
+ * sfuntmpl_basic.c by The MathWorks, Inc. has been used to accomplish
+ * required S-function structure.
+ */
+
+
+#define S_FUNCTION_NAME  sfDCMotorVecOnZynq
+#define S_FUNCTION_LEVEL 2
+
+/*
+ * The S-function has next parameters
+ *
+ * Sample time     - sample time value or -1 for inherited
+ * Measure skew    - optional, nonzero adds skew output [2 x 1], time span
+ *                   of the IRC read pair and of the duty write pair in
+ *                   seconds, the clock read overhead calibrated at start
+ *                   is subtracted
+ * PWM dither      - optional, sigma-delta dither order of the duty
+ *                   quantization, 0 truncates (default), 1 or 2 carry
+ *                   the sub-count residual across steps
+ *
+ * Both motors (DCSPDRV_BASE_PHYS_0 and _1) are handled by one
+ * instance. Both IRC counters are read back to back, then both duty
+ * registers are written back to back, so the skew between the axes
+ * does not depend on the Simulink block ordering.
+ *
+ * The duties and positions are logged at full rate when MZAPO_LOGDIR
+ * is set, in replay (MZAPO_REPLAYDIR) the positions are taken from
+ * the log and the registers are mapped from the replay stand-in.
+ */
+
+#define PRM_TS(S)               (mxGetScalar(ssGetSFcnParam(S, 0)))
+#define PRM_SKEW(S)             (ssGetSFcnParamsCount(S) > 1 && \
+                                 mxGetScalar(ssGetSFcnParam(S, 1)) != 0)
+#define PRM_DITHER(S)           (ssGetSFcnParamsCount(S) > 2? \
+                                 (int)mxGetScalar(ssGetSFcnParam(S, 2)): 0)
+
+#define PRM_COUNT_MIN               1
+#define PRM_COUNT                   3
+
+#define DCMOTVEC_AXES               2
+
+#define PWORK_IDX_DCMOTVEC_STATE    0
+#define PWORK_IDX_DCMOTVEC_LOG      1
+#define PWORK_IDX_DCMOTVEC_REPLAY   2
+
+#define PWORK_COUNT                 3
+
+#define PWORK_DCMOTVEC_STATE(S)     (ssGetPWork(S)[PWORK_IDX_DCMOTVEC_STATE])
+#define PWORK_DCMOTVEC_LOG(S)       (ssGetPWork(S)[PWORK_IDX_DCMOTVEC_LOG])
+#define PWORK_DCMOTVEC_REPLAY(S)    (ssGetPWork(S)[PWORK_IDX_DCMOTVEC_REPLAY])
+
+enum {
+    sIn_N_MOT_PWM = 0,  /* PWM values from interval [-1, 1], dimensions: [2 x 1]  */
+    sIn_N_NUM
+};
+
+/* Enumerated constants for output ports ******************************************** */
+enum {
+    sOut_N_IRC_POS,       /* IRC positions [2 x 1] */
+    sOut_N_SKEW,          /* IRC read and duty write skew [2 x 1], optional */
+    sOut_N_NUM
+};
+
+/*
+ * Need to include simstruc.h for the definition of the SimStruct and
+ * its associated macro definitions.
+ */
+#include "simstruc.h"
+
+#ifndef WITHOUT_HW
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../common/mzapo_regmap.h"
+#include "../common/phys_address_access.h"
+#include "../common/mzapo_sdm.h"
+#include "../common/mzapo_log.h"
+#include "../common/mzapo_replay.h"
+
+/*
+ * Full-rate compressed log, enabled by MZAPO_LOGDIR, read by tools/mzapo_log_read,
+ * the IRC positions are taken from it in replay (MZAPO_REPLAYDIR)
+ */
+#define DCMOTVEC_LOG_NAME           "dcmotvec"
+#define DCMOTVEC_LOG_CHAN_COUNT     4
+
+static const char *const dcmotvec_log_chan_name[DCMOTVEC_LOG_CHAN_COUNT] = {
+    "duty0", "irc_pos0", "duty1", "irc_pos1"
+};
+
+static const char *const dcmotvec_replay_chan_name[DCMOTVEC_AXES] = {
+    "irc_pos0", "irc_pos1"
+};
+
+typedef struct dcmotvec_state_t {
+    mem_address_map_t *memadrs[DCMOTVEC_AXES];
+    /* Register pointers resolved at start, accessed back to back */
+    volatile uint32_t *irc_reg[DCMOTVEC_AXES];
+    volatile uint32_t *duty_reg[DCMOTVEC_AXES];
+    int32_T  irc_pos[DCMOTVEC_AXES];
+    mzapo_sdm_t dither[DCMOTVEC_AXES];
+    int      measure_skew;
+    int64_t  clock_overhead_ns;
+    real_T   skew[2];           /* read pair and write pair span [s] */
+} dcmotvec_state_t;
+
+static const uintptr_t dcmotvec_base_phys[DCMOTVEC_AXES] = {
+    DCSPDRV_BASE_PHYS_0,
+    DCSPDRV_BASE_PHYS_1,
+};
+
+static inline int64_t dcmotvec_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Minimal span of two consecutive clock reads, subtracted from the skew */
+static int64_t dcmotvec_clock_overhead(void)
+{
+    int64_t t0, t1, best = INT64_MAX;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        t0 = dcmotvec_time_ns();
+        t1 = dcmotvec_time_ns();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return best;
+}
+
+static inline real_T dcmotvec_span(dcmotvec_state_t *st, int64_t t0, int64_t t1)
+{
+    int64_t d = t1 - t0 - st->clock_overhead_ns;
+
+    return d > 0? d * 1e-9: 0;
+}
+
+#endif /*WITHOUT_HW*/
+
+/* Error handling
+ * --------------
+ *
+ * You should use the following technique to report errors encountered within
+ * an S-function:
+ *
+ *       ssSetErrorStatus(S,"Error encountered due to ...");
+ *       return;
+ *
+ * Note that the 2nd argument to ssSetErrorStatus must be persistent memory.
+ * It cannot be a local variable. For example the following will cause
+ * unpredictable errors:
+ *
+ *      mdlOutputs()
+ *      {
+ *         char msg[256];         {ILLEGAL: to fix use "static char msg[256];"}
+ *         sprintf(msg,"Error due to %s", string);
+ *         ssSetErrorStatus(S,msg);
+ *         return;
+ *      }
+ *
+ * See matlabroot/simulink/src/sfuntmpl_doc.c for more details.
+ */
+
+/*====================*
+ * S-function methods *
+ *====================*/
+
+#define MDL_CHECK_PARAMETERS   /* Change to #undef to remove function */
+#if defined(MDL_CHECK_PARAMETERS) && defined(MATLAB_MEX_FILE)
+  /* Function: mdlCheckParameters =============================================
+   * Abstract:
+   *    mdlCheckParameters verifies new parameter settings whenever parameter
+   *    change or are re-evaluated during a simulation. When a simulation is
+   *    running, changes to S-function parameters can occur at any time during
+   *    the simulation loop.
+   */
+static void mdlCheckParameters(SimStruct *S)
+{
+    if ((PRM_TS(S) < 0) && (PRM_TS(S) != -1))
+        ssSetErrorStatus(S, "Ts has to be positive or -1 for automatic step");
+    if ((PRM_DITHER(S) < 0) || (PRM_DITHER(S) > 2))
+        ssSetErrorStatus(S, "PWM dither order has to be 0, 1 or 2");
+}
+#endif /* MDL_CHECK_PARAMETERS */
+
+
+/* Function: mdlInitializeSizes ===============================================
+ * Abstract:
+ *    The sizes information is used by Simulink to determine the S-function
+ *    block's characteristics (number of inputs, outputs, states, etc.).
+ */
+static void mdlInitializeSizes(SimStruct *S)
+{
+    ssSetNumSFcnParams(S, -1);
+    if ((ssGetSFcnParamsCount(S) < PRM_COUNT_MIN) ||
+        (ssGetSFcnParamsCount(S) > PRM_COUNT)) {
+        ssSetErrorStatus(S, "1 to 3 parameters required: Ts, [Measure skew], [PWM dither]");
+        return;
+    }
+
+  #if defined(MDL_CHECK_PARAMETERS) && defined(MATLAB_MEX_FILE)
+    mdlCheckParameters(S);
+    if (ssGetErrorStatus(S) != NULL) return;
+  #endif
+
+    ssSetNumContStates(S, 0);
+    ssSetNumDiscStates(S, 0);
+
+    if (!ssSetNumInputPorts(S, sIn_N_NUM)) return;
+
+    ssSetInputPortWidth(S, sIn_N_MOT_PWM, DCMOTVEC_AXES);
+
+    /*
+     * Set direct feedthrough flag (1=yes, 0=no).
+     * A port has direct feedthrough if the input is used in either
+     * the mdlOutputs or mdlGetTimeOfNextVarHit functions.
+     * See matlabroot/simulink/src/sfuntmpl_directfeed.txt.
+     */
+
+    if (!ssSetNumOutputPorts(S, PRM_SKEW(S)? sOut_N_NUM: sOut_N_IRC_POS + 1)) return;
+    ssSetOutputPortWidth(S, sOut_N_IRC_POS, DCMOTVEC_AXES);
+    ssSetOutputPortDataType(S, sOut_N_IRC_POS, SS_INT32);
+    if (PRM_SKEW(S))
+        ssSetOutputPortWidth(S, sOut_N_SKEW, 2);
+
+    ssSetNumSampleTimes(S, 1);
+    ssSetNumRWork(S, 0);
+    ssSetNumIWork(S, 0);
+    ssSetNumPWork(S, PWORK_COUNT);
+    ssSetNumModes(S, 0);
+    ssSetNumNonsampledZCs(S, 0);
+
+    /* Specify the sim state compliance to be same as a built-in block */
+    ssSetSimStateCompliance(S, USE_DEFAULT_SIM_STATE);
+
+    ssSetOptions(S, 0);
+}
+
+
+
+/* Function: mdlInitializeSampleTimes =========================================
+ * Abstract:
+ *    This function is used to specify the sample time(s) for your
+ *    S-function. You must register the same number of sample times as
+ *    specified in ssSetNumSampleTimes.
+ */
+static void mdlInitializeSampleTimes(SimStruct *S)
+{
+    if (PRM_TS(S) == -1) {
+        ssSetSampleTime(S, 0, CONTINUOUS_SAMPLE_TIME);
+        ssSetOffsetTime(S, 0, FIXED_IN_MINOR_STEP_OFFSET);
+    } else {
+        ssSetSampleTime(S, 0, PRM_TS(S));
+        ssSetOffsetTime(S, 0, 0.0);
+    }
+}
+
+
+
+#define MDL_INITIALIZE_CONDITIONS   /* Change to #undef to remove function */
+#if defined(MDL_INITIALIZE_CONDITIONS)
+  /* Function: mdlInitializeConditions ========================================
+   * Abstract:
+   *    In this function, you should initialize the continuous and discrete
+   *    states for your S-function block.  The initial states are placed
+   *    in the state vector, ssGetContStates(S) or ssGetRealDiscStates(S).
+   *    You can also perform any other initialization activities that your
+   *    S-function may require. Note, this routine will be called at the
+   *    start of simulation and if it is present in an enabled subsystem
+   *    configured to reset states, it will be call when the enabled subsystem
+   *    restarts execution to reset the states.
+   */
+static void mdlInitializeConditions(SimStruct *S)
+{
+  #ifndef WITHOUT_HW
+    dcmotvec_state_t *st = (dcmotvec_state_t *)PWORK_DCMOTVEC_STATE(S);
+    int i;
+
+    if (st == NULL)
+        return;
+
+    for (i = 0; i < DCMOTVEC_AXES; i++) {
+        mem_address_map_t *memadrs = st->memadrs[i];
+
+        /* Reset IRC variable */
+        st->irc_pos[i] = 0;
+
+        /* Reset IRC counter (and disable DC motor PWM) */
+        mem_address_reg_wr(memadrs, DCSPDRV_CR_OFFS,
+                           MZAPO_REGMAP_VAL(DCSPDRV_CR_IRC_RESET, 1));
+
+        /* Set frequency of DC motor PWM to 20 kHz (period is given in multiples of 10 ns) */
+        mem_address_reg_wr(memadrs, DCSPDRV_PERIOD_OFFS,
+                           MZAPO_REGMAP_VAL(DCSPDRV_PERIOD_VALUE, 5000));
+
+        /* Set DC motor PWM duty cycle to 0 (given in multiples of 10 ns, hence it should be less than 5000) */
+        mem_address_reg_wr(memadrs, DCSPDRV_DUTY_OFFS, 0);
+    }
+
+    /* Enable both PWMs after both are configured */
+    for (i = 0; i < DCMOTVEC_AXES; i++)
+        mem_address_reg_wr(st->memadrs[i], DCSPDRV_CR_OFFS,
+                           MZAPO_REGMAP_VAL(DCSPDRV_CR_PWM_ENABLE, 1));
+
+    st->skew[0] = 0;
+    st->skew[1] = 0;
+
+  #endif /*WITHOUT_HW*/
+}
+#endif /* MDL_INITIALIZE_CONDITIONS */
+
+
+
+#define MDL_START  /* Change to #undef to remove function */
+#if defined(MDL_START)
+  /* Function: mdlStart =======================================================
+   * Abstract:
+   *    This function is called once at start of model execution. If you
+   *    have states that should be initialized once, this is the place
+   *    to do it.
+   */
+static void mdlStart(SimStruct *S)
+{
+  #ifndef WITHOUT_HW
+    dcmotvec_state_t *st;
+    int i;
+
+    PWORK_DCMOTVEC_STATE(S) = NULL;
+    PWORK_DCMOTVEC_LOG(S) = NULL;
+    PWORK_DCMOTVEC_REPLAY(S) = NULL;
+
+    /* Recorded IRC positions, the registers are mapped from the replay stand-in */
+    if (mzapo_replay_enabled()) {
+        PWORK_DCMOTVEC_REPLAY(S) = mzapo_replay_open(DCMOTVEC_LOG_NAME,
+                        DCMOTVEC_AXES, dcmotvec_replay_chan_name);
+        if (PWORK_DCMOTVEC_REPLAY(S) == NULL) {
+            ssSetErrorStatus(S, "DC motor replay trace cannot be used");
+            return;
+        }
+    }
+
+    /* Lock memory before the state and mappings are created */
+    mzapo_rtmem_prepare(ssGetPath(S));
+
+    st = mzapo_rtmem_alloc(sizeof(*st));
+    if (st == NULL) {
+        ssSetErrorStatus(S, "Error when calling malloc.");
+        return;
+    }
+
+    for (i = 0; i < DCMOTVEC_AXES; i++) {
+        /* Map physical address of DC motor interface to virtual address */
+        st->memadrs[i] = mem_address_map_create(dcmotvec_base_phys[i],
+                                                DCSPDRV_SIZE, 0);
+        if (st->memadrs[i] == NULL) {
+            while (i--)
+                mem_address_unmap_and_free(st->memadrs[i]);
+            mzapo_rtmem_free(st);
+            ssSetErrorStatus(S, "Error when accessing physical address.");
+            return;
+        }
+
+        /* Name accesses of this block in MMIO profile (when enabled) */
+        mem_address_map_prof_name(st->memadrs[i], ssGetPath(S));
+
+        st->irc_reg[i] = (volatile uint32_t *)((char *)st->memadrs[i]->regs_base_virt +
+                                               DCSPDRV_IRC_OFFS);
+        st->duty_reg[i] = (volatile uint32_t *)((char *)st->memadrs[i]->regs_base_virt +
+                                                DCSPDRV_DUTY_OFFS);
+
+        mzapo_sdm_init(&st->dither[i], PRM_DITHER(S));
+    }
+
+    st->measure_skew = PRM_SKEW(S);
+    if (st->measure_skew)
+        st->clock_overhead_ns = dcmotvec_clock_overhead();
+
+    PWORK_DCMOTVEC_STATE(S) = st;
+
+    /* Only when logging is enabled */
+    PWORK_DCMOTVEC_LOG(S) = mzapo_log_create(DCMOTVEC_LOG_NAME,
+                        DCMOTVEC_LOG_CHAN_COUNT, dcmotvec_log_chan_name, PRM_TS(S), NULL);
+
+  #endif /*WITHOUT_HW*/
+
+    mdlInitializeConditions(S);
+
+  #ifndef WITHOUT_HW
+    mzapo_rtmem_started(ssGetPath(S));
+  #endif /*WITHOUT_HW*/
+}
+#endif /*  MDL_START */
+
+
+/* Function: mdlOutputs =======================================================
+ * Abstract:
+ *    In this function, you compute the outputs of your S-function
+ *    block.
+ */
+static void mdlOutputs(SimStruct *S, int_T tid)
+{
+    int32_T *irc_pos_output = ssGetOutputPortSignal(S, sOut_N_IRC_POS);
+    int i;
+
+  #ifndef WITHOUT_HW
+    dcmotvec_state_t *st = (dcmotvec_state_t *)PWORK_DCMOTVEC_STATE(S);
+
+    for (i = 0; i < DCMOTVEC_AXES; i++)
+        irc_pos_output[i] = st->irc_pos[i];
+    if (st->measure_skew) {
+        real_T *skew_output = ssGetOutputPortSignal(S, sOut_N_SKEW);
+        skew_output[0] = st->skew[0];
+        skew_output[1] = st->skew[1];
+    }
+  #else /*WITHOUT_HW*/
+    for (i = 0; i < DCMOTVEC_AXES; i++)
+        irc_pos_output[i] = 0;
+    if (PRM_SKEW(S)) {
+        real_T *skew_output = ssGetOutputPortSignal(S, sOut_N_SKEW);
+        skew_output[0] = 0;
+        skew_output[1] = 0;
+    }
+  #endif /*WITHOUT_HW*/
+}
+
+
+
+#define MDL_UPDATE  /* Change to #undef to remove function */
+#if defined(MDL_UPDATE)
+  /* Function: mdlUpdate ======================================================
+   * Abstract:
+   *    This function is called once for every major integration time step.
+   *    Discrete states are typically updated here, but this function is useful
+   *    for performing any tasks that should only take place once per
+   *    integration step.
+   */
+static void mdlUpdate(SimStruct *S, int_T tid)
+{
+  #ifndef WITHOUT_HW
+
+    InputRealPtrsType pwm_input = ssGetInputPortRealSignalPtrs(S, sIn_N_MOT_PWM);
+    dcmotvec_state_t *st = (dcmotvec_state_t *)PWORK_DCMOTVEC_STATE(S);
+    uint32_t duty[DCMOTVEC_AXES];
+    int32_t q[DCMOTVEC_AXES];
+    uint32_t irc0, irc1;
+    int64_t t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+    real_T pwm;
+    int i;
+
+    mem_address_map_prof_step(st->memadrs[0]);
+    mem_address_map_prof_step(st->memadrs[1]);
+
+    /* Prepare both duty words before any register access */
+    for (i = 0; i < DCMOTVEC_AXES; i++) {
+        pwm = *pwm_input[i] * 5000;
+        if (pwm > 5000) pwm = 5000;
+        if (pwm < -5000) pwm = -5000;
+
+        /* Integer duty, the dither stage carries the sub-count residual */
+        q[i] = mzapo_sdm_quantize(&st->dither[i], pwm, -5000, 5000);
+
+        if ((q[i] > 0) || ((q[i] == 0) && (pwm > 0)))
+            duty[i] = (uint32_t)  q[i] | MZAPO_REGMAP_MASK(DCSPDRV_DUTY_DIR_A);
+        else
+            duty[i] = (uint32_t) -q[i] | MZAPO_REGMAP_MASK(DCSPDRV_DUTY_DIR_B);
+    }
+
+    if (st->measure_skew)
+        t0 = dcmotvec_time_ns();
+
+  #ifdef MMIO_PROF
+    irc0 = mem_address_reg_rd(st->memadrs[0], DCSPDRV_IRC_OFFS);
+    irc1 = mem_address_reg_rd(st->memadrs[1], DCSPDRV_IRC_OFFS);
+  #else /*MMIO_PROF*/
+    /* Sample both axes back to back */
+    irc0 = *st->irc_reg[0];
+    irc1 = *st->irc_reg[1];
+  #endif /*MMIO_PROF*/
+
+    if (st->measure_skew) {
+        t1 = dcmotvec_time_ns();
+        t2 = dcmotvec_time_ns();
+    }
+
+  #ifdef MMIO_PROF
+    mem_address_reg_wr(st->memadrs[0], DCSPDRV_DUTY_OFFS, duty[0]);
+    mem_address_reg_wr(st->memadrs[1], DCSPDRV_DUTY_OFFS, duty[1]);
+  #else /*MMIO_PROF*/
+    /* Actuate both axes back to back */
+    *st->duty_reg[0] = duty[0];
+    *st->duty_reg[1] = duty[1];
+  #endif /*MMIO_PROF*/
+
+    if (st->measure_skew) {
+        t3 = dcmotvec_time_ns();
+        st->skew[0] = dcmotvec_span(st, t0, t1);
+        st->skew[1] = dcmotvec_span(st, t2, t3);
+    }
+
+    /* Recorded positions instead of the registers, stop at the trace end */
+    if (PWORK_DCMOTVEC_REPLAY(S) != NULL) {
+        int32_t val[DCMOTVEC_AXES];
+
+        if (mzapo_replay_next((mzapo_replay_t *)PWORK_DCMOTVEC_REPLAY(S), val) < 0)
+            ssSetStopRequested(S, 1);
+        irc0 = val[0];
+        irc1 = val[1];
+    }
+
+    st->irc_pos[0] = irc0;
+    st->irc_pos[1] = irc1;
+
+    if (PWORK_DCMOTVEC_LOG(S) != NULL) {
+        int32_t val[DCMOTVEC_LOG_CHAN_COUNT] = {q[0], irc0, q[1], irc1};
+
+        mzapo_log_write((mzapo_log_t *)PWORK_DCMOTVEC_LOG(S), val);
+    }
+
+  #endif /*WITHOUT_HW*/
+}
+#endif /* MDL_UPDATE */
+
+
+
+#undef MDL_DERIVATIVES  /* Change to #undef to remove function */
+#if defined(MDL_DERIVATIVES)
+  /* Function: mdlDerivatives =================================================
+   * Abstract:
+   *    In this function, you compute the S-function block's derivatives.
+   *    The derivatives are placed in the derivative vector, ssGetdX(S).
+   */
+  static void mdlDerivatives(SimStruct *S)
+  {
+  }
+#endif /* MDL_DERIVATIVES */
+
+
+
+/* Function: mdlTerminate =====================================================
+ * Abstract:
+ *    In this function, you should perform any actions that are necessary
+ *    at the termination of a simulation.  For example, if memory was
+ *    allocated in mdlStart, this is the place to free it.
+ */
+static void mdlTerminate(SimStruct *S)
+{
+  #ifndef WITHOUT_HW
+    dcmotvec_state_t *st = (dcmotvec_state_t *)PWORK_DCMOTVEC_STATE(S);
+    int i;
+
+    mzapo_rtmem_release(ssGetPath(S));
+
+    mzapo_log_destroy((mzapo_log_t *)PWORK_DCMOTVEC_LOG(S));
+    PWORK_DCMOTVEC_LOG(S) = NULL;
+
+    mzapo_replay_close((mzapo_replay_t *)PWORK_DCMOTVEC_REPLAY(S));
+    PWORK_DCMOTVEC_REPLAY(S) = NULL;
+
+    if (st == NULL)
+        return;
+
+    /* Stop both axes before releasing the mappings */
+    for (i = 0; i < DCMOTVEC_AXES; i++)
+        mem_address_reg_wr(st->memadrs[i], DCSPDRV_DUTY_OFFS, 0);
+
+    for (i = 0; i < DCMOTVEC_AXES; i++) {
+        /* Disable PWM */
+        mem_address_reg_wr(st->memadrs[i], DCSPDRV_CR_OFFS, 0);
+        /* Release reference to the shared mapping */
+        mem_address_unmap_and_free(st->memadrs[i]);
+    }
+
+    PWORK_DCMOTVEC_STATE(S) = NULL;
+    mzapo_rtmem_free(st);
+  #endif /*WITHOUT_HW*/
+}
+
+
+/*======================================================*
+ * See sfuntmpl_doc.c for the optional S-function methods *
+ *======================================================*/
+
+/*=============================*
+ * Required S-function trailer *
+ *=============================*/
+
+#ifdef  MATLAB_MEX_FILE    /* Is this file being compiled as a MEX-file? */
+#include "simulink.c"      /* MEX-file interface mechanism */
+#else
+#include "cg_sfun.h"       /* Code generation registration function */
+#endif
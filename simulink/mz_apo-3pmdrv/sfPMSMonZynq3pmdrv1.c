@@ -31,6 +31,8 @@
  */
 
 
+#define _GNU_SOURCE      /* CPU affinity of the inner loop thread */
+
 #define S_FUNCTION_NAME  sfPMSMonZynq3pmdrv1
 #define S_FUNCTION_LEVEL 2
 
@@ -38,6 +40,56 @@
  * The S-function has next parameters
  *
  * Sample time     - sample time value or -1 for inherited
+ * ADC format      - optional, current ADC output representation
+ *                   0 .. double (default), 1 .. single,
+ *                   2 .. int32 Q16 (16 fractional bits)
+ * FOC parameters  - optional, empty for direct phase PWM inputs, otherwise
+ *                   [kp ki pole_pairs irc_per_rev irc_offset cur_scale umax]
+ *                   selects field oriented current control, the first input
+ *                   is then [id_ref iq_ref] in current units (ADC units
+ *                   multiplied by cur_scale), kp/ki in DC bus voltage
+ *                   per current unit (ki multiplied by Ts), irc_offset is
+ *                   IRC counter value of zero electrical angle, umax
+ *                   limits voltage vector (0 for 1/sqrt(3))
+ * Inner loop      - optional, empty or [period_s priority cpu] runs register
+ *                   transfer and current control (FOC or PWM duties)
+ *                   in SCHED_FIFO thread of given priority (1 to 99)
+ *                   at given period, cpu is online CPU index or -1 to
+ *                   keep default affinity
+ * PWM dither      - optional, sigma-delta dither order of the PWM duty
+ *                   quantization, 0 truncates (default), 1 or 2 carry
+ *                   the sub-count residual across steps
+ * Dead-time comp. - optional, empty, [1 i_max c0 .. cN-1] adds to each
+ *                   phase duty sign(i) * comp(|i|) interpolated from N
+ *                   (2 to 16) points over 0 .. i_max current (ADC units),
+ *                   [2 i_max N] calibrates the table from the commanded
+ *                   duties and measured currents, the result is written
+ *                   at termination to z3pmdrv1_dtc_cal.m, calibration
+ *                   runs without the inner loop
+ * ADC offset cal. - optional, empty keeps zero current ADC offsets,
+ *                   [avg_time] or [avg_time force] measures the offsets
+ *                   at start with PWM in shutdown averaging over avg_time
+ *                   seconds after settling, the result is cached per
+ *                   board (MZAPO_CALDIR or current directory) and loaded
+ *                   on following starts unless force is nonzero
+ * Commissioning   - optional, empty or [amp elec_hz elec_revs] or
+ *                   [amp elec_hz elec_revs force] learns at start the Hall
+ *                   table, pole pairs and IRC index to electrical angle
+ *                   offset by open-loop voltage vector of amplitude amp
+ *                   (duty) turning elec_revs electrical revolutions forth
+ *                   and back at elec_hz, irc_per_rev is taken from FOC
+ *                   parameters or measured by index (elec_revs has to
+ *                   cover more than one mechanical revolution then),
+ *                   the result is cached per board like the ADC offsets,
+ *                   replaces FOC pole_pairs and irc_offset and the Hall
+ *                   sector table, FOC angle is aligned by Hall code at
+ *                   start and by each IRC index event
+ * ADC decimation  - optional, empty or [filter len par] selects post-filter
+ *                   of the current ADC window averages and adds ADC flags
+ *                   and ADC samples outputs, filter 0 .. none, 1 .. moving
+ *                   average over len windows, 2 .. IIR with alpha par,
+ *                   3 .. CIC of order par over len windows (len up to 64),
+ *                   the current output always holds the last valid value
  * Counter Mode    -
  * Counter Gating
  * Reset Control
@@ -45,17 +97,64 @@
  */
 
 #define PRM_TS(S)               (mxGetScalar(ssGetSFcnParam(S, 0)))
+#define PRM_ADC_FMT(S)          (ssGetSFcnParamsCount(S) > 1? \
+                                 (int)mxGetScalar(ssGetSFcnParam(S, 1)): 0)
+
+#define PRM_FOC(S)              (ssGetSFcnParam(S, 2))
+#define PRM_FOC_MODE(S)         (ssGetSFcnParamsCount(S) > 2 && \
+                                 mxGetNumberOfElements(PRM_FOC(S)) > 0)
+
+#define PRM_RTLOOP(S)           (ssGetSFcnParam(S, 3))
+#define PRM_RTLOOP_MODE(S)      (ssGetSFcnParamsCount(S) > 3 && \
+                                 mxGetNumberOfElements(PRM_RTLOOP(S)) > 0)
+
+#define PRM_DITHER(S)           (ssGetSFcnParamsCount(S) > 4? \
+                                 (int)mxGetScalar(ssGetSFcnParam(S, 4)): 0)
+
+#define PRM_DTC(S)              (ssGetSFcnParam(S, 5))
+#define PRM_DTC_MODE(S)         (ssGetSFcnParamsCount(S) > 5 && \
+                                 mxGetNumberOfElements(PRM_DTC(S)) > 0? \
+                                 (int)mxGetPr(PRM_DTC(S))[0]: 0)
+
+#define PRM_ADC_CAL(S)          (ssGetSFcnParam(S, 6))
+#define PRM_ADC_CAL_MODE(S)     (ssGetSFcnParamsCount(S) > 6 && \
+                                 mxGetNumberOfElements(PRM_ADC_CAL(S)) > 0)
+
+#define PRM_COMMIS(S)           (ssGetSFcnParam(S, 7))
+#define PRM_COMMIS_MODE(S)      (ssGetSFcnParamsCount(S) > 7 && \
+                                 mxGetNumberOfElements(PRM_COMMIS(S)) > 0)
 
-#define PRM_COUNT                   1
+#define PRM_ADC_DEC(S)          (ssGetSFcnParam(S, 8))
+#define PRM_ADC_DEC_MODE(S)     (ssGetSFcnParamsCount(S) > 8 && \
+                                 mxGetNumberOfElements(PRM_ADC_DEC(S)) > 0)
+
+#define PRM_FOC_LEN                 7
+#define PRM_RTLOOP_LEN              3
+#define PRM_ADC_DEC_LEN             3
+
+#define PRM_COUNT_MIN               1
+#define PRM_COUNT                   9
 
 #define PWORK_IDX_Z3PMDRV1_STATE       0
+#define PWORK_IDX_Z3PMDRV1_TLM         1
+#define PWORK_IDX_Z3PMDRV1_STREAM      2
+#define PWORK_IDX_Z3PMDRV1_FOC         3
+#define PWORK_IDX_Z3PMDRV1_RTLOOP      4
+#define PWORK_IDX_Z3PMDRV1_ADCDEC      5
+#define PWORK_IDX_Z3PMDRV1_LOG         6
 
-#define PWORK_COUNT                 1
+#define PWORK_COUNT                 7
 
 #define PWORK_Z3PMDRV1_STATE(S)        (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_STATE])
+#define PWORK_Z3PMDRV1_TLM(S)          (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_TLM])
+#define PWORK_Z3PMDRV1_STREAM(S)       (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_STREAM])
+#define PWORK_Z3PMDRV1_FOC(S)          (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_FOC])
+#define PWORK_Z3PMDRV1_RTLOOP(S)       (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_RTLOOP])
+#define PWORK_Z3PMDRV1_ADCDEC(S)       (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_ADCDEC])
+#define PWORK_Z3PMDRV1_LOG(S)          (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_LOG])
 
 enum {
-    sIn_N_PWM_VAL = 0,  /* PWM value [3 x 1]  */
+    sIn_N_PWM_VAL = 0,  /* PWM value [3 x 1] or id/iq reference [2 x 1] */
     sIn_N_PWM_EN,       /* PWM enable [3 x 1] */
     sIn_N_NUM
 };
@@ -67,6 +166,8 @@ enum {
     sOut_N_IRC_Idx,     /* IRC index [1 x 1] */
     sOut_N_IRC_Occur,   /* IRC index occurence [1 x 1] */
     sOut_N_HAL_Sector,  /* Hal sector [1 x 1] <0 .. 5>  and -1 ) */
+    sOut_N_ADC_Flags,   /* ADC window flags [1 x 1], decimation only */
+    sOut_N_ADC_Count,   /* ADC samples in window [1 x 1], decimation only */
     sOut_N_NUM
 };
 
@@ -76,6 +177,9 @@ enum {
  */
 #include "simstruc.h"
 
+#include <sched.h>
+#include <unistd.h>
+
 #ifndef WITHOUT_HW
 
 #include <sys/types.h>
@@ -83,8 +187,44 @@ enum {
 #include <fcntl.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_tlm.h"
+#include "zynq_3pmdrv1_adcavg.h"
+#include "zynq_3pmdrv1_adcdec.h"
+#include "zynq_3pmdrv1_foc.h"
+#include "zynq_3pmdrv1_dtc.h"
+#include "zynq_3pmdrv1_adccal.h"
+#include "zynq_3pmdrv1_commis.h"
+#include "zynq_3pmdrv1_rtloop.h"
+#include "../common/mzapo_stream.h"
+#include "../common/mzapo_log.h"
+#include "../common/mzapo_replay.h"
+#include "../common/mzapo_rtmem.h"
+
+/* Live signal stream, read by tools/mzapo_stream_tail */
+#define Z3PMDRV1_STREAM_SHM_NAME       "/z3pmdrv1_stream"
+
+/* Dead-time calibration result, the block parameter vector */
+#define Z3PMDRV1_DTC_CAL_FILE          "z3pmdrv1_dtc_cal.m"
+
+/*
+ * Full-rate compressed log, enabled by MZAPO_LOGDIR, read by tools/mzapo_log_read.
+ * The raw sensor channels make it the trace replayed with MZAPO_REPLAYDIR.
+ */
+#define Z3PMDRV1_LOG_NAME              "z3pmdrv1"
+#define Z3PMDRV1_LOG_CHAN_COUNT        13
+
+static const char *const z3pmdrv1_log_chan_name[Z3PMDRV1_LOG_CHAN_COUNT] = {
+    "pwm1", "pwm2", "pwm3", "cur1", "cur2", "cur3", "irc_pos", "irc_idx", "hall",
+    "adc_sqn", "adc1", "adc2", "adc3"
+};
+
+/* Trace channels in the Z3PMDRV1_REPLAY_* order */
+static const char *const z3pmdrv1_replay_chan_name[Z3PMDRV1_REPLAY_CHAN_COUNT] = {
+    "irc_pos", "irc_idx", "hall", "adc_sqn", "adc1", "adc2", "adc3"
+};
 
 #endif /*WITHOUT_HW*/
 
@@ -129,6 +269,68 @@ static void mdlCheckParameters(SimStruct *S)
 {
     if ((PRM_TS(S) < 0) && (PRM_TS(S) != -1))
         ssSetErrorStatus(S, "Ts has to be positive or -1 for automatic step");
+    if ((PRM_ADC_FMT(S) < 0) || (PRM_ADC_FMT(S) > 2))
+        ssSetErrorStatus(S, "ADC format has to be 0 (double), 1 (single) or 2 (Q16)");
+    if ((ssGetSFcnParamsCount(S) > 2) &&
+        (mxGetNumberOfElements(PRM_FOC(S)) != 0) &&
+        (mxGetNumberOfElements(PRM_FOC(S)) != PRM_FOC_LEN))
+        ssSetErrorStatus(S, "FOC parameters have to be empty or "
+                         "[kp ki pole_pairs irc_per_rev irc_offset cur_scale umax]");
+    else if (PRM_FOC_MODE(S) && ((mxGetPr(PRM_FOC(S))[2] < 1) ||
+                                 (mxGetPr(PRM_FOC(S))[3] < 1)))
+        ssSetErrorStatus(S, "FOC pole_pairs and irc_per_rev have to be positive");
+    if ((ssGetSFcnParamsCount(S) > 3) &&
+        (mxGetNumberOfElements(PRM_RTLOOP(S)) != 0) &&
+        ((mxGetNumberOfElements(PRM_RTLOOP(S)) != PRM_RTLOOP_LEN) ||
+         (mxGetPr(PRM_RTLOOP(S))[0] <= 0)))
+        ssSetErrorStatus(S, "Inner loop has to be empty or [period_s priority cpu]");
+    else if (PRM_RTLOOP_MODE(S) &&
+             ((mxGetPr(PRM_RTLOOP(S))[1] < sched_get_priority_min(SCHED_FIFO)) ||
+              (mxGetPr(PRM_RTLOOP(S))[1] > sched_get_priority_max(SCHED_FIFO))))
+        ssSetErrorStatus(S, "Inner loop priority has to be within SCHED_FIFO range (1 to 99 on Linux)");
+    else if (PRM_RTLOOP_MODE(S) &&
+             ((mxGetPr(PRM_RTLOOP(S))[2] < -1) ||
+              (mxGetPr(PRM_RTLOOP(S))[2] >= sysconf(_SC_NPROCESSORS_ONLN))))
+        ssSetErrorStatus(S, "Inner loop cpu has to be -1 or index of online CPU");
+    if ((PRM_DITHER(S) < 0) || (PRM_DITHER(S) > 2))
+        ssSetErrorStatus(S, "PWM dither order has to be 0, 1 or 2");
+    if (PRM_DTC_MODE(S) == 1) {
+        if ((mxGetNumberOfElements(PRM_DTC(S)) < 4) ||
+            (mxGetNumberOfElements(PRM_DTC(S)) > 18) ||
+            (mxGetPr(PRM_DTC(S))[1] <= 0))
+            ssSetErrorStatus(S, "Dead-time compensation has to be [1 i_max c0 .. cN-1], N 2 to 16");
+    } else if (PRM_DTC_MODE(S) == 2) {
+        if ((mxGetNumberOfElements(PRM_DTC(S)) != 3) ||
+            (mxGetPr(PRM_DTC(S))[1] <= 0) ||
+            (mxGetPr(PRM_DTC(S))[2] < 2) || (mxGetPr(PRM_DTC(S))[2] > 16))
+            ssSetErrorStatus(S, "Dead-time calibration has to be [2 i_max N], N 2 to 16");
+        else if (PRM_RTLOOP_MODE(S))
+            ssSetErrorStatus(S, "Dead-time calibration runs without the inner loop");
+    } else if (PRM_DTC_MODE(S) != 0) {
+        ssSetErrorStatus(S, "Dead-time compensation mode has to be 1 or 2");
+    }
+    if (PRM_ADC_CAL_MODE(S) &&
+        ((mxGetNumberOfElements(PRM_ADC_CAL(S)) > 2) ||
+         (mxGetPr(PRM_ADC_CAL(S))[0] <= 0)))
+        ssSetErrorStatus(S, "ADC offset calibration has to be empty or [avg_time force]");
+    if (PRM_COMMIS_MODE(S) &&
+        ((mxGetNumberOfElements(PRM_COMMIS(S)) < 3) ||
+         (mxGetNumberOfElements(PRM_COMMIS(S)) > 4) ||
+         (mxGetPr(PRM_COMMIS(S))[0] <= 0) || (mxGetPr(PRM_COMMIS(S))[0] >= 0.5) ||
+         (mxGetPr(PRM_COMMIS(S))[1] <= 0) || (mxGetPr(PRM_COMMIS(S))[2] <= 0)))
+        ssSetErrorStatus(S, "Commissioning has to be empty or [amp elec_hz elec_revs force], amp below 0.5");
+    if (PRM_ADC_DEC_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_ADC_DEC(S));
+        int n = mxGetNumberOfElements(PRM_ADC_DEC(S));
+
+        if ((n > PRM_ADC_DEC_LEN) || (prm[0] < 0) || (prm[0] > 3) ||
+            ((n > 1) && ((prm[1] < 1) || (prm[1] > 64))))
+            ssSetErrorStatus(S, "ADC decimation has to be [filter len par], filter 0 to 3, len 1 to 64");
+        else if ((prm[0] == 2) && ((n < 3) || (prm[2] <= 0) || (prm[2] > 1)))
+            ssSetErrorStatus(S, "ADC decimation IIR alpha has to be within (0, 1]");
+        else if ((prm[0] == 3) && ((n < 3) || (prm[2] < 1) || (prm[2] > 4)))
+            ssSetErrorStatus(S, "ADC decimation CIC order has to be 1 to 4");
+    }
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -140,10 +342,11 @@ static void mdlCheckParameters(SimStruct *S)
  */
 static void mdlInitializeSizes(SimStruct *S)
 {
-    ssSetNumSFcnParams(S, PRM_COUNT);  /* Number of expected parameters */
-    if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
-        /* Return if number of expected != number of actual parameters */
-        ssSetErrorStatus(S, "1-parameter requited: Ts");
+    /* ADC format is optional to keep existing models working */
+    ssSetNumSFcnParams(S, -1);
+    if ((ssGetSFcnParamsCount(S) < PRM_COUNT_MIN) ||
+        (ssGetSFcnParamsCount(S) > PRM_COUNT)) {
+        ssSetErrorStatus(S, "1 to 9 parameters required: Ts, [ADC format], [FOC parameters], [Inner loop], [PWM dither], [Dead-time comp.], [ADC offset cal.], [Commissioning], [ADC decimation]");
         return;
     }
 
@@ -157,7 +360,7 @@ static void mdlInitializeSizes(SimStruct *S)
 
     if (!ssSetNumInputPorts(S, sIn_N_NUM)) return;
 
-    ssSetInputPortWidth(S, sIn_N_PWM_VAL, 3);
+    ssSetInputPortWidth(S, sIn_N_PWM_VAL, PRM_FOC_MODE(S)? 2: 3);
     ssSetInputPortWidth(S, sIn_N_PWM_EN, 3);
 
     /*
@@ -167,8 +370,17 @@ static void mdlInitializeSizes(SimStruct *S)
      * See matlabroot/simulink/src/sfuntmpl_directfeed.txt.
      */
 
-    if (!ssSetNumOutputPorts(S, sOut_N_NUM)) return;
+    if (!ssSetNumOutputPorts(S, PRM_ADC_DEC_MODE(S)? sOut_N_NUM:
+                             sOut_N_HAL_Sector + 1)) return;
     ssSetOutputPortWidth(S, sOut_N_Cur_ADC, 3);
+    switch (PRM_ADC_FMT(S)) {
+    case 1:
+        ssSetOutputPortDataType(S, sOut_N_Cur_ADC, SS_SINGLE);
+        break;
+    case 2:
+        ssSetOutputPortDataType(S, sOut_N_Cur_ADC, SS_INT32);
+        break;
+    }
     ssSetOutputPortWidth(S, sOut_N_IRC_Pos, 1);
     ssSetOutputPortDataType(S, sOut_N_IRC_Pos, SS_INT32);
     ssSetOutputPortWidth(S, sOut_N_IRC_Idx, 1);
@@ -177,6 +389,12 @@ static void mdlInitializeSizes(SimStruct *S)
     ssSetOutputPortDataType(S, sOut_N_IRC_Occur, SS_INT32);
     ssSetOutputPortWidth(S, sOut_N_HAL_Sector, 1);
     ssSetOutputPortDataType(S, sOut_N_HAL_Sector, SS_INT32);
+    if (PRM_ADC_DEC_MODE(S)) {
+        ssSetOutputPortWidth(S, sOut_N_ADC_Flags, 1);
+        ssSetOutputPortDataType(S, sOut_N_ADC_Flags, SS_INT32);
+        ssSetOutputPortWidth(S, sOut_N_ADC_Count, 1);
+        ssSetOutputPortDataType(S, sOut_N_ADC_Count, SS_INT32);
+    }
 
     ssSetNumSampleTimes(S, 1);
     ssSetNumRWork(S, 0);
@@ -230,9 +448,10 @@ static void mdlInitializeConditions(SimStruct *S)
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst = (z3pmdrv1_state_t *)PWORK_Z3PMDRV1_STATE(S);
 
-    z3pmcst->curadc_offs[0] = 0; /*2072*/
-    z3pmcst->curadc_offs[1] = 0; /*2077*/
-    z3pmcst->curadc_offs[2] = 0; /*2051*/
+    /* Calibrated at start when requested, zero otherwise */
+    z3pmcst->curadc_offs[0] = z3pmcst->curadc_offs_cal[0];
+    z3pmcst->curadc_offs[1] = z3pmcst->curadc_offs_cal[1];
+    z3pmcst->curadc_offs[2] = z3pmcst->curadc_offs_cal[2];
 
     z3pmcst->pos_offset = -z3pmcst->act_pos;
 
@@ -254,30 +473,208 @@ static void mdlStart(SimStruct *S)
 {
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst;
+    real_T step_ts;
+    int i;
 
     PWORK_Z3PMDRV1_STATE(S) = NULL;
+    PWORK_Z3PMDRV1_TLM(S) = NULL;
+    PWORK_Z3PMDRV1_STREAM(S) = NULL;
+    PWORK_Z3PMDRV1_FOC(S) = NULL;
+    PWORK_Z3PMDRV1_RTLOOP(S) = NULL;
+    PWORK_Z3PMDRV1_ADCDEC(S) = NULL;
+    PWORK_Z3PMDRV1_LOG(S) = NULL;
 
-    z3pmcst = malloc(sizeof(*z3pmcst));
+    /* Lock memory before the state and mappings are created */
+    mzapo_rtmem_prepare(ssGetPath(S));
+
+    z3pmcst = mzapo_rtmem_alloc(sizeof(*z3pmcst));
     if (z3pmcst == NULL) {
         ssSetErrorStatus(S, "malloc z3pmcst failed");
         return;
     }
-    memset(z3pmcst, sizeof(*z3pmcst), 0);
+
+    z3pmdrv1_adcavg_init();
 
     z3pmcst->regs_base_phys = 0;
 
+    z3pmcst->replay = NULL;
+    if (mzapo_replay_enabled()) {
+        z3pmcst->replay = mzapo_replay_open(Z3PMDRV1_LOG_NAME,
+                        Z3PMDRV1_REPLAY_CHAN_COUNT, z3pmdrv1_replay_chan_name);
+        if (z3pmcst->replay == NULL) {
+            mzapo_rtmem_free(z3pmcst);
+            ssSetErrorStatus(S, "z3pmdrv1 replay trace cannot be used");
+            return;
+        }
+    }
+
     if (z3pmdrv1_init(z3pmcst) < 0) {
+        mzapo_replay_close(z3pmcst->replay);
+        mzapo_rtmem_free(z3pmcst);
         ssSetErrorStatus(S, "z3pmdrv1_init z3pmcst failed");
         return;
     }
 
     PWORK_Z3PMDRV1_STATE(S) = z3pmcst;
 
+    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+        mzapo_sdm_init(&z3pmcst->pwm_sdm[i], PRM_DITHER(S));
+
+    if (PRM_DTC_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_DTC(S));
+        float comp[Z3PMDRV1_DTC_POINTS_MAX];
+        int n;
+
+        if (PRM_DTC_MODE(S) == Z3PMDRV1_DTC_MODE_COMP) {
+            n = mxGetNumberOfElements(PRM_DTC(S)) - 2;
+            for (i = 0; i < n && i < Z3PMDRV1_DTC_POINTS_MAX; i++)
+                comp[i] = prm[2 + i];
+        } else {
+            n = (int)prm[2];
+        }
+
+        z3pmcst->dtc = mzapo_rtmem_alloc(sizeof(*z3pmcst->dtc));
+        if ((z3pmcst->dtc == NULL) ||
+            (z3pmdrv1_dtc_init(z3pmcst->dtc, PRM_DTC_MODE(S), prm[1], n,
+                    PRM_DTC_MODE(S) == Z3PMDRV1_DTC_MODE_COMP? comp: NULL) < 0)) {
+            ssSetErrorStatus(S, "dead-time compensation setup failed");
+            return;
+        }
+    }
+
+    if (PRM_ADC_CAL_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_ADC_CAL(S));
+        int force = mxGetNumberOfElements(PRM_ADC_CAL(S)) > 1 && prm[1] != 0;
+        z3pmdrv1_adccal_rec_t rec;
+        int res;
+
+        res = z3pmdrv1_adccal_run(z3pmcst, prm[0], force, &rec);
+        if (res < 0) {
+            ssSetErrorStatus(S, "current ADC offset calibration failed");
+            return;
+        }
+        fprintf(stderr, "%s: current ADC offsets %d %d %d (%s, %u samples)\n",
+                ssGetPath(S), (int)rec.offs[0], (int)rec.offs[1],
+                (int)rec.offs[2], res? "cached": "measured",
+                (unsigned)rec.samples);
+    }
+
+    if (PRM_COMMIS_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_COMMIS(S));
+        int force = mxGetNumberOfElements(PRM_COMMIS(S)) > 3 && prm[3] != 0;
+        int32_t irc_per_rev = PRM_FOC_MODE(S)? (int32_t)mxGetPr(PRM_FOC(S))[3]: 0;
+        z3pmdrv1_commis_t *cm;
+        int res;
+
+        cm = mzapo_rtmem_alloc(sizeof(*cm));
+        if (cm == NULL) {
+            ssSetErrorStatus(S, "malloc commissioning state failed");
+            return;
+        }
+        z3pmcst->commis = cm;
+        res = z3pmdrv1_commis_run(z3pmcst, cm, prm[0], prm[1], prm[2],
+                                  irc_per_rev, force);
+        if (res < 0) {
+            ssSetErrorStatus(S, "commutation commissioning failed");
+            return;
+        }
+        fprintf(stderr, "%s: irc_per_rev %d, pole pairs %d, index offset %d (%s)\n",
+                ssGetPath(S), (int)cm->res.irc_per_rev, (int)cm->res.pole_pairs,
+                (int)cm->res.idx_offs, res? "cached": "measured");
+    }
+
+    /* Step period from the resolved sample time, Ts -1 runs continuous
+       fixed in minor step, that is at the fixed step of the model */
+    step_ts = ssGetSampleTime(S, 0);
+    if (step_ts <= 0)
+        step_ts = ssGetFixedStepSize(S);
+
+    /* Loop timing telemetry, the control runs without it on failure */
+    PWORK_Z3PMDRV1_TLM(S) = z3pmdrv1_tlm_create(step_ts);
+
+    /* Per step signal record stream, optional as well */
+    PWORK_Z3PMDRV1_STREAM(S) = mzapo_stream_create(Z3PMDRV1_STREAM_SHM_NAME,
+                        MZAPO_STREAM_TYPE_PMSM, sizeof(mzapo_stream_pmsm_rec_t));
+
+    /* Log of PWM words, currents (Q16 ADC) and raw sensors, when enabled */
+    {
+        char ident[MZAPO_CALCACHE_IDENT_LEN];
+
+        z3pmdrv1_ident(z3pmcst, ident);
+        PWORK_Z3PMDRV1_LOG(S) = mzapo_log_create(Z3PMDRV1_LOG_NAME,
+                        Z3PMDRV1_LOG_CHAN_COUNT, z3pmdrv1_log_chan_name,
+                        step_ts, ident);
+    }
+
+    if (PRM_FOC_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_FOC(S));
+        z3pmdrv1_foc_t *foc;
+
+        foc = mzapo_rtmem_alloc(sizeof(*foc));
+        if (foc == NULL) {
+            ssSetErrorStatus(S, "malloc FOC state failed");
+            return;
+        }
+        if (z3pmcst->commis != NULL)
+            z3pmdrv1_foc_init(foc, prm[0], prm[1], prm[6], prm[5],
+                              z3pmcst->commis->res.pole_pairs,
+                              z3pmcst->commis->res.irc_per_rev, 0);
+        else
+            z3pmdrv1_foc_init(foc, prm[0], prm[1], prm[6], prm[5],
+                              (int)prm[2], (int32_t)prm[3], (int32_t)prm[4]);
+        PWORK_Z3PMDRV1_FOC(S) = foc;
+    }
+
+    {
+        z3pmdrv1_adcdec_t *dec;
+        const real_T *prm = PRM_ADC_DEC_MODE(S)? mxGetPr(PRM_ADC_DEC(S)): NULL;
+        int n = PRM_ADC_DEC_MODE(S)? mxGetNumberOfElements(PRM_ADC_DEC(S)): 0;
+        int filter = n > 0? (int)prm[0]: Z3PMDRV1_ADCDEC_FILT_NONE;
+
+        dec = mzapo_rtmem_alloc(sizeof(*dec));
+        if ((dec == NULL) ||
+            (z3pmdrv1_adcdec_init(dec, filter, n > 1? (int)prm[1]: 1,
+                    filter == Z3PMDRV1_ADCDEC_FILT_CIC? (int)prm[2]: 1,
+                    filter == Z3PMDRV1_ADCDEC_FILT_IIR? prm[2]: 1,
+                    z3pmcst->curadc_cumsum, z3pmcst->curadc_sqn) < 0)) {
+            mzapo_rtmem_free(dec);
+            ssSetErrorStatus(S, "ADC decimation setup failed");
+            return;
+        }
+        PWORK_Z3PMDRV1_ADCDEC(S) = dec;
+    }
+
     z3pmdrv1_transfer(z3pmcst);
 
+    /* Coarse rotor alignment until the first IRC index event */
+    if ((z3pmcst->commis != NULL) && (PWORK_Z3PMDRV1_FOC(S) != NULL))
+        z3pmdrv1_commis_align_hall(z3pmcst->commis,
+                        (z3pmdrv1_foc_t *)PWORK_Z3PMDRV1_FOC(S),
+                        z3pmcst->hal_sensors, z3pmcst->act_pos);
+
+    /* From now on the thread owns the hardware, z3pmcst is its view */
+    if (PRM_RTLOOP_MODE(S) && (z3pmcst->replay != NULL)) {
+        fprintf(stderr, "%s: inner loop not used in replay, the step runs"
+                " the transfer\n", ssGetPath(S));
+    } else if (PRM_RTLOOP_MODE(S)) {
+        const real_T *prm = mxGetPr(PRM_RTLOOP(S));
+
+        PWORK_Z3PMDRV1_RTLOOP(S) = z3pmdrv1_rtloop_start(z3pmcst,
+                        (z3pmdrv1_foc_t *)PWORK_Z3PMDRV1_FOC(S),
+                        prm[0], (int)prm[1], (int)prm[2]);
+        if (PWORK_Z3PMDRV1_RTLOOP(S) == NULL) {
+            ssSetErrorStatus(S, "z3pmdrv1 inner loop thread start failed");
+            return;
+        }
+    }
+
   #endif /*WITHOUT_HW*/
 
     mdlInitializeConditions(S);
+
+  #ifndef WITHOUT_HW
+    mzapo_rtmem_started(ssGetPath(S));
+  #endif /*WITHOUT_HW*/
 }
 #endif /*  MDL_START */
 
@@ -294,6 +691,19 @@ const unsigned char pxmc_lpc_bdc_hal_pos_table[8] =
   [2] = 4, /*4*/
   [3] = 5, /*5*/
 };
+
+/* Current ADC output port value in ADC units regardless of its format */
+static real_T cur_adc_value(const void *cur_adc, int adc_fmt, int i)
+{
+    switch (adc_fmt) {
+    case Z3PMDRV1_ADCAVG_FMT_SINGLE:
+        return ((const real32_T *)cur_adc)[i];
+    case Z3PMDRV1_ADCAVG_FMT_Q16:
+        return ((const int32_T *)cur_adc)[i] * (1.0 / (1 << Z3PMDRV1_ADCAVG_Q));
+    default:
+        return ((const real_T *)cur_adc)[i];
+    }
+}
 #endif /*WITHOUT_HW*/
 
 /* Function: mdlOutputs =======================================================
@@ -303,87 +713,127 @@ const unsigned char pxmc_lpc_bdc_hal_pos_table[8] =
  */
 static void mdlOutputs(SimStruct *S, int_T tid)
 {
-    real_T *cur_adc = ssGetOutputPortSignal(S, sOut_N_Cur_ADC);
+    void *cur_adc = ssGetOutputPortSignal(S, sOut_N_Cur_ADC);
     int32_T *irc_pos = ssGetOutputPortSignal(S, sOut_N_IRC_Pos);
     int32_T *irc_idx = ssGetOutputPortSignal(S, sOut_N_IRC_Idx);
     int32_T *irc_idx_occ = ssGetOutputPortSignal(S, sOut_N_IRC_Occur);
     int32_T *hal_sec = ssGetOutputPortSignal(S, sOut_N_HAL_Sector);
+    int adc_fmt = PRM_ADC_FMT(S);
+    int i;
 
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst = (z3pmdrv1_state_t *)PWORK_Z3PMDRV1_STATE(S);
+    z3pmdrv1_adcdec_t *dec = (z3pmdrv1_adcdec_t *)PWORK_Z3PMDRV1_ADCDEC(S);
+    mzapo_stream_pmsm_rec_t rec;
     uint32_t curadc_sqn_diff;
-    uint32_t curadc_val_diff;
-    int i;
-    int diff_to_last_fl = 1;
-   #if 0
-    static unsigned long sqn_accum;
-    static unsigned long sqn_accum_over;
-    static unsigned long runs;
-    static unsigned long runs_over;
-    static unsigned long runs_miss;
-    static unsigned int hist[512];
-   #endif
-    curadc_sqn_diff = z3pmcst->curadc_sqn;
-    if (diff_to_last_fl) {
-      curadc_sqn_diff -= z3pmcst->curadc_sqn_last;
-      curadc_sqn_diff &= 0xfff;
-    }
-
-    if ((curadc_sqn_diff > 1) && (curadc_sqn_diff <= 450)) {
-        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
-            curadc_val_diff = z3pmcst->curadc_cumsum[i];
-            if (diff_to_last_fl) {
-              curadc_val_diff -= z3pmcst->curadc_cumsum_last[i];
-              curadc_val_diff &= 0xffffff;
-            }
-            cur_adc[i] = (real_T)curadc_val_diff / curadc_sqn_diff -
-                            z3pmcst->curadc_offs[i];
+    unsigned wr_issued, wr_elided;
+    unsigned flags;
+
+    if (PWORK_Z3PMDRV1_RTLOOP(S) != NULL)
+        z3pmdrv1_rtloop_meas_get((z3pmdrv1_rtloop_t *)PWORK_Z3PMDRV1_RTLOOP(S),
+                                 z3pmcst);
+
+    curadc_sqn_diff = (z3pmcst->curadc_sqn - z3pmcst->curadc_sqn_last) &
+                      Z3PMDRV1_ADCAVG_SQN_m;
+
+    /* The output holds the last valid value when the window is not usable */
+    flags = z3pmdrv1_adcdec_step(dec, z3pmcst->curadc_cumsum,
+                                 z3pmcst->curadc_sqn, z3pmcst->curadc_offs);
+    /* Window average kept for current control running in mdlUpdate */
+    if (flags & Z3PMDRV1_ADCDEC_VALID)
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            z3pmcst->curadc_val[i] = dec->avg_q16[i];
+    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+        switch (adc_fmt) {
+        case Z3PMDRV1_ADCAVG_FMT_SINGLE:
+            ((real32_T *)cur_adc)[i] = dec->out_q16[i] *
+                               (1.0f / (1 << Z3PMDRV1_ADCAVG_Q));
+            break;
+        case Z3PMDRV1_ADCAVG_FMT_Q16:
+            ((int32_T *)cur_adc)[i] = dec->out_q16[i];
+            break;
+        default:
+            ((real_T *)cur_adc)[i] = dec->out_q16[i] *
+                               (1.0 / (1 << Z3PMDRV1_ADCAVG_Q));
         }
-       #if 0
-        runs++;
-        sqn_accum += curadc_sqn_diff;
-       #endif
     }
-   #if 0
-    else {
-        if (curadc_sqn_diff) {
-          sqn_accum_over += curadc_sqn_diff;
-          runs_over++;
-        } else runs_miss++;
+    if (PRM_ADC_DEC_MODE(S)) {
+        *(int32_T *)ssGetOutputPortSignal(S, sOut_N_ADC_Flags) = flags;
+        *(int32_T *)ssGetOutputPortSignal(S, sOut_N_ADC_Count) = dec->n;
     }
 
-    hist[curadc_sqn_diff]++;
-    if (runs >= 1000) {
-      fprintf(stderr, "aver sqn diff %ld runs %ld\n", sqn_accum / runs, runs);
-      if (runs_over)
-        fprintf(stderr, "over sqn diff %ld runs %ld\n", sqn_accum_over / runs_over, runs_over);
-      if (runs_miss)
-        fprintf(stderr, "missed runs %ld\n", runs_miss);
-      for (i = 0; i < 512; i++) {
-        fprintf(stderr, " %d", hist[i]);
-        hist[i] = 0;
-      }
-      fprintf(stderr, "\n");
-      runs = 0;
-      runs_over = 0;
-      runs_miss = 0;
-      sqn_accum = 0;
-      sqn_accum_over = 0;
+    /*
+     * ADC window, step timing and PWM write statistics, rendered by
+     * separate reader, the inner loop transfers are not accounted
+     */
+    wr_elided = z3pmcst->pwm_elided;
+    wr_issued = PWORK_Z3PMDRV1_RTLOOP(S) == NULL? Z3PMDRV1_CHAN_COUNT - wr_elided: 0;
+    z3pmdrv1_tlm_step((z3pmdrv1_tlm_t *)PWORK_Z3PMDRV1_TLM(S), curadc_sqn_diff,
+                      wr_issued, wr_elided);
+    if (PWORK_Z3PMDRV1_RTLOOP(S) != NULL) {
+        uint32_t rtl_steps, rtl_overruns;
+
+        z3pmdrv1_rtloop_counts((z3pmdrv1_rtloop_t *)PWORK_Z3PMDRV1_RTLOOP(S),
+                               &rtl_steps, &rtl_overruns);
+        z3pmdrv1_tlm_rtloop((z3pmdrv1_tlm_t *)PWORK_Z3PMDRV1_TLM(S),
+                            rtl_steps, rtl_overruns);
     }
-   #endif
 
     irc_pos[0] = z3pmcst->act_pos + z3pmcst->pos_offset;
     irc_idx[0] = z3pmcst->index_pos + z3pmcst->pos_offset;
     irc_idx_occ[0] = z3pmcst->index_occur;
-    hal_sec[0] = pxmc_lpc_bdc_hal_pos_table[z3pmcst->hal_sensors];
+    hal_sec[0] = z3pmcst->commis != NULL?
+                 z3pmcst->commis->res.hall_table[z3pmcst->hal_sensors]:
+                 pxmc_lpc_bdc_hal_pos_table[z3pmcst->hal_sensors];
+
+    if (PWORK_Z3PMDRV1_STREAM(S) != NULL) {
+        rec.t = ssGetT(S);
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            rec.cur_adc[i] = cur_adc_value(cur_adc, adc_fmt, i);
+        rec.irc_pos = irc_pos[0];
+        rec.irc_idx = irc_idx[0];
+        rec.irc_idx_occ = irc_idx_occ[0];
+        rec.hal_sec = hal_sec[0];
+        rec.wr_elided = z3pmcst->pwm_elided;
+        mzapo_stream_write((mzapo_stream_t *)PWORK_Z3PMDRV1_STREAM(S), &rec);
+    }
+
+    if (PWORK_Z3PMDRV1_LOG(S) != NULL) {
+        int32_t val[Z3PMDRV1_LOG_CHAN_COUNT];
+
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+            val[i] = z3pmcst->pwm[i];
+            val[Z3PMDRV1_CHAN_COUNT + i] = dec->out_q16[i];
+        }
+        val[6] = z3pmcst->act_pos;
+        val[7] = z3pmcst->index_pos;
+        val[8] = z3pmcst->hal_sensors;
+        val[9] = z3pmcst->curadc_sqn;
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            val[10 + i] = z3pmcst->curadc_cumsum[i];
+        mzapo_log_write((mzapo_log_t *)PWORK_Z3PMDRV1_LOG(S), val);
+    }
   #else /*WITHOUT_HW*/
-    cur_adc[0] = 0;
-    cur_adc[1] = 0;
-    cur_adc[2] = 0;
+    for (i = 0; i < 3; i++) {
+        switch (adc_fmt) {
+        case 1:
+            ((real32_T *)cur_adc)[i] = 0;
+            break;
+        case 2:
+            ((int32_T *)cur_adc)[i] = 0;
+            break;
+        default:
+            ((real_T *)cur_adc)[i] = 0;
+        }
+    }
     irc_pos[0] = 0;
     irc_idx[0] = 0;
     irc_idx_occ[0] = 0;
     hal_sec[0] = 0;
+    if (PRM_ADC_DEC_MODE(S)) {
+        *(int32_T *)ssGetOutputPortSignal(S, sOut_N_ADC_Flags) = 0;
+        *(int32_T *)ssGetOutputPortSignal(S, sOut_N_ADC_Count) = 0;
+    }
   #endif /*WITHOUT_HW*/
 }
 
@@ -405,28 +855,73 @@ static void mdlUpdate(SimStruct *S, int_T tid)
 
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst = (z3pmdrv1_state_t *)PWORK_Z3PMDRV1_STATE(S);
-    int i;
-    real_T pwm;
+    z3pmdrv1_foc_t *foc = (z3pmdrv1_foc_t *)PWORK_Z3PMDRV1_FOC(S);
+    z3pmdrv1_rtloop_t *rtl = (z3pmdrv1_rtloop_t *)PWORK_Z3PMDRV1_RTLOOP(S);
+    float duty[Z3PMDRV1_CHAN_COUNT];
+    int i, n;
 
     z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
 
     for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
         z3pmcst->curadc_cumsum_last[i] = z3pmcst->curadc_cumsum[i];
 
-    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
-        if (*pwm_en[i]) {
-            pwm = *pwm_val[i] * 5000;
-            if (pwm > 5000)
-                pwm = 5000;
-            if (pwm < 0)
-                pwm = 0;
-            z3pmcst->pwm[i] = (uint32_t)pwm | Z3PMDRV1_PWM_ENABLE;
-        } else {
-            z3pmcst->pwm[i] = 0 | Z3PMDRV1_PWM_SHUTDOWN;
+    /* Inner loop runs control and transfer, only pass the setpoints */
+    if (rtl != NULL) {
+        float val[Z3PMDRV1_CHAN_COUNT];
+        uint8_t en[Z3PMDRV1_CHAN_COUNT];
+
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+            val[i] = i < (foc != NULL? 2: 3)? *pwm_val[i]: 0;
+            en[i] = *pwm_en[i] != 0;
         }
+        z3pmdrv1_rtloop_cmd_put(rtl, val, en, z3pmcst->curadc_offs);
+        /* The thread has left the bridge in shutdown */
+        if (z3pmdrv1_rtloop_error(rtl))
+            ssSetErrorStatus(S, "z3pmdrv1 inner loop stopped, PWM period interrupt wait failed");
+        return;
     }
 
-    z3pmdrv1_transfer(z3pmcst);
+    if (foc != NULL) {
+        if (z3pmcst->commis != NULL)
+            z3pmdrv1_commis_track(z3pmcst->commis, foc, z3pmcst);
+        /* Regulators are held in reset while any phase is disabled */
+        if (*pwm_en[0] && *pwm_en[1] && *pwm_en[2])
+            z3pmdrv1_foc_step(foc, z3pmcst->curadc_val, z3pmcst->act_pos,
+                              *pwm_val[0], *pwm_val[1]);
+        else
+            z3pmdrv1_foc_reset(foc);
+    }
+
+    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+        duty[i] = foc != NULL? foc->duty[i]: *pwm_val[i];
+
+    if (z3pmcst->dtc != NULL)
+        z3pmdrv1_dtc_cal_step(z3pmcst->dtc, duty, z3pmcst->curadc_val,
+                              *pwm_en[0] && *pwm_en[1] && *pwm_en[2]);
+
+    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+        z3pmcst->pwm[i] = z3pmdrv1_pwm_duty(z3pmcst, i,
+                        z3pmdrv1_dtc_apply(z3pmcst->dtc, z3pmcst->curadc_val, i, duty[i]),
+                        *pwm_en[i] != 0);
+
+    /* Align the transfer to the PWM period when interrupt is available */
+    do
+        n = z3pmdrv1_wait_period(z3pmcst);
+    while ((n < 0) && (errno == EINTR));
+    if (n < 0) {
+        /* Do not leave the last duty driven when the interrupt is gone */
+        z3pmdrv1_pwm_shutdown(z3pmcst);
+        ssSetErrorStatus(S, errno == ETIMEDOUT?
+                         "z3pmdrv1 PWM period interrupt timed out, bridge shut down":
+                         "z3pmdrv1 PWM period interrupt wait failed, bridge shut down");
+        return;
+    }
+    if (n > 1)
+        z3pmdrv1_tlm_missed((z3pmdrv1_tlm_t *)PWORK_Z3PMDRV1_TLM(S), n - 1);
+
+    /* Fails only when the replayed trace has ended */
+    if (z3pmdrv1_transfer(z3pmcst) < 0)
+        ssSetStopRequested(S, 1);
 
   #endif /*WITHOUT_HW*/
 }
@@ -459,10 +954,44 @@ static void mdlTerminate(SimStruct *S)
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst = (z3pmdrv1_state_t *)PWORK_Z3PMDRV1_STATE(S);
 
+    /* Stop the inner loop before its state and mapping are released */
+    z3pmdrv1_rtloop_stop((z3pmdrv1_rtloop_t *)PWORK_Z3PMDRV1_RTLOOP(S));
+    PWORK_Z3PMDRV1_RTLOOP(S) = NULL;
+
     if (z3pmcst != NULL) {
         PWORK_Z3PMDRV1_STATE(S) = NULL;
-        free(z3pmcst);
+        z3pmdrv1_release(z3pmcst);
+        if (z3pmcst->dtc != NULL) {
+            if (z3pmcst->dtc->mode == Z3PMDRV1_DTC_MODE_CAL) {
+                if ((z3pmdrv1_dtc_cal_finish(z3pmcst->dtc) < 0) ||
+                    (z3pmdrv1_dtc_cal_save(z3pmcst->dtc, Z3PMDRV1_DTC_CAL_FILE) < 0))
+                    fprintf(stderr, "%s: dead-time calibration failed\n", ssGetPath(S));
+            }
+            mzapo_rtmem_free(z3pmcst->dtc);
+        }
+        mzapo_rtmem_free(z3pmcst->commis);
+        mzapo_replay_close(z3pmcst->replay);
+        mzapo_rtmem_free(z3pmcst);
     }
+
+    z3pmdrv1_tlm_destroy((z3pmdrv1_tlm_t *)PWORK_Z3PMDRV1_TLM(S));
+    PWORK_Z3PMDRV1_TLM(S) = NULL;
+
+    mzapo_stream_destroy((mzapo_stream_t *)PWORK_Z3PMDRV1_STREAM(S));
+    PWORK_Z3PMDRV1_STREAM(S) = NULL;
+
+    mzapo_log_destroy((mzapo_log_t *)PWORK_Z3PMDRV1_LOG(S));
+    PWORK_Z3PMDRV1_LOG(S) = NULL;
+
+    if (PWORK_Z3PMDRV1_FOC(S) != NULL) {
+        mzapo_rtmem_free(PWORK_Z3PMDRV1_FOC(S));
+        PWORK_Z3PMDRV1_FOC(S) = NULL;
+    }
+
+    mzapo_rtmem_free(PWORK_Z3PMDRV1_ADCDEC(S));
+    PWORK_Z3PMDRV1_ADCDEC(S) = NULL;
+
+    mzapo_rtmem_release(ssGetPath(S));
   #endif /*WITHOUT_HW*/
 }
 
@@ -0,0 +1,160 @@
+/*
+  Integer averaging of the current ADC windows of the 3-phase
+  motor driver.
+
+  The FPGA accumulates ADC samples of each channel into 24-bit
+  wrapping sums and counts them by 12-bit wrapping sequence number.
+  The average over the window since the previous step is
+
+    avg = ((cumsum - cumsum_last) & 0xffffff) / ((sqn - sqn_last) & 0xfff)
+
+  The divide is replaced by multiplication by reciprocal from table
+  covering all valid window lengths 1..Z3PMDRV1_ADCAVG_SQN_MAX.
+  Entry for n holds mul = ceil(2^shift / n) with shift = 31 + ceil(log2 n),
+  so mul fits into 32 bits and (x * mul) >> shift == x / n holds exactly
+  for all x < 2^31. The quotient and the 16-bit fraction computed from
+  the remainder give floor(avg * 2^16) exactly, equal to the value
+  obtained from the double divide. All three channels share the window
+  length and are processed together by NEON when it is available.
+
+  The result is Q16 (16 fractional bits) signed value with offset
+  subtracted, saturated to int32 range (only reachable for corrupted
+  sums, 12-bit samples average below 4096).
+*/
+
+#ifndef _ZYNQ_3PMDRV1_ADCAVG_H
+#define _ZYNQ_3PMDRV1_ADCAVG_H
+
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define Z3PMDRV1_ADCAVG_NEON
+#endif
+
+#define Z3PMDRV1_ADCAVG_SQN_MAX    450
+#define Z3PMDRV1_ADCAVG_Q          16
+#define Z3PMDRV1_ADCAVG_CUMSUM_m   0xffffff
+#define Z3PMDRV1_ADCAVG_SQN_m      0xfff
+
+/* Output representations selectable for the current ADC port */
+#define Z3PMDRV1_ADCAVG_FMT_DOUBLE 0
+#define Z3PMDRV1_ADCAVG_FMT_SINGLE 1
+#define Z3PMDRV1_ADCAVG_FMT_Q16    2
+
+typedef struct z3pmdrv1_adcavg_recip_t {
+  uint32_t mul;
+  uint32_t shift;
+} z3pmdrv1_adcavg_recip_t;
+
+typedef struct z3pmdrv1_adcavg_table_t {
+  int      ready;
+  z3pmdrv1_adcavg_recip_t recip[Z3PMDRV1_ADCAVG_SQN_MAX + 1];
+} z3pmdrv1_adcavg_table_t;
+
+/* Shared by all blocks linked into the executable */
+__attribute__((weak))
+z3pmdrv1_adcavg_table_t z3pmdrv1_adcavg_table;
+
+/* Fill the reciprocal table, called from mdlStart before the first step */
+static inline
+void z3pmdrv1_adcavg_init(void)
+{
+	z3pmdrv1_adcavg_table_t *tab = &z3pmdrv1_adcavg_table;
+	unsigned n, l;
+
+	if (tab->ready)
+		return;
+	tab->recip[0].mul = 0;
+	tab->recip[0].shift = 0;
+	for (n = 1; n <= Z3PMDRV1_ADCAVG_SQN_MAX; n++) {
+		for (l = 0; (1u << l) < n; l++);
+		tab->recip[n].shift = 31 + l;
+		tab->recip[n].mul = (((uint64_t)1 << (31 + l)) + n - 1) / n;
+	}
+	tab->ready = 1;
+}
+
+static inline
+int32_t z3pmdrv1_adcavg_sat_sub(uint32_t avg_q16, int32_t offs)
+{
+	int64_t v = (int64_t)avg_q16 - ((int64_t)offs << Z3PMDRV1_ADCAVG_Q);
+
+	if (v > INT32_MAX)
+		return INT32_MAX;
+	if (v < INT32_MIN)
+		return INT32_MIN;
+	return v;
+}
+
+/*
+ * Compute averages of all three channels in Q16 format.
+ * Returns the window length when it is within 2..SQN_MAX range
+ * (the same acceptance as the original double path) and 0 otherwise,
+ * the avg_q16 is left untouched in such case.
+ */
+static inline
+unsigned z3pmdrv1_adcavg_q16(const uint32_t *cumsum, const uint32_t *cumsum_last,
+		const int32_t *offs, unsigned sqn, unsigned sqn_last, int32_t *avg_q16)
+{
+	unsigned n = (sqn - sqn_last) & Z3PMDRV1_ADCAVG_SQN_m;
+	const z3pmdrv1_adcavg_recip_t *rc;
+  #ifdef Z3PMDRV1_ADCAVG_NEON
+	uint32_t buf[4] = {cumsum[0], cumsum[1], cumsum[2], 0};
+	uint32_t buf_last[4] = {cumsum_last[0], cumsum_last[1], cumsum_last[2], 0};
+	int32_t buf_offs[4] = {offs[0], offs[1], offs[2], 0};
+	uint32x4_t x, q, r, f;
+	uint32x2_t mul;
+	int64x2_t nshift;
+	int32x4_t v;
+  #else /*Z3PMDRV1_ADCAVG_NEON*/
+	uint32_t x, q, r, f;
+	int i;
+  #endif /*Z3PMDRV1_ADCAVG_NEON*/
+
+	if ((n <= 1) || (n > Z3PMDRV1_ADCAVG_SQN_MAX))
+		return 0;
+	rc = &z3pmdrv1_adcavg_table.recip[n];
+
+  #ifdef Z3PMDRV1_ADCAVG_NEON
+	mul = vdup_n_u32(rc->mul);
+	nshift = vdupq_n_s64(-(int64_t)rc->shift);
+
+	x = vsubq_u32(vld1q_u32(buf), vld1q_u32(buf_last));
+	x = vandq_u32(x, vdupq_n_u32(Z3PMDRV1_ADCAVG_CUMSUM_m));
+
+	q = vcombine_u32(
+		vmovn_u64(vshlq_u64(vmull_u32(vget_low_u32(x), mul), nshift)),
+		vmovn_u64(vshlq_u64(vmull_u32(vget_high_u32(x), mul), nshift)));
+	r = vmlsq_u32(x, q, vdupq_n_u32(n));
+	r = vshlq_n_u32(r, Z3PMDRV1_ADCAVG_Q);
+	f = vcombine_u32(
+		vmovn_u64(vshlq_u64(vmull_u32(vget_low_u32(r), mul), nshift)),
+		vmovn_u64(vshlq_u64(vmull_u32(vget_high_u32(r), mul), nshift)));
+
+	/* Quotient limited to keep the sign bit, offset subtracted saturated */
+	q = vminq_u32(q, vdupq_n_u32(INT32_MAX >> Z3PMDRV1_ADCAVG_Q));
+	v = vreinterpretq_s32_u32(vorrq_u32(vshlq_n_u32(q, Z3PMDRV1_ADCAVG_Q), f));
+	v = vqsubq_s32(v, vshlq_n_s32(vld1q_s32(buf_offs), Z3PMDRV1_ADCAVG_Q));
+
+	vst1q_s32(buf_offs, v);
+	avg_q16[0] = buf_offs[0];
+	avg_q16[1] = buf_offs[1];
+	avg_q16[2] = buf_offs[2];
+  #else /*Z3PMDRV1_ADCAVG_NEON*/
+	for (i = 0; i < 3; i++) {
+		x = (cumsum[i] - cumsum_last[i]) & Z3PMDRV1_ADCAVG_CUMSUM_m;
+		q = ((uint64_t)x * rc->mul) >> rc->shift;
+		r = (x - q * n) << Z3PMDRV1_ADCAVG_Q;
+		f = ((uint64_t)r * rc->mul) >> rc->shift;
+		if (q > (INT32_MAX >> Z3PMDRV1_ADCAVG_Q))
+			q = INT32_MAX >> Z3PMDRV1_ADCAVG_Q;
+		avg_q16[i] = z3pmdrv1_adcavg_sat_sub((q << Z3PMDRV1_ADCAVG_Q) | f,
+						     offs[i]);
+	}
+  #endif /*Z3PMDRV1_ADCAVG_NEON*/
+
+	return n;
+}
+
+#endif /*_ZYNQ_3PMDRV1_ADCAVG_H*/
@@ -0,0 +1,159 @@
+/*
+  Automatic offset calibration of the current ADC channels of
+  the 3-phase motor driver.
+
+  All three PWM outputs are held in shutdown, so no phase current
+  flows. After the settling time the ADC windows are summed over
+  the averaging time and the offset of each channel is the rounded
+  mean of all samples. The windows are polled every millisecond,
+  window longer than the valid averaging range (the cumulative sums
+  could wrap) is dropped. Offsets far from the middle of the 12-bit
+  range indicate current flowing or broken channel, such result is
+  rejected.
+
+  The result is stored in the calibration cache (common/mzapo_calcache.h)
+  keyed by the board identity. The next start loads it without any
+  settling and averaging unless the calibration is forced.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_ADCCAL_H
+#define _ZYNQ_3PMDRV1_ADCCAL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_adcavg.h"
+#include "../common/mzapo_calcache.h"
+
+#define Z3PMDRV1_ADCCAL_CACHE_PREFIX   "z3pmdrv1_adc_cal"
+#define Z3PMDRV1_ADCCAL_SETTLE_S       0.2
+#define Z3PMDRV1_ADCCAL_POLL_NS        1000000
+#define Z3PMDRV1_ADCCAL_OFFS_MIN       1024
+#define Z3PMDRV1_ADCCAL_OFFS_MAX       3072
+
+/* Payload of the cache entry */
+typedef struct z3pmdrv1_adccal_rec_t {
+  int32_t  offs[Z3PMDRV1_CHAN_COUNT];
+  uint32_t samples;         /* ADC samples per channel averaged */
+  double   avg_time;
+} z3pmdrv1_adccal_rec_t;
+
+static inline
+double z3pmdrv1_adccal_elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/*
+ * Measure the offsets with the PWM in shutdown. The pwm[] is left
+ * in shutdown and the next ADC window starts at the last transfer.
+ * Returns -1 when no valid sample has been collected or the result
+ * is out of the plausible range.
+ */
+static inline
+int z3pmdrv1_adccal_measure(z3pmdrv1_state_t *z3pmcst, double avg_time,
+			    z3pmdrv1_adccal_rec_t *rec)
+{
+	struct timespec start, poll = {0, Z3PMDRV1_ADCCAL_POLL_NS};
+	uint64_t sum[Z3PMDRV1_CHAN_COUNT] = {0, 0, 0};
+	uint64_t cnt = 0;
+	uint32_t cumsum_last[Z3PMDRV1_CHAN_COUNT];
+	unsigned sqn_last, n;
+	int i, averaging = 0;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->pwm[i] = 0 | Z3PMDRV1_PWM_SHUTDOWN;
+	z3pmdrv1_transfer(z3pmcst);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		sqn_last = z3pmcst->curadc_sqn;
+		memcpy(cumsum_last, z3pmcst->curadc_cumsum, sizeof(cumsum_last));
+
+		while (nanosleep(&poll, NULL) < 0 && errno == EINTR);
+		z3pmdrv1_transfer(z3pmcst);
+
+		if (!averaging) {
+			if (z3pmdrv1_adccal_elapsed(&start) < Z3PMDRV1_ADCCAL_SETTLE_S)
+				continue;
+			averaging = 1;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			continue;
+		}
+
+		n = (z3pmcst->curadc_sqn - sqn_last) & Z3PMDRV1_ADCAVG_SQN_m;
+		if (n <= Z3PMDRV1_ADCAVG_SQN_MAX) {
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+				sum[i] += (z3pmcst->curadc_cumsum[i] - cumsum_last[i]) &
+					  Z3PMDRV1_ADCAVG_CUMSUM_m;
+			cnt += n;
+		}
+
+		if (z3pmdrv1_adccal_elapsed(&start) >= avg_time)
+			break;
+	}
+
+	z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
+	memcpy(z3pmcst->curadc_cumsum_last, z3pmcst->curadc_cumsum,
+	       sizeof(z3pmcst->curadc_cumsum_last));
+
+	if (cnt == 0)
+		return -1;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+		rec->offs[i] = (sum[i] + cnt / 2) / cnt;
+		if ((rec->offs[i] < Z3PMDRV1_ADCCAL_OFFS_MIN) ||
+		    (rec->offs[i] > Z3PMDRV1_ADCCAL_OFFS_MAX))
+			return -1;
+	}
+	rec->samples = cnt > UINT32_MAX? UINT32_MAX: cnt;
+	rec->avg_time = avg_time;
+
+	return 0;
+}
+
+/*
+ * Obtain the offsets of the board, from the cache unless forced or
+ * missing, measured and stored to the cache otherwise. The result
+ * is placed to curadc_offs_cal. Returns 1 when loaded from cache,
+ * 0 when measured and -1 on measurement failure. The replay uses
+ * only the cached offsets of the board the trace comes from.
+ */
+static inline
+int z3pmdrv1_adccal_run(z3pmdrv1_state_t *z3pmcst, double avg_time, int force,
+			z3pmdrv1_adccal_rec_t *rec)
+{
+	char ident[MZAPO_CALCACHE_IDENT_LEN];
+	int from_cache = 0;
+
+	z3pmdrv1_ident(z3pmcst, ident);
+
+	if ((!force || (z3pmcst->replay != NULL)) &&
+	    (mzapo_calcache_load(Z3PMDRV1_ADCCAL_CACHE_PREFIX, ident,
+				 rec, sizeof(*rec)) == 0)) {
+		from_cache = 1;
+	} else if (z3pmcst->replay != NULL) {
+		fprintf(stderr, "ADC offsets of %s not cached, cannot be measured"
+			" in replay\n", ident);
+		return -1;
+	} else {
+		if (z3pmdrv1_adccal_measure(z3pmcst, avg_time, rec) < 0)
+			return -1;
+		/* Failure to store only costs calibration next time */
+		mzapo_calcache_save(Z3PMDRV1_ADCCAL_CACHE_PREFIX, ident,
+				    rec, sizeof(*rec));
+	}
+
+	memcpy(z3pmcst->curadc_offs_cal, rec->offs, sizeof(rec->offs));
+
+	return from_cache;
+}
+
+#endif /*_ZYNQ_3PMDRV1_ADCCAL_H*/
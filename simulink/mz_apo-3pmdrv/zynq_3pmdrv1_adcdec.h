@@ -0,0 +1,266 @@
+/*
+  Decimation of the current ADC cumulative sums of the 3-phase
+  motor driver with gap handling and selectable post-filter.
+
+  The FPGA 24-bit sums and 12-bit sample sequence number are
+  extended to 64 bits by accumulating their masked differences each
+  step. Window is accepted when its sums are consistent with its
+  sample count (no channel exceeds 4095 per sample), so windows
+  outside of the fast 2..Z3PMDRV1_ADCAVG_SQN_MAX range are decoded
+  as well (by divide) and flagged. Inconsistent window means lost
+  sequence wrap or corrupted read, its samples are dropped and the
+  filters restart. Step without new samples holds the output.
+
+  Every step sets the flags and sample count and writes the output,
+  it always holds the last valid value (zero before the first one),
+  never stale or uninitialized memory.
+
+  The post-filters run on valid windows only, each with constant
+  per-step cost:
+
+    NONE - window average
+    MA   - sample weighted moving average over the last len windows,
+           difference of the extended totals against snapshot ring
+    IIR  - first order low-pass of window averages, y += alpha (x - y)
+    CIC  - order cascaded moving averages of len windows, the first
+           is the MA stage, the next ones are running sums in Q16
+
+  All values are Q16 ADC units with the offset subtracted.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_ADCDEC_H
+#define _ZYNQ_3PMDRV1_ADCDEC_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_adcavg.h"
+
+#define Z3PMDRV1_ADCDEC_FILT_NONE  0
+#define Z3PMDRV1_ADCDEC_FILT_MA    1
+#define Z3PMDRV1_ADCDEC_FILT_IIR   2
+#define Z3PMDRV1_ADCDEC_FILT_CIC   3
+
+#define Z3PMDRV1_ADCDEC_LEN_MAX    64
+#define Z3PMDRV1_ADCDEC_ORDER_MAX  4
+
+/* Largest 12-bit sample, bounds the sum of consistent window */
+#define Z3PMDRV1_ADCDEC_SAMPLE_MAX 4095
+
+/* Step flags */
+#define Z3PMDRV1_ADCDEC_VALID      0x01  /* output updated from new samples */
+#define Z3PMDRV1_ADCDEC_HOLD       0x02  /* no usable samples, output held */
+#define Z3PMDRV1_ADCDEC_SHORT      0x04  /* single sample window */
+#define Z3PMDRV1_ADCDEC_LONG       0x08  /* window over SQN_MAX samples */
+#define Z3PMDRV1_ADCDEC_GAP        0x10  /* inconsistent window dropped */
+
+typedef struct z3pmdrv1_adcdec_t {
+  /* Configuration */
+  int      filter;
+  int      len;
+  int      order;
+  float    alpha;
+  /* Raw values of the previous step */
+  uint32_t cumsum_last[Z3PMDRV1_CHAN_COUNT];
+  unsigned sqn_last;
+  /* Extended totals */
+  uint64_t total_cnt;
+  uint64_t total_sum[Z3PMDRV1_CHAN_COUNT];
+  /* Snapshots of the totals at window ends, hist_fill before hist_head */
+  uint64_t hist_cnt[Z3PMDRV1_ADCDEC_LEN_MAX];
+  uint64_t hist_sum[Z3PMDRV1_ADCDEC_LEN_MAX][Z3PMDRV1_CHAN_COUNT];
+  int      hist_head;
+  int      hist_fill;
+  /* Further CIC stages */
+  int32_t  cic_ring[Z3PMDRV1_ADCDEC_ORDER_MAX - 1][Z3PMDRV1_ADCDEC_LEN_MAX]
+                   [Z3PMDRV1_CHAN_COUNT];
+  int64_t  cic_sum[Z3PMDRV1_ADCDEC_ORDER_MAX - 1][Z3PMDRV1_CHAN_COUNT];
+  int      cic_head;
+  int      cic_fill;
+  float    iir[Z3PMDRV1_CHAN_COUNT];
+  int      iir_ready;
+  /* Step results */
+  int32_t  avg_q16[Z3PMDRV1_CHAN_COUNT];  /* last valid window average */
+  int32_t  out_q16[Z3PMDRV1_CHAN_COUNT];  /* post-filter output */
+  unsigned n;                             /* samples of the last window */
+  unsigned flags;
+} z3pmdrv1_adcdec_t;
+
+/* Restart the filters, the next valid window starts them again */
+static inline
+void z3pmdrv1_adcdec_restart(z3pmdrv1_adcdec_t *dec)
+{
+	dec->hist_fill = 0;
+	dec->cic_fill = 0;
+	memset(dec->cic_sum, 0, sizeof(dec->cic_sum));
+	dec->iir_ready = 0;
+}
+
+/*
+ * Configure the engine and take the current raw values as start of
+ * the first window. Returns -1 for unsupported len or order.
+ */
+static inline
+int z3pmdrv1_adcdec_init(z3pmdrv1_adcdec_t *dec, int filter, int len,
+		int order, float alpha, const uint32_t *cumsum, unsigned sqn)
+{
+	if ((len < 1) || (len > Z3PMDRV1_ADCDEC_LEN_MAX) ||
+	    (order < 1) || (order > Z3PMDRV1_ADCDEC_ORDER_MAX))
+		return -1;
+
+	memset(dec, 0, sizeof(*dec));
+	dec->filter = filter;
+	dec->len = len;
+	dec->order = filter == Z3PMDRV1_ADCDEC_FILT_CIC? order: 1;
+	dec->alpha = alpha;
+	memcpy(dec->cumsum_last, cumsum, sizeof(dec->cumsum_last));
+	dec->sqn_last = sqn;
+	dec->flags = Z3PMDRV1_ADCDEC_HOLD;
+
+	return 0;
+}
+
+/* Mean of count samples with sum in Q16, offset subtracted, saturated */
+static inline
+int32_t z3pmdrv1_adcdec_mean(uint64_t sum, uint64_t count, int32_t offs)
+{
+	return z3pmdrv1_adcavg_sat_sub((uint32_t)((sum << Z3PMDRV1_ADCAVG_Q) /
+					count), offs);
+}
+
+static inline
+void z3pmdrv1_adcdec_hist_push(z3pmdrv1_adcdec_t *dec)
+{
+	int i;
+
+	dec->hist_cnt[dec->hist_head] = dec->total_cnt;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		dec->hist_sum[dec->hist_head][i] = dec->total_sum[i];
+	if (++dec->hist_head >= Z3PMDRV1_ADCDEC_LEN_MAX)
+		dec->hist_head = 0;
+}
+
+/*
+ * Moving average of the windows since the oldest snapshot, called
+ * after the window is added to the totals. The snapshot of the start
+ * of the first window after restart is taken by the caller.
+ */
+static inline
+void z3pmdrv1_adcdec_ma(z3pmdrv1_adcdec_t *dec, const int32_t *offs,
+		int32_t *ma)
+{
+	int old = dec->hist_head - dec->hist_fill;
+	int i;
+
+	if (old < 0)
+		old += Z3PMDRV1_ADCDEC_LEN_MAX;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		ma[i] = z3pmdrv1_adcdec_mean(dec->total_sum[i] -
+				dec->hist_sum[old][i],
+				dec->total_cnt - dec->hist_cnt[old], offs[i]);
+
+	z3pmdrv1_adcdec_hist_push(dec);
+	if (dec->hist_fill < dec->len)
+		dec->hist_fill++;
+}
+
+/* Further running sum stages of the CIC cascade */
+static inline
+void z3pmdrv1_adcdec_cic(z3pmdrv1_adcdec_t *dec, int32_t *val)
+{
+	int s, i, fill;
+
+	fill = dec->cic_fill < dec->len? dec->cic_fill + 1: dec->len;
+	for (s = 0; s < dec->order - 1; s++) {
+		int32_t *slot = dec->cic_ring[s][dec->cic_head];
+
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+			if (dec->cic_fill >= dec->len)
+				dec->cic_sum[s][i] -= slot[i];
+			slot[i] = val[i];
+			dec->cic_sum[s][i] += val[i];
+			val[i] = dec->cic_sum[s][i] / fill;
+		}
+	}
+	dec->cic_fill = fill;
+	if (++dec->cic_head >= dec->len)
+		dec->cic_head = 0;
+}
+
+/*
+ * Process the raw values of one step. Returns the flags, the outputs
+ * are in dec->out_q16 (filtered) and dec->avg_q16 (window average).
+ */
+static inline
+unsigned z3pmdrv1_adcdec_step(z3pmdrv1_adcdec_t *dec, const uint32_t *cumsum,
+		unsigned sqn, const int32_t *offs)
+{
+	uint32_t d[Z3PMDRV1_CHAN_COUNT];
+	unsigned n = (sqn - dec->sqn_last) & Z3PMDRV1_ADCAVG_SQN_m;
+	int consistent = 1, i;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+		d[i] = (cumsum[i] - dec->cumsum_last[i]) & Z3PMDRV1_ADCAVG_CUMSUM_m;
+		if (d[i] > Z3PMDRV1_ADCDEC_SAMPLE_MAX * n)
+			consistent = 0;
+	}
+
+	dec->n = n;
+	if (!consistent) {
+		dec->flags = Z3PMDRV1_ADCDEC_GAP | Z3PMDRV1_ADCDEC_HOLD;
+		z3pmdrv1_adcdec_restart(dec);
+	} else if (n == 0) {
+		dec->flags = Z3PMDRV1_ADCDEC_HOLD;
+	} else {
+		dec->flags = Z3PMDRV1_ADCDEC_VALID;
+		/* Common window range takes the divide free path */
+		if (!z3pmdrv1_adcavg_q16(cumsum, dec->cumsum_last, offs, sqn,
+					 dec->sqn_last, dec->avg_q16)) {
+			dec->flags |= n == 1? Z3PMDRV1_ADCDEC_SHORT:
+					      Z3PMDRV1_ADCDEC_LONG;
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+				dec->avg_q16[i] = z3pmdrv1_adcdec_mean(d[i], n, offs[i]);
+		}
+
+		/* Snapshot of the first window start after restart */
+		if ((dec->filter == Z3PMDRV1_ADCDEC_FILT_MA ||
+		     dec->filter == Z3PMDRV1_ADCDEC_FILT_CIC) &&
+		    (dec->hist_fill == 0)) {
+			z3pmdrv1_adcdec_hist_push(dec);
+			dec->hist_fill = 1;
+		}
+		dec->total_cnt += n;
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+			dec->total_sum[i] += d[i];
+
+		switch (dec->filter) {
+		case Z3PMDRV1_ADCDEC_FILT_MA:
+		case Z3PMDRV1_ADCDEC_FILT_CIC:
+			z3pmdrv1_adcdec_ma(dec, offs, dec->out_q16);
+			if (dec->order > 1)
+				z3pmdrv1_adcdec_cic(dec, dec->out_q16);
+			break;
+		case Z3PMDRV1_ADCDEC_FILT_IIR:
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+				if (dec->iir_ready)
+					dec->iir[i] += dec->alpha *
+						(dec->avg_q16[i] - dec->iir[i]);
+				else
+					dec->iir[i] = dec->avg_q16[i];
+				dec->out_q16[i] = dec->iir[i];
+			}
+			dec->iir_ready = 1;
+			break;
+		default:
+			memcpy(dec->out_q16, dec->avg_q16, sizeof(dec->out_q16));
+		}
+	}
+
+	memcpy(dec->cumsum_last, cumsum, sizeof(dec->cumsum_last));
+	dec->sqn_last = sqn;
+
+	return dec->flags;
+}
+
+#endif /*_ZYNQ_3PMDRV1_ADCDEC_H*/
@@ -0,0 +1,316 @@
+/*
+  Commutation commissioning of the motor connected to the 3-phase
+  motor driver.
+
+  The bridge drives slow open-loop rotating voltage vector of given
+  amplitude. The rotor is first aligned to electrical angle zero,
+  then the vector turns given number of electrical revolutions
+  forward and the same number back. Every step the commanded angle,
+  IRC position and Hall code are recorded, IRC index events are
+  recorded separately. From the record are derived
+
+    irc_per_rev - distance of consecutive index events, unless it is
+                  given (FOC parameters)
+    pole_pairs  - electrical revolutions commanded per mechanical
+                  revolutions travelled
+    phase_offs  - circular mean of commanded angle minus IRC based
+                  angle over both directions, the load lag of the
+                  rotor cancels between them
+    idx_offs    - IRC counts from the index to zero electrical angle
+    hall        - electrical angle at the middle of each Hall code,
+                  the sector is the 60 degree interval containing it
+
+  The result is kept in the calibration cache (common/mzapo_calcache.h)
+  keyed by the board identity, following starts use it without moving
+  the rotor unless the commissioning is forced.
+
+  At run time the Hall code gives the rotor angle within +-30 degrees
+  right after start, the first IRC index event then sets the exact
+  alignment. Both only move the FOC angle offset.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_COMMIS_H
+#define _ZYNQ_3PMDRV1_COMMIS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+
+#include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_foc.h"
+#include "../common/mzapo_calcache.h"
+
+#define Z3PMDRV1_COMMIS_CACHE_PREFIX   "z3pmdrv1_commis"
+#define Z3PMDRV1_COMMIS_STEP_NS        1000000
+#define Z3PMDRV1_COMMIS_ALIGN_S        1.0
+#define Z3PMDRV1_COMMIS_STEPS_MAX      120000
+#define Z3PMDRV1_COMMIS_INDEX_MAX      64
+#define Z3PMDRV1_COMMIS_HALL_CODES     8
+#define Z3PMDRV1_COMMIS_SECTOR_NONE    0xff
+
+/* Payload of the cache entry */
+typedef struct z3pmdrv1_commis_res_t {
+  int32_t  irc_per_rev;
+  int32_t  pole_pairs;
+  int32_t  idx_offs;        /* -1 when no index has been seen */
+  uint32_t reserved;
+  uint32_t hall_phase[Z3PMDRV1_COMMIS_HALL_CODES];
+  uint8_t  hall_table[Z3PMDRV1_COMMIS_HALL_CODES]; /* code to sector */
+} z3pmdrv1_commis_res_t;
+
+typedef struct z3pmdrv1_commis_t {
+  z3pmdrv1_commis_res_t res;
+  uint32_t index_occur_last;
+} z3pmdrv1_commis_t;
+
+typedef struct z3pmdrv1_commis_sample_t {
+  uint32_t phase;           /* commanded electrical angle */
+  uint32_t pos;
+  uint8_t  hall;
+} z3pmdrv1_commis_sample_t;
+
+static inline
+uint32_t z3pmdrv1_commis_phase_per_irc(const z3pmdrv1_commis_res_t *res)
+{
+	return (uint32_t)llround(4294967296.0 * res->pole_pairs /
+				 res->irc_per_rev);
+}
+
+/* Apply the voltage vector of given angle and amplitude, one transfer */
+static inline
+void z3pmdrv1_commis_drive(z3pmdrv1_state_t *z3pmcst, uint32_t phase, float amp)
+{
+	double a = phase * (2 * M_PI / 4294967296.0);
+	int i;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->pwm[i] = z3pmdrv1_pwm_duty(z3pmcst, i,
+				0.5f + amp * cos(a - i * (2 * M_PI / 3)), 1);
+	z3pmdrv1_transfer(z3pmcst);
+}
+
+/* Circular mean of 32-bit phases accumulated as cosine and sine sums */
+static inline
+uint32_t z3pmdrv1_commis_mean_phase(double sc, double ss)
+{
+	double a = atan2(ss, sc);
+
+	if (a < 0)
+		a += 2 * M_PI;
+	return (uint32_t)(int64_t)llround(a * (4294967296.0 / (2 * M_PI)));
+}
+
+/*
+ * Derive the result from the record. The irc_per_rev is used when
+ * positive, measured from index events otherwise. Returns -1 when
+ * the record does not allow consistent result.
+ */
+static inline
+int z3pmdrv1_commis_eval(z3pmdrv1_commis_res_t *res, double elec_revs,
+		const z3pmdrv1_commis_sample_t *smp, int nsmp, int nfwd,
+		const uint32_t *index_pos, int nindex)
+{
+	double sc = 0, ss = 0, hc[Z3PMDRV1_COMMIS_HALL_CODES],
+	       hs[Z3PMDRV1_COMMIS_HALL_CODES];
+	int32_t travel;
+	uint32_t ppi, offs, ph;
+	uint8_t used = 0;
+	int i, s;
+
+	if ((nfwd < 2) || (nsmp <= nfwd))
+		return -1;
+
+	/* IRC has to count along with the electrical angle */
+	travel = (int32_t)(smp[nfwd - 1].pos - smp[0].pos);
+	if (travel <= 0)
+		return -1;
+
+	if ((res->irc_per_rev <= 0) && (nindex >= 2))
+		res->irc_per_rev = (int32_t)(index_pos[1] - index_pos[0]);
+	if (res->irc_per_rev <= 0)
+		return -1;
+
+	res->pole_pairs = lround(elec_revs * res->irc_per_rev / travel);
+	if (res->pole_pairs < 1)
+		return -1;
+	ppi = z3pmdrv1_commis_phase_per_irc(res);
+
+	for (i = 0; i < nsmp; i++) {
+		double a = (smp[i].phase - smp[i].pos * ppi) *
+			   (2 * M_PI / 4294967296.0);
+		sc += cos(a);
+		ss += sin(a);
+	}
+	offs = z3pmdrv1_commis_mean_phase(sc, ss);
+
+	/* Rotor angle at index, counts forward to the next zero */
+	res->idx_offs = -1;
+	if (nindex >= 1) {
+		ph = index_pos[0] * ppi + offs;
+		res->idx_offs = (uint32_t)-ph / ppi;
+	}
+
+	for (i = 0; i < Z3PMDRV1_COMMIS_HALL_CODES; i++) {
+		hc[i] = 0;
+		hs[i] = 0;
+		res->hall_phase[i] = 0;
+		res->hall_table[i] = Z3PMDRV1_COMMIS_SECTOR_NONE;
+	}
+	for (i = 0; i < nsmp; i++) {
+		double a = (smp[i].pos * ppi + offs) * (2 * M_PI / 4294967296.0);
+		hc[smp[i].hall & 7] += cos(a);
+		hs[smp[i].hall & 7] += sin(a);
+	}
+	for (i = 1; i < Z3PMDRV1_COMMIS_HALL_CODES - 1; i++) {
+		if ((hc[i] == 0) && (hs[i] == 0))
+			return -1;
+		res->hall_phase[i] = z3pmdrv1_commis_mean_phase(hc[i], hs[i]);
+		s = (uint64_t)res->hall_phase[i] * 6 >> 32;
+		/* Each sector has to belong to exactly one code */
+		if (used & (1 << s))
+			return -1;
+		used |= 1 << s;
+		res->hall_table[i] = s;
+	}
+
+	return 0;
+}
+
+/*
+ * Run the open-loop commissioning, amp is the voltage vector amplitude
+ * (duty), elec_hz its speed. The bridge is left in shutdown.
+ */
+static inline
+int z3pmdrv1_commis_measure(z3pmdrv1_state_t *z3pmcst, float amp,
+		double elec_hz, double elec_revs, z3pmdrv1_commis_res_t *res)
+{
+	struct timespec step = {0, Z3PMDRV1_COMMIS_STEP_NS};
+	uint32_t index_pos[Z3PMDRV1_COMMIS_INDEX_MAX];
+	z3pmdrv1_commis_sample_t *smp;
+	uint32_t phase = 0, dphase, index_occur;
+	long k, nalign, nrot;
+	int nsmp = 0, nfwd, nindex = 0, ret, i;
+
+	nalign = Z3PMDRV1_COMMIS_ALIGN_S * 1e9 / Z3PMDRV1_COMMIS_STEP_NS;
+	nrot = elec_revs / elec_hz * 1e9 / Z3PMDRV1_COMMIS_STEP_NS;
+	if ((nrot < 1) || (2 * nrot > Z3PMDRV1_COMMIS_STEPS_MAX))
+		return -1;
+	dphase = (uint32_t)(int64_t)llround(elec_revs * 4294967296.0 / nrot);
+
+	smp = malloc(2 * nrot * sizeof(*smp));
+	if (smp == NULL)
+		return -1;
+
+	/* Amplitude ramp at zero angle pulls the rotor to alignment */
+	for (k = 0; k < nalign; k++) {
+		z3pmdrv1_commis_drive(z3pmcst, 0, amp * (k < nalign / 2?
+					(float)k / (nalign / 2): 1));
+		while (nanosleep(&step, NULL) < 0 && errno == EINTR);
+	}
+
+	index_occur = z3pmcst->index_occur;
+	for (k = 0; k < 2 * nrot; k++) {
+		if (k < nrot)
+			phase += dphase;
+		else
+			phase -= dphase;
+		z3pmdrv1_commis_drive(z3pmcst, phase, amp);
+		while (nanosleep(&step, NULL) < 0 && errno == EINTR);
+
+		/* Position read by the same transfer lags by one step,
+		   the lag cancels between the directions as the load one */
+		smp[nsmp].phase = phase;
+		smp[nsmp].pos = z3pmcst->act_pos;
+		smp[nsmp].hall = z3pmcst->hal_sensors;
+		nsmp++;
+		if ((z3pmcst->index_occur != index_occur) && (k < nrot) &&
+		    (nindex < Z3PMDRV1_COMMIS_INDEX_MAX))
+			index_pos[nindex++] = z3pmcst->index_pos;
+		index_occur = z3pmcst->index_occur;
+	}
+	nfwd = nrot;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->pwm[i] = z3pmdrv1_pwm_duty(z3pmcst, i, 0, 0);
+	z3pmdrv1_transfer(z3pmcst);
+
+	ret = z3pmdrv1_commis_eval(res, elec_revs, smp, nsmp, nfwd,
+				   index_pos, nindex);
+	free(smp);
+
+	return ret;
+}
+
+/*
+ * Obtain the commissioning result of the board, from the cache unless
+ * forced or missing, measured and stored otherwise. The irc_per_rev
+ * is known value or 0 to measure it. Returns 1 when loaded from cache,
+ * 0 when measured and -1 on failure. The replay uses only the cached
+ * result of the board the trace comes from.
+ */
+static inline
+int z3pmdrv1_commis_run(z3pmdrv1_state_t *z3pmcst, z3pmdrv1_commis_t *cm,
+		float amp, double elec_hz, double elec_revs, int32_t irc_per_rev,
+		int force)
+{
+	char ident[MZAPO_CALCACHE_IDENT_LEN];
+	z3pmdrv1_commis_res_t *res = &cm->res;
+
+	memset(cm, 0, sizeof(*cm));
+	z3pmdrv1_ident(z3pmcst, ident);
+
+	if ((!force || (z3pmcst->replay != NULL)) &&
+	    (mzapo_calcache_load(Z3PMDRV1_COMMIS_CACHE_PREFIX, ident,
+				 res, sizeof(*res)) == 0) &&
+	    ((irc_per_rev <= 0) || (res->irc_per_rev == irc_per_rev))) {
+		cm->index_occur_last = z3pmcst->index_occur;
+		return 1;
+	}
+	if (z3pmcst->replay != NULL) {
+		fprintf(stderr, "commissioning of %s not cached, cannot be run"
+			" in replay\n", ident);
+		return -1;
+	}
+
+	memset(res, 0, sizeof(*res));
+	res->irc_per_rev = irc_per_rev;
+	if (z3pmdrv1_commis_measure(z3pmcst, amp, elec_hz, elec_revs, res) < 0)
+		return -1;
+	mzapo_calcache_save(Z3PMDRV1_COMMIS_CACHE_PREFIX, ident,
+			    res, sizeof(*res));
+	cm->index_occur_last = z3pmcst->index_occur;
+
+	return 0;
+}
+
+/* Align the FOC angle by the Hall code, +-30 degrees accuracy */
+static inline
+void z3pmdrv1_commis_align_hall(const z3pmdrv1_commis_t *cm,
+		z3pmdrv1_foc_t *foc, uint8_t hall, uint32_t act_pos)
+{
+	const z3pmdrv1_commis_res_t *res = &cm->res;
+
+	if (res->hall_table[hall & 7] == Z3PMDRV1_COMMIS_SECTOR_NONE)
+		return;
+	z3pmdrv1_foc_set_offset(foc, act_pos -
+			res->hall_phase[hall & 7] / foc->phase_per_irc, act_pos);
+}
+
+/* Align the FOC angle exactly at each new IRC index event */
+static inline
+void z3pmdrv1_commis_track(z3pmdrv1_commis_t *cm, z3pmdrv1_foc_t *foc,
+		const z3pmdrv1_state_t *z3pmcst)
+{
+	if (z3pmcst->index_occur == cm->index_occur_last)
+		return;
+	cm->index_occur_last = z3pmcst->index_occur;
+	if (cm->res.idx_offs < 0)
+		return;
+	z3pmdrv1_foc_set_offset(foc, z3pmcst->index_pos + cm->res.idx_offs,
+				z3pmcst->act_pos);
+}
+
+#endif /*_ZYNQ_3PMDRV1_COMMIS_H*/
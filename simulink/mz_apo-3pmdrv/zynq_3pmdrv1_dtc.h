@@ -0,0 +1,277 @@
+/*
+  Dead-time and inverter nonlinearity compensation for the 3-phase
+  motor driver PWM output.
+
+  The inverter loses part of the commanded phase voltage which has
+  the sign of the phase current and magnitude growing from zero at
+  zero current to the dead-time and switch drop value at higher
+  currents. The stage adds the compensation duty
+
+    duty += sign(i) * comp(|i|)
+
+  to each phase before the duty is quantized. The comp(|i|) is piece
+  wise linear table over n equidistant current points 0 .. i_max
+  (ADC units, the offset subtracted Q16 curadc_val), constant above
+  i_max. The lookup is constant time, there is no search.
+
+  In calibration mode no compensation is applied. The commanded phase
+  voltage (duty minus the mean of the three phases) of the previous
+  step is paired with the current measured during it and the model
+
+    v = R i + l(i) - (l(ia) + l(ib) + l(ic)) / 3,  l(i) = sign(i) comp(|i|)
+
+  is fitted by least squares. The losses of all three phases reach
+  the phase voltage through the star point the same way as the
+  compensation does, so the table holds the loss of single phase.
+  The model is linear in R and the table points, only the normal
+  equations are accumulated per step. Table growing linearly with
+  current cannot be told apart from the resistance, the last two
+  points are therefore fitted as equal (the loss is assumed to
+  saturate before i_max). Run the calibration at
+  standstill with slowly varying current command over the range
+  of both signs.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_DTC_H
+#define _ZYNQ_3PMDRV1_DTC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "zynq_3pmdrv1_mc.h"
+
+#define Z3PMDRV1_DTC_POINTS_MAX    16
+
+#define Z3PMDRV1_DTC_MODE_COMP     1
+#define Z3PMDRV1_DTC_MODE_CAL      2
+
+/* Unknowns of the fit, R followed by the table points */
+#define Z3PMDRV1_DTC_CAL_VARS      (Z3PMDRV1_DTC_POINTS_MAX + 1)
+
+typedef struct z3pmdrv1_dtc_cal_t {
+  float    duty_last[Z3PMDRV1_CHAN_COUNT];
+  int      duty_valid;
+  uint32_t samples;
+  /* Normal equations of the least squares fit */
+  double   ata[Z3PMDRV1_DTC_CAL_VARS][Z3PMDRV1_DTC_CAL_VARS];
+  double   atb[Z3PMDRV1_DTC_CAL_VARS];
+  double   r;
+} z3pmdrv1_dtc_cal_t;
+
+typedef struct z3pmdrv1_dtc_t {
+  int      mode;
+  int      n;
+  float    i_max;
+  float    inv_step;        /* table points per current unit */
+  float    comp[Z3PMDRV1_DTC_POINTS_MAX];
+  z3pmdrv1_dtc_cal_t cal;
+} z3pmdrv1_dtc_t;
+
+/*
+ * Configure the stage, comp is NULL for calibration mode. Returns -1
+ * for unsupported number of points.
+ */
+static inline
+int z3pmdrv1_dtc_init(z3pmdrv1_dtc_t *dtc, int mode, float i_max, int n,
+		      const float *comp)
+{
+	if ((n < 2) || (n > Z3PMDRV1_DTC_POINTS_MAX) || (i_max <= 0))
+		return -1;
+
+	memset(dtc, 0, sizeof(*dtc));
+	dtc->mode = mode;
+	dtc->n = n;
+	dtc->i_max = i_max;
+	dtc->inv_step = (n - 1) / i_max;
+	if (comp != NULL)
+		memcpy(dtc->comp, comp, n * sizeof(*comp));
+
+	return 0;
+}
+
+/* Compensation duty for phase current in Q16 ADC units */
+static inline
+float z3pmdrv1_dtc_comp(const z3pmdrv1_dtc_t *dtc, int32_t cur_q16)
+{
+	float i = cur_q16 * (1.0f / 65536);
+	float a = fabsf(i) * dtc->inv_step;
+	float c;
+	int k;
+
+	if (dtc->mode != Z3PMDRV1_DTC_MODE_COMP)
+		return 0;
+
+	if (a >= dtc->n - 1) {
+		c = dtc->comp[dtc->n - 1];
+	} else {
+		k = (int)a;
+		c = dtc->comp[k] + (dtc->comp[k + 1] - dtc->comp[k]) * (a - k);
+	}
+
+	return i < 0? -c: c;
+}
+
+/* Phase duty with compensation, dtc can be NULL */
+static inline
+float z3pmdrv1_dtc_apply(const z3pmdrv1_dtc_t *dtc, const int32_t *cur_q16,
+			 int chan, float duty)
+{
+	if (dtc == NULL)
+		return duty;
+	return duty + z3pmdrv1_dtc_comp(dtc, cur_q16[chan]);
+}
+
+/*
+ * Calibration step, duty are the phase duties commanded in this step,
+ * cur_q16 the currents measured during the previous one.
+ */
+static inline
+void z3pmdrv1_dtc_cal_step(z3pmdrv1_dtc_t *dtc, const float *duty,
+			   const int32_t *cur_q16, int en)
+{
+	z3pmdrv1_dtc_cal_t *cal = &dtc->cal;
+	double w[Z3PMDRV1_CHAN_COUNT][Z3PMDRV1_DTC_POINTS_MAX];
+	double wmean[Z3PMDRV1_DTC_POINTS_MAX];
+	double x[Z3PMDRV1_DTC_CAL_VARS];
+	int nv = dtc->n + 1;
+	float mean;
+	int ph, k, j;
+
+	if (dtc->mode != Z3PMDRV1_DTC_MODE_CAL)
+		return;
+
+	if (cal->duty_valid && en) {
+		/* Interpolation weights of each phase loss, signed by current */
+		memset(w, 0, sizeof(w));
+		for (ph = 0; ph < Z3PMDRV1_CHAN_COUNT; ph++) {
+			double i = cur_q16[ph] * (1.0 / 65536);
+			double s = i < 0? -1: 1;
+			double a = fabs(i) * dtc->inv_step;
+
+			if (a >= dtc->n - 1) {
+				w[ph][dtc->n - 1] = s;
+			} else {
+				k = (int)a;
+				w[ph][k] = s * (1 - (a - k));
+				w[ph][k + 1] = s * (a - k);
+			}
+		}
+		for (k = 0; k < dtc->n; k++)
+			wmean[k] = (w[0][k] + w[1][k] + w[2][k]) * (1.0 / 3);
+
+		mean = (cal->duty_last[0] + cal->duty_last[1] +
+			cal->duty_last[2]) * (1.0f / 3);
+		for (ph = 0; ph < Z3PMDRV1_CHAN_COUNT; ph++) {
+			double v = cal->duty_last[ph] - mean;
+
+			x[0] = cur_q16[ph] * (1.0 / 65536);
+			for (k = 0; k < dtc->n; k++)
+				x[k + 1] = w[ph][k] - wmean[k];
+			for (k = 0; k < nv; k++) {
+				for (j = 0; j < nv; j++)
+					cal->ata[k][j] += x[k] * x[j];
+				cal->atb[k] += x[k] * v;
+			}
+		}
+		cal->samples++;
+	}
+
+	memcpy(cal->duty_last, duty, sizeof(cal->duty_last));
+	cal->duty_valid = en;
+}
+
+/*
+ * Solve the normal equations for the resistance and the table. Small
+ * ridge term keeps points without samples near zero instead of making
+ * the system singular. Returns -1 when there are too few samples.
+ */
+static inline
+int z3pmdrv1_dtc_cal_finish(z3pmdrv1_dtc_t *dtc)
+{
+	z3pmdrv1_dtc_cal_t *cal = &dtc->cal;
+	double a[Z3PMDRV1_DTC_CAL_VARS][Z3PMDRV1_DTC_CAL_VARS + 1];
+	int nv = dtc->n;        /* last two table points share one unknown */
+	double ridge = 0, f;
+	int k, j, r, p;
+
+	if ((nv < 2) || (cal->samples < 10u * (uint32_t)nv))
+		return -1;
+
+	for (k = 0; k < nv; k++) {
+		for (j = 0; j < nv; j++)
+			a[k][j] = cal->ata[k][j];
+		a[k][nv] = cal->atb[k];
+	}
+	for (k = 0; k < nv; k++) {
+		a[k][nv - 1] += cal->ata[k][nv];
+		a[nv - 1][k] += cal->ata[nv][k];
+	}
+	a[nv - 1][nv - 1] += cal->ata[nv][nv];
+	a[nv - 1][nv] += cal->atb[nv];
+
+	for (k = 0; k < nv; k++)
+		ridge += a[k][k];
+	ridge *= 1e-9 / nv;
+	for (k = 0; k < nv; k++)
+		a[k][k] += ridge;
+
+	/* Gaussian elimination with partial pivoting */
+	for (k = 0; k < nv; k++) {
+		p = k;
+		for (r = k + 1; r < nv; r++)
+			if (fabs(a[r][k]) > fabs(a[p][k]))
+				p = r;
+		if (a[p][k] == 0)
+			return -1;
+		for (j = k; j <= nv; j++) {
+			f = a[k][j];
+			a[k][j] = a[p][j];
+			a[p][j] = f;
+		}
+		for (r = k + 1; r < nv; r++) {
+			f = a[r][k] / a[k][k];
+			for (j = k; j <= nv; j++)
+				a[r][j] -= f * a[k][j];
+		}
+	}
+	for (k = nv - 1; k >= 0; k--) {
+		f = a[k][nv];
+		for (j = k + 1; j < nv; j++)
+			f -= a[k][j] * a[j][nv];
+		a[k][nv] = f / a[k][k];
+	}
+
+	cal->r = a[0][nv];
+	for (k = 0; k < dtc->n - 1; k++)
+		dtc->comp[k] = a[k + 1][nv];
+	dtc->comp[dtc->n - 1] = dtc->comp[dtc->n - 2];
+
+	return 0;
+}
+
+/*
+ * Write the calibration result as the block parameter vector
+ * [1 i_max comp...] preceded by comment with the fitted model.
+ */
+static inline
+int z3pmdrv1_dtc_cal_save(const z3pmdrv1_dtc_t *dtc, const char *fname)
+{
+	FILE *f = fopen(fname, "w");
+	int k;
+
+	if (f == NULL)
+		return -1;
+	fprintf(f, "%% R %g duty per ADC unit, %u samples\n",
+		dtc->cal.r, dtc->cal.samples);
+	fprintf(f, "[%d %g", Z3PMDRV1_DTC_MODE_COMP, dtc->i_max);
+	for (k = 0; k < dtc->n; k++)
+		fprintf(f, " %.6g", dtc->comp[k]);
+	fprintf(f, "]\n");
+	fclose(f);
+
+	return 0;
+}
+
+#endif /*_ZYNQ_3PMDRV1_DTC_H*/
@@ -0,0 +1,275 @@
+/*
+  Field oriented current control kernel for the 3-phase motor
+  driver.
+
+  The kernel transforms the measured phase currents into the rotor
+  d/q frame (Clarke and Park), runs d and q PI regulators with
+  anti-windup and converts the resulting voltage vector back into
+  three phase duty cycles (inverse Park, inverse Clarke and min/max
+  zero sequence injection equivalent to space vector modulation).
+
+  The electrical angle is represented by 32-bit phase, 2^32 is one
+  electrical revolution, derived from IRC position. Sine and cosine
+  are taken from the shared table with linear interpolation.
+
+  All computations are in float32, so they stay in single precision
+  VFP/NEON registers on Zynq. The state is plain structure without
+  pointers, the functions are static inline and the header does not
+  depend on the S-function, so the kernel can be benchmarked on the
+  host (tools/z3pmdrv1_foc_bench).
+
+  Voltages are normalized to the DC bus voltage, duty cycles are
+  in 0..1 range.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_FOC_H
+#define _ZYNQ_3PMDRV1_FOC_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define Z3PMDRV1_FOC_SIN_BITS      10
+#define Z3PMDRV1_FOC_SIN_SIZE      (1 << Z3PMDRV1_FOC_SIN_BITS)
+
+/* Largest voltage vector which can be generated without clipping */
+#define Z3PMDRV1_FOC_UMAX_LINEAR   0.57735027f
+
+typedef struct z3pmdrv1_foc_sin_table_t {
+  int      ready;
+  /* Extra entry to interpolate over the last segment without wrap */
+  float    sin[Z3PMDRV1_FOC_SIN_SIZE + 1];
+} z3pmdrv1_foc_sin_table_t;
+
+/* Shared by all blocks linked into the executable */
+__attribute__((weak))
+z3pmdrv1_foc_sin_table_t z3pmdrv1_foc_sin_table;
+
+typedef struct z3pmdrv1_foc_pi_t {
+  float    kp;
+  float    ki;              /* integral gain multiplied by sample period */
+  float    integ;
+} z3pmdrv1_foc_pi_t;
+
+typedef struct z3pmdrv1_foc_t {
+  /* Configuration */
+  z3pmdrv1_foc_pi_t pi_d;
+  z3pmdrv1_foc_pi_t pi_q;
+  float    umax;            /* limit of voltage vector magnitude */
+  float    cur_scale;       /* ADC units (Q16) to current units */
+  int32_t  irc_per_rev;     /* IRC counts per mechanical revolution */
+  uint32_t phase_per_irc;   /* electrical phase increment per IRC count */
+  int32_t  irc_offset;      /* IRC position of zero electrical angle */
+  /* Angle tracking */
+  int32_t  irc_last;
+  int32_t  irc_in_rev;      /* position modulo irc_per_rev */
+  uint32_t phase;
+  /* Last step values for diagnostics */
+  float    i_d;
+  float    i_q;
+  float    u_d;
+  float    u_q;
+  float    duty[3];
+} z3pmdrv1_foc_t;
+
+static inline
+void z3pmdrv1_foc_sin_table_init(void)
+{
+	z3pmdrv1_foc_sin_table_t *tab = &z3pmdrv1_foc_sin_table;
+	int i;
+
+	if (tab->ready)
+		return;
+	for (i = 0; i <= Z3PMDRV1_FOC_SIN_SIZE; i++)
+		tab->sin[i] = sin(2 * M_PI * i / Z3PMDRV1_FOC_SIN_SIZE);
+	tab->ready = 1;
+}
+
+static inline
+void z3pmdrv1_foc_sincos(uint32_t phase, float *s, float *c)
+{
+	const float *tab = z3pmdrv1_foc_sin_table.sin;
+	const float frac_scale = 1.0f / (1 << (32 - Z3PMDRV1_FOC_SIN_BITS));
+	unsigned i;
+	float frac;
+
+	i = phase >> (32 - Z3PMDRV1_FOC_SIN_BITS);
+	frac = (phase & ((1u << (32 - Z3PMDRV1_FOC_SIN_BITS)) - 1)) * frac_scale;
+	*s = tab[i] + (tab[i + 1] - tab[i]) * frac;
+
+	phase += 1u << 30;
+	i = phase >> (32 - Z3PMDRV1_FOC_SIN_BITS);
+	*c = tab[i] + (tab[i + 1] - tab[i]) * frac;
+}
+
+/* Clear regulator states, duty cycles return to the PWM center */
+static inline
+void z3pmdrv1_foc_reset(z3pmdrv1_foc_t *foc)
+{
+	foc->pi_d.integ = 0;
+	foc->pi_q.integ = 0;
+	foc->duty[0] = 0.5f;
+	foc->duty[1] = 0.5f;
+	foc->duty[2] = 0.5f;
+}
+
+/*
+ * Configure the regulators. The kp/ki are in voltage (normalized
+ * to DC bus) per current unit, ki is already multiplied by the
+ * sample period.
+ */
+static inline
+void z3pmdrv1_foc_init(z3pmdrv1_foc_t *foc, float kp, float ki, float umax,
+		float cur_scale, int pole_pairs, int32_t irc_per_rev,
+		int32_t irc_offset)
+{
+	z3pmdrv1_foc_sin_table_init();
+
+	foc->pi_d.kp = kp;
+	foc->pi_d.ki = ki;
+	foc->pi_q.kp = kp;
+	foc->pi_q.ki = ki;
+	foc->umax = (umax > 0) && (umax < Z3PMDRV1_FOC_UMAX_LINEAR)?
+		    umax: Z3PMDRV1_FOC_UMAX_LINEAR;
+	foc->cur_scale = cur_scale;
+	foc->irc_per_rev = irc_per_rev > 0? irc_per_rev: 1;
+	foc->phase_per_irc = (uint32_t)llround(4294967296.0 * pole_pairs /
+					       foc->irc_per_rev);
+	foc->irc_offset = irc_offset;
+	foc->irc_last = irc_offset;
+	foc->irc_in_rev = 0;
+	foc->phase = 0;
+	z3pmdrv1_foc_reset(foc);
+}
+
+/*
+ * Move the zero electrical angle to irc_offset while running, irc_pos
+ * is the current position. Used when the rotor alignment becomes known
+ * (Hall sector at start, IRC index later).
+ */
+static inline
+void z3pmdrv1_foc_set_offset(z3pmdrv1_foc_t *foc, int32_t irc_offset,
+		int32_t irc_pos)
+{
+	int32_t pos = (int32_t)(irc_pos - irc_offset) % foc->irc_per_rev;
+
+	if (pos < 0)
+		pos += foc->irc_per_rev;
+	foc->irc_offset = irc_offset;
+	foc->irc_last = irc_pos;
+	foc->irc_in_rev = pos;
+}
+
+/*
+ * Track electrical angle from IRC position. The position is reduced
+ * modulo one revolution incrementally, there is no integer divide
+ * on Cortex-A9 and phase error does not grow with distance. Only
+ * a move over one revolution since the previous step is reduced by
+ * divide, the first step from irc_offset or a step after stall of
+ * the loop, so the loops below run once at most.
+ */
+static inline
+uint32_t z3pmdrv1_foc_angle(z3pmdrv1_foc_t *foc, int32_t irc_pos)
+{
+	int32_t d = (int32_t)(irc_pos - foc->irc_last);
+	int32_t pos;
+
+	if ((d >= foc->irc_per_rev) || (d <= -foc->irc_per_rev))
+		d %= foc->irc_per_rev;
+	pos = foc->irc_in_rev + d;
+
+	foc->irc_last = irc_pos;
+	while (pos >= foc->irc_per_rev)
+		pos -= foc->irc_per_rev;
+	while (pos < 0)
+		pos += foc->irc_per_rev;
+	foc->irc_in_rev = pos;
+	foc->phase = (uint32_t)pos * foc->phase_per_irc;
+
+	return foc->phase;
+}
+
+/* PI step with conditional integration, output limited to +-lim */
+static inline
+float z3pmdrv1_foc_pi(z3pmdrv1_foc_pi_t *pi, float err, float lim)
+{
+	float p = pi->kp * err;
+	float u = p + pi->integ + pi->ki * err;
+
+	if (u > lim) {
+		u = lim;
+		if (err < 0)
+			pi->integ += pi->ki * err;
+	} else if (u < -lim) {
+		u = -lim;
+		if (err > 0)
+			pi->integ += pi->ki * err;
+	} else {
+		pi->integ += pi->ki * err;
+	}
+	/* Keep integrator within the reachable range */
+	if (pi->integ > lim)
+		pi->integ = lim;
+	if (pi->integ < -lim)
+		pi->integ = -lim;
+
+	return u;
+}
+
+/*
+ * One current control step. The cur_q16 are phase current ADC averages
+ * with offset subtracted (Q16), the irc_pos is block position counter.
+ * Resulting duty cycles are stored in foc->duty.
+ */
+static inline
+void z3pmdrv1_foc_step(z3pmdrv1_foc_t *foc, const int32_t *cur_q16,
+		int32_t irc_pos, float id_ref, float iq_ref)
+{
+	const float k_1_3 = 1.0f / 3;
+	const float k_1_sqrt3 = 0.57735027f;
+	const float k_sqrt3_2 = 0.86602540f;
+	float ia, ib, ic, i_alpha, i_beta;
+	float u_alpha, u_beta, ua, ub, uc;
+	float s, c, u_d, u_q, uq_lim, umin, umax, zs;
+	float scale = foc->cur_scale * (1.0f / 65536);
+
+	z3pmdrv1_foc_sincos(z3pmdrv1_foc_angle(foc, irc_pos), &s, &c);
+
+	ia = cur_q16[0] * scale;
+	ib = cur_q16[1] * scale;
+	ic = cur_q16[2] * scale;
+
+	/* Clarke, uses all three phases, common mode is rejected */
+	i_alpha = (2 * ia - ib - ic) * k_1_3;
+	i_beta = (ib - ic) * k_1_sqrt3;
+
+	/* Park */
+	foc->i_d = i_alpha * c + i_beta * s;
+	foc->i_q = -i_alpha * s + i_beta * c;
+
+	/* D axis has priority, Q uses remaining voltage magnitude */
+	u_d = z3pmdrv1_foc_pi(&foc->pi_d, id_ref - foc->i_d, foc->umax);
+	uq_lim = sqrtf(foc->umax * foc->umax - u_d * u_d);
+	u_q = z3pmdrv1_foc_pi(&foc->pi_q, iq_ref - foc->i_q, uq_lim);
+	foc->u_d = u_d;
+	foc->u_q = u_q;
+
+	/* Inverse Park and Clarke */
+	u_alpha = u_d * c - u_q * s;
+	u_beta = u_d * s + u_q * c;
+	ua = u_alpha;
+	ub = -0.5f * u_alpha + k_sqrt3_2 * u_beta;
+	uc = -0.5f * u_alpha - k_sqrt3_2 * u_beta;
+
+	/* Min/max zero sequence centers the phases in the PWM range */
+	umax = ua > ub? ua: ub;
+	umax = umax > uc? umax: uc;
+	umin = ua < ub? ua: ub;
+	umin = umin < uc? umin: uc;
+	zs = 0.5f - 0.5f * (umax + umin);
+
+	foc->duty[0] = ua + zs;
+	foc->duty[1] = ub + zs;
+	foc->duty[2] = uc + zs;
+}
+
+#endif /*_ZYNQ_3PMDRV1_FOC_H*/
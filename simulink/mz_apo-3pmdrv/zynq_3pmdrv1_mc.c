@@ -18,211 +18,259 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 
 #include "zynq_3pmdrv1_mc.h"
+#include "../common/phys_address_access.h"
+#include "../common/mzapo_calcache.h"
+#include "../common/mzapo_regmap.h"
+#include "../common/mzapo_rtmem.h"
+#include "../common/mzapo_replay.h"
 
-#define Z3PMDRV1_REG_BASE_PHYS     0x43c20000
-#define Z3PMDRV1_REG_SIZE          0x00001000
-
-#define Z3PMDRV1_REG_IRC_POS_o         0x0008
-#define Z3PMDRV1_REG_IRC_IDX_POS_o     0x000C
-
-#define Z3PMDRV1_REG_PWM1_o            0x0010
-#define Z3PMDRV1_REG_PWM2_o            0x0014
-#define Z3PMDRV1_REG_PWM3_o            0x0018
-
-#define Z3PMDRV1_REG_PWMX_VAL_m    0x00003fff
-#define Z3PMDRV1_REG_PWMX_EN_m     0x40000000
-#define Z3PMDRV1_REG_PWMX_SHDN_m   0x80000000
+/*
+ * Register offsets and fields are generated by mzapo_regmap.h from
+ * the common description (../common/mzapo_regs.def). All three PWM
+ * registers share the PWM1 field layout.
+ */
+#define Z3PMDRV1_PWM_LAYOUT_EQ(reg) \
+	((MZAPO_REGMAP_MASK(Z3PMDRV1_##reg##_VAL) == \
+	  MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_VAL)) && \
+	 (MZAPO_REGMAP_MASK(Z3PMDRV1_##reg##_EN) == \
+	  MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_EN)) && \
+	 (MZAPO_REGMAP_MASK(Z3PMDRV1_##reg##_SHDN) == \
+	  MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_SHDN)))
 
-#define Z3PMDRV1_REG_ADC_SQN_STAT_o    0x0020
+typedef char z3pmdrv1_pwm_layout_check[
+	Z3PMDRV1_PWM_LAYOUT_EQ(PWM2) && Z3PMDRV1_PWM_LAYOUT_EQ(PWM3)? 1: -1];
 
-#define Z3PMDRV1_REG_ADSQST_SQN_m  0x00000fff
-#define Z3PMDRV1_REG_ADSQST_HAL1_m 0x00010000
-#define Z3PMDRV1_REG_ADSQST_HAL2_m 0x00020000
-#define Z3PMDRV1_REG_ADSQST_HAL3_m 0x00040000
-#define Z3PMDRV1_REG_ADSQST_ST1_m  0x00100000
-#define Z3PMDRV1_REG_ADSQST_ST2_m  0x00200000
-#define Z3PMDRV1_REG_ADSQST_ST3_m  0x00400000
-#define Z3PMDRV1_REG_ADSQST_PWST_m 0x01000000
+#define Z3PMDRV1_REG_PWMX_VAL_m    MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_VAL)
 
-#define Z3PMDRV1_REG_ADC1_o            0x0024
-#define Z3PMDRV1_REG_ADC2_o            0x0028
-#define Z3PMDRV1_REG_ADC3_o            0x002C
+/*
+ * The registers are mapped through the process-wide registry of
+ * ../common/phys_address_access.h, which honours MZAPO_MEMDEV (regular
+ * file stand-in on host without hardware or UIO device /dev/uioN) and
+ * maps the stand-in of the replay directory in replay mode.
+ * Buffer words of the register runs below, the runs are executed
+ * by mem_address_xfer().
+ */
+enum {
+	Z3PMDRV1_XFER_BUF_PWM1 = 0,
+	Z3PMDRV1_XFER_BUF_PWM2,
+	Z3PMDRV1_XFER_BUF_PWM3,
+	Z3PMDRV1_XFER_BUF_IRC_POS,
+	Z3PMDRV1_XFER_BUF_IRC_IDX_POS,
+	Z3PMDRV1_XFER_BUF_ADC_SQN_STAT,
+	Z3PMDRV1_XFER_BUF_ADC1,
+	Z3PMDRV1_XFER_BUF_ADC2,
+	Z3PMDRV1_XFER_BUF_ADC3,
+	Z3PMDRV1_XFER_BUF_NUM
+};
 
-char *memdev="/dev/mem";
+/*
+ * PWM1..3 writes followed by IRC (0x08-0x0C) and ADC (0x20-0x2C) reads,
+ * the PWM writes go through the map shadow and the ones equal to the
+ * last written values are skipped
+ */
+static const mem_address_xfer_t z3pmdrv1_transfer_xfer[] = {
+	MEM_ADDRESS_XFER(WRS, Z3PMDRV1_PWM1_OFFS, 3, Z3PMDRV1_XFER_BUF_PWM1),
+	MEM_ADDRESS_XFER(RD, Z3PMDRV1_IRC_POS_OFFS, 2, Z3PMDRV1_XFER_BUF_IRC_POS),
+	MEM_ADDRESS_XFER(RD, Z3PMDRV1_ADC_SQN_STAT_OFFS, 4, Z3PMDRV1_XFER_BUF_ADC_SQN_STAT),
+};
+
+/* ADC and IRC index state read at initialization */
+static const mem_address_xfer_t z3pmdrv1_meas_xfer[] = {
+	MEM_ADDRESS_XFER(RD, Z3PMDRV1_IRC_POS_OFFS, 2, Z3PMDRV1_XFER_BUF_IRC_POS),
+	MEM_ADDRESS_XFER(RD, Z3PMDRV1_ADC_SQN_STAT_OFFS, 4, Z3PMDRV1_XFER_BUF_ADC_SQN_STAT),
+};
 
+/*
+ * Register words the transfer would read, from the replayed trace.
+ * Returns -1 at the trace end, the last values are repeated then.
+ */
 static inline
-uint32_t z3pmdrv1_reg_rd(z3pmdrv1_state_t *z3pmcst, unsigned reg_offs)
+int z3pmdrv1_replay_rd(z3pmdrv1_state_t *z3pmcst, uint32_t *buf, int peek)
 {
-	return *(volatile uint32_t*)((char*)z3pmcst->regs_base_virt + reg_offs);
+	int32_t val[Z3PMDRV1_REPLAY_CHAN_COUNT];
+	int res;
+
+	res = peek? mzapo_replay_peek(z3pmcst->replay, val):
+		    mzapo_replay_next(z3pmcst->replay, val);
+
+	buf[Z3PMDRV1_XFER_BUF_IRC_POS] = val[Z3PMDRV1_REPLAY_IRC_POS];
+	buf[Z3PMDRV1_XFER_BUF_IRC_IDX_POS] = val[Z3PMDRV1_REPLAY_IRC_IDX];
+	buf[Z3PMDRV1_XFER_BUF_ADC_SQN_STAT] =
+		Z3PMDRV1_ADC_SQN_STAT_SQN_val(val[Z3PMDRV1_REPLAY_ADC_SQN]) |
+		Z3PMDRV1_ADC_SQN_STAT_HAL_val(val[Z3PMDRV1_REPLAY_HALL]);
+	buf[Z3PMDRV1_XFER_BUF_ADC1] = val[Z3PMDRV1_REPLAY_ADC1];
+	buf[Z3PMDRV1_XFER_BUF_ADC2] = val[Z3PMDRV1_REPLAY_ADC2];
+	buf[Z3PMDRV1_XFER_BUF_ADC3] = val[Z3PMDRV1_REPLAY_ADC3];
+
+	return res;
 }
 
+/*
+ * Block PWM word to register value, the EN and SHDN bits are constants
+ * packed at compile time, the value saturates to the field width.
+ */
 static inline
-void z3pmdrv1_reg_wr(z3pmdrv1_state_t *z3pmcst, unsigned reg_offs, uint32_t val)
+uint32_t z3pmdrv1_pwm_reg(uint32_t pwm)
 {
-	*(volatile uint32_t*)((char*)z3pmcst->regs_base_virt + reg_offs) = val;
+	uint32_t val = pwm & Z3PMDRV1_PWM_VALUE_m;
+
+	if (val > Z3PMDRV1_REG_PWMX_VAL_m)
+		val = Z3PMDRV1_REG_PWMX_VAL_m;
+
+	return val |
+	       ((pwm & Z3PMDRV1_PWM_ENABLE)?
+		MZAPO_REGMAP_VAL(Z3PMDRV1_PWM1_EN, 1): 0) |
+	       ((pwm & Z3PMDRV1_PWM_SHUTDOWN)?
+		MZAPO_REGMAP_VAL(Z3PMDRV1_PWM1_SHDN, 1): 0);
 }
 
 int z3pmdrv1_transfer(z3pmdrv1_state_t *z3pmcst)
 {
+	uint32_t buf[Z3PMDRV1_XFER_BUF_NUM];
 	uint32_t sqn_stat;
-	uint32_t pwm1, pwm2, pwm3;
-	uint32_t pwm1_fl = 0;
-	uint32_t pwm2_fl = 0;
-	uint32_t pwm3_fl = 0;
 	uint32_t idx;
+	int ret = 0;
+
+	mem_address_map_prof_step(z3pmcst->memadrs);
+	mem_address_map_shadow_step(z3pmcst->memadrs);
+
+	buf[Z3PMDRV1_XFER_BUF_PWM1] = z3pmdrv1_pwm_reg(z3pmcst->pwm[0]);
+	buf[Z3PMDRV1_XFER_BUF_PWM2] = z3pmdrv1_pwm_reg(z3pmcst->pwm[1]);
+	buf[Z3PMDRV1_XFER_BUF_PWM3] = z3pmdrv1_pwm_reg(z3pmcst->pwm[2]);
+
+	if (z3pmcst->replay != NULL) {
+		/* Only the PWM run, the measurements come from the trace */
+		mem_address_xfer(z3pmcst->memadrs, z3pmdrv1_transfer_xfer, 1, buf);
+		ret = z3pmdrv1_replay_rd(z3pmcst, buf, 0);
+	} else {
+		mem_address_xfer(z3pmcst->memadrs, z3pmdrv1_transfer_xfer,
+			sizeof(z3pmdrv1_transfer_xfer) / sizeof(*z3pmdrv1_transfer_xfer),
+			buf);
+	}
+	z3pmcst->pwm_elided = mem_address_map_shadow_elided(z3pmcst->memadrs);
 
-	pwm1 = z3pmcst->pwm[0];
-	pwm2 = z3pmcst->pwm[1];
-	pwm3 = z3pmcst->pwm[2];
-
-	if (pwm1 & Z3PMDRV1_PWM_ENABLE)
-	  pwm1_fl |= Z3PMDRV1_REG_PWMX_EN_m;
-	if (pwm1 & Z3PMDRV1_PWM_SHUTDOWN)
-	  pwm1_fl |= Z3PMDRV1_REG_PWMX_SHDN_m;
-	if (pwm2 & Z3PMDRV1_PWM_ENABLE)
-	  pwm2_fl |= Z3PMDRV1_REG_PWMX_EN_m;
-	if (pwm2 & Z3PMDRV1_PWM_SHUTDOWN)
-	  pwm2_fl |= Z3PMDRV1_REG_PWMX_SHDN_m;
-	if (pwm3 & Z3PMDRV1_PWM_ENABLE)
-	  pwm3_fl |= Z3PMDRV1_REG_PWMX_EN_m;
-	if (pwm3 & Z3PMDRV1_PWM_SHUTDOWN)
-	  pwm3_fl |= Z3PMDRV1_REG_PWMX_SHDN_m;
-
-	pwm1 &= Z3PMDRV1_PWM_VALUE_m;
-	pwm2 &= Z3PMDRV1_PWM_VALUE_m;
-	pwm3 &= Z3PMDRV1_PWM_VALUE_m;
-
-	if (pwm1 > Z3PMDRV1_REG_PWMX_VAL_m)
-		pwm1 = Z3PMDRV1_REG_PWMX_VAL_m;
-	if (pwm2 > Z3PMDRV1_REG_PWMX_VAL_m)
-		pwm2 = Z3PMDRV1_REG_PWMX_VAL_m;
-	if (pwm3 > Z3PMDRV1_REG_PWMX_VAL_m)
-		pwm3 = Z3PMDRV1_REG_PWMX_VAL_m;
-
-	z3pmdrv1_reg_wr(z3pmcst, Z3PMDRV1_REG_PWM1_o, pwm1 | pwm1_fl);
-	z3pmdrv1_reg_wr(z3pmcst, Z3PMDRV1_REG_PWM2_o, pwm2 | pwm2_fl);
-	z3pmdrv1_reg_wr(z3pmcst, Z3PMDRV1_REG_PWM3_o, pwm3 | pwm3_fl);
-
-	z3pmcst->act_pos = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_IRC_POS_o);
-	idx = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_IRC_IDX_POS_o);
+	z3pmcst->act_pos = buf[Z3PMDRV1_XFER_BUF_IRC_POS];
+	idx = buf[Z3PMDRV1_XFER_BUF_IRC_IDX_POS];
 
 	if (idx ^ z3pmcst->index_pos) {
 		z3pmcst->index_occur += 1;
 	}
 	z3pmcst->index_pos = idx;
 
-	sqn_stat = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC_SQN_STAT_o);
-	z3pmcst->curadc_sqn = sqn_stat & Z3PMDRV1_REG_ADSQST_SQN_m;
+	sqn_stat = buf[Z3PMDRV1_XFER_BUF_ADC_SQN_STAT];
+	z3pmcst->curadc_sqn = Z3PMDRV1_ADC_SQN_STAT_SQN_get(sqn_stat);
 
-	z3pmcst->curadc_cumsum[0] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC1_o);
+	z3pmcst->curadc_cumsum[0] = buf[Z3PMDRV1_XFER_BUF_ADC1];
 
-	z3pmcst->curadc_cumsum[1] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC2_o);
+	z3pmcst->curadc_cumsum[1] = buf[Z3PMDRV1_XFER_BUF_ADC2];
 
-	z3pmcst->curadc_cumsum[2] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC3_o);
+	z3pmcst->curadc_cumsum[2] = buf[Z3PMDRV1_XFER_BUF_ADC3];
 
-	z3pmcst->hal_sensors =
-		((sqn_stat & Z3PMDRV1_REG_ADSQST_HAL1_m)?1:0) |
-		((sqn_stat & Z3PMDRV1_REG_ADSQST_HAL2_m)?2:0) |
-		((sqn_stat & Z3PMDRV1_REG_ADSQST_HAL3_m)?4:0);
+	z3pmcst->hal_sensors = Z3PMDRV1_ADC_SQN_STAT_HAL_get(sqn_stat);
 
-	return 0;
+	return ret;
 }
 
 
-/*
- * The support function which returns pointer to the virtual
- * address at which starts remapped physical region in the
- * process virtual memory space.
- */
-static inline
-void *map_phys_address(off_t region_base, size_t region_size, int opt_cached)
-{
-	unsigned long mem_window_size;
-	unsigned long pagesize;
-	unsigned char *mm;
-	unsigned char *mem;
-	int fd;
-
-	/*
-	 * Open a device ("/dev/mem") representing physical address space
-	 * in POSIX systems
-	 */
-	fd = open(memdev, O_RDWR | (!opt_cached? O_SYNC: 0));
-	if (fd < 0) {
-		fprintf(stderr, "cannot open %s\n", memdev);
-		return NULL;
-	}
-
-	/*
-	 * The virtual to physical address mapping translation granularity
-	 * corresponds to memory page size. This call obtains the page
-	 * size used by running operating system at given CPU architecture.
-	 * 4kB are used by Linux running on ARM, ARM64, x86 and x86_64 systems.
-	 */
-	pagesize=sysconf(_SC_PAGESIZE);
-
-	/*
-	 * Extend physical region start address and size to page size boundaries
-	 * to cover complete requested region.
-	 */
-	mem_window_size = ((region_base & (pagesize-1)) +
-			  region_size + pagesize-1) & ~(pagesize-1);
-
-	/*
-	 * Map file (in our case physical memory) range at specified offset
-	 * to virtual memory ragion/area (see VMA Linux kernel structures)
-	 * of the process.
-	 */
-	mm = mmap(NULL, mem_window_size, PROT_WRITE|PROT_READ,
-		MAP_SHARED, fd, region_base & ~(pagesize-1));
-
-	/* Report failure if the mmap is not allowed for given file or its region */
-	if (mm == MAP_FAILED) {
-		return NULL;
-	}
-
-	/*
-	 * Add offset in the page to the returned pointer for non-page-aligned
-	 * requests.
-	 */
-	mem = mm + (region_base & (pagesize-1));
-
-	return mem;
-}
-
 int z3pmdrv1_init(z3pmdrv1_state_t *z3pmcst)
 {
 	int ret = 0;
+	uint32_t buf[Z3PMDRV1_XFER_BUF_NUM];
 	uint32_t sqn_stat;
 
 	if (z3pmcst->regs_base_phys == 0) {
-		z3pmcst->regs_base_phys = Z3PMDRV1_REG_BASE_PHYS;
+		z3pmcst->regs_base_phys = Z3PMDRV1_BASE_PHYS;
 	}
 
-	z3pmcst->regs_base_virt = map_phys_address(z3pmcst->regs_base_phys,
-					Z3PMDRV1_REG_SIZE, 0);
+	z3pmcst->memadrs = mem_address_map_create(z3pmcst->regs_base_phys,
+					Z3PMDRV1_SIZE, 0);
 
-	if (z3pmcst->regs_base_virt == NULL) {
+	if (z3pmcst->memadrs == NULL) {
 		ret = -1;
 		return ret;
 	}
 
-	sqn_stat = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC_SQN_STAT_o);
-	z3pmcst->curadc_sqn = sqn_stat & Z3PMDRV1_REG_ADSQST_SQN_m;
+	mem_address_map_prof_name(z3pmcst->memadrs, "z3pmdrv1");
+
+	/* Replay starts from the state of the first record */
+	if (z3pmcst->replay != NULL)
+		z3pmdrv1_replay_rd(z3pmcst, buf, 1);
+	else
+		mem_address_xfer(z3pmcst->memadrs, z3pmdrv1_meas_xfer,
+			sizeof(z3pmdrv1_meas_xfer) / sizeof(*z3pmdrv1_meas_xfer),
+			buf);
+
+	sqn_stat = buf[Z3PMDRV1_XFER_BUF_ADC_SQN_STAT];
+	z3pmcst->curadc_sqn = Z3PMDRV1_ADC_SQN_STAT_SQN_get(sqn_stat);
 	z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
 
-	z3pmcst->curadc_cumsum[0] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC1_o);
+	z3pmcst->curadc_cumsum[0] = buf[Z3PMDRV1_XFER_BUF_ADC1];
+
+	z3pmcst->curadc_cumsum[1] = buf[Z3PMDRV1_XFER_BUF_ADC2];
 
-	z3pmcst->curadc_cumsum[1] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC2_o);
+	z3pmcst->curadc_cumsum[2] = buf[Z3PMDRV1_XFER_BUF_ADC3];
 
-	z3pmcst->curadc_cumsum[2] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC3_o);
+	z3pmcst->index_pos = buf[Z3PMDRV1_XFER_BUF_IRC_IDX_POS];
 
-	z3pmcst->index_pos = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_IRC_IDX_POS_o);
+	/* Optional PWM period interrupt selected by MZAPO_IRQDEV, replay runs free */
+	z3pmcst->irq = z3pmcst->replay == NULL?
+		       mzapo_irq_open(NULL, Z3PMDRV1_PWM_PERIOD_NS): NULL;
 
 	return ret;
 }
+
+/*
+ * Block until the next PWM period interrupt, so the following
+ * transfer is aligned to the PWM period. Returns number of periods
+ * since the previous wait, 0 when no interrupt source is configured
+ * (the step runs directly) and -1 on error, errno is ETIMEDOUT when
+ * the interrupt has not fired for MZAPO_IRQ_TIMEOUT_PERIODS periods.
+ */
+int z3pmdrv1_wait_period(z3pmdrv1_state_t *z3pmcst)
+{
+	if (z3pmcst->irq == NULL)
+		return 0;
+
+	return mzapo_irq_wait(z3pmcst->irq);
+}
+
+void z3pmdrv1_pwm_refresh(z3pmdrv1_state_t *z3pmcst)
+{
+	mzapo_regshadow_invalidate(&z3pmcst->memadrs->shadow);
+}
+
+void z3pmdrv1_pwm_shutdown(z3pmdrv1_state_t *z3pmcst)
+{
+	int i;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->pwm[i] = 0 | Z3PMDRV1_PWM_SHUTDOWN;
+	z3pmdrv1_pwm_refresh(z3pmcst);
+	z3pmdrv1_transfer(z3pmcst);
+}
+
+void z3pmdrv1_release(z3pmdrv1_state_t *z3pmcst)
+{
+	mzapo_irq_close(z3pmcst->irq);
+	z3pmcst->irq = NULL;
+	mem_address_unmap_and_free(z3pmcst->memadrs);
+	z3pmcst->memadrs = NULL;
+}
+
+void z3pmdrv1_ident(z3pmdrv1_state_t *z3pmcst, char *ident)
+{
+	/* Calibration of the board the replayed trace comes from */
+	if ((z3pmcst->replay != NULL) && *mzapo_replay_ident(z3pmcst->replay)) {
+		snprintf(ident, MZAPO_CALCACHE_IDENT_LEN, "%s",
+			 mzapo_replay_ident(z3pmcst->replay));
+		return;
+	}
+	mzapo_calcache_ident(ident, z3pmcst->regs_base_phys,
+			     mem_address_memdev());
+}
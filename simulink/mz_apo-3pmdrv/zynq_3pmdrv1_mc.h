@@ -3,31 +3,131 @@
 
 #include <stdint.h>
 
+#include "../common/mzapo_sdm.h"
+
 #define Z3PMDRV1_CHAN_COUNT    3
 
 #define Z3PMDRV1_PWM_VALUE_m   0x0ffff
 #define Z3PMDRV1_PWM_ENABLE    0x10000
 #define Z3PMDRV1_PWM_SHUTDOWN  0x20000
 
+/* PWM counts corresponding to duty cycle 1 */
+#define Z3PMDRV1_PWM_DUTY_FULL 5000
+
+/* PWM period, the counter runs at 100 MHz */
+#define Z3PMDRV1_PWM_PERIOD_NS (Z3PMDRV1_PWM_DUTY_FULL * 10)
+
+struct mzapo_irq_t;
+struct mem_address_map_t;
+struct mzapo_replay_t;
+struct z3pmdrv1_dtc_t;
+struct z3pmdrv1_commis_t;
+
+#define Z3PMDRV1_CACHE_LINE    64
+
+/*
+ * Driver state split by access pattern, the member names are the same
+ * as in the original flat layout, so the users are not affected.
+ *
+ * Three cache lines, the first one is written by each transfer, the
+ * second one by the control step. The third one holds configuration
+ * written at start and only read during the run, so it stays clean
+ * and can be shared with other threads (view, telemetry) without
+ * ping-pong. The PWM write shadow lives in the register map handle.
+ * Members used only at start fill the spare room and are not accessed
+ * during the run, the last one spills over the third line. The state
+ * has to be allocated cache line aligned (mzapo_rtmem_alloc).
+ */
 typedef struct z3pmdrv1_state_t {
-  uintptr_t regs_base_phys;
-  void     *regs_base_virt;
-  uint32_t pwm[Z3PMDRV1_CHAN_COUNT];
-  uint32_t act_pos;
-  uint32_t index_pos;
-  uint32_t index_occur;
-  uint32_t pos_offset;
-  int32_t  curadc_val[Z3PMDRV1_CHAN_COUNT];
-  int32_t  curadc_offs[Z3PMDRV1_CHAN_COUNT];
-  uint8_t  hal_sensors;
-  uint16_t curadc_sqn;
-  uint16_t curadc_sqn_last;
-  uint32_t curadc_cumsum[Z3PMDRV1_CHAN_COUNT];
-  uint32_t curadc_cumsum_last[Z3PMDRV1_CHAN_COUNT];
+  /* Hot, transfer inputs and outputs */
+  struct {
+    uint32_t pwm[Z3PMDRV1_CHAN_COUNT];
+    uint32_t act_pos;
+    uint32_t index_pos;
+    uint32_t index_occur;
+    uint32_t curadc_cumsum[Z3PMDRV1_CHAN_COUNT];
+    uint32_t curadc_cumsum_last[Z3PMDRV1_CHAN_COUNT];
+    uint16_t curadc_sqn;
+    uint16_t curadc_sqn_last;
+    uint8_t  hal_sensors;
+    uint8_t  pwm_elided;        /* PWM writes skipped by the last transfer */
+    uintptr_t regs_base_phys;   /* start only */
+  } __attribute__((aligned(Z3PMDRV1_CACHE_LINE)));
+  /* Hot, control step */
+  struct {
+    int32_t  curadc_val[Z3PMDRV1_CHAN_COUNT];
+    mzapo_sdm_t pwm_sdm[Z3PMDRV1_CHAN_COUNT]; /* duty dither, order 0 truncates */
+  } __attribute__((aligned(Z3PMDRV1_CACHE_LINE)));
+  /* Read-mostly configuration */
+  struct {
+    struct mem_address_map_t *memadrs; /* registers, shared mapping */
+    int32_t  curadc_offs[Z3PMDRV1_CHAN_COUNT];
+    uint32_t pos_offset;
+    struct z3pmdrv1_dtc_t *dtc; /* dead-time compensation, NULL if not used */
+    struct z3pmdrv1_commis_t *commis; /* commutation commissioning, NULL if not used */
+    struct mzapo_irq_t *irq;  /* PWM period interrupt, NULL if not used */
+    struct mzapo_replay_t *replay; /* sensor trace replayed instead of registers, NULL if not used */
+    int32_t  curadc_offs_cal[Z3PMDRV1_CHAN_COUNT]; /* calibrated, 0 if not used, start only */
+  } __attribute__((aligned(Z3PMDRV1_CACHE_LINE)));
 } z3pmdrv1_state_t;
 
+/*
+ * Channels of the replayed trace in the order z3pmdrv1_transfer takes
+ * them, the raw values of the IRC, index and ADC registers
+ */
+enum {
+	Z3PMDRV1_REPLAY_IRC_POS,
+	Z3PMDRV1_REPLAY_IRC_IDX,
+	Z3PMDRV1_REPLAY_HALL,
+	Z3PMDRV1_REPLAY_ADC_SQN,
+	Z3PMDRV1_REPLAY_ADC1,
+	Z3PMDRV1_REPLAY_ADC2,
+	Z3PMDRV1_REPLAY_ADC3,
+	Z3PMDRV1_REPLAY_CHAN_COUNT
+};
+
+/* The replay is set by the caller before init, NULL for the hardware */
 int z3pmdrv1_init(z3pmdrv1_state_t *z3pmcst);
 
+/*
+ * Convert duty cycle 0..1 of the channel to pwm[] value, disabled
+ * channel is shut down. The dither stage of the channel carries
+ * the sub-count residual to the following steps.
+ */
+static inline
+uint32_t z3pmdrv1_pwm_duty(z3pmdrv1_state_t *z3pmcst, int chan, float duty, int en)
+{
+	mzapo_sdm_t *sdm = &z3pmcst->pwm_sdm[chan];
+
+	if (!en) {
+		mzapo_sdm_reset(sdm);
+		return 0 | Z3PMDRV1_PWM_SHUTDOWN;
+	}
+	return (uint32_t)mzapo_sdm_quantize(sdm, duty * Z3PMDRV1_PWM_DUTY_FULL,
+				0, Z3PMDRV1_PWM_DUTY_FULL) | Z3PMDRV1_PWM_ENABLE;
+}
+
+/*
+ * Write changed PWM registers and read the measurements. The PWM
+ * writes equal to the last written values are skipped by the shadow
+ * of the register map, their count is left in pwm_elided. In replay
+ * the measurements are taken from the next trace record, -1 is
+ * returned when the trace has ended.
+ */
 int z3pmdrv1_transfer(z3pmdrv1_state_t *z3pmcst);
 
+/* Make the next transfer write all PWM registers (final shutdown) */
+void z3pmdrv1_pwm_refresh(z3pmdrv1_state_t *z3pmcst);
+
+/* Put all phases into shutdown, written regardless of the shadow */
+void z3pmdrv1_pwm_shutdown(z3pmdrv1_state_t *z3pmcst);
+
+int z3pmdrv1_wait_period(z3pmdrv1_state_t *z3pmcst);
+
+void z3pmdrv1_release(z3pmdrv1_state_t *z3pmcst);
+
+/* Identity of the board and driver instance for calibration cache,
+ * ident has to hold MZAPO_CALCACHE_IDENT_LEN characters */
+void z3pmdrv1_ident(z3pmdrv1_state_t *z3pmcst, char *ident);
+
 #endif /*_ZYNQ_3PMDRV1_MC_H*/
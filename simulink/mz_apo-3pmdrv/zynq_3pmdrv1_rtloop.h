@@ -0,0 +1,387 @@
+/*
+  Inner current loop thread of the 3-phase motor driver.
+
+  When enabled, the register transfer and the current control run
+  in dedicated SCHED_FIFO thread pinned to selected CPU at rate
+  independent of the Simulink step. The block exchanges data with
+  the thread only through two lock-free triple buffers
+
+    command     - block to thread, PWM duty or id/iq references,
+                  phase enables and ADC offsets
+    measurement - thread to block, raw IRC, Hall and cumulative ADC
+                  values of the last transfer
+
+  Measurements carry the FPGA cumulative sums, so the block computes
+  its current averages over its own (longer) period the same way as
+  when it accesses the hardware directly, decimation is implicit.
+  Each side always sees the most recent complete record and never
+  waits for the other one.
+
+  When the PWM period interrupt is configured (MZAPO_IRQDEV), the
+  thread waits for it instead of the timer, so each inner step is
+  aligned to the PWM period and the period_s only enables the loop.
+  Interrupts missed while the step runs are counted as overruns,
+  the block publishes the count in its telemetry. When the wait
+  fails or times out, the thread shuts the bridge down and ends, the
+  error is kept for the block, which stops the simulation with it.
+
+  The process memory is locked by mzapo_rtmem_prepare() of the block
+  before the thread starts and the loop state is taken from the
+  ../common/mzapo_rtmem.h arena.
+  When real-time priority or CPU affinity cannot be set (host without
+  privileges), the thread runs with default policy and warning is
+  printed.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_RTLOOP_H
+#define _ZYNQ_3PMDRV1_RTLOOP_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_adcavg.h"
+#include "zynq_3pmdrv1_foc.h"
+#include "zynq_3pmdrv1_dtc.h"
+#include "zynq_3pmdrv1_commis.h"
+#include "../common/mzapo_rtmem.h"
+
+#define Z3PMDRV1_RTLOOP_TBUF_NEW   4
+
+/*
+ * Triple buffer index word. The shared word holds index of the slot
+ * most recently published and flag that it has not been fetched yet.
+ * The writer and reader own one slot each, exchange swaps the owned
+ * slot with the shared one.
+ */
+typedef struct z3pmdrv1_tbuf_t {
+  uint32_t shared;
+  uint32_t wr __attribute__((aligned(64)));
+  uint32_t rd __attribute__((aligned(64)));
+} z3pmdrv1_tbuf_t;
+
+static inline
+void z3pmdrv1_tbuf_init(z3pmdrv1_tbuf_t *tb)
+{
+	tb->shared = 1;
+	tb->wr = 0;
+	tb->rd = 2;
+}
+
+/* Publish the slot tb->wr and get another one for next write */
+static inline
+void z3pmdrv1_tbuf_publish(z3pmdrv1_tbuf_t *tb)
+{
+	uint32_t prev;
+
+	prev = __atomic_exchange_n(&tb->shared, tb->wr | Z3PMDRV1_RTLOOP_TBUF_NEW,
+				   __ATOMIC_ACQ_REL);
+	tb->wr = prev & 3;
+}
+
+/* Make the most recent slot available in tb->rd, returns 1 if it is new */
+static inline
+int z3pmdrv1_tbuf_fetch(z3pmdrv1_tbuf_t *tb)
+{
+	uint32_t prev;
+
+	if (!(__atomic_load_n(&tb->shared, __ATOMIC_RELAXED) &
+	      Z3PMDRV1_RTLOOP_TBUF_NEW))
+		return 0;
+	prev = __atomic_exchange_n(&tb->shared, tb->rd, __ATOMIC_ACQ_REL);
+	tb->rd = prev & 3;
+	return 1;
+}
+
+/*
+ * Each published record occupies its own cache line(s), so the slot
+ * written by one side never shares a line with the slot read by the
+ * other one.
+ */
+typedef struct z3pmdrv1_rtloop_cmd_t {
+  float    val[Z3PMDRV1_CHAN_COUNT];   /* duty 0..1 or id_ref, iq_ref */
+  uint8_t  en[Z3PMDRV1_CHAN_COUNT];
+  int32_t  curadc_offs[Z3PMDRV1_CHAN_COUNT];
+} __attribute__((aligned(Z3PMDRV1_CACHE_LINE))) z3pmdrv1_rtloop_cmd_t;
+
+typedef struct z3pmdrv1_rtloop_meas_t {
+  uint32_t act_pos;
+  uint32_t index_pos;
+  uint32_t index_occur;
+  uint32_t curadc_cumsum[Z3PMDRV1_CHAN_COUNT];
+  uint16_t curadc_sqn;
+  uint8_t  hal_sensors;
+  uint32_t steps;
+} __attribute__((aligned(Z3PMDRV1_CACHE_LINE))) z3pmdrv1_rtloop_meas_t;
+
+typedef struct z3pmdrv1_rtloop_t {
+  /* Owned by the thread after start */
+  z3pmdrv1_state_t hw;
+  z3pmdrv1_foc_t  *foc;
+  z3pmdrv1_rtloop_cmd_t cmd;
+  uint32_t steps;
+  uint32_t overruns;        /* written by the thread, read atomically */
+  int      error;           /* errno of the failed interrupt wait, 0 if none */
+  /* Configuration */
+  long     period_ns;
+  int      priority;
+  int      cpu;
+  /* Exchange */
+  z3pmdrv1_tbuf_t cmd_tb;
+  z3pmdrv1_rtloop_cmd_t cmd_slot[3];
+  z3pmdrv1_tbuf_t meas_tb;
+  z3pmdrv1_rtloop_meas_t meas_slot[3];
+  int      stop;
+  int      running;
+  pthread_t thread;
+} z3pmdrv1_rtloop_t;
+
+/* One inner loop period: control from previous measurement, transfer, publish */
+static inline
+void z3pmdrv1_rtloop_step(z3pmdrv1_rtloop_t *rtl)
+{
+	z3pmdrv1_state_t *hw = &rtl->hw;
+	z3pmdrv1_rtloop_meas_t *meas;
+	int i;
+
+	if (z3pmdrv1_tbuf_fetch(&rtl->cmd_tb))
+		rtl->cmd = rtl->cmd_slot[rtl->cmd_tb.rd];
+
+	if ((rtl->foc != NULL) || (hw->dtc != NULL))
+		z3pmdrv1_adcavg_q16(hw->curadc_cumsum, hw->curadc_cumsum_last,
+				    rtl->cmd.curadc_offs, hw->curadc_sqn,
+				    hw->curadc_sqn_last, hw->curadc_val);
+	if (rtl->foc != NULL) {
+		if (hw->commis != NULL)
+			z3pmdrv1_commis_track(hw->commis, rtl->foc, hw);
+		if (rtl->cmd.en[0] && rtl->cmd.en[1] && rtl->cmd.en[2])
+			z3pmdrv1_foc_step(rtl->foc, hw->curadc_val, hw->act_pos,
+					  rtl->cmd.val[0], rtl->cmd.val[1]);
+		else
+			z3pmdrv1_foc_reset(rtl->foc);
+	}
+	hw->curadc_sqn_last = hw->curadc_sqn;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		hw->curadc_cumsum_last[i] = hw->curadc_cumsum[i];
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		hw->pwm[i] = z3pmdrv1_pwm_duty(hw, i, z3pmdrv1_dtc_apply(hw->dtc,
+				hw->curadc_val, i, rtl->foc != NULL?
+				rtl->foc->duty[i]: rtl->cmd.val[i]), rtl->cmd.en[i]);
+
+	z3pmdrv1_transfer(hw);
+
+	meas = &rtl->meas_slot[rtl->meas_tb.wr];
+	meas->act_pos = hw->act_pos;
+	meas->index_pos = hw->index_pos;
+	meas->index_occur = hw->index_occur;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		meas->curadc_cumsum[i] = hw->curadc_cumsum[i];
+	meas->curadc_sqn = hw->curadc_sqn;
+	meas->hal_sensors = hw->hal_sensors;
+	__atomic_store_n(&rtl->steps, rtl->steps + 1, __ATOMIC_RELAXED);
+	meas->steps = rtl->steps;
+	z3pmdrv1_tbuf_publish(&rtl->meas_tb);
+}
+
+static inline
+void *z3pmdrv1_rtloop_thread(void *arg)
+{
+	z3pmdrv1_rtloop_t *rtl = (z3pmdrv1_rtloop_t *)arg;
+	struct timespec next, now;
+	int64_t late_ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (!__atomic_load_n(&rtl->stop, __ATOMIC_ACQUIRE)) {
+		if (rtl->hw.irq != NULL) {
+			int n = z3pmdrv1_wait_period(&rtl->hw);
+
+			if ((n < 0) && (errno == EINTR))
+				continue;
+			if (n < 0) {
+				__atomic_store_n(&rtl->error, errno? errno: EIO,
+						 __ATOMIC_RELEASE);
+				break;
+			}
+			if (n > 1)
+				__atomic_store_n(&rtl->overruns,
+						 rtl->overruns + n - 1, __ATOMIC_RELAXED);
+			z3pmdrv1_rtloop_step(rtl);
+			continue;
+		}
+
+		next.tv_nsec += rtl->period_ns;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &next, NULL) == EINTR);
+
+		z3pmdrv1_rtloop_step(rtl);
+
+		/* Skip missed periods instead of bursting to catch up */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late_ns = (int64_t)(now.tv_sec - next.tv_sec) * 1000000000LL +
+			  (now.tv_nsec - next.tv_nsec);
+		if (late_ns > rtl->period_ns) {
+			__atomic_store_n(&rtl->overruns, rtl->overruns + 1,
+					 __ATOMIC_RELAXED);
+			next = now;
+		}
+	}
+
+	/* Leave the bridge in shutdown */
+	z3pmdrv1_pwm_shutdown(&rtl->hw);
+
+	return NULL;
+}
+
+/*
+ * Start the inner loop. The hardware state initialized by the caller
+ * is copied into the loop and the caller's copy is thereafter used only
+ * as view updated by z3pmdrv1_rtloop_meas_get. The foc can be NULL
+ * for direct PWM duty commands, it is owned by the thread while it runs.
+ * The cpu < 0 leaves affinity unchanged.
+ */
+static inline
+z3pmdrv1_rtloop_t *z3pmdrv1_rtloop_start(const z3pmdrv1_state_t *z3pmcst,
+		z3pmdrv1_foc_t *foc, double period_s, int priority, int cpu)
+{
+	z3pmdrv1_rtloop_t *rtl;
+	struct sched_param schp;
+	pthread_attr_t attr;
+	int i, res;
+
+	if (period_s <= 0)
+		return NULL;
+
+	rtl = mzapo_rtmem_alloc(sizeof(*rtl));
+	if (rtl == NULL)
+		return NULL;
+
+	rtl->hw = *z3pmcst;
+	rtl->foc = foc;
+	rtl->period_ns = period_s * 1e9;
+	rtl->priority = priority;
+	rtl->cpu = cpu;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		rtl->cmd.curadc_offs[i] = z3pmcst->curadc_offs[i];
+	z3pmdrv1_tbuf_init(&rtl->cmd_tb);
+	z3pmdrv1_tbuf_init(&rtl->meas_tb);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	schp.sched_priority = priority;
+	pthread_attr_setschedparam(&attr, &schp);
+	if (cpu >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+	}
+
+	res = pthread_create(&rtl->thread, &attr, z3pmdrv1_rtloop_thread, rtl);
+	if (res == EPERM) {
+		fprintf(stderr, "z3pmdrv1_rtloop: SCHED_FIFO or affinity not permitted,"
+			" running with default policy\n");
+		pthread_attr_destroy(&attr);
+		pthread_attr_init(&attr);
+		res = pthread_create(&rtl->thread, &attr, z3pmdrv1_rtloop_thread, rtl);
+	}
+	pthread_attr_destroy(&attr);
+
+	if (res != 0) {
+		mzapo_rtmem_free(rtl);
+		return NULL;
+	}
+	rtl->running = 1;
+
+	return rtl;
+}
+
+static inline
+void z3pmdrv1_rtloop_stop(z3pmdrv1_rtloop_t *rtl)
+{
+	if (rtl == NULL)
+		return;
+	if (rtl->running) {
+		__atomic_store_n(&rtl->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(rtl->thread, NULL);
+		rtl->running = 0;
+	}
+	mzapo_rtmem_free(rtl);
+}
+
+/* Block side, pass command for the following inner loop periods */
+static inline
+void z3pmdrv1_rtloop_cmd_put(z3pmdrv1_rtloop_t *rtl, const float *val,
+		const uint8_t *en, const int32_t *curadc_offs)
+{
+	z3pmdrv1_rtloop_cmd_t *cmd = &rtl->cmd_slot[rtl->cmd_tb.wr];
+	int i;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+		cmd->val[i] = val[i];
+		cmd->en[i] = en[i];
+		cmd->curadc_offs[i] = curadc_offs[i];
+	}
+	z3pmdrv1_tbuf_publish(&rtl->cmd_tb);
+}
+
+/*
+ * Block side, update the view by the most recent measurement.
+ * Returns inner loop step counter of the record or 0 when no new
+ * record has been published since the previous call.
+ */
+static inline
+uint32_t z3pmdrv1_rtloop_meas_get(z3pmdrv1_rtloop_t *rtl, z3pmdrv1_state_t *view)
+{
+	const z3pmdrv1_rtloop_meas_t *meas;
+	int i;
+
+	if (!z3pmdrv1_tbuf_fetch(&rtl->meas_tb))
+		return 0;
+	meas = &rtl->meas_slot[rtl->meas_tb.rd];
+
+	view->act_pos = meas->act_pos;
+	view->index_pos = meas->index_pos;
+	view->index_occur = meas->index_occur;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		view->curadc_cumsum[i] = meas->curadc_cumsum[i];
+	view->curadc_sqn = meas->curadc_sqn;
+	view->hal_sensors = meas->hal_sensors;
+
+	return meas->steps;
+}
+
+/* Block side, nonzero errno when the thread has ended on its own */
+static inline
+int z3pmdrv1_rtloop_error(const z3pmdrv1_rtloop_t *rtl)
+{
+	return __atomic_load_n(&rtl->error, __ATOMIC_ACQUIRE);
+}
+
+/* Block side, inner loop steps and overruns since start */
+static inline
+void z3pmdrv1_rtloop_counts(const z3pmdrv1_rtloop_t *rtl, uint32_t *steps,
+		uint32_t *overruns)
+{
+	*steps = __atomic_load_n(&rtl->steps, __ATOMIC_RELAXED);
+	*overruns = __atomic_load_n(&rtl->overruns, __ATOMIC_RELAXED);
+}
+
+#endif /*_ZYNQ_3PMDRV1_RTLOOP_H*/
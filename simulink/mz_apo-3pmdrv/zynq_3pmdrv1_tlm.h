@@ -0,0 +1,243 @@
+/*
+  Loop timing and current ADC telemetry of the 3-phase motor
+  driver control step published in POSIX shared memory.
+
+  The control step only increments counters in the page, it never
+  calls stdio or blocks. The writer brackets each update by odd/even
+  sequence number (seqlock), readers retry when they observe odd
+  or changed value. The counters are never cleared by the writer,
+  readers compute differences between two consistent snapshots.
+  The tools/z3pmdrv1_tlm_view renders the histograms.
+*/
+
+#ifndef _ZYNQ_3PMDRV1_TLM_H
+#define _ZYNQ_3PMDRV1_TLM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define Z3PMDRV1_TLM_SHM_NAME       "/z3pmdrv1_tlm"
+#define Z3PMDRV1_TLM_SHM_ENV        "Z3PMDRV1_TLM_SHM"
+#define Z3PMDRV1_TLM_MAGIC          0x544c4d33
+#define Z3PMDRV1_TLM_VERSION        4
+
+#define Z3PMDRV1_TLM_SQN_HIST_SIZE  512
+#define Z3PMDRV1_TLM_JIT_HIST_SIZE  256
+#define Z3PMDRV1_TLM_JIT_BIN_NS     1000
+
+/* ADC samples per step accepted as valid averaging window */
+#define Z3PMDRV1_TLM_SQN_VALID_MIN  2
+#define Z3PMDRV1_TLM_SQN_VALID_MAX  450
+
+typedef struct z3pmdrv1_tlm_t {
+  uint32_t magic;
+  uint32_t version;
+  volatile uint32_t seq;
+  uint32_t period_ns;       /* nominal step period */
+  uint32_t jit_bin_ns;      /* width of jitter histogram bin */
+  uint32_t reserved;
+  uint64_t steps;
+  uint64_t runs_valid;      /* window within valid range */
+  uint64_t runs_over;       /* window longer than valid range or single sample */
+  uint64_t runs_miss;       /* no new ADC sample since last step */
+  uint64_t sqn_accum;       /* sum of ADC samples in valid windows */
+  uint64_t sqn_accum_over;  /* sum of ADC samples in over-range windows */
+  int64_t  jit_min_ns;      /* step-to-step period deviation extremes */
+  int64_t  jit_max_ns;
+  uint64_t jit_abs_accum_ns;
+  uint64_t last_step_ns;
+  uint64_t wr_issued;       /* PWM register writes of the transfers */
+  uint64_t wr_elided;       /* writes skipped as equal to the last value */
+  uint64_t rtl_steps;       /* inner loop thread steps, 0 when not used */
+  uint64_t rtl_overruns;    /* inner loop periods missed */
+  uint64_t irq_missed;      /* PWM periods missed by the interrupt wait of the step */
+  uint32_t sqn_hist[Z3PMDRV1_TLM_SQN_HIST_SIZE];
+  /* deviation from nominal period, center bin is zero deviation */
+  uint32_t jit_hist[Z3PMDRV1_TLM_JIT_HIST_SIZE];
+} z3pmdrv1_tlm_t;
+
+static inline
+uint64_t z3pmdrv1_tlm_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Create and map the shared page. When shared memory is not
+ * available, private memory is used so the counters stay usable
+ * (for example through external mode or debugger).
+ */
+static inline
+z3pmdrv1_tlm_t *z3pmdrv1_tlm_create(double period_s)
+{
+	z3pmdrv1_tlm_t *tlm = MAP_FAILED;
+	const char *name;
+	size_t size;
+	int fd;
+
+	size = (sizeof(*tlm) + sysconf(_SC_PAGESIZE) - 1) &
+	       ~(sysconf(_SC_PAGESIZE) - 1);
+
+	name = getenv(Z3PMDRV1_TLM_SHM_ENV);
+	if ((name == NULL) || (*name == 0))
+		name = Z3PMDRV1_TLM_SHM_NAME;
+
+	fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd >= 0) {
+		if (ftruncate(fd, size) == 0)
+			tlm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				   MAP_SHARED, fd, 0);
+		close(fd);
+	}
+	if (tlm == MAP_FAILED)
+		tlm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (tlm == MAP_FAILED)
+		return NULL;
+
+	memset(tlm, 0, sizeof(*tlm));
+	tlm->period_ns = period_s > 0? period_s * 1e9: 0;
+	tlm->jit_bin_ns = Z3PMDRV1_TLM_JIT_BIN_NS;
+	tlm->jit_min_ns = INT64_MAX;
+	tlm->jit_max_ns = INT64_MIN;
+	tlm->version = Z3PMDRV1_TLM_VERSION;
+	__atomic_store_n(&tlm->magic, Z3PMDRV1_TLM_MAGIC, __ATOMIC_RELEASE);
+
+	return tlm;
+}
+
+static inline
+void z3pmdrv1_tlm_destroy(z3pmdrv1_tlm_t *tlm)
+{
+	size_t size;
+
+	if (tlm == NULL)
+		return;
+	size = (sizeof(*tlm) + sysconf(_SC_PAGESIZE) - 1) &
+	       ~(sysconf(_SC_PAGESIZE) - 1);
+	/* The name is kept, so readers can inspect the last run */
+	munmap(tlm, size);
+}
+
+/*
+ * Account one control step. The sqn_diff is number of ADC samples
+ * accumulated since the previous step (12-bit wrapped difference),
+ * the wr_issued and wr_elided are register writes done and skipped
+ * by the last transfer.
+ */
+static inline
+void z3pmdrv1_tlm_step(z3pmdrv1_tlm_t *tlm, unsigned sqn_diff,
+		       unsigned wr_issued, unsigned wr_elided)
+{
+	uint64_t now = z3pmdrv1_tlm_time_ns();
+	int64_t jit;
+	int bin;
+
+	if (tlm == NULL)
+		return;
+
+	__atomic_store_n(&tlm->seq, tlm->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if ((sqn_diff >= Z3PMDRV1_TLM_SQN_VALID_MIN) &&
+	    (sqn_diff <= Z3PMDRV1_TLM_SQN_VALID_MAX)) {
+		tlm->runs_valid++;
+		tlm->sqn_accum += sqn_diff;
+	} else if (sqn_diff) {
+		tlm->runs_over++;
+		tlm->sqn_accum_over += sqn_diff;
+	} else {
+		tlm->runs_miss++;
+	}
+	tlm->sqn_hist[sqn_diff < Z3PMDRV1_TLM_SQN_HIST_SIZE? sqn_diff:
+		      Z3PMDRV1_TLM_SQN_HIST_SIZE - 1]++;
+
+	tlm->wr_issued += wr_issued;
+	tlm->wr_elided += wr_elided;
+
+	if (tlm->steps && tlm->period_ns) {
+		jit = (int64_t)(now - tlm->last_step_ns) - tlm->period_ns;
+		if (jit < tlm->jit_min_ns)
+			tlm->jit_min_ns = jit;
+		if (jit > tlm->jit_max_ns)
+			tlm->jit_max_ns = jit;
+		tlm->jit_abs_accum_ns += jit < 0? -jit: jit;
+		bin = jit / (int64_t)tlm->jit_bin_ns + Z3PMDRV1_TLM_JIT_HIST_SIZE / 2;
+		if (bin < 0)
+			bin = 0;
+		if (bin >= Z3PMDRV1_TLM_JIT_HIST_SIZE)
+			bin = Z3PMDRV1_TLM_JIT_HIST_SIZE - 1;
+		tlm->jit_hist[bin]++;
+	}
+	tlm->last_step_ns = now;
+	tlm->steps++;
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&tlm->seq, tlm->seq + 1, __ATOMIC_RELAXED);
+}
+
+/* Publish the inner loop counters, taken by the block from the thread */
+static inline
+void z3pmdrv1_tlm_rtloop(z3pmdrv1_tlm_t *tlm, uint32_t steps, uint32_t overruns)
+{
+	if (tlm == NULL)
+		return;
+
+	__atomic_store_n(&tlm->seq, tlm->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	tlm->rtl_steps = steps;
+	tlm->rtl_overruns = overruns;
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&tlm->seq, tlm->seq + 1, __ATOMIC_RELAXED);
+}
+
+/* Account PWM periods missed by the interrupt wait of the control step */
+static inline
+void z3pmdrv1_tlm_missed(z3pmdrv1_tlm_t *tlm, unsigned missed)
+{
+	if (tlm == NULL)
+		return;
+
+	__atomic_store_n(&tlm->seq, tlm->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	tlm->irq_missed += missed;
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&tlm->seq, tlm->seq + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Copy consistent snapshot of the page, returns 0 on success
+ * and -1 when the writer kept updating during all attempts.
+ */
+static inline
+int z3pmdrv1_tlm_snapshot(const z3pmdrv1_tlm_t *tlm, z3pmdrv1_tlm_t *snap)
+{
+	uint32_t seq;
+	int retry;
+
+	for (retry = 0; retry < 1000; retry++) {
+		seq = __atomic_load_n(&tlm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(snap, (const void *)tlm, sizeof(*snap));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&tlm->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	return -1;
+}
+
+#endif /*_ZYNQ_3PMDRV1_TLM_H*/
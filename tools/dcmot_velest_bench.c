@@ -0,0 +1,173 @@
+/*******************************************************************
+  Host check of the velocity and acceleration estimator used by
+  sfDCMotorOnZynq against synthetic encoder traces.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-2dc -o dcmot_velest_bench \
+        dcmot_velest_bench.c -lm
+
+  Usage:
+    dcmot_velest_bench [-t ts] [-b bandwidth_hz] [-e edge_blend]
+
+  The traces are quantized to whole counts and start close to the
+  int32 overflow, so each of them crosses the counter wrap:
+
+    ramp     - constant speed 20000 counts/s
+    accel    - constant acceleration 2e6 counts/s^2 from standstill
+    sine     - sinusoidal speed 5000 counts/s amplitude at 5 Hz
+    creep    - 30 counts/s, below one count per period
+    reverse  - slow sinusoidal speed 40 counts/s crossing zero
+
+  For each trace the RMS and maximal velocity error of the observer
+  and of the output with edge blending, and the RMS acceleration error
+  are printed after the initial transient, together with the
+  difference quotient of the counter for comparison.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dcmot_velest.h"
+
+#define BENCH_DURATION   2.0
+#define BENCH_SETTLE     0.2
+#define BENCH_POS0       (2147483647.0 - 2000.0)
+
+enum {
+	TRACE_RAMP,
+	TRACE_ACCEL,
+	TRACE_SINE,
+	TRACE_CREEP,
+	TRACE_REVERSE,
+	TRACE_NUM
+};
+
+static const char *trace_name[TRACE_NUM] = {
+	"ramp", "accel", "sine", "creep", "reverse"
+};
+
+/* Exact position, velocity and acceleration of the trace at time t */
+static void trace_eval(int trace, double t, double *p, double *v, double *a)
+{
+	double w;
+
+	switch (trace) {
+	case TRACE_RAMP:
+		*p = 20000 * t;
+		*v = 20000;
+		*a = 0;
+		break;
+	case TRACE_ACCEL:
+		*p = 0.5 * 2e6 * t * t;
+		*v = 2e6 * t;
+		*a = 2e6;
+		break;
+	case TRACE_SINE:
+		w = 2 * M_PI * 5;
+		*p = -5000 / w * cos(w * t);
+		*v = 5000 * sin(w * t);
+		*a = 5000 * w * cos(w * t);
+		break;
+	case TRACE_CREEP:
+		*p = 30 * t;
+		*v = 30;
+		*a = 0;
+		break;
+	default:
+		w = 2 * M_PI * 1;
+		*p = -40 / w * cos(w * t);
+		*v = 40 * sin(w * t);
+		*a = 40 * w * cos(w * t);
+		break;
+	}
+	*p += BENCH_POS0;
+}
+
+static int32_t counter(double p)
+{
+	/* Hardware counter wraps at 32 bits */
+	return (int32_t)(uint32_t)(int64_t)floor(p);
+}
+
+int main(int argc, char *argv[])
+{
+	double ts = 1e-3, bandwidth = 50, edge_blend = 2;
+	dcmot_velest_t est, est_e;
+	int opt, trace;
+
+	while ((opt = getopt(argc, argv, "t:b:e:")) != -1) {
+		switch (opt) {
+		case 't':
+			ts = atof(optarg);
+			break;
+		case 'b':
+			bandwidth = atof(optarg);
+			break;
+		case 'e':
+			edge_blend = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t ts] [-b bandwidth_hz]"
+				" [-e edge_blend]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("ts %g s, bandwidth %g Hz, edge blend %g counts/period\n",
+	       ts, bandwidth, edge_blend);
+	printf("%-8s %12s %12s %12s %12s %12s %12s\n", "trace",
+	       "diff rms", "obs rms", "obs max", "blend rms", "blend max",
+	       "acc rms");
+
+	for (trace = 0; trace < TRACE_NUM; trace++) {
+		double e_diff = 0, e_obs = 0, m_obs = 0, e_bl = 0, m_bl = 0;
+		double e_acc = 0;
+		long steps = BENCH_DURATION / ts;
+		long n = 0, k;
+		int32_t irc, irc_last = 0;
+
+		dcmot_velest_init(&est, ts, bandwidth, 0);
+		dcmot_velest_init(&est_e, ts, bandwidth, edge_blend);
+
+		for (k = 0; k < steps; k++) {
+			double p, v, a, vd, d;
+
+			trace_eval(trace, k * ts, &p, &v, &a);
+			irc = counter(p);
+			dcmot_velest_update(&est, irc);
+			dcmot_velest_update(&est_e, irc);
+			vd = (int32_t)((uint32_t)irc - (uint32_t)irc_last) / ts;
+			irc_last = irc;
+
+			if (k * ts < BENCH_SETTLE)
+				continue;
+			n++;
+			/* Estimates refer to the sample instant */
+			e_diff += (vd - v) * (vd - v);
+			d = est.vel_out - v;
+			e_obs += d * d;
+			if (fabs(d) > m_obs)
+				m_obs = fabs(d);
+			d = est_e.vel_out - v;
+			e_bl += d * d;
+			if (fabs(d) > m_bl)
+				m_bl = fabs(d);
+			d = est.acc_out - a;
+			e_acc += d * d;
+		}
+
+		printf("%-8s %12.2f %12.2f %12.2f %12.2f %12.2f %12.1f\n",
+		       trace_name[trace], sqrt(e_diff / n), sqrt(e_obs / n), m_obs,
+		       sqrt(e_bl / n), m_bl, sqrt(e_acc / n));
+	}
+
+	return 0;
+}
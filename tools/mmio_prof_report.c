@@ -0,0 +1,172 @@
+/*******************************************************************
+  Offline summary of MMIO access profile recorded by the blocks
+  compiled with MMIO_PROF (and optionally MMIO_PROF_TRACE) defined.
+
+  Build on host:
+    gcc -O2 -Wall -o mmio_prof_report mmio_prof_report.c
+
+  Usage:
+    mmio_prof_report [mmio_prof.dat]
+
+  The report lists reads and writes per block and per register,
+  average access time and per step cost. When the trace is present,
+  writes repeating the last written value and reads of the register
+  already read in the same step of the block are reported as
+  redundant.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "../simulink/common/mmio_prof.h"
+
+typedef struct redundancy_t {
+  uint64_t rd;
+  uint64_t wr;
+  uint64_t steps_seen;
+  uint32_t last_wr_val[MMIO_PROF_REG_MAX];
+  uint8_t  last_wr_valid[MMIO_PROF_REG_MAX];
+  uint8_t  rd_in_step[MMIO_PROF_REG_MAX];
+} redundancy_t;
+
+static double avg_ns(uint64_t sum_ns, uint64_t count, unsigned overhead)
+{
+	double avg;
+
+	if (!count)
+		return 0;
+	avg = (double)sum_ns / count - overhead;
+	return avg < 0? 0: avg;
+}
+
+static void report_block(const mmio_prof_block_t *blk, int id,
+			 unsigned reg_max, unsigned overhead,
+			 const redundancy_t *red)
+{
+	uint64_t rd_total = 0, wr_total = 0;
+	double ns_total = 0;
+	double steps = blk->steps? (double)blk->steps: 1;
+	unsigned reg;
+
+	printf("block %d: %s phys 0x%08" PRIx64 " steps %" PRIu64 "\n",
+	       id, blk->name, blk->regs_base_phys, blk->steps);
+	printf("  %-6s %12s %12s %9s %9s %9s %9s\n", "reg", "reads", "writes",
+	       "rd/step", "wr/step", "rd ns", "wr ns");
+
+	for (reg = 0; reg < reg_max; reg++) {
+		double rd_ns, wr_ns;
+
+		if (!blk->rd_count[reg] && !blk->wr_count[reg])
+			continue;
+		rd_ns = avg_ns(blk->rd_ns[reg], blk->rd_count[reg], overhead);
+		wr_ns = avg_ns(blk->wr_ns[reg], blk->wr_count[reg], overhead);
+		printf("  0x%04x %12" PRIu64 " %12" PRIu64 " %9.2f %9.2f %9.1f %9.1f\n",
+		       reg * 4, blk->rd_count[reg], blk->wr_count[reg],
+		       blk->rd_count[reg] / steps, blk->wr_count[reg] / steps,
+		       rd_ns, wr_ns);
+		rd_total += blk->rd_count[reg];
+		wr_total += blk->wr_count[reg];
+		ns_total += rd_ns * blk->rd_count[reg] + wr_ns * blk->wr_count[reg];
+	}
+
+	printf("  per step: %.2f reads, %.2f writes, %.1f ns\n",
+	       rd_total / steps, wr_total / steps, ns_total / steps);
+
+	if (red != NULL)
+		printf("  redundant in trace: %" PRIu64 " reads, %" PRIu64
+		       " writes over %" PRIu64 " steps\n",
+		       red->rd, red->wr, red->steps_seen);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *fname = argc > 1? argv[1]: MMIO_PROF_FILE_DEFAULT;
+	mmio_prof_file_hdr_t hdr;
+	mmio_prof_block_t *blk;
+	redundancy_t *red = NULL;
+	uint64_t trace_count = 0;
+	FILE *f;
+	unsigned i;
+
+	f = fopen(fname, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "cannot open %s\n", fname);
+		return 1;
+	}
+
+	if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+	    memcmp(hdr.magic, MMIO_PROF_MAGIC, sizeof(hdr.magic)) ||
+	    (hdr.reg_max != MMIO_PROF_REG_MAX) ||
+	    (hdr.block_count > MMIO_PROF_BLOCK_MAX)) {
+		fprintf(stderr, "%s: not a compatible MMIO profile\n", fname);
+		return 1;
+	}
+
+	blk = calloc(hdr.block_count + 1, sizeof(*blk));
+	if ((blk == NULL) ||
+	    (fread(blk, sizeof(*blk), hdr.block_count, f) != hdr.block_count)) {
+		fprintf(stderr, "%s: truncated block table\n", fname);
+		return 1;
+	}
+
+	if (hdr.trace_size) {
+		mmio_prof_trace_rec_t rec;
+
+		trace_count = hdr.trace_total < hdr.trace_size?
+			      hdr.trace_total: hdr.trace_size;
+		red = calloc(hdr.block_count + 1, sizeof(*red));
+		if (red == NULL)
+			return 1;
+
+		while (fread(&rec, sizeof(rec), 1, f) == 1) {
+			redundancy_t *r;
+			unsigned reg = rec.reg_offs / 4;
+
+			if (rec.block >= hdr.block_count)
+				continue;
+			r = &red[rec.block];
+			if (rec.kind == MMIO_PROF_KIND_STEP) {
+				memset(r->rd_in_step, 0, sizeof(r->rd_in_step));
+				r->steps_seen++;
+				continue;
+			}
+			if (reg >= MMIO_PROF_REG_MAX)
+				continue;
+			if (rec.kind == MMIO_PROF_KIND_RD) {
+				if (r->rd_in_step[reg])
+					r->rd++;
+				r->rd_in_step[reg] = 1;
+			} else {
+				if (r->last_wr_valid[reg] &&
+				    (r->last_wr_val[reg] == rec.value))
+					r->wr++;
+				r->last_wr_val[reg] = rec.value;
+				r->last_wr_valid[reg] = 1;
+			}
+		}
+	}
+	fclose(f);
+
+	printf("%s: %u blocks, timestamp overhead %u ns subtracted",
+	       fname, hdr.block_count, hdr.clock_overhead_ns);
+	if (hdr.trace_size)
+		printf(", trace %" PRIu64 " of %" PRIu64 " accesses",
+		       trace_count, hdr.trace_total);
+	printf("\n\n");
+
+	for (i = 0; i < hdr.block_count; i++) {
+		report_block(&blk[i], i, hdr.reg_max, hdr.clock_overhead_ns,
+			     red != NULL? &red[i]: NULL);
+		printf("\n");
+	}
+
+	free(red);
+	free(blk);
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*******************************************************************
+  Reader of the compressed signal logs written by the driver blocks
+  when MZAPO_LOGDIR is set, see ../simulink/common/mzapo_log.h.
+
+  Build (on target or host):
+    gcc -O2 -Wall -o mzapo_log_read mzapo_log_read.c -lpthread
+
+  Usage:
+    mzapo_log_read [-o out.mat] [-t] [-d decimation] file.mzlog
+
+  The valid blocks of the file ring are ordered by their sequence
+  number and decoded into one column array per channel. Without
+  options summary of the log is printed (channels, records, time
+  span, gaps, compressed size per record). The -o stores the columns
+  as MATLAB level 4 MAT-file with variables n (step number), t (time
+  from the log start in seconds), start_unix (wall clock time of the
+  log start) and one int32 column per channel named as in the log,
+  it is loaded by MATLAB load() and Python scipy.io.loadmat(). The -t
+  prints the columns as text, every -d th record.
+
+  The log can be read while the block runs, only the blocks closed
+  so far are included.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../simulink/common/mzapo_log.h"
+
+/* MAT-file level 4 type: little endian, full numeric matrix */
+#define MAT4_DOUBLE   0
+#define MAT4_INT32    20
+
+typedef struct blk_ref_t {
+	uint64_t seq;
+	const mzapo_log_blk_t *blk;
+} blk_ref_t;
+
+static int blk_ref_cmp(const void *a, const void *b)
+{
+	uint64_t sa = ((const blk_ref_t *)a)->seq;
+	uint64_t sb = ((const blk_ref_t *)b)->seq;
+
+	return sa < sb? -1: sa > sb;
+}
+
+static int mat4_write(FILE *f, const char *name, int32_t type,
+		      const void *data, size_t elem, uint32_t rows)
+{
+	int32_t hdr[5];
+
+	hdr[0] = type;
+	hdr[1] = rows;
+	hdr[2] = 1;
+	hdr[3] = 0;
+	hdr[4] = strlen(name) + 1;
+	if ((fwrite(hdr, sizeof(hdr), 1, f) != 1) ||
+	    (fwrite(name, hdr[4], 1, f) != 1) ||
+	    (fwrite(data, elem, rows, f) != rows))
+		return -1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *out_name = NULL;
+	const mzapo_log_hdr_t *hdr;
+	const unsigned char *base;
+	blk_ref_t *ref;
+	uint64_t *n;
+	int32_t *col[MZAPO_LOG_CHAN_MAX];
+	double *dbl;
+	size_t nref = 0, total = 0, pos, bytes = 0, gaps = 0;
+	uint64_t slot;
+	unsigned ch;
+	int text = 0;
+	long decim = 1;
+	struct stat st;
+	int fd, opt, res;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "o:td:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out_name = optarg;
+			break;
+		case 't':
+			text = 1;
+			break;
+		case 'd':
+			decim = atol(optarg);
+			if (decim < 1)
+				decim = 1;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-o out.mat] [-t] [-d decimation]"
+			" file.mzlog\n", argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "cannot open %s\n", argv[optind]);
+		return 1;
+	}
+	if ((fstat(fd, &st) < 0) || (st.st_size < MZAPO_LOG_HDR_SIZE)) {
+		fprintf(stderr, "%s: not a log\n", argv[optind]);
+		return 1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "cannot map %s\n", argv[optind]);
+		return 1;
+	}
+	hdr = (const mzapo_log_hdr_t *)base;
+	if ((hdr->magic != MZAPO_LOG_MAGIC) ||
+	    (hdr->version != MZAPO_LOG_VERSION) ||
+	    (hdr->chan_count > MZAPO_LOG_CHAN_MAX) ||
+	    (hdr->blk_size <= sizeof(mzapo_log_blk_t)) ||
+	    (MZAPO_LOG_HDR_SIZE + hdr->blk_count * hdr->blk_size >
+	     (uint64_t)st.st_size)) {
+		fprintf(stderr, "%s: incompatible log layout\n", argv[optind]);
+		return 1;
+	}
+
+	/* Closed blocks in order, the slot has to match the sequence number */
+	ref = malloc(sizeof(*ref) * (hdr->blk_count + 1));
+	if (ref == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (slot = 0; slot < hdr->blk_count; slot++) {
+		const mzapo_log_blk_t *blk = (const mzapo_log_blk_t *)(base +
+				MZAPO_LOG_HDR_SIZE + slot * hdr->blk_size);
+
+		if ((__atomic_load_n(&blk->magic, __ATOMIC_ACQUIRE) !=
+		     MZAPO_LOG_BLK_MAGIC) || !blk->rec_count ||
+		    (blk->seq % hdr->blk_count != slot))
+			continue;
+		ref[nref].seq = blk->seq;
+		ref[nref].blk = blk;
+		total += blk->rec_count;
+		bytes += blk->bytes;
+		nref++;
+	}
+	qsort(ref, nref, sizeof(*ref), blk_ref_cmp);
+
+	n = malloc(sizeof(*n) * (total + 1));
+	dbl = malloc(sizeof(*dbl) * (total + 1));
+	for (ch = 0; ch < hdr->chan_count; ch++)
+		if ((col[ch] = malloc(sizeof(int32_t) * (total + 1))) == NULL)
+			n = NULL;
+	if ((n == NULL) || (dbl == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	pos = 0;
+	for (i = 0; i < nref; i++) {
+		int32_t *dst[MZAPO_LOG_CHAN_MAX];
+
+		for (ch = 0; ch < hdr->chan_count; ch++)
+			dst[ch] = col[ch] + pos;
+		res = mzapo_log_blk_decode(ref[i].blk, hdr->blk_size,
+					   hdr->chan_count, n + pos, dst);
+		if (res < 0) {
+			fprintf(stderr, "block %" PRIu64 " damaged, skipped\n",
+				ref[i].seq);
+			continue;
+		}
+		pos += res;
+	}
+	total = pos;
+	for (i = 1; i < total; i++)
+		if (n[i] != n[i - 1] + 1)
+			gaps++;
+
+	if (!text && (out_name == NULL)) {
+		printf("channels %u:", hdr->chan_count);
+		for (ch = 0; ch < hdr->chan_count; ch++)
+			printf(" %.*s", MZAPO_LOG_NAME_LEN, hdr->chan_name[ch]);
+		if (hdr->ident[0])
+			printf("\nident %.*s", MZAPO_LOG_IDENT_LEN, hdr->ident);
+		printf("\nblocks %zu of %" PRIu64 " (%u bytes), written %" PRIu64
+		       "\n", nref, hdr->blk_count, hdr->blk_size, hdr->blocks);
+		printf("records %zu, dropped %" PRIu64 ", gaps %zu\n", total,
+		       hdr->dropped, gaps);
+		if (total) {
+			printf("steps %" PRIu64 " .. %" PRIu64, n[0], n[total - 1]);
+			if (hdr->period_ns)
+				printf(", %.3f s .. %.3f s", n[0] * hdr->period_ns * 1e-9,
+				       n[total - 1] * hdr->period_ns * 1e-9);
+			printf("\nbytes per record %.2f (raw %zu)\n",
+			       (double)bytes / total, sizeof(int32_t) * hdr->chan_count +
+			       sizeof(uint64_t));
+		}
+	}
+
+	if (text) {
+		printf("# n t");
+		for (ch = 0; ch < hdr->chan_count; ch++)
+			printf(" %.*s", MZAPO_LOG_NAME_LEN, hdr->chan_name[ch]);
+		putchar('\n');
+		for (i = 0; i < total; i++) {
+			if (n[i] % decim)
+				continue;
+			printf("%" PRIu64 " %.6f", n[i], n[i] * hdr->period_ns * 1e-9);
+			for (ch = 0; ch < hdr->chan_count; ch++)
+				printf(" %d", col[ch][i]);
+			putchar('\n');
+		}
+	}
+
+	if (out_name != NULL) {
+		FILE *f = fopen(out_name, "wb");
+		char name[MZAPO_LOG_NAME_LEN + 1];
+		double start = hdr->start_ns * 1e-9;
+
+		if (f == NULL) {
+			fprintf(stderr, "cannot create %s\n", out_name);
+			return 1;
+		}
+		for (i = 0; i < total; i++)
+			dbl[i] = n[i];
+		res = mat4_write(f, "n", MAT4_DOUBLE, dbl, sizeof(*dbl), total);
+		for (i = 0; i < total; i++)
+			dbl[i] = n[i] * hdr->period_ns * 1e-9;
+		res |= mat4_write(f, "t", MAT4_DOUBLE, dbl, sizeof(*dbl), total);
+		res |= mat4_write(f, "start_unix", MAT4_DOUBLE, &start,
+				  sizeof(start), 1);
+		for (ch = 0; ch < hdr->chan_count; ch++) {
+			memcpy(name, hdr->chan_name[ch], MZAPO_LOG_NAME_LEN);
+			name[MZAPO_LOG_NAME_LEN] = 0;
+			res |= mat4_write(f, name, MAT4_INT32, col[ch],
+					  sizeof(int32_t), total);
+		}
+		if ((fclose(f) != 0) || res) {
+			fprintf(stderr, "write of %s failed\n", out_name);
+			return 1;
+		}
+	}
+
+	return 0;
+}
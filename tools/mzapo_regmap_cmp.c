@@ -0,0 +1,370 @@
+/*******************************************************************
+  Comparison of the typed register layer (mzapo_regmap.h) with the
+  hand-written offset and mask code it replaces.
+
+  Build (the same source as C and as C++ consumer of the layer):
+    gcc -O2 -Wall -I../simulink/common -I../simulink/mz_apo-2dc \
+        -o mzapo_regmap_cmp mzapo_regmap_cmp.c
+    g++ -O2 -Wall -I../simulink/common -I../simulink/mz_apo-2dc \
+        -x c++ -o mzapo_regmap_cmpxx mzapo_regmap_cmp.c
+
+  Code size of each pair:
+    nm -S --size-sort mzapo_regmap_cmp | grep -e hand_ -e typed_
+    objdump -d --no-show-raw-insn mzapo_regmap_cmp | less
+
+  Usage:
+    mzapo_regmap_cmp [-n calls]
+
+  The legacy defines of mzapo_regs.h are checked against the
+  description at compile time. Each pair of functions is called for
+  random arguments on in-memory register file and must leave the same
+  register contents and results, then time per call is reported.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mzapo_regs.h"
+#include "mzapo_regmap.h"
+
+#ifdef __cplusplus
+#define CMP_FN extern "C" __attribute__((noinline))
+#define CMP_CHECK(cond) static_assert(cond, #cond)
+#else /*__cplusplus*/
+#define CMP_FN __attribute__((noinline))
+#define CMP_CHECK(cond) _Static_assert(cond, #cond)
+#endif /*__cplusplus*/
+
+/* Legacy defines have to match the description */
+CMP_CHECK(SPILED_REG_BASE_PHYS == SPILED_BASE_PHYS);
+CMP_CHECK(SPILED_REG_LED_LINE_o == SPILED_LED_LINE_OFFS);
+CMP_CHECK(SPILED_REG_LED_RGB1_o == SPILED_LED_RGB1_OFFS);
+CMP_CHECK(SPILED_REG_LED_RGB2_o == SPILED_LED_RGB2_OFFS);
+CMP_CHECK(SPILED_REG_LED_KBDWR_DIRECT_o == SPILED_LED_KBDWR_DIRECT_OFFS);
+CMP_CHECK(SPILED_REG_KBDRD_KNOBS_DIRECT_o == SPILED_KBDRD_KNOBS_DIRECT_OFFS);
+CMP_CHECK(SPILED_REG_KNOBS_8BIT_o == SPILED_KNOBS_8BIT_OFFS);
+CMP_CHECK(PARLCD_REG_BASE_PHYS == PARLCD_BASE_PHYS);
+CMP_CHECK(PARLCD_REG_CMD_o == PARLCD_CMD_OFFS);
+CMP_CHECK(PARLCD_REG_DATA_o == PARLCD_DATA_OFFS);
+CMP_CHECK(SERVOPS2_REG_BASE_PHYS == SERVOPS2_BASE_PHYS);
+CMP_CHECK(SERVOPS2_REG_PWMPER_o == SERVOPS2_PWMPER_OFFS);
+CMP_CHECK(SERVOPS2_REG_PWM4_o == SERVOPS2_PWM4_OFFS);
+CMP_CHECK(AUDIOPWM_REG_BASE_PHYS == AUDIOPWM_BASE_PHYS);
+CMP_CHECK(AUDIOPWM_REG_PWMPER_o == AUDIOPWM_PWMPER_OFFS);
+CMP_CHECK(AUDIOPWM_REG_PWM_o == AUDIOPWM_PWM_OFFS);
+CMP_CHECK(DCSPDRV_REG_BASE_PHYS_0 == DCSPDRV_BASE_PHYS_0);
+CMP_CHECK(DCSPDRV_REG_BASE_PHYS_1 == DCSPDRV_BASE_PHYS_1);
+CMP_CHECK(DCSPDRV_REG_CR_o == DCSPDRV_CR_OFFS);
+CMP_CHECK(DCSPDRV_REG_CR_PWM_ENABLE_m ==
+	  MZAPO_REGMAP_MASK(DCSPDRV_CR_PWM_ENABLE));
+CMP_CHECK(DCSPDRV_REG_CR_IRC_RESET_m ==
+	  MZAPO_REGMAP_MASK(DCSPDRV_CR_IRC_RESET));
+CMP_CHECK(DCSPDRV_REG_SR_o == DCSPDRV_SR_OFFS);
+CMP_CHECK(DCSPDRV_REG_SR_IRC_IRQ_MON_m ==
+	  MZAPO_REGMAP_MASK(DCSPDRV_SR_IRC_IRQ_MON));
+CMP_CHECK(DCSPDRV_REG_PERIOD_o == DCSPDRV_PERIOD_OFFS);
+CMP_CHECK(DCSPDRV_REG_PERIOD_MASK_m ==
+	  MZAPO_REGMAP_MASK(DCSPDRV_PERIOD_VALUE));
+CMP_CHECK(DCSPDRV_REG_DUTY_o == DCSPDRV_DUTY_OFFS);
+CMP_CHECK(DCSPDRV_REG_DUTY_DIR_A_m == MZAPO_REGMAP_MASK(DCSPDRV_DUTY_DIR_A));
+CMP_CHECK(DCSPDRV_REG_DUTY_DIR_B_m == MZAPO_REGMAP_MASK(DCSPDRV_DUTY_DIR_B));
+CMP_CHECK(DCSPDRV_REG_IRC_o == DCSPDRV_IRC_OFFS);
+
+#define CMP_REGS_WORDS  (0x40 / 4)
+
+/* Block PWM words of zynq_3pmdrv1_mc.h */
+#define PWM_VALUE_m   0x0ffff
+#define PWM_ENABLE    0x10000
+#define PWM_SHUTDOWN  0x20000
+
+typedef void cmp_fn_t(void *regs, uint32_t arg, uint32_t *res);
+
+static inline
+void hand_wr(void *regs, unsigned offs, uint32_t val)
+{
+	*(volatile uint32_t *)((char *)regs + offs) = val;
+}
+
+static inline
+uint32_t hand_rd(void *regs, unsigned offs)
+{
+	return *(volatile uint32_t *)((char *)regs + offs);
+}
+
+/* The PWM packing of z3pmdrv1_transfer before the typed layer */
+static inline
+uint32_t hand_pwm_pack(uint32_t pwm)
+{
+	uint32_t fl = 0;
+
+	if (pwm & PWM_ENABLE)
+		fl |= 0x40000000;
+	if (pwm & PWM_SHUTDOWN)
+		fl |= 0x80000000;
+	pwm &= PWM_VALUE_m;
+	if (pwm > 0x00003fff)
+		pwm = 0x00003fff;
+	return pwm | fl;
+}
+
+CMP_FN
+void hand_z3pm_pwm(void *regs, uint32_t arg, uint32_t *res)
+{
+	hand_wr(regs, 0x0010, hand_pwm_pack(arg));
+	hand_wr(regs, 0x0014, hand_pwm_pack(arg >> 1));
+	hand_wr(regs, 0x0018, hand_pwm_pack(arg >> 2));
+}
+
+CMP_FN
+void hand_z3pm_stat(void *regs, uint32_t arg, uint32_t *res)
+{
+	uint32_t sqn_stat = hand_rd(regs, 0x0020);
+
+	res[0] = sqn_stat & 0x00000fff;
+	res[1] = ((sqn_stat & 0x00010000)?1:0) |
+		 ((sqn_stat & 0x00020000)?2:0) |
+		 ((sqn_stat & 0x00040000)?4:0);
+}
+
+CMP_FN
+void hand_dcspdrv_duty(void *regs, uint32_t arg, uint32_t *res)
+{
+	int32_t duty = (int32_t)arg >> 2;
+	uint32_t val;
+
+	if (duty >= 0)
+		val = (uint32_t)duty | DCSPDRV_REG_DUTY_DIR_A_m;
+	else
+		val = (uint32_t)-duty | DCSPDRV_REG_DUTY_DIR_B_m;
+	hand_wr(regs, DCSPDRV_REG_DUTY_o, val);
+}
+
+CMP_FN
+void hand_spiled_knobs(void *regs, uint32_t arg, uint32_t *res)
+{
+	uint32_t knobs = hand_rd(regs, SPILED_REG_KNOBS_8BIT_o);
+	unsigned chan = arg % 3;
+
+	res[0] = (knobs >> (8 * chan)) & 0xff;
+	res[1] = (knobs & (0x01000000 << chan))? 1: 0;
+}
+
+#ifndef __cplusplus
+
+/* Same as z3pmdrv1_pwm_reg of zynq_3pmdrv1_mc.c */
+static inline
+uint32_t typed_pwm_pack(uint32_t pwm)
+{
+	uint32_t val = pwm & PWM_VALUE_m;
+
+	if (val > MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_VAL))
+		val = MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_VAL);
+
+	return val |
+	       ((pwm & PWM_ENABLE)?
+		MZAPO_REGMAP_VAL(Z3PMDRV1_PWM1_EN, 1): 0) |
+	       ((pwm & PWM_SHUTDOWN)?
+		MZAPO_REGMAP_VAL(Z3PMDRV1_PWM1_SHDN, 1): 0);
+}
+
+CMP_FN
+void typed_z3pm_pwm(void *regs, uint32_t arg, uint32_t *res)
+{
+	Z3PMDRV1_regs_t h = Z3PMDRV1_regs(regs);
+
+	Z3PMDRV1_PWM1_wr(h, typed_pwm_pack(arg));
+	Z3PMDRV1_PWM2_wr(h, typed_pwm_pack(arg >> 1));
+	Z3PMDRV1_PWM3_wr(h, typed_pwm_pack(arg >> 2));
+}
+
+CMP_FN
+void typed_z3pm_stat(void *regs, uint32_t arg, uint32_t *res)
+{
+	uint32_t sqn_stat = Z3PMDRV1_ADC_SQN_STAT_rd(Z3PMDRV1_regs(regs));
+
+	res[0] = Z3PMDRV1_ADC_SQN_STAT_SQN_get(sqn_stat);
+	res[1] = Z3PMDRV1_ADC_SQN_STAT_HAL_get(sqn_stat);
+}
+
+CMP_FN
+void typed_dcspdrv_duty(void *regs, uint32_t arg, uint32_t *res)
+{
+	int32_t duty = (int32_t)arg >> 2;
+	uint32_t val;
+
+	if (duty >= 0)
+		val = (uint32_t)duty | MZAPO_REGMAP_VAL(DCSPDRV_DUTY_DIR_A, 1);
+	else
+		val = (uint32_t)-duty | MZAPO_REGMAP_VAL(DCSPDRV_DUTY_DIR_B, 1);
+	DCSPDRV_DUTY_wr(DCSPDRV_regs(regs), val);
+}
+
+CMP_FN
+void typed_spiled_knobs(void *regs, uint32_t arg, uint32_t *res)
+{
+	uint32_t knobs = SPILED_KNOBS_8BIT_rd(SPILED_regs(regs));
+	unsigned chan = arg % 3;
+
+	res[0] = (knobs >> (SPILED_KNOBS_8BIT_VALUE_GREEN_SHIFT * chan)) &
+		 MZAPO_REGMAP_MASK(SPILED_KNOBS_8BIT_VALUE_BLUE);
+	res[1] = (knobs >> (SPILED_KNOBS_8BIT_BUTTON_BLUE_SHIFT + chan)) & 1;
+}
+
+#else /*__cplusplus*/
+
+using namespace mzapo_regmap;
+
+static inline
+uint32_t typed_pwm_pack(uint32_t pwm)
+{
+	uint32_t v = pwm & PWM_VALUE_m;
+
+	if (v > mask<Z3PMDRV1::PWM1_VAL>())
+		v = mask<Z3PMDRV1::PWM1_VAL>();
+
+	return v |
+	       ((pwm & PWM_ENABLE)? val<Z3PMDRV1::PWM1_EN, 1>(): 0) |
+	       ((pwm & PWM_SHUTDOWN)? val<Z3PMDRV1::PWM1_SHDN, 1>(): 0);
+}
+
+CMP_FN
+void typed_z3pm_pwm(void *regs, uint32_t arg, uint32_t *res)
+{
+	mzapo_regmap::regs<Z3PMDRV1::block> h(regs);
+
+	h.wr<Z3PMDRV1::PWM1>(typed_pwm_pack(arg));
+	h.wr<Z3PMDRV1::PWM2>(typed_pwm_pack(arg >> 1));
+	h.wr<Z3PMDRV1::PWM3>(typed_pwm_pack(arg >> 2));
+}
+
+CMP_FN
+void typed_z3pm_stat(void *regs, uint32_t arg, uint32_t *res)
+{
+	mzapo_regmap::regs<Z3PMDRV1::block> h(regs);
+	uint32_t sqn_stat = h.rd<Z3PMDRV1::ADC_SQN_STAT>();
+
+	res[0] = get<Z3PMDRV1::ADC_SQN_STAT_SQN>(sqn_stat);
+	res[1] = get<Z3PMDRV1::ADC_SQN_STAT_HAL>(sqn_stat);
+}
+
+CMP_FN
+void typed_dcspdrv_duty(void *regs, uint32_t arg, uint32_t *res)
+{
+	mzapo_regmap::regs<DCSPDRV::block> h(regs);
+	int32_t duty = (int32_t)arg >> 2;
+
+	if (duty >= 0)
+		h.wr<DCSPDRV::DUTY>((uint32_t)duty | val<DCSPDRV::DUTY_DIR_A, 1>());
+	else
+		h.wr<DCSPDRV::DUTY>((uint32_t)-duty | val<DCSPDRV::DUTY_DIR_B, 1>());
+}
+
+CMP_FN
+void typed_spiled_knobs(void *regs, uint32_t arg, uint32_t *res)
+{
+	mzapo_regmap::regs<SPILED::block> h(regs);
+	uint32_t knobs = h.rd<SPILED::KNOBS_8BIT>();
+	unsigned chan = arg % 3;
+
+	res[0] = (knobs >> (SPILED::KNOBS_8BIT_VALUE_GREEN::shift * chan)) &
+		 mask<SPILED::KNOBS_8BIT_VALUE_BLUE>();
+	res[1] = (knobs >> (SPILED::KNOBS_8BIT_BUTTON_BLUE::shift + chan)) & 1;
+}
+
+#endif /*__cplusplus*/
+
+typedef struct cmp_pair_t {
+	const char *name;
+	cmp_fn_t   *hand;
+	cmp_fn_t   *typed;
+} cmp_pair_t;
+
+static const cmp_pair_t cmp_pairs[] = {
+	{"z3pm_pwm", hand_z3pm_pwm, typed_z3pm_pwm},
+	{"z3pm_stat", hand_z3pm_stat, typed_z3pm_stat},
+	{"dcspdrv_duty", hand_dcspdrv_duty, typed_dcspdrv_duty},
+	{"spiled_knobs", hand_spiled_knobs, typed_spiled_knobs},
+};
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t rnd_state = 12345;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static double time_fn(cmp_fn_t *fn, uint32_t *regs, long calls)
+{
+	uint32_t res[2];
+	uint64_t t0;
+	long k;
+
+	t0 = time_ns();
+	for (k = 0; k < calls; k++)
+		fn(regs, (uint32_t)k * 2654435761u, res);
+	return (double)(time_ns() - t0) / calls;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint32_t regs_hand[CMP_REGS_WORDS], regs_typed[CMP_REGS_WORDS];
+	long calls = 100000000;
+	long err = 0;
+	unsigned p;
+	long k;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			calls = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n calls]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (p = 0; p < sizeof(cmp_pairs) / sizeof(*cmp_pairs); p++) {
+		const cmp_pair_t *c = &cmp_pairs[p];
+		long mism = 0;
+
+		for (k = 0; k < 1000000; k++) {
+			uint32_t res_hand[2] = {0, 0}, res_typed[2] = {0, 0};
+			uint32_t arg = rnd();
+
+			for (i = 0; i < CMP_REGS_WORDS; i++)
+				regs_hand[i] = regs_typed[i] = rnd();
+			c->hand(regs_hand, arg, res_hand);
+			c->typed(regs_typed, arg, res_typed);
+			if (memcmp(regs_hand, regs_typed, sizeof(regs_hand)) ||
+			    memcmp(res_hand, res_typed, sizeof(res_hand)))
+				mism++;
+		}
+		err += mism;
+
+		printf("%-14s mismatches %ld  hand %.2f ns  typed %.2f ns\n",
+		       c->name, mism, time_fn(c->hand, regs_hand, calls),
+		       time_fn(c->typed, regs_typed, calls));
+	}
+
+	return err? 1: 0;
+}
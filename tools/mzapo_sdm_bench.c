@@ -0,0 +1,144 @@
+/*******************************************************************
+  Host measurement of the PWM resolution gain of the sigma-delta
+  dither stage used by the DC and 3-phase motor blocks.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/common -o mzapo_sdm_bench \
+        mzapo_sdm_bench.c -lm
+
+  Usage:
+    mzapo_sdm_bench [-t tau_steps] [-n steps]
+
+  The quantized counts drive first order low-pass (motor current
+  with electrical time constant tau_steps PWM steps) and are compared
+  with the same filter driven by the unquantized command:
+
+    static  - mean absolute error of the filtered output for 1000
+              constant commands spread over one count
+    slow    - RMS error for slow sine of 3 counts amplitude
+    bits    - resolution gain log2(RMS order 0 / RMS order N)
+              over both tests together
+
+  The maximal step to step change of the written value is printed
+  as well, it is the ripple cost paid for the resolution.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "mzapo_sdm.h"
+
+#define BENCH_BASE     1000.0      /* command offset in counts */
+
+typedef struct bench_res_t {
+	double static_err;
+	double slow_rms;
+	double all_rms;
+	int    max_step;
+} bench_res_t;
+
+static void bench_order(int order, double tau, long steps, bench_res_t *res)
+{
+	double a = 1 - exp(-1 / tau);
+	double sum_abs = 0, sum_sq = 0, sum_all = 0;
+	long n_all = 0;
+	int32_t y, y_last = 0;
+	mzapo_sdm_t sdm;
+	int c, first;
+	long k;
+
+	res->max_step = 0;
+
+	/* Constant commands with fractional part 0 .. 1 */
+	for (c = 0; c < 1000; c++) {
+		double x = BENCH_BASE + c / 1000.0;
+		double f = x, fr;
+
+		mzapo_sdm_init(&sdm, order);
+		first = 1;
+		for (k = 0; k < steps; k++) {
+			y = mzapo_sdm_quantize(&sdm, x, 0, 5000);
+			f += a * (y - f);
+			if (!first && abs(y - y_last) > res->max_step)
+				res->max_step = abs(y - y_last);
+			first = 0;
+			y_last = y;
+		}
+		/* Settled filtered value, averaged over the next 4 tau */
+		fr = f;
+		f = 0;
+		for (k = 0; k < (long)tau * 4; k++) {
+			y = mzapo_sdm_quantize(&sdm, x, 0, 5000);
+			fr += a * (y - fr);
+			f += fr;
+		}
+		f /= (long)tau * 4;
+		sum_abs += fabs(f - x);
+		sum_all += (f - x) * (f - x);
+		n_all++;
+	}
+	res->static_err = sum_abs / 1000;
+
+	/* Slow sine, the reference passes the same filter */
+	{
+		double f = BENCH_BASE, fr = BENCH_BASE;
+
+		mzapo_sdm_init(&sdm, order);
+		for (k = 0; k < steps * 100; k++) {
+			double x = BENCH_BASE + 3 * sin(2 * M_PI * k / (tau * 200));
+
+			y = mzapo_sdm_quantize(&sdm, x, 0, 5000);
+			f += a * (y - f);
+			fr += a * (x - fr);
+			if (k > tau * 10) {
+				sum_sq += (f - fr) * (f - fr);
+				n_all++;
+				sum_all += (f - fr) * (f - fr);
+			}
+		}
+		res->slow_rms = sqrt(sum_sq / (steps * 100 - tau * 10));
+	}
+
+	res->all_rms = sqrt(sum_all / n_all);
+}
+
+int main(int argc, char *argv[])
+{
+	double tau = 20;
+	long steps = 2000;
+	bench_res_t res[MZAPO_SDM_ORDER_MAX + 1];
+	int opt, order;
+
+	while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+		switch (opt) {
+		case 't':
+			tau = atof(optarg);
+			break;
+		case 'n':
+			steps = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t tau_steps] [-n steps]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("filter tau %g steps\n", tau);
+	printf("%-6s %14s %14s %8s %9s\n", "order", "static [cnt]", "slow rms [cnt]",
+	       "bits", "max step");
+	for (order = 0; order <= MZAPO_SDM_ORDER_MAX; order++) {
+		bench_order(order, tau, steps, &res[order]);
+		printf("%-6d %14.5f %14.5f %8.2f %9d\n", order,
+		       res[order].static_err, res[order].slow_rms,
+		       log2(res[0].all_rms / res[order].all_rms),
+		       res[order].max_step);
+	}
+
+	return 0;
+}
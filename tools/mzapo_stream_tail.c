@@ -0,0 +1,175 @@
+/*******************************************************************
+  Reference consumer of the live signal streams published by
+  sfPMSMonZynq3pmdrv1 and sfDCMotorOnZynq in POSIX shared memory.
+
+  Build (on target or host):
+    gcc -O2 -Wall -o mzapo_stream_tail mzapo_stream_tail.c -lrt
+
+  Usage:
+    mzapo_stream_tail [-n shm_name] [-d decimation] [-c count] [-a]
+
+  The stream is attached read-only, any number of consumers can run
+  in parallel and none of them influences the control step. Records
+  are printed one per line from the current head (or from the oldest
+  still available one with -a). When the consumer falls behind by
+  more than the ring size, the number of lost records is reported
+  and reading continues from the oldest record still present.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "../simulink/common/mzapo_stream.h"
+
+static void print_rec(uint32_t rec_type, uint64_t n, const void *rec)
+{
+	const mzapo_stream_pmsm_rec_t *pmsm = rec;
+	const mzapo_stream_dc_rec_t *dc = rec;
+
+	switch (rec_type) {
+	case MZAPO_STREAM_TYPE_PMSM:
+		printf("%" PRIu64 " %.6f %.2f %.2f %.2f %d %d %d %d %u\n", n,
+		       pmsm->t, pmsm->cur_adc[0], pmsm->cur_adc[1],
+		       pmsm->cur_adc[2], pmsm->irc_pos, pmsm->irc_idx,
+		       pmsm->irc_idx_occ, pmsm->hal_sec, pmsm->wr_elided);
+		break;
+	case MZAPO_STREAM_TYPE_DC:
+		printf("%" PRIu64 " %.6f %.4f %d 0x%08x %u\n", n, dc->t, dc->pwm,
+		       dc->irc_pos, dc->duty_reg, dc->wr_elided);
+		break;
+	}
+}
+
+static const char *header(uint32_t rec_type)
+{
+	switch (rec_type) {
+	case MZAPO_STREAM_TYPE_PMSM:
+		return "# n t cur_adc1 cur_adc2 cur_adc3 irc_pos irc_idx"
+		       " irc_idx_occ hal_sec wr_elided";
+	case MZAPO_STREAM_TYPE_DC:
+		return "# n t pwm irc_pos duty_reg wr_elided";
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = "/z3pmdrv1_stream";
+	struct sched_param schp = {.sched_priority = 0};
+	const mzapo_stream_hdr_t *hdr;
+	uint64_t rec_buf[64];
+	uint64_t n, head, lost = 0;
+	long long count = -1;
+	int decim = 1;
+	int from_oldest = 0;
+	struct stat st;
+	int fd;
+	int opt;
+	int res;
+
+	while ((opt = getopt(argc, argv, "n:d:c:a")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'd':
+			decim = atoi(optarg);
+			if (decim < 1)
+				decim = 1;
+			break;
+		case 'c':
+			count = atoll(optarg);
+			break;
+		case 'a':
+			from_oldest = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n shm_name] [-d decimation]"
+				" [-c count] [-a]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	sched_setscheduler(0, SCHED_IDLE, &schp);
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "cannot open shared memory %s\n", name);
+		return 1;
+	}
+	if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(*hdr))) {
+		fprintf(stderr, "%s: stream not initialized\n", name);
+		return 1;
+	}
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		fprintf(stderr, "cannot map shared memory %s\n", name);
+		return 1;
+	}
+	if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != MZAPO_STREAM_MAGIC) ||
+	    (hdr->version != MZAPO_STREAM_VERSION) ||
+	    (hdr->rec_size > sizeof(rec_buf)) ||
+	    (hdr->rec_count & (hdr->rec_count - 1)) ||
+	    ((off_t)mzapo_stream_map_size(hdr->rec_size, hdr->rec_count) >
+	     st.st_size) || (header(hdr->rec_type) == NULL)) {
+		fprintf(stderr, "%s: incompatible stream layout\n", name);
+		return 1;
+	}
+
+	puts(header(hdr->rec_type));
+
+	head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	n = head;
+	if (from_oldest)
+		n = head > hdr->rec_count? head - hdr->rec_count: 0;
+
+	while (count) {
+		res = mzapo_stream_read(hdr, n, rec_buf);
+		if (res > 0) {
+			if (!(n % decim)) {
+				print_rec(hdr->rec_type, n, rec_buf);
+				if (count > 0)
+					count--;
+			}
+			n++;
+			continue;
+		}
+		if (res < 0) {
+			/* Overrun, skip to the oldest record which is safe to read */
+			head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+			if (head > n + hdr->rec_count / 2) {
+				lost += head - hdr->rec_count / 2 - n;
+				n = head - hdr->rec_count / 2;
+			} else {
+				lost++;
+				n++;
+			}
+			fprintf(stderr, "%s: overrun, %" PRIu64 " records lost\n",
+				name, lost);
+			continue;
+		}
+		if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) !=
+		     MZAPO_STREAM_MAGIC) ||
+		    (__atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) < n)) {
+			fprintf(stderr, "%s: stream restarted\n", name);
+			return 2;
+		}
+		fflush(stdout);
+		usleep(1000);
+	}
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+/*******************************************************************
+  Registration trailer of the S-function for tools/sfbench.
+
+  cg_sfun.h          - included at the end of each S-function source
+                       instead of the code generation trailer, exports
+                       <S_FUNCTION_NAME>_sfbench method table
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#define SFBENCH_CAT(a, b)   a##b
+#define SFBENCH_XCAT(a, b)  SFBENCH_CAT(a, b)
+#define SFBENCH_STR(a)      #a
+#define SFBENCH_XSTR(a)     SFBENCH_STR(a)
+
+const sfbench_methods_t SFBENCH_XCAT(S_FUNCTION_NAME, _sfbench) = {
+	.name = SFBENCH_XSTR(S_FUNCTION_NAME),
+	.initialize_sizes = mdlInitializeSizes,
+	.initialize_sample_times = mdlInitializeSampleTimes,
+  #ifdef MDL_INITIALIZE_CONDITIONS
+	.initialize_conditions = mdlInitializeConditions,
+  #endif
+  #ifdef MDL_START
+	.start = mdlStart,
+  #endif
+	.outputs = mdlOutputs,
+  #ifdef MDL_UPDATE
+	.update = mdlUpdate,
+  #endif
+	.terminate = mdlTerminate,
+};
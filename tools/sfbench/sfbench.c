@@ -0,0 +1,423 @@
+/*******************************************************************
+  Host micro-benchmark of the S-function hot paths.
+
+  The S-function sources are compiled unchanged against the SimStruct
+  stand-in of this directory and run with the register file stand-in
+  (MZAPO_MEMDEV regular file on tmpfs), so the measured step includes
+  the same register transfers, telemetry and stream writes as on the
+  target, only the bus is RAM. Simple FPGA model advances the ADC
+  sums and sequence number, IRC counters, Hall code and knobs between
+  the steps.
+
+  Build:
+    S=../../simulink
+    gcc -O2 -Wall -I. -I$S/mz_apo-3pmdrv -o sfbench sfbench.c \
+        $S/mz_apo-3pmdrv/sfPMSMonZynq3pmdrv1.c \
+        $S/mz_apo-3pmdrv/zynq_3pmdrv1_mc.c \
+        $S/mz_apo-2dc/sfDCMotorOnZynq.c $S/mz_apo-2dc/sfAPOKnobInput.c \
+        $S/mz_apo-2dc/sfDCMotorVecOnZynq.c -lm -lpthread -lrt
+  (the current directory has to precede the model directories, it
+  provides simstruc.h and cg_sfun.h)
+
+  Usage:
+    sfbench [-n steps] [-m memdev] [case ...]
+
+  Cases (all by default):
+
+    feeder     - FPGA model of the 3-phase driver alone, the baseline
+                 included in the transfer and pmsm rows
+    transfer   - z3pmdrv1_transfer() alone
+    pmsm       - sfPMSMonZynq3pmdrv1, direct PWM duties
+    pmsm_foc   - sfPMSMonZynq3pmdrv1, FOC with Q16 ADC output
+    pmsm_cic   - sfPMSMonZynq3pmdrv1, CIC decimation and PWM dither
+    dcmot      - sfDCMotorOnZynq
+    dcmot_est  - sfDCMotorOnZynq with velocity estimator and dither
+    dcmotvec   - sfDCMotorVecOnZynq, both axes, motor 0 fed
+    knob       - sfAPOKnobInput
+
+  For each case mdlOutputs and mdlUpdate are called for the given
+  number of steps after 1000 warm-up steps and ns/step is reported,
+  together with cycles, instructions, L1D read misses and last level
+  cache misses per step from perf_event when the kernel allows it
+  (kernel.perf_event_paranoid <= 2, user space only), "-" otherwise.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "simstruc.h"
+#include "zynq_3pmdrv1_mc.h"
+
+#define BENCH_TS           1e-3
+#define BENCH_WARMUP       1000
+
+#define BENCH_WIN_SIZE     0x4000
+#define BENCH_DRV_PHYS     0x43c20000  /* Z3PMDRV1 or DCSPDRV motor 0 */
+#define BENCH_SPILED_PHYS  0x43c40000
+
+extern const sfbench_methods_t sfPMSMonZynq3pmdrv1_sfbench;
+extern const sfbench_methods_t sfDCMotorOnZynq_sfbench;
+extern const sfbench_methods_t sfAPOKnobInput_sfbench;
+extern const sfbench_methods_t sfDCMotorVecOnZynq_sfbench;
+
+enum {
+	FEED_NONE = 0,
+	FEED_Z3PM,
+	FEED_DCMOT,
+	FEED_KNOB,
+};
+
+typedef struct bench_prm_t {
+	int      n;
+	real_T   v[8];
+} bench_prm_t;
+
+typedef struct bench_case_t {
+	const char *name;
+	const sfbench_methods_t *m;     /* NULL for the non-block cases */
+	int      feed;
+	int      num_prm;
+	bench_prm_t prm[SFBENCH_PRM_MAX];
+	real_T   in[2][3];
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+	{"feeder", NULL, FEED_Z3PM, 0, {{0}}, {{0}}},
+	{"transfer", NULL, FEED_Z3PM, 0, {{0}}, {{0}}},
+	{"pmsm", &sfPMSMonZynq3pmdrv1_sfbench, FEED_Z3PM,
+	 1, {{1, {BENCH_TS}}},
+	 {{0.45, 0.5, 0.55}, {1, 1, 1}}},
+	{"pmsm_foc", &sfPMSMonZynq3pmdrv1_sfbench, FEED_Z3PM,
+	 3, {{1, {BENCH_TS}}, {1, {2}},
+	     {7, {0.5, 0.05, 4, 4000, 0, 0.001, 0}}},
+	 {{0, 1, 0}, {1, 1, 1}}},
+	{"pmsm_cic", &sfPMSMonZynq3pmdrv1_sfbench, FEED_Z3PM,
+	 9, {{1, {BENCH_TS}}, {1, {0}}, {0}, {0}, {1, {2}}, {0}, {0}, {0},
+	     {3, {3, 8, 2}}},
+	 {{0.45, 0.5, 0.55}, {1, 1, 1}}},
+	{"dcmot", &sfDCMotorOnZynq_sfbench, FEED_DCMOT,
+	 2, {{1, {BENCH_TS}}, {1, {0}}},
+	 {{0.3}}},
+	{"dcmot_est", &sfDCMotorOnZynq_sfbench, FEED_DCMOT,
+	 4, {{1, {BENCH_TS}}, {1, {0}}, {2, {200, 2}}, {1, {1}}},
+	 {{0.3}}},
+	{"dcmotvec", &sfDCMotorVecOnZynq_sfbench, FEED_DCMOT,
+	 1, {{1, {BENCH_TS}}},
+	 {{0.3, -0.2}}},
+	{"knob", &sfAPOKnobInput_sfbench, FEED_KNOB,
+	 3, {{1, {BENCH_TS}}, {1, {1}}, {1, {0}}},
+	 {{0}}},
+};
+
+/* Register windows of the stand-in file seen by the FPGA model */
+typedef struct bench_feeder_t {
+	volatile uint32_t *drv;
+	volatile uint32_t *spiled;
+	uint32_t cumsum[3];
+	uint32_t sqn;
+	uint32_t irc;
+} bench_feeder_t;
+
+static bench_feeder_t feeder;
+
+typedef struct bench_perf_t {
+	int      fd[4];
+	uint64_t val[4];
+} bench_perf_t;
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} bench_perf_events[4] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+			     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void perf_open(bench_perf_t *perf)
+{
+	struct perf_event_attr pe;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		memset(&pe, 0, sizeof(pe));
+		pe.size = sizeof(pe);
+		pe.type = bench_perf_events[i].type;
+		pe.config = bench_perf_events[i].config;
+		pe.disabled = 1;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+		perf->fd[i] = syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+	}
+}
+
+static void perf_ctl(bench_perf_t *perf, int req)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		if (perf->fd[i] >= 0)
+			ioctl(perf->fd[i], req, 0);
+}
+
+static void perf_close(bench_perf_t *perf)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		perf->val[i] = 0;
+		if (perf->fd[i] < 0)
+			continue;
+		if (read(perf->fd[i], &perf->val[i], sizeof(perf->val[i])) !=
+		    sizeof(perf->val[i]))
+			perf->fd[i] = -1;
+		close(perf->fd[i]);
+	}
+}
+
+static volatile uint32_t *feeder_map(int fd, off_t phys)
+{
+	void *mm = mmap(NULL, BENCH_WIN_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, phys);
+
+	return mm == MAP_FAILED? NULL: (volatile uint32_t *)mm;
+}
+
+static void feeder_reset(void)
+{
+	memset((void *)feeder.drv, 0, BENCH_WIN_SIZE);
+	memset((void *)feeder.spiled, 0, BENCH_WIN_SIZE);
+	memset(feeder.cumsum, 0, sizeof(feeder.cumsum));
+	feeder.sqn = 0;
+	feeder.irc = 0;
+}
+
+/* One PWM period batch of the FPGA model, registers as mzapo_regs.def */
+static inline void feeder_step(int feed, long k)
+{
+	static const uint8_t hal_code[6] = {1, 5, 4, 6, 2, 3};
+	unsigned n, i;
+
+	switch (feed) {
+	case FEED_Z3PM:
+		n = 18 + (k & 3);
+		for (i = 0; i < 3; i++) {
+			feeder.cumsum[i] += n * (2048 + 64 * i + (k & 15));
+			feeder.drv[(0x24 >> 2) + i] = feeder.cumsum[i] & 0xffffff;
+		}
+		feeder.sqn = (feeder.sqn + n) & 0xfff;
+		feeder.irc += 3;
+		feeder.drv[0x08 >> 2] = feeder.irc;
+		if ((k % 4000) == 0)
+			feeder.drv[0x0c >> 2] = feeder.irc;
+		feeder.drv[0x20 >> 2] = feeder.sqn |
+			(hal_code[(feeder.irc / 125) % 6] << 16);
+		break;
+	case FEED_DCMOT:
+		feeder.irc += 5;
+		feeder.drv[0x10 >> 2] = feeder.irc;
+		break;
+	case FEED_KNOB:
+		if ((k & 255) == 0)
+			feeder.spiled[0x24 >> 2] += 0x010101;
+		break;
+	}
+}
+
+static int bench_setup_block(const bench_case_t *c, SimStruct *S)
+{
+	int p, i;
+
+	memset(S, 0, sizeof(*S));
+	S->path = c->name;
+	S->num_prm = c->num_prm;
+	for (p = 0; p < c->num_prm; p++) {
+		S->prm[p].pr = c->prm[p].v;
+		S->prm[p].n = c->prm[p].n;
+	}
+
+	c->m->initialize_sizes(S);
+	if (S->err != NULL)
+		return -1;
+	for (p = 0; p < S->num_in; p++) {
+		for (i = 0; i < SFBENCH_WIDTH_MAX; i++) {
+			S->in_buf[p][i] = (p < 2) && (i < 3)? c->in[p][i]: 0;
+			S->in_ptrs[p][i] = &S->in_buf[p][i];
+		}
+	}
+	S->fixed_step = BENCH_TS;
+	c->m->initialize_sample_times(S);
+
+	if (c->m->start != NULL)
+		c->m->start(S);
+	if ((S->err == NULL) && (c->m->initialize_conditions != NULL))
+		c->m->initialize_conditions(S);
+	if (S->err != NULL) {
+		c->m->terminate(S);
+		return -1;
+	}
+	return 0;
+}
+
+static inline void bench_step(const bench_case_t *c, SimStruct *S,
+			      z3pmdrv1_state_t *z3pmcst, long k)
+{
+	feeder_step(c->feed, k);
+	if (c->m != NULL) {
+		S->t = k * BENCH_TS;
+		c->m->outputs(S, 0);
+		if (c->m->update != NULL)
+			c->m->update(S, 0);
+	} else if (z3pmcst != NULL) {
+		z3pmdrv1_transfer(z3pmcst);
+	}
+}
+
+static int bench_run(const bench_case_t *c, long steps)
+{
+	static SimStruct S;
+	z3pmdrv1_state_t z3pmcst;
+	z3pmdrv1_state_t *z3pmcst_p = NULL;
+	bench_perf_t perf;
+	uint64_t t0, t1;
+	long k;
+	int i;
+
+	feeder_reset();
+
+	if (c->m != NULL) {
+		if (bench_setup_block(c, &S) < 0) {
+			fprintf(stderr, "%s: %s\n", c->name, S.err);
+			return -1;
+		}
+	} else if (!strcmp(c->name, "transfer")) {
+		memset(&z3pmcst, 0, sizeof(z3pmcst));
+		if (z3pmdrv1_init(&z3pmcst) < 0) {
+			fprintf(stderr, "%s: z3pmdrv1_init failed\n", c->name);
+			return -1;
+		}
+		z3pmcst.pwm[0] = 2000 | Z3PMDRV1_PWM_ENABLE;
+		z3pmcst.pwm[1] = 2500 | Z3PMDRV1_PWM_ENABLE;
+		z3pmcst.pwm[2] = 3000 | Z3PMDRV1_PWM_ENABLE;
+		z3pmcst_p = &z3pmcst;
+	}
+
+	for (k = 0; k < BENCH_WARMUP; k++)
+		bench_step(c, &S, z3pmcst_p, k);
+
+	perf_open(&perf);
+	perf_ctl(&perf, PERF_EVENT_IOC_RESET);
+	perf_ctl(&perf, PERF_EVENT_IOC_ENABLE);
+	t0 = time_ns();
+	for (k = BENCH_WARMUP; k < BENCH_WARMUP + steps; k++)
+		bench_step(c, &S, z3pmcst_p, k);
+	t1 = time_ns();
+	perf_ctl(&perf, PERF_EVENT_IOC_DISABLE);
+	perf_close(&perf);
+
+	if (c->m != NULL)
+		c->m->terminate(&S);
+	else if (z3pmcst_p != NULL)
+		z3pmdrv1_release(z3pmcst_p);
+
+	printf("%-10s %9.1f", c->name, (double)(t1 - t0) / steps);
+	for (i = 0; i < 4; i++) {
+		if (perf.fd[i] >= 0)
+			printf(" %9.2f", (double)perf.val[i] / steps);
+		else
+			printf(" %9s", "-");
+	}
+	printf("\n");
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char memdev_buf[64];
+	const char *memdev = NULL;
+	long steps = 1000000;
+	int err = 0;
+	unsigned c;
+	int opt, i, fd;
+
+	while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+		switch (opt) {
+		case 'n':
+			steps = atol(optarg);
+			break;
+		case 'm':
+			memdev = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n steps] [-m memdev] [case ...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (steps <= 0)
+		steps = 1;
+
+	/* Register file on tmpfs, the blocks map it as physical memory */
+	if (memdev == NULL) {
+		snprintf(memdev_buf, sizeof(memdev_buf), "/dev/shm/sfbench_regs.%d",
+			 (int)getpid());
+		memdev = memdev_buf;
+	}
+	setenv("MZAPO_MEMDEV", memdev, 1);
+	unsetenv("MZAPO_IRQDEV");
+
+	fd = open(memdev, O_RDWR | O_CREAT, 0644);
+	if ((fd < 0) ||
+	    (ftruncate(fd, BENCH_SPILED_PHYS + BENCH_WIN_SIZE) < 0)) {
+		fprintf(stderr, "cannot create register file %s\n", memdev);
+		return 1;
+	}
+	feeder.drv = feeder_map(fd, BENCH_DRV_PHYS);
+	feeder.spiled = feeder_map(fd, BENCH_SPILED_PHYS);
+	close(fd);
+	if ((feeder.drv == NULL) || (feeder.spiled == NULL)) {
+		fprintf(stderr, "cannot map register file %s\n", memdev);
+		return 1;
+	}
+
+	printf("%-10s %9s %9s %9s %9s %9s\n", "case", "ns/step", "cycles",
+	       "instr", "L1D-miss", "LLC-miss");
+
+	for (c = 0; c < sizeof(bench_cases) / sizeof(*bench_cases); c++) {
+		int sel = optind >= argc;
+
+		for (i = optind; i < argc; i++)
+			if (!strcmp(argv[i], bench_cases[c].name))
+				sel = 1;
+		if (sel && (bench_run(&bench_cases[c], steps) < 0))
+			err = 1;
+	}
+
+	if (memdev == memdev_buf)
+		unlink(memdev);
+
+	return err;
+}
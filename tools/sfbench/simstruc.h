@@ -0,0 +1,178 @@
+/*******************************************************************
+  Minimal SimStruct stand-in for running the Level-2 C S-functions
+  of this repository outside of Simulink (host benchmarks).
+
+  simstruc.h         - replaces the MATLAB header when tools/sfbench
+                       is first in the include path
+
+  Only the part of the SimStruct API used by the blocks is provided.
+  Parameters are plain double vectors, ports have static storage
+  large enough for any data type, work vectors are fixed arrays.
+  The harness (sfbench.c) fills the parameters, calls the methods
+  registered by cg_sfun.h and advances the time.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#ifndef SFBENCH_SIMSTRUC_H
+#define SFBENCH_SIMSTRUC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef double   real_T;
+typedef double   time_T;
+typedef float    real32_T;
+typedef int      int_T;
+typedef unsigned uint_T;
+typedef int8_t   int8_T;
+typedef uint8_t  uint8_T;
+typedef int16_t  int16_T;
+typedef uint16_t uint16_T;
+typedef int32_t  int32_T;
+typedef uint32_t uint32_T;
+typedef unsigned char boolean_T;
+typedef char     char_T;
+
+typedef const real_T * const *InputRealPtrsType;
+
+#define SFBENCH_PRM_MAX     16
+#define SFBENCH_PORT_MAX    8
+#define SFBENCH_WIDTH_MAX   8
+#define SFBENCH_WORK_MAX    16
+
+typedef struct mxArray {
+  const real_T *pr;
+  size_t    n;
+} mxArray;
+
+#define mxGetPr(a)                 ((real_T *)(a)->pr)
+#define mxGetScalar(a)             ((a)->n > 0? (a)->pr[0]: 0.0)
+#define mxGetNumberOfElements(a)   ((a)->n)
+
+/* Data type identifiers of ssSetOutputPortDataType */
+#define SS_DOUBLE   0
+#define SS_SINGLE   1
+#define SS_INT8     2
+#define SS_UINT8    3
+#define SS_INT16    4
+#define SS_UINT16   5
+#define SS_INT32    6
+#define SS_UINT32   7
+#define SS_BOOLEAN  8
+
+#define CONTINUOUS_SAMPLE_TIME          0.0
+#define INHERITED_SAMPLE_TIME          -1.0
+#define FIXED_IN_MINOR_STEP_OFFSET      1.0
+#define USE_DEFAULT_SIM_STATE           0
+#define SS_OPTION_EXCEPTION_FREE_CODE   0
+
+typedef struct SimStruct {
+  const char *path;
+  const char *err;
+  int       stop_requested;
+  /* Parameters */
+  int       num_prm_expected;
+  int       num_prm;
+  mxArray   prm[SFBENCH_PRM_MAX];
+  /* Ports */
+  int       num_in;
+  int       in_width[SFBENCH_PORT_MAX];
+  real_T    in_buf[SFBENCH_PORT_MAX][SFBENCH_WIDTH_MAX];
+  const real_T *in_ptrs[SFBENCH_PORT_MAX][SFBENCH_WIDTH_MAX];
+  int       num_out;
+  int       out_width[SFBENCH_PORT_MAX];
+  int       out_dtype[SFBENCH_PORT_MAX];
+  unsigned char out_buf[SFBENCH_PORT_MAX][SFBENCH_WIDTH_MAX * 8]
+            __attribute__((aligned(8)));
+  /* Work vectors */
+  int       num_pwork;
+  int       num_iwork;
+  int       num_rwork;
+  void     *pwork[SFBENCH_WORK_MAX];
+  int_T     iwork[SFBENCH_WORK_MAX];
+  real_T    rwork[SFBENCH_WORK_MAX];
+  /* Timing */
+  time_T    t;
+  time_T    sample_time;
+  time_T    offset_time;
+  time_T    fixed_step;
+} SimStruct;
+
+/* Methods of one S-function, filled by cg_sfun.h */
+typedef struct sfbench_methods_t {
+  const char *name;
+  void (*initialize_sizes)(SimStruct *S);
+  void (*initialize_sample_times)(SimStruct *S);
+  void (*initialize_conditions)(SimStruct *S);
+  void (*start)(SimStruct *S);
+  void (*outputs)(SimStruct *S, int_T tid);
+  void (*update)(SimStruct *S, int_T tid);
+  void (*terminate)(SimStruct *S);
+} sfbench_methods_t;
+
+static inline
+int sfbench_set_num_ports(int *num, int n)
+{
+	if ((n < 0) || (n > SFBENCH_PORT_MAX))
+		return 0;
+	*num = n;
+	return 1;
+}
+
+static inline
+void sfbench_set_width(int *width, int n)
+{
+	*width = n <= SFBENCH_WIDTH_MAX? n: SFBENCH_WIDTH_MAX;
+}
+
+#define ssGetPath(S)                        ((S)->path)
+#define ssSetErrorStatus(S, msg)            ((S)->err = (msg))
+#define ssGetErrorStatus(S)                 ((S)->err)
+#define ssSetStopRequested(S, val)          ((S)->stop_requested = (val))
+#define ssGetStopRequested(S)               ((S)->stop_requested)
+
+#define ssSetNumSFcnParams(S, n)            ((S)->num_prm_expected = (n))
+#define ssGetNumSFcnParams(S)               ((S)->num_prm_expected)
+#define ssGetSFcnParamsCount(S)             ((S)->num_prm)
+#define ssGetSFcnParam(S, i)                (&(S)->prm[i])
+
+#define ssSetNumContStates(S, n)            ((void)(n))
+#define ssSetNumDiscStates(S, n)            ((void)(n))
+#define ssSetNumModes(S, n)                 ((void)(n))
+#define ssSetNumNonsampledZCs(S, n)         ((void)(n))
+#define ssSetSimStateCompliance(S, n)       ((void)(n))
+#define ssSetOptions(S, n)                  ((void)(n))
+#define ssSetNumSampleTimes(S, n)           ((void)(n))
+
+#define ssSetNumInputPorts(S, n)            sfbench_set_num_ports(&(S)->num_in, n)
+#define ssSetInputPortWidth(S, p, n)        sfbench_set_width(&(S)->in_width[p], n)
+#define ssSetInputPortDataType(S, p, t)     ((void)(t))
+#define ssSetInputPortDirectFeedThrough(S, p, f) ((void)(f))
+#define ssSetInputPortRequiredContiguous(S, p, f) ((void)(f))
+#define ssGetInputPortRealSignalPtrs(S, p)  ((InputRealPtrsType)(S)->in_ptrs[p])
+
+#define ssSetNumOutputPorts(S, n)           sfbench_set_num_ports(&(S)->num_out, n)
+#define ssSetOutputPortWidth(S, p, n)       sfbench_set_width(&(S)->out_width[p], n)
+#define ssSetOutputPortDataType(S, p, t)    ((S)->out_dtype[p] = (t))
+#define ssGetOutputPortSignal(S, p)         ((void *)(S)->out_buf[p])
+
+#define ssSetNumPWork(S, n)                 ((S)->num_pwork = (n))
+#define ssSetNumIWork(S, n)                 ((S)->num_iwork = (n))
+#define ssSetNumRWork(S, n)                 ((S)->num_rwork = (n))
+#define ssGetPWork(S)                       ((S)->pwork)
+#define ssGetIWork(S)                       ((S)->iwork)
+#define ssGetRWork(S)                       ((S)->rwork)
+
+#define ssSetSampleTime(S, i, ts)           ((S)->sample_time = (ts))
+#define ssSetOffsetTime(S, i, to)           ((S)->offset_time = (to))
+#define ssGetSampleTime(S, i)               ((S)->sample_time)
+#define ssGetFixedStepSize(S)               ((S)->fixed_step)
+#define ssGetT(S)                           ((S)->t)
+#define ssGetTaskTime(S, tid)               ((S)->t)
+
+#endif /*SFBENCH_SIMSTRUC_H*/
@@ -0,0 +1,219 @@
+/*******************************************************************
+  Host (or target) benchmark and exactness check of the current ADC
+  window averaging used by sfPMSMonZynq3pmdrv1.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_adcavg_bench \
+        z3pmdrv1_adcavg_bench.c
+  (add -mfpu=neon -mfloat-abi=hard for the NEON path on Zynq)
+
+  Usage:
+    z3pmdrv1_adcavg_bench [-q] [-n steps]
+
+  The check compares the Q16 kernel against floor(avg * 2^16) computed
+  from the original double divide for every window length 2..450 and
+  every sum reachable by 12-bit samples, then for random 24-bit sums
+  including wrap of the cumulative sums and of the sequence number.
+  The -q option skips the exhaustive part. The benchmark reports time
+  per step of three channels for both paths.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "zynq_3pmdrv1_adcavg.h"
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t rnd_state = 12345;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/* The original computation of mdlOutputs */
+static int avg_double(const uint32_t *cumsum, const uint32_t *cumsum_last,
+		      const int32_t *offs, unsigned sqn, unsigned sqn_last,
+		      double *cur_adc)
+{
+	uint32_t sqn_diff = (sqn - sqn_last) & 0xfff;
+	uint32_t val_diff;
+	int i;
+
+	if ((sqn_diff <= 1) || (sqn_diff > 450))
+		return 0;
+	for (i = 0; i < 3; i++) {
+		val_diff = (cumsum[i] - cumsum_last[i]) & 0xffffff;
+		cur_adc[i] = (double)val_diff / sqn_diff - offs[i];
+	}
+	return sqn_diff;
+}
+
+static int32_t ref_q16(double avg)
+{
+	double v = floor(avg * (1 << Z3PMDRV1_ADCAVG_Q));
+
+	if (v > INT32_MAX)
+		return INT32_MAX;
+	if (v < INT32_MIN)
+		return INT32_MIN;
+	return v;
+}
+
+static long check_one(const uint32_t *cumsum, const uint32_t *cumsum_last,
+		      const int32_t *offs, unsigned sqn, unsigned sqn_last)
+{
+	double cur_d[3];
+	int32_t cur_q[3];
+	int nd, nq, i;
+	long err = 0;
+
+	nd = avg_double(cumsum, cumsum_last, offs, sqn, sqn_last, cur_d);
+	nq = z3pmdrv1_adcavg_q16(cumsum, cumsum_last, offs, sqn, sqn_last, cur_q);
+	if (nd != nq)
+		return 1;
+	if (!nd)
+		return 0;
+	for (i = 0; i < 3; i++) {
+		/* Saturation of corrupted sums is not part of the double path */
+		if ((cur_d[i] + offs[i]) * (1 << Z3PMDRV1_ADCAVG_Q) >= INT32_MAX)
+			continue;
+		if (cur_q[i] != ref_q16(cur_d[i])) {
+			if (err < 10)
+				fprintf(stderr, "mismatch n %u x %u: q16 %d ref %d\n",
+					nd, (cumsum[i] - cumsum_last[i]) & 0xffffff,
+					cur_q[i], ref_q16(cur_d[i]));
+			err++;
+		}
+	}
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint32_t cs[1024][3], csl[1024][3];
+	static uint16_t sq[1024], sql[1024];
+	int32_t offs[3] = {2072, 2077, 2051};
+	int32_t offs0[3] = {0, 0, 0};
+	uint32_t cumsum[3], cumsum_last[3];
+	long steps = 10000000;
+	long err = 0, checked = 0;
+	int quick = 0;
+	double cur_d[3], acc_d = 0;
+	int32_t cur_q[3];
+	int64_t acc_q = 0;
+	uint64_t t0, t1;
+	unsigned n, x;
+	long k;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "qn:")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = 1;
+			break;
+		case 'n':
+			steps = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-n steps]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	z3pmdrv1_adcavg_init();
+
+	if (!quick) {
+		/* All sums of n 12-bit samples, starting from random base */
+		for (n = 2; n <= Z3PMDRV1_ADCAVG_SQN_MAX; n++) {
+			for (x = 0; x <= 4095 * n; x++) {
+				cumsum_last[0] = rnd();
+				cumsum_last[1] = cumsum_last[0];
+				cumsum_last[2] = cumsum_last[0];
+				cumsum[0] = cumsum_last[0] + x;
+				cumsum[1] = cumsum_last[0] + x;
+				cumsum[2] = cumsum_last[0] + x;
+				err += check_one(cumsum, cumsum_last, offs0,
+						 4090 + n, 4090);
+				checked++;
+			}
+		}
+		printf("exhaustive: %ld windows checked, %ld mismatches\n",
+		       checked, err);
+	}
+
+	checked = 0;
+	for (k = 0; k < 10000000; k++) {
+		unsigned sqn_last = rnd() & 0xfff;
+
+		for (i = 0; i < 3; i++) {
+			cumsum_last[i] = rnd();
+			cumsum[i] = rnd();
+		}
+		err += check_one(cumsum, cumsum_last, offs, sqn_last + (rnd() % 460),
+				 sqn_last);
+		checked++;
+	}
+	printf("random 24-bit: %ld steps checked, total mismatches %ld\n",
+	       checked, err);
+
+	/* Benchmark over precomputed realistic windows */
+	for (k = 0; k < 1024; k++) {
+		n = 2 + rnd() % 40;
+		sql[k] = rnd() & 0xfff;
+		sq[k] = sql[k] + n;
+		for (i = 0; i < 3; i++) {
+			csl[k][i] = rnd();
+			cs[k][i] = csl[k][i] + n * (rnd() % 4096);
+		}
+	}
+
+	t0 = time_ns();
+	for (k = 0; k < steps; k++) {
+		unsigned j = k & 1023;
+
+		avg_double(cs[j], csl[j], offs, sq[j], sql[j], cur_d);
+		acc_d += cur_d[0] + cur_d[1] + cur_d[2];
+	}
+	t1 = time_ns();
+	printf("double divide: %.2f ns/step\n", (double)(t1 - t0) / steps);
+
+	t0 = time_ns();
+	for (k = 0; k < steps; k++) {
+		unsigned j = k & 1023;
+
+		z3pmdrv1_adcavg_q16(cs[j], csl[j], offs, sq[j], sql[j], cur_q);
+		acc_q += cur_q[0] + cur_q[1] + cur_q[2];
+	}
+	t1 = time_ns();
+	printf("Q16 reciprocal%s: %.2f ns/step\n",
+  #ifdef Z3PMDRV1_ADCAVG_NEON
+	       " (NEON)",
+  #else
+	       "",
+  #endif
+	       (double)(t1 - t0) / steps);
+
+	/* Keep the results alive */
+	if (acc_d == 1.0 && acc_q == 1)
+		printf("\n");
+
+	return err? 2: 0;
+}
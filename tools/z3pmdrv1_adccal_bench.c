@@ -0,0 +1,195 @@
+/*******************************************************************
+  Host check of the current ADC offset calibration of the 3-phase
+  driver (zynq_3pmdrv1_adccal.h) and of its per-board cache.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_adccal_bench \
+        z3pmdrv1_adccal_bench.c ../simulink/mz_apo-3pmdrv/zynq_3pmdrv1_mc.c \
+        -lm -lpthread -lrt
+
+  Usage:
+    z3pmdrv1_adccal_bench [-m memdev] [-c caldir] [-t avg_time]
+                          [-o offs1,offs2,offs3] [-s noise]
+
+  The registers are mapped from the regular file stand-in -m
+  (/dev/shm/z3pmdrv1_adccal.mem), the calibration cache is kept in
+  -c directory (/tmp/z3pmdrv1_adccal), both are created when missing.
+  Model thread plays the FPGA, every 50 us it adds 20 ADC samples of
+  each channel to the cumulative sums and advances the sequence
+  number. The samples are the -o offsets (2072,2077,2051) plus
+  uniform noise of -s amplitude (8).
+
+  The calibration is run twice, the first run measures the offsets
+  with -t averaging time (0.5 s) after the settling and stores them
+  to the cache, the second one has to load them from the cache
+  without measuring. The recovered offsets, the number of samples
+  and the duration of each run are printed, the exit status is
+  nonzero when an offset differs from the model or the second run
+  does not use the cache.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "zynq_3pmdrv1_adccal.h"
+#include "../common/mzapo_regmap.h"
+
+#define BENCH_MODEL_PERIOD_NS  50000
+#define BENCH_MODEL_SAMPLES    20
+
+static volatile uint32_t *model_regs;
+static int model_offs[Z3PMDRV1_CHAN_COUNT] = {2072, 2077, 2051};
+static int model_noise = 8;
+static int model_stop;
+
+static void *model_thread(void *arg)
+{
+	struct timespec next;
+	uint32_t cumsum[Z3PMDRV1_CHAN_COUNT] = {0, 0, 0};
+	uint32_t sqn = 0, seed = 1;
+	int i, k;
+
+	(void)arg;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&model_stop, __ATOMIC_RELAXED)) {
+		next.tv_nsec += BENCH_MODEL_PERIOD_NS;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		for (k = 0; k < BENCH_MODEL_SAMPLES; k++)
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+				seed = seed * 1103515245 + 12345;
+				cumsum[i] += model_offs[i] + (int)((seed >> 16) %
+					     (2 * model_noise + 1)) - model_noise;
+			}
+		sqn = (sqn + BENCH_MODEL_SAMPLES) & Z3PMDRV1_ADCAVG_SQN_m;
+
+		/* Sums first, the sequence number publishes the batch */
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+			model_regs[(Z3PMDRV1_ADC1_OFFS >> 2) + i] =
+				cumsum[i] & Z3PMDRV1_ADCAVG_CUMSUM_m;
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		model_regs[Z3PMDRV1_ADC_SQN_STAT_OFFS >> 2] = sqn;
+	}
+	return NULL;
+}
+
+static double bench_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	static z3pmdrv1_state_t z3pmcst __attribute__((aligned(Z3PMDRV1_CACHE_LINE)));
+	const char *memdev = "/dev/shm/z3pmdrv1_adccal.mem";
+	const char *caldir = "/tmp/z3pmdrv1_adccal";
+	z3pmdrv1_adccal_rec_t rec;
+	double avg_time = 0.5, t;
+	pthread_t thread;
+	int fd, run, res, i, opt;
+	int fail = 0;
+	void *mm;
+
+	while ((opt = getopt(argc, argv, "m:c:t:o:s:")) != -1) {
+		switch (opt) {
+		case 'm':
+			memdev = optarg;
+			break;
+		case 'c':
+			caldir = optarg;
+			break;
+		case 't':
+			avg_time = atof(optarg);
+			break;
+		case 'o':
+			if (sscanf(optarg, "%d,%d,%d", &model_offs[0],
+				   &model_offs[1], &model_offs[2]) != 3)
+				goto usage;
+			break;
+		case 's':
+			model_noise = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	mkdir(caldir, 0755);
+	setenv("MZAPO_MEMDEV", memdev, 1);
+	setenv("MZAPO_CALDIR", caldir, 1);
+	unsetenv("MZAPO_IRQDEV");
+	unsetenv("MZAPO_REPLAYDIR");
+
+	if (z3pmdrv1_init(&z3pmcst) < 0) {
+		fprintf(stderr, "z3pmdrv1_init failed (MZAPO_MEMDEV %s)\n", memdev);
+		return 1;
+	}
+
+	/* The stand-in exists now, map the block the same way as the driver */
+	fd = open(memdev, O_RDWR);
+	mm = fd < 0? MAP_FAILED: mmap(NULL, Z3PMDRV1_SIZE, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, fd, Z3PMDRV1_BASE_PHYS);
+	if (fd >= 0)
+		close(fd);
+	if (mm == MAP_FAILED) {
+		fprintf(stderr, "cannot map %s for the model\n", memdev);
+		return 1;
+	}
+	model_regs = (volatile uint32_t *)mm;
+	if (pthread_create(&thread, NULL, model_thread, NULL) != 0) {
+		fprintf(stderr, "cannot start the model\n");
+		return 1;
+	}
+
+	for (run = 0; run < 2; run++) {
+		t = bench_time();
+		/* The first run is forced, so a stale cache entry is replaced */
+		res = z3pmdrv1_adccal_run(&z3pmcst, avg_time, run == 0, &rec);
+		t = bench_time() - t;
+		if (res < 0) {
+			printf("run %d: calibration failed\n", run + 1);
+			fail = 1;
+			break;
+		}
+		printf("run %d: %s, offsets %d %d %d, %u samples, %.3f s\n",
+		       run + 1, res? "cache": "measured", rec.offs[0],
+		       rec.offs[1], rec.offs[2], rec.samples, t);
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+			if (rec.offs[i] != model_offs[i])
+				fail = 1;
+		if (res != run)
+			fail = 1;
+	}
+
+	__atomic_store_n(&model_stop, 1, __ATOMIC_RELAXED);
+	pthread_join(thread, NULL);
+	munmap(mm, Z3PMDRV1_SIZE);
+	z3pmdrv1_release(&z3pmcst);
+
+	printf("%s\n", fail? "FAIL": "OK");
+	return fail;
+
+usage:
+	fprintf(stderr, "usage: %s [-m memdev] [-c caldir] [-t avg_time]"
+		" [-o offs1,offs2,offs3] [-s noise]\n", argv[0]);
+	return 1;
+}
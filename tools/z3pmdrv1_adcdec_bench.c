@@ -0,0 +1,364 @@
+/*******************************************************************
+  Host check of the current ADC decimation engine of the 3-phase
+  driver (zynq_3pmdrv1_adcdec.h) on synthetic sample stream.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_adcdec_bench \
+        z3pmdrv1_adcdec_bench.c -lm
+
+  Usage:
+    z3pmdrv1_adcdec_bench [-n windows] [-l len] [-o order] [-a alpha]
+                          [-s seed]
+
+  The three channels are 12-bit samples of phase shifted sinusoids
+  of 1500 units amplitude around 2048 with uniform noise of +-8, the
+  offset 2048 is subtracted. The FPGA sums and sequence number are
+  generated for -n windows (20000) of random length 10..450 samples
+  with injected special windows
+
+    empty     - no samples, HOLD expected
+    single    - one sample, VALID and SHORT expected
+    long      - 451..4000 samples, VALID and LONG expected
+    lost wrap - 4096 to 4546 samples, the sequence number seen
+                differs by 0..450, GAP expected
+    torn read - bit 23 of one sum flipped in one step, GAP expected
+                in the step and the following one
+
+  The window after torn read is kept within 450 samples, the flip
+  is not seen when the true sum of that window exceeds 2^23 (long
+  window of large samples), it is taken as valid window of small
+  average then.
+
+  The same stream is decoded with each filter (NONE, MA, IIR and CIC
+  with -l len 8, -o order 3, -a alpha 0.1). The flags are compared
+  with the expected ones, valid window averages with the exact Q16
+  floor of the generated sums, the filter outputs with straight
+  reference implementations and the held outputs with the previous
+  ones. The largest window average deviation from the noise free
+  signal is printed as well. The exit status is nonzero on any
+  mismatch.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "zynq_3pmdrv1_adcdec.h"
+
+#define BENCH_OFFS       2048
+#define BENCH_AMP        1500.0
+#define BENCH_NOISE      8
+#define BENCH_PERIOD     100000.0
+
+enum {
+	BENCH_WIN_NORMAL,
+	BENCH_WIN_EMPTY,
+	BENCH_WIN_SINGLE,
+	BENCH_WIN_LONG,
+	BENCH_WIN_WRAP,
+	BENCH_WIN_TORN,
+	BENCH_WIN_KINDS
+};
+
+static const char *const bench_win_name[BENCH_WIN_KINDS] = {
+	"normal", "empty", "single", "long", "lost wrap", "torn read"
+};
+
+static const char *const bench_filt_name[] = {"NONE", "MA", "IIR", "CIC"};
+
+/* One generated step, the raw values read and the expectation */
+typedef struct bench_win_t {
+	uint32_t cumsum[Z3PMDRV1_CHAN_COUNT];
+	unsigned sqn;
+	unsigned flags;
+	unsigned n;
+	uint64_t sum[Z3PMDRV1_CHAN_COUNT];  /* window sums of valid window */
+	double   ideal[Z3PMDRV1_CHAN_COUNT]; /* noise free window mean */
+	int      kind;
+} bench_win_t;
+
+static uint32_t bench_seed = 1;
+
+static uint32_t bench_rand(void)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return bench_seed >> 16;
+}
+
+static int bench_sample(uint64_t t, int ch, double *ideal)
+{
+	double v = BENCH_OFFS + BENCH_AMP *
+		   sin(2 * M_PI * t / BENCH_PERIOD - ch * (2 * M_PI / 3));
+	int s;
+
+	*ideal += v;
+	s = (int)lrint(v) + (int)(bench_rand() % (2 * BENCH_NOISE + 1)) -
+	    BENCH_NOISE;
+	return s < 0? 0: s > Z3PMDRV1_ADCDEC_SAMPLE_MAX?
+	       Z3PMDRV1_ADCDEC_SAMPLE_MAX: s;
+}
+
+/* Generate the stream, win[0] holds the initial raw values */
+static void bench_generate(bench_win_t *win, int nwin, int *count)
+{
+	uint32_t cumsum[Z3PMDRV1_CHAN_COUNT] = {0x123456, 0xfff000, 0x800000};
+	unsigned sqn = 0xf80;
+	uint64_t t = 0;
+	unsigned len, r, k;
+	int w, i, kind, torn_prev = 0;
+
+	memset(win, 0, sizeof(*win) * (nwin + 1));
+	memcpy(win[0].cumsum, cumsum, sizeof(cumsum));
+	win[0].sqn = sqn;
+
+	for (w = 1; w <= nwin; w++) {
+		r = bench_rand() % 1000;
+		kind = r < 20? BENCH_WIN_EMPTY: r < 40? BENCH_WIN_SINGLE:
+		       r < 60? BENCH_WIN_LONG: r < 70? BENCH_WIN_WRAP:
+		       r < 75? BENCH_WIN_TORN: BENCH_WIN_NORMAL;
+		/* Torn read is followed by short window, see above */
+		if (torn_prev && (kind != BENCH_WIN_EMPTY) &&
+		    (kind != BENCH_WIN_SINGLE))
+			kind = BENCH_WIN_NORMAL;
+		switch (kind) {
+		case BENCH_WIN_EMPTY:
+			len = 0;
+			break;
+		case BENCH_WIN_SINGLE:
+			len = 1;
+			break;
+		case BENCH_WIN_LONG:
+			len = Z3PMDRV1_ADCAVG_SQN_MAX + 1 + bench_rand() %
+			      (4000 - Z3PMDRV1_ADCAVG_SQN_MAX);
+			break;
+		case BENCH_WIN_WRAP:
+			len = Z3PMDRV1_ADCAVG_SQN_m + 1 + bench_rand() %
+			      (Z3PMDRV1_ADCAVG_SQN_MAX + 1);
+			break;
+		default:
+			len = 10 + bench_rand() % (Z3PMDRV1_ADCAVG_SQN_MAX - 9);
+		}
+		count[kind]++;
+
+		for (k = 0; k < len; k++, t++)
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+				int s = bench_sample(t, i, &win[w].ideal[i]);
+
+				win[w].sum[i] += s;
+				cumsum[i] = (cumsum[i] + s) & Z3PMDRV1_ADCAVG_CUMSUM_m;
+			}
+		sqn = (sqn + len) & Z3PMDRV1_ADCAVG_SQN_m;
+
+		memcpy(win[w].cumsum, cumsum, sizeof(cumsum));
+		win[w].sqn = sqn;
+		win[w].kind = kind;
+		win[w].n = len & Z3PMDRV1_ADCAVG_SQN_m;
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+			if (len)
+				win[w].ideal[i] = win[w].ideal[i] / len - BENCH_OFFS;
+
+		if ((kind == BENCH_WIN_WRAP) || (kind == BENCH_WIN_TORN) ||
+		    torn_prev)
+			win[w].flags = Z3PMDRV1_ADCDEC_GAP | Z3PMDRV1_ADCDEC_HOLD;
+		else if (len == 0)
+			win[w].flags = Z3PMDRV1_ADCDEC_HOLD;
+		else if (len == 1)
+			win[w].flags = Z3PMDRV1_ADCDEC_VALID | Z3PMDRV1_ADCDEC_SHORT;
+		else if (len > Z3PMDRV1_ADCAVG_SQN_MAX)
+			win[w].flags = Z3PMDRV1_ADCDEC_VALID | Z3PMDRV1_ADCDEC_LONG;
+		else
+			win[w].flags = Z3PMDRV1_ADCDEC_VALID;
+
+		if (kind == BENCH_WIN_TORN)
+			win[w].cumsum[bench_rand() % Z3PMDRV1_CHAN_COUNT] ^= 1u << 23;
+		torn_prev = kind == BENCH_WIN_TORN;
+	}
+}
+
+/* Exact floor of the mean in Q16 with the offset subtracted */
+static int32_t bench_mean(uint64_t sum, uint64_t cnt)
+{
+	return (int32_t)((sum << Z3PMDRV1_ADCAVG_Q) / cnt) -
+	       (BENCH_OFFS << Z3PMDRV1_ADCAVG_Q);
+}
+
+/*
+ * Decode the stream with one filter and compare every step with
+ * straight reference, returns the number of mismatching steps.
+ */
+static int bench_run(const bench_win_t *win, int nwin, int filter, int len,
+		int order, float alpha, double *dev_max)
+{
+	static z3pmdrv1_adcdec_t dec;
+	static int32_t stage[Z3PMDRV1_ADCDEC_ORDER_MAX][Z3PMDRV1_ADCDEC_LEN_MAX]
+			    [Z3PMDRV1_CHAN_COUNT];
+	static int valid[Z3PMDRV1_ADCDEC_LEN_MAX];  /* valid windows since restart */
+	const int32_t offs[Z3PMDRV1_CHAN_COUNT] = {BENCH_OFFS, BENCH_OFFS, BENCH_OFFS};
+	int32_t avg_prev[Z3PMDRV1_CHAN_COUNT] = {0, 0, 0};
+	int32_t out_prev[Z3PMDRV1_CHAN_COUNT] = {0, 0, 0};
+	int32_t ref[Z3PMDRV1_CHAN_COUNT];
+	float iir[Z3PMDRV1_CHAN_COUNT];
+	int nvalid = 0, mismatch = 0, w, i, j, s, m;
+	unsigned flags;
+
+	if (z3pmdrv1_adcdec_init(&dec, filter, len, order, alpha,
+				 win[0].cumsum, win[0].sqn) < 0)
+		return -1;
+	if (filter != Z3PMDRV1_ADCDEC_FILT_CIC)
+		order = 1;
+
+	for (w = 1; w <= nwin; w++) {
+		const bench_win_t *wi = &win[w];
+		int bad = 0;
+
+		flags = z3pmdrv1_adcdec_step(&dec, wi->cumsum, wi->sqn, offs);
+		if ((flags != wi->flags) || (dec.n != wi->n))
+			bad = 1;
+
+		if (flags & Z3PMDRV1_ADCDEC_GAP)
+			nvalid = 0;
+		if (!(flags & Z3PMDRV1_ADCDEC_VALID)) {
+			/* Held outputs */
+			if (memcmp(dec.avg_q16, avg_prev, sizeof(avg_prev)) ||
+			    memcmp(dec.out_q16, out_prev, sizeof(out_prev)))
+				bad = 1;
+			mismatch += bad;
+			continue;
+		}
+
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+			int32_t a = bench_mean(wi->sum[i], wi->n);
+			double dev = fabs(dec.avg_q16[i] / 65536.0 - wi->ideal[i]);
+
+			if (dec.avg_q16[i] != a)
+				bad = 1;
+			if (dev > *dev_max)
+				*dev_max = dev;
+		}
+
+		/* Reference filter over the valid windows since restart */
+		valid[nvalid % len] = w;
+		m = nvalid < len? nvalid + 1: len;
+		switch (filter) {
+		case Z3PMDRV1_ADCDEC_FILT_MA:
+		case Z3PMDRV1_ADCDEC_FILT_CIC:
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+				uint64_t sum = 0, cnt = 0;
+
+				for (j = 0; j < m; j++) {
+					sum += win[valid[j]].sum[i];
+					cnt += win[valid[j]].n;
+				}
+				ref[i] = bench_mean(sum, cnt);
+			}
+			for (s = 1; s < order; s++) {
+				memcpy(stage[s][nvalid % len], ref, sizeof(ref));
+				for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+					int64_t sum = 0;
+
+					for (j = 0; j < m; j++)
+						sum += stage[s][j][i];
+					ref[i] = sum / m;
+				}
+			}
+			break;
+		case Z3PMDRV1_ADCDEC_FILT_IIR:
+			for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+				if (nvalid)
+					iir[i] += alpha * (dec.avg_q16[i] - iir[i]);
+				else
+					iir[i] = dec.avg_q16[i];
+				ref[i] = iir[i];
+			}
+			break;
+		default:
+			memcpy(ref, dec.avg_q16, sizeof(ref));
+		}
+		if (memcmp(dec.out_q16, ref, sizeof(ref)))
+			bad = 1;
+
+		nvalid++;
+		memcpy(avg_prev, dec.avg_q16, sizeof(avg_prev));
+		memcpy(out_prev, dec.out_q16, sizeof(out_prev));
+		mismatch += bad;
+	}
+
+	return mismatch;
+}
+
+int main(int argc, char *argv[])
+{
+	int count[BENCH_WIN_KINDS] = {0};
+	bench_win_t *win;
+	double dev_max = 0;
+	float alpha = 0.1f;
+	int nwin = 20000, len = 8, order = 3;
+	int filter, res, opt, k;
+	int fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:l:o:a:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nwin = atoi(optarg);
+			break;
+		case 'l':
+			len = atoi(optarg);
+			break;
+		case 'o':
+			order = atoi(optarg);
+			break;
+		case 'a':
+			alpha = atof(optarg);
+			break;
+		case 's':
+			bench_seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (nwin < 1)
+		goto usage;
+
+	z3pmdrv1_adcavg_init();
+
+	win = malloc(sizeof(*win) * (nwin + 1));
+	if (win == NULL)
+		return 1;
+	bench_generate(win, nwin, count);
+
+	printf("# %d windows:", nwin);
+	for (k = 0; k < BENCH_WIN_KINDS; k++)
+		printf(" %s %d%s", bench_win_name[k], count[k],
+		       k < BENCH_WIN_KINDS - 1? ",": "\n");
+
+	for (filter = Z3PMDRV1_ADCDEC_FILT_NONE; filter <= Z3PMDRV1_ADCDEC_FILT_CIC;
+	     filter++) {
+		res = bench_run(win, nwin, filter, len, order, alpha, &dev_max);
+		if (res < 0) {
+			fprintf(stderr, "unsupported len %d or order %d\n", len, order);
+			free(win);
+			return 1;
+		}
+		printf("%-4s mismatching steps %d\n", bench_filt_name[filter], res);
+		if (res)
+			fail = 1;
+	}
+	printf("# window average deviation from noise free signal max %.3f\n",
+	       dev_max);
+
+	free(win);
+	printf("%s\n", fail? "FAIL": "OK");
+	return fail;
+
+usage:
+	fprintf(stderr, "usage: %s [-n windows] [-l len] [-o order] [-a alpha]"
+		" [-s seed]\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,266 @@
+/*******************************************************************
+  Host check of the commutation commissioning of the 3-phase driver
+  (zynq_3pmdrv1_commis.h) against simulated motor.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_commis_bench \
+        z3pmdrv1_commis_bench.c ../simulink/mz_apo-3pmdrv/zynq_3pmdrv1_mc.c \
+        -lm -lpthread -lrt
+
+  Usage:
+    z3pmdrv1_commis_bench [-m memdev] [-c caldir] [-p pole_pairs]
+                          [-i irc_per_rev] [-x index_pos] [-h hall_shift]
+
+  The registers are mapped from the regular file stand-in -m
+  (/dev/shm/z3pmdrv1_commis.mem), the calibration cache is kept in
+  -c directory (/tmp/z3pmdrv1_commis), both are created when missing.
+  Model thread plays the FPGA and the motor, every 20 us it takes
+  the voltage vector angle from the PWM registers and the rotor
+  electrical angle follows it with 5 ms first order lag, so the lag
+  grows with speed and changes sign with direction. The motor has
+  -p pole pairs (4) and -i IRC counts per revolution (2000), counter
+  zero is at electrical angle zero and the index is at -x counts
+  (617.8) of each revolution. The Hall sectors are the 60 degree
+  intervals of the original hard-coded table of the PMSM block
+  shifted by -h degrees (10), the expected sector of a code is the
+  one containing its middle.
+
+  The vector turns two mechanical revolutions at 4 Hz electrical,
+  so two index events are seen. The commissioning is run three
+  times, forced with irc_per_rev given, forced with irc_per_rev
+  measured by index events and last from the cache. The pole pairs,
+  index offset, Hall phases and table are printed against the model,
+  the exit status is nonzero when pole pairs, irc_per_rev or Hall
+  table differ, the index offset is more than 2 counts off (the
+  truncating counter and the index latch bias it by up to 1.5
+  counts) or the last run does not use the cache.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "zynq_3pmdrv1_commis.h"
+#include "../common/mzapo_regmap.h"
+
+#define BENCH_MODEL_PERIOD_NS  20000
+#define BENCH_MODEL_TAU        0.005
+#define BENCH_AMP              0.1f
+#define BENCH_ELEC_HZ          4.0
+#define BENCH_MECH_REVS        2
+
+/* Hall code of each sector, inverse of the PMSM block table */
+static const uint8_t model_hall_code[6] = {1, 5, 4, 6, 2, 3};
+
+static volatile uint32_t *model_regs;
+static int model_pole_pairs = 4;
+static int model_irc_per_rev = 2000;
+static double model_index_pos = 617.8;
+static double model_hall_shift = 10;
+static int model_stop;
+
+static void *model_thread(void *arg)
+{
+	struct timespec next;
+	double theta = 2.0, a, alpha, beta, d[Z3PMDRV1_CHAN_COUNT];
+	double k = 1 - exp(-BENCH_MODEL_PERIOD_NS * 1e-9 / BENCH_MODEL_TAU);
+	double counts_per_rad = model_irc_per_rev / (2 * M_PI * model_pole_pairs);
+	double pos, idx_prev, idx;
+	uint32_t reg, idx_latch = 0;
+	int i, shdn, sector;
+
+	(void)arg;
+	idx_prev = floor((theta * counts_per_rad - model_index_pos) /
+			 model_irc_per_rev);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&model_stop, __ATOMIC_RELAXED)) {
+		next.tv_nsec += BENCH_MODEL_PERIOD_NS;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		shdn = 0;
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+			reg = model_regs[(Z3PMDRV1_PWM1_OFFS >> 2) + i];
+			if (reg & MZAPO_REGMAP_MASK(Z3PMDRV1_PWM1_SHDN))
+				shdn = 1;
+			d[i] = (double)Z3PMDRV1_PWM1_VAL_get(reg) /
+			       Z3PMDRV1_PWM_DUTY_FULL;
+		}
+		alpha = d[0] - (d[1] + d[2]) / 2;
+		beta = (d[1] - d[2]) * sqrt(3) / 2;
+
+		/* The rotor follows the vector, released in shutdown */
+		if (!shdn && (hypot(alpha, beta) > 1e-3)) {
+			a = atan2(beta, alpha) - theta;
+			a -= 2 * M_PI * floor(a / (2 * M_PI) + 0.5);
+			theta += k * a;
+		}
+
+		pos = theta * counts_per_rad;
+		idx = floor((pos - model_index_pos) / model_irc_per_rev);
+		if (idx != idx_prev) {
+			/* First count past the index in the direction of motion,
+			   so forward and backward crossings latch different values */
+			idx_latch = (uint32_t)(int32_t)floor(model_index_pos +
+				    model_irc_per_rev * (idx > idx_prev? idx: idx_prev));
+			if (idx > idx_prev)
+				idx_latch++;
+			idx_prev = idx;
+		}
+		a = theta * 180 / M_PI + model_hall_shift;
+		sector = (int)floor(a / 60 - 6 * floor(a / 360));
+		if (sector > 5)
+			sector = 5;
+
+		model_regs[Z3PMDRV1_IRC_POS_OFFS >> 2] = (uint32_t)(int32_t)floor(pos);
+		model_regs[Z3PMDRV1_IRC_IDX_POS_OFFS >> 2] = idx_latch;
+		model_regs[Z3PMDRV1_ADC_SQN_STAT_OFFS >> 2] =
+			Z3PMDRV1_ADC_SQN_STAT_HAL_val(model_hall_code[sector]);
+	}
+	return NULL;
+}
+
+/* Check the result against the model, returns nonzero on mismatch */
+static int bench_check(const z3pmdrv1_commis_res_t *res)
+{
+	double per_elec = (double)model_irc_per_rev / model_pole_pairs;
+	double idx_offs = ceil(model_index_pos / per_elec) * per_elec -
+			  model_index_pos;
+	double ph;
+	int fail = 0, s, c, ms;
+
+	printf("  irc_per_rev %d pole_pairs %d idx_offs %d (model %.1f)\n",
+	       res->irc_per_rev, res->pole_pairs, res->idx_offs, idx_offs);
+	if ((res->irc_per_rev != model_irc_per_rev) ||
+	    (res->pole_pairs != model_pole_pairs) ||
+	    (fabs(res->idx_offs - idx_offs) > 2))
+		fail = 1;
+
+	for (s = 0; s < 6; s++) {
+		c = model_hall_code[s];
+		/* Middle of the code and the sector containing it */
+		ph = s * 60 + 30 - model_hall_shift;
+		ph -= 360 * floor(ph / 360);
+		ms = (int)(ph / 60);
+		printf("  code %d sector %d (model %d) phase %5.1f (model %5.1f) deg\n",
+		       c, res->hall_table[c], ms,
+		       res->hall_phase[c] * (360 / 4294967296.0), ph);
+		if (res->hall_table[c] != ms)
+			fail = 1;
+	}
+
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	static z3pmdrv1_state_t z3pmcst __attribute__((aligned(Z3PMDRV1_CACHE_LINE)));
+	const char *memdev = "/dev/shm/z3pmdrv1_commis.mem";
+	const char *caldir = "/tmp/z3pmdrv1_commis";
+	z3pmdrv1_commis_t cm;
+	pthread_t thread;
+	int fd, run, res, opt;
+	int fail = 0;
+	void *mm;
+
+	while ((opt = getopt(argc, argv, "m:c:p:i:x:h:")) != -1) {
+		switch (opt) {
+		case 'm':
+			memdev = optarg;
+			break;
+		case 'c':
+			caldir = optarg;
+			break;
+		case 'p':
+			model_pole_pairs = atoi(optarg);
+			break;
+		case 'i':
+			model_irc_per_rev = atoi(optarg);
+			break;
+		case 'x':
+			model_index_pos = atof(optarg);
+			break;
+		case 'h':
+			model_hall_shift = atof(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if ((model_pole_pairs < 1) || (model_irc_per_rev < model_pole_pairs) ||
+	    (model_index_pos < 0) || (model_index_pos >= model_irc_per_rev))
+		goto usage;
+
+	mkdir(caldir, 0755);
+	setenv("MZAPO_MEMDEV", memdev, 1);
+	setenv("MZAPO_CALDIR", caldir, 1);
+	unsetenv("MZAPO_IRQDEV");
+	unsetenv("MZAPO_REPLAYDIR");
+
+	if (z3pmdrv1_init(&z3pmcst) < 0) {
+		fprintf(stderr, "z3pmdrv1_init failed (MZAPO_MEMDEV %s)\n", memdev);
+		return 1;
+	}
+
+	/* The stand-in exists now, map the block the same way as the driver */
+	fd = open(memdev, O_RDWR);
+	mm = fd < 0? MAP_FAILED: mmap(NULL, Z3PMDRV1_SIZE, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, fd, Z3PMDRV1_BASE_PHYS);
+	if (fd >= 0)
+		close(fd);
+	if (mm == MAP_FAILED) {
+		fprintf(stderr, "cannot map %s for the model\n", memdev);
+		return 1;
+	}
+	model_regs = (volatile uint32_t *)mm;
+	if (pthread_create(&thread, NULL, model_thread, NULL) != 0) {
+		fprintf(stderr, "cannot start the model\n");
+		return 1;
+	}
+
+	for (run = 0; run < 3; run++) {
+		/* Given irc_per_rev, measured by index, then from cache */
+		res = z3pmdrv1_commis_run(&z3pmcst, &cm, BENCH_AMP, BENCH_ELEC_HZ,
+				BENCH_MECH_REVS * model_pole_pairs,
+				run == 0? model_irc_per_rev: 0, run < 2);
+		if (res < 0) {
+			printf("run %d: commissioning failed\n", run + 1);
+			fail = 1;
+			break;
+		}
+		printf("run %d: %s, irc_per_rev %s\n", run + 1,
+		       res? "cache": "measured", run == 0? "given": "by index");
+		if (bench_check(&cm.res))
+			fail = 1;
+		if (res != (run == 2))
+			fail = 1;
+	}
+
+	__atomic_store_n(&model_stop, 1, __ATOMIC_RELAXED);
+	pthread_join(thread, NULL);
+	munmap(mm, Z3PMDRV1_SIZE);
+	z3pmdrv1_release(&z3pmcst);
+
+	printf("%s\n", fail? "FAIL": "OK");
+	return fail;
+
+usage:
+	fprintf(stderr, "usage: %s [-m memdev] [-c caldir] [-p pole_pairs]"
+		" [-i irc_per_rev] [-x index_pos] [-h hall_shift]\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,170 @@
+/*******************************************************************
+  Host check of the dead-time compensation stage of the 3-phase
+  driver (zynq_3pmdrv1_dtc.h) in a resistive toy model.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_dtc_bench \
+        z3pmdrv1_dtc_bench.c -lm
+
+  Usage:
+    z3pmdrv1_dtc_bench [-n points] [-m i_max] [-r resistance] [-l loss]
+
+  The load is pure resistance R (duty per ADC unit), each phase loses
+  loss * tanh(i / 5) of its voltage, the losses reach the phase
+  voltages through the star point. Phase a is driven by sinusoidal
+  current reference of 60 ADC units amplitude in open loop, phases
+  b and c return half of the current each.
+
+  The calibration mode is fed by 200000 steps, the fitted resistance
+  and table are printed against the true values together with the
+  largest table error relative to the saturated loss. Then the
+  compensation mode with the fitted table is run and the RMS current
+  error with and without the compensation is printed. The default
+  table has 9 points up to 20 ADC units, the table spacing has to
+  resolve the knee of the loss, 9 points up to 40 units leave the
+  table error above 10 %.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "zynq_3pmdrv1_dtc.h"
+
+#define BENCH_CAL_STEPS  200000
+#define BENCH_RUN_STEPS  40000
+#define BENCH_REF_AMP    60.0
+#define BENCH_REF_STEPS  20000.0
+#define BENCH_LOSS_I0    5.0
+
+static double bench_r = 0.004;
+static double bench_loss = 0.02;
+
+static double toy_loss(double i)
+{
+	return bench_loss * tanh(i / BENCH_LOSS_I0);
+}
+
+/*
+ * One step of the toy model. The duties are commanded for the step,
+ * *ia is the phase a current measured in the previous one and it is
+ * replaced by the current flowing during this step.
+ */
+static void toy_step(const float *duty, double *ia)
+{
+	double la = toy_loss(*ia), lb = toy_loss(-*ia / 2);
+	double va;
+
+	va = (duty[0] - (duty[0] + duty[1] + duty[2]) / 3) -
+	     (la - (la + lb + lb) / 3);
+	*ia = va / bench_r;
+}
+
+static void toy_duty(int k, float *duty)
+{
+	double u = BENCH_REF_AMP * sin(2 * M_PI * k / BENCH_REF_STEPS) * bench_r;
+
+	/* Phase a voltage against the star point is u */
+	duty[0] = 0.5 + u;
+	duty[1] = 0.5 - u / 2;
+	duty[2] = 0.5 - u / 2;
+}
+
+static void toy_cur(double ia, int32_t *cur)
+{
+	cur[0] = lrint(ia * 65536);
+	cur[1] = lrint(-ia / 2 * 65536);
+	cur[2] = cur[1];
+}
+
+/* RMS error of phase a current against the reference, dtc can be NULL */
+static double toy_run(const z3pmdrv1_dtc_t *dtc)
+{
+	double ia = 0, ref, err = 0;
+	int32_t cur[Z3PMDRV1_CHAN_COUNT];
+	float duty[Z3PMDRV1_CHAN_COUNT];
+	int k, ph;
+
+	for (k = 0; k < BENCH_RUN_STEPS; k++) {
+		ref = BENCH_REF_AMP * sin(2 * M_PI * k / BENCH_REF_STEPS);
+		toy_duty(k, duty);
+		toy_cur(ia, cur);
+		for (ph = 0; ph < Z3PMDRV1_CHAN_COUNT; ph++)
+			duty[ph] = z3pmdrv1_dtc_apply(dtc, cur, ph, duty[ph]);
+		toy_step(duty, &ia);
+		err += (ia - ref) * (ia - ref);
+	}
+	return sqrt(err / BENCH_RUN_STEPS);
+}
+
+int main(int argc, char *argv[])
+{
+	static z3pmdrv1_dtc_t dtc;
+	int32_t cur[Z3PMDRV1_CHAN_COUNT];
+	float duty[Z3PMDRV1_CHAN_COUNT];
+	double i_max = 20, ia = 0, err, err_max = 0;
+	int n = 9;
+	int k, opt;
+
+	while ((opt = getopt(argc, argv, "n:m:r:l:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'm':
+			i_max = atof(optarg);
+			break;
+		case 'r':
+			bench_r = atof(optarg);
+			break;
+		case 'l':
+			bench_loss = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n points] [-m i_max]"
+				" [-r resistance] [-l loss]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (z3pmdrv1_dtc_init(&dtc, Z3PMDRV1_DTC_MODE_CAL, i_max, n, NULL) < 0) {
+		fprintf(stderr, "unsupported table %d points up to %g\n", n, i_max);
+		return 1;
+	}
+
+	for (k = 0; k < BENCH_CAL_STEPS; k++) {
+		toy_duty(k, duty);
+		toy_cur(ia, cur);
+		z3pmdrv1_dtc_cal_step(&dtc, duty, cur, 1);
+		toy_step(duty, &ia);
+	}
+	if (z3pmdrv1_dtc_cal_finish(&dtc) < 0) {
+		fprintf(stderr, "calibration failed, %u samples\n", dtc.cal.samples);
+		return 1;
+	}
+
+	printf("# %u samples, R %.6g (true %.6g)\n", dtc.cal.samples,
+	       dtc.cal.r, bench_r);
+	printf("#   current      fitted        true\n");
+	for (k = 0; k < n; k++) {
+		double i = k * i_max / (n - 1);
+
+		err = fabs(dtc.comp[k] - toy_loss(i)) / bench_loss;
+		if (err > err_max)
+			err_max = err;
+		printf("%10.2f %11.6f %11.6f\n", i, dtc.comp[k], toy_loss(i));
+	}
+	printf("# table error max %.1f %% of the saturated loss\n", err_max * 100);
+
+	dtc.mode = Z3PMDRV1_DTC_MODE_COMP;
+	printf("# RMS current error: uncompensated %.2f, compensated %.2f\n",
+	       toy_run(NULL), toy_run(&dtc));
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*******************************************************************
+  Host (or target) benchmark of the field oriented current control
+  kernel used by sfPMSMonZynq3pmdrv1 in FOC mode.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_foc_bench \
+        z3pmdrv1_foc_bench.c -lm
+  (use -mfpu=neon -mfloat-abi=hard -ffast-math on Zynq)
+
+  Usage:
+    z3pmdrv1_foc_bench [-n steps] [-d id_ref] [-q iq_ref] [-w irc_per_step]
+
+  The kernel closes the loop around simple star connected RL load
+  which rotates at constant speed (IRC counts per step), current
+  is fed back as Q16 ADC averages. The tool reports the kernel time
+  per step (measured separately without the load model) and d/q
+  current tracking over the last 1000 closed loop steps.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "zynq_3pmdrv1_foc.h"
+
+/* Load and loop parameters, currents in ADC units */
+#define BENCH_TS           50e-6
+#define BENCH_R            1.0
+#define BENCH_L            1e-3
+#define BENCH_UDC          100.0     /* ADC units per unit of normalized voltage */
+#define BENCH_POLE_PAIRS   4
+#define BENCH_IRC_PER_REV  4000
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	z3pmdrv1_foc_t foc;
+	double cur[3] = {0, 0, 0};
+	int32_t cur_q16[3];
+	double id_ref = 0, iq_ref = 20;
+	double id_err = 0, iq_err = 0;
+	double kp, ki, alpha;
+	uint64_t t_kernel, t0;
+	int32_t irc = 123456;
+	int irc_per_step = 3;
+	long steps = 1000000;
+	long k;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:d:q:w:")) != -1) {
+		switch (opt) {
+		case 'n':
+			steps = atol(optarg);
+			break;
+		case 'd':
+			id_ref = atof(optarg);
+			break;
+		case 'q':
+			iq_ref = atof(optarg);
+			break;
+		case 'w':
+			irc_per_step = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n steps] [-d id_ref] [-q iq_ref]"
+				" [-w irc_per_step]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	/* Pole-zero cancellation, closed loop bandwidth 1/(10 Ts) */
+	alpha = 1.0 / (10 * BENCH_TS);
+	kp = alpha * BENCH_L / BENCH_UDC;
+	ki = alpha * BENCH_R / BENCH_UDC * BENCH_TS;
+
+	memset(&foc, 0, sizeof(foc));
+	z3pmdrv1_foc_init(&foc, kp, ki, 0, 1.0, BENCH_POLE_PAIRS,
+			  BENCH_IRC_PER_REV, 1000);
+
+	for (k = 0; k < steps; k++) {
+		double v[3], vn;
+
+		for (i = 0; i < 3; i++)
+			cur_q16[i] = lrint(cur[i] * 65536);
+
+		z3pmdrv1_foc_step(&foc, cur_q16, irc, id_ref, iq_ref);
+
+		/* Star connected load, phase voltage relative to neutral */
+		vn = (foc.duty[0] + foc.duty[1] + foc.duty[2]) / 3;
+		for (i = 0; i < 3; i++) {
+			v[i] = (foc.duty[i] - vn) * BENCH_UDC;
+			cur[i] += (v[i] - BENCH_R * cur[i]) / BENCH_L * BENCH_TS;
+		}
+		irc += irc_per_step;
+
+		if (k >= steps - 1000) {
+			id_err += fabs(foc.i_d - id_ref);
+			iq_err += fabs(foc.i_q - iq_ref);
+		}
+	}
+
+	printf("tracking over last 1000 steps: |id - id_ref| %.4f,"
+	       " |iq - iq_ref| %.4f, u_d %.4f u_q %.4f\n",
+	       id_err / 1000, iq_err / 1000, foc.u_d, foc.u_q);
+
+	/* Kernel alone, the last currents rotated by the advancing angle */
+	t0 = time_ns();
+	for (k = 0; k < steps; k++) {
+		z3pmdrv1_foc_step(&foc, cur_q16, irc, id_ref, iq_ref);
+		irc += irc_per_step;
+	}
+	t_kernel = time_ns() - t0;
+	printf("kernel: %.2f ns/step\n", (double)t_kernel / steps);
+
+	return 0;
+}
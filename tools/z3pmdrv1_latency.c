@@ -0,0 +1,392 @@
+/*******************************************************************
+  Latency and jitter of the 3-phase driver control path measured
+  on the real register transfer (cyclictest on the control path).
+
+  Build (on target or host):
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_latency \
+        z3pmdrv1_latency.c ../simulink/mz_apo-3pmdrv/zynq_3pmdrv1_mc.c \
+        -lm -lpthread -lrt
+
+  Usage:
+    z3pmdrv1_latency [-r rate_hz] [-p priority] [-a cpu] [-n steps]
+                     [-m memdev] [-i irqdev] [-e duty] [-b bin_ns]
+                     [-H bins] [-T trace_len] [-q]
+
+  The loop runs at -r rate (10 kHz default) in SCHED_FIFO with -p
+  priority (80) pinned to -a cpu (not pinned by default), memory
+  locked, the same way as the inner loop of zynq_3pmdrv1_rtloop.h.
+  Each period it calls z3pmdrv1_transfer() on the backend selected
+  the same way as the blocks do, MZAPO_MEMDEV (or -m) is /dev/mem by
+  default or the regular file stand-in, MZAPO_IRQDEV (or -i) makes
+  the loop wait for the PWM period interrupt instead of the timer.
+
+  Measured per step, all CLOCK_MONOTONIC
+
+    wakeup  - wake-up time minus the programmed absolute time, with
+              the interrupt the step interval minus the nominal period
+              (signed, the histogram is centered then)
+    xfer    - duration of z3pmdrv1_transfer()
+    s2a     - sensor to actuator time, the transfer writes the PWM
+              computed from the previous step first and then reads
+              the IRC, Hall and ADC registers, so the sensor values
+              read at the end of step k reach the bridge at the start
+              of the transfer of step k+1
+
+  The report gives min/avg/max of each, overruns (missed periods),
+  histograms with -b bin width (1000 ns) and -H bins (200) as nonzero
+  "ns count" rows for plotting and, unless -q, the trace of last -T
+  steps (16) leading to the worst case of each quantity.
+
+  The PWM outputs are kept in shutdown unless -e duty 0..1 enables
+  all three phases with the same duty, the bridge then applies zero
+  voltage vector only, still be careful with a motor connected.
+  The command is constant, so the PWM writes are elided except for
+  the periodic refresh (MZAPO_REGSHADOW_REFRESH), build with
+  -DMZAPO_REGSHADOW_REFRESH=0 to measure the transfer writing all
+  registers every step.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "zynq_3pmdrv1_mc.h"
+
+#define LAT_NUM     3
+#define LAT_WAKEUP  0
+#define LAT_XFER    1
+#define LAT_S2A     2
+
+static const char *const lat_name[LAT_NUM] = {"wakeup", "xfer", "s2a"};
+
+/* One step of the loop, times relative to the loop start */
+typedef struct lat_rec_t {
+	uint32_t step;
+	int64_t  t_sched;
+	int64_t  t_wake;
+	int64_t  t_xfer_beg;
+	int64_t  t_xfer_end;
+	uint32_t act_pos;
+	uint16_t curadc_sqn;
+	uint8_t  hal_sensors;
+} lat_rec_t;
+
+typedef struct lat_stat_t {
+	int64_t  min;
+	int64_t  max;
+	int64_t  sum;
+	uint64_t cnt;
+	int64_t  hist_base;
+	uint32_t *hist;
+	uint32_t under;
+	uint32_t over;
+	lat_rec_t *worst;   /* trace_len records ending by the worst step */
+} lat_stat_t;
+
+static int hist_bins = 200;
+static int bin_ns = 1000;
+static int trace_len = 16;
+
+static int64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void ts_add_ns(struct timespec *ts, long ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000) {
+		ts->tv_nsec -= 1000000000;
+		ts->tv_sec++;
+	}
+}
+
+static int lat_stat_init(lat_stat_t *st, int centered)
+{
+	memset(st, 0, sizeof(*st));
+	st->min = INT64_MAX;
+	st->max = INT64_MIN;
+	st->hist_base = centered? -(int64_t)(hist_bins / 2) * bin_ns: 0;
+	st->hist = calloc(hist_bins, sizeof(*st->hist));
+	st->worst = calloc(trace_len, sizeof(*st->worst));
+	return (st->hist != NULL) && (st->worst != NULL)? 0: -1;
+}
+
+/* Account value of the step, the ring holds the last trace_len steps */
+static inline void lat_stat_add(lat_stat_t *st, int64_t v,
+				const lat_rec_t *ring, uint32_t step)
+{
+	int64_t bin;
+	int i;
+
+	st->sum += v;
+	st->cnt++;
+	if (v < st->min)
+		st->min = v;
+	if (v > st->max) {
+		st->max = v;
+		/* Snapshot is rare after the first steps, copy in the loop is fine */
+		for (i = 0; i < trace_len; i++)
+			st->worst[i] = ring[(step + 1 + i) % trace_len];
+	}
+
+	bin = (v - st->hist_base) / bin_ns;
+	if (v < st->hist_base)
+		st->under++;
+	else if (bin >= hist_bins)
+		st->over++;
+	else
+		st->hist[bin]++;
+}
+
+static void print_stats(lat_stat_t *st)
+{
+	int i, j;
+
+	printf("%-8s %10s %10s %10s  [ns]\n", "", "min", "avg", "max");
+	for (j = 0; j < LAT_NUM; j++) {
+		if (!st[j].cnt)
+			continue;
+		printf("%-8s %10" PRId64 " %10" PRId64 " %10" PRId64 "\n",
+		       lat_name[j], st[j].min, st[j].sum / (int64_t)st[j].cnt,
+		       st[j].max);
+	}
+
+	for (j = 0; j < LAT_NUM; j++) {
+		if (!st[j].cnt)
+			continue;
+		printf("\n# %s histogram, bin %d ns, under %u, over %u\n",
+		       lat_name[j], bin_ns, st[j].under, st[j].over);
+		for (i = 0; i < hist_bins; i++)
+			if (st[j].hist[i])
+				printf("  %10" PRId64 " %10u\n",
+				       st[j].hist_base + (int64_t)i * bin_ns,
+				       st[j].hist[i]);
+	}
+}
+
+static void print_trace(const lat_stat_t *st, const char *name)
+{
+	const lat_rec_t *r;
+	int64_t t_ref = 0;
+	int i;
+
+	printf("\n# worst %s trace, times in ns from the scheduled wake-up "
+	       "of the first listed step\n", name);
+	printf("# %8s %10s %10s %10s %10s %8s %6s %3s\n", "step", "sched",
+	       "wake", "xfer_beg", "xfer_end", "irc", "sqn", "hal");
+	for (i = 0; i < trace_len; i++) {
+		r = &st->worst[i];
+		if (!r->step)
+			continue;
+		if (!t_ref)
+			t_ref = r->t_sched;
+		printf("  %8u %10" PRId64 " %10" PRId64 " %10" PRId64 " %10" PRId64
+		       " %8" PRIu32 " %6u %3u\n", r->step, r->t_sched - t_ref,
+		       r->t_wake - t_ref, r->t_xfer_beg - t_ref,
+		       r->t_xfer_end - t_ref, r->act_pos, r->curadc_sqn,
+		       r->hal_sensors);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	z3pmdrv1_state_t z3pmcst;
+	lat_stat_t st[LAT_NUM];
+	lat_rec_t *ring, *rec;
+	struct sched_param schp;
+	struct timespec next;
+	double rate = 10000;
+	double duty = -1;
+	long period_ns;
+	long steps = 100000;
+	uint32_t step;
+	uint32_t overruns = 0;
+	uint64_t elided = 0;
+	int64_t t0, t_prev_wake = 0, t_prev_xfer_end = 0;
+	int use_irq;
+	int priority = 80;
+	int cpu = -1;
+	int quiet = 0;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "r:p:a:n:m:i:e:b:H:T:q")) != -1) {
+		switch (opt) {
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'p':
+			priority = atoi(optarg);
+			break;
+		case 'a':
+			cpu = atoi(optarg);
+			break;
+		case 'n':
+			steps = atol(optarg);
+			break;
+		case 'm':
+			setenv("MZAPO_MEMDEV", optarg, 1);
+			break;
+		case 'i':
+			setenv("MZAPO_IRQDEV", optarg, 1);
+			break;
+		case 'e':
+			duty = atof(optarg);
+			break;
+		case 'b':
+			bin_ns = atoi(optarg);
+			break;
+		case 'H':
+			hist_bins = atoi(optarg);
+			break;
+		case 'T':
+			trace_len = atoi(optarg);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r rate_hz] [-p priority] [-a cpu]"
+				" [-n steps] [-m memdev] [-i irqdev] [-e duty]"
+				" [-b bin_ns] [-H bins] [-T trace_len] [-q]\n", argv[0]);
+			return 1;
+		}
+	}
+	if ((rate <= 0) || (steps <= 0) || (bin_ns <= 0) ||
+	    (hist_bins <= 0) || (trace_len <= 0)) {
+		fprintf(stderr, "rate, steps, bin, bins and trace length have to be positive\n");
+		return 1;
+	}
+	period_ns = 1e9 / rate;
+
+	ring = calloc(trace_len, sizeof(*ring));
+	for (i = 0; i < LAT_NUM; i++) {
+		if ((ring == NULL) || (lat_stat_init(&st[i], 0) < 0)) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+	}
+
+	memset(&z3pmcst, 0, sizeof(z3pmcst));
+	if (z3pmdrv1_init(&z3pmcst) < 0) {
+		fprintf(stderr, "z3pmdrv1_init failed (MZAPO_MEMDEV %s)\n",
+			getenv("MZAPO_MEMDEV")? getenv("MZAPO_MEMDEV"): "unset");
+		return 1;
+	}
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst.pwm[i] = z3pmdrv1_pwm_duty(&z3pmcst, i, duty, duty >= 0);
+
+	/* With the interrupt the wake-up is interval deviation, signed */
+	use_irq = z3pmcst.irq != NULL;
+	if (use_irq) {
+		free(st[LAT_WAKEUP].hist);
+		free(st[LAT_WAKEUP].worst);
+		lat_stat_init(&st[LAT_WAKEUP], 1);
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		fprintf(stderr, "mlockall failed\n");
+	schp.sched_priority = priority;
+	if (sched_setscheduler(0, SCHED_FIFO, &schp) < 0)
+		fprintf(stderr, "SCHED_FIFO not permitted, running with default policy\n");
+	if (cpu >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		if (sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0)
+			fprintf(stderr, "cannot pin to CPU %d\n", cpu);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	t0 = (int64_t)next.tv_sec * 1000000000 + next.tv_nsec;
+
+	for (step = 1; step <= steps; step++) {
+		rec = &ring[step % trace_len];
+		rec->step = step;
+
+		if (use_irq) {
+			int n;
+
+			do
+				n = z3pmdrv1_wait_period(&z3pmcst);
+			while ((n < 0) && (errno == EINTR));
+			if (n < 0) {
+				fprintf(stderr, "interrupt wait %s\n", errno == ETIMEDOUT?
+					"timed out": "failed");
+				break;
+			}
+			if (n > 1)
+				overruns += n - 1;
+			rec->t_wake = time_ns() - t0;
+			rec->t_sched = step > 1? t_prev_wake + period_ns: rec->t_wake;
+		} else {
+			ts_add_ns(&next, period_ns);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &next, NULL) == EINTR);
+			rec->t_wake = time_ns() - t0;
+			rec->t_sched = (int64_t)next.tv_sec * 1000000000 +
+				       next.tv_nsec - t0;
+		}
+
+		rec->t_xfer_beg = time_ns() - t0;
+		z3pmdrv1_transfer(&z3pmcst);
+		rec->t_xfer_end = time_ns() - t0;
+		elided += z3pmcst.pwm_elided;
+
+		rec->act_pos = z3pmcst.act_pos;
+		rec->curadc_sqn = z3pmcst.curadc_sqn;
+		rec->hal_sensors = z3pmcst.hal_sensors;
+
+		if ((step > 1) || !use_irq)
+			lat_stat_add(&st[LAT_WAKEUP], rec->t_wake - rec->t_sched,
+				     ring, step);
+		lat_stat_add(&st[LAT_XFER], rec->t_xfer_end - rec->t_xfer_beg,
+			     ring, step);
+		if (step > 1)
+			lat_stat_add(&st[LAT_S2A], rec->t_xfer_beg - t_prev_xfer_end,
+				     ring, step);
+		t_prev_wake = rec->t_wake;
+		t_prev_xfer_end = rec->t_xfer_end;
+
+		/* Skip missed periods instead of bursting to catch up */
+		if (!use_irq &&
+		    (rec->t_xfer_end - rec->t_sched > period_ns)) {
+			overruns += (rec->t_xfer_end - rec->t_sched) / period_ns;
+			clock_gettime(CLOCK_MONOTONIC, &next);
+		}
+	}
+
+	z3pmdrv1_pwm_shutdown(&z3pmcst);
+	z3pmdrv1_release(&z3pmcst);
+
+	schp.sched_priority = 0;
+	sched_setscheduler(0, SCHED_OTHER, &schp);
+
+	printf("# %u steps at %.1f Hz (%ld ns), %s, overruns %u\n",
+	       step - 1, rate, period_ns, use_irq? "interrupt": "timer",
+	       overruns);
+	printf("# PWM writes elided %" PRIu64 " of %" PRIu64 "\n", elided,
+	       (uint64_t)(step - 1) * Z3PMDRV1_CHAN_COUNT);
+	print_stats(st);
+	if (!quiet)
+		for (i = 0; i < LAT_NUM; i++)
+			print_trace(&st[i], lat_name[i]);
+
+	return 0;
+}
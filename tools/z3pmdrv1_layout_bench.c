@@ -0,0 +1,424 @@
+/*******************************************************************
+  Cache behavior of the z3pmdrv1_state_t hot/cold layout compared
+  with the original flat layout.
+
+  Build:
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_layout_bench \
+        z3pmdrv1_layout_bench.c -lm -lpthread
+
+  Usage:
+    z3pmdrv1_layout_bench [-n instances] [-s steps] [-r repeats]
+
+  Both layouts run the same per-step accesses of the driver state as
+  z3pmdrv1_transfer() and the sfPMSMonZynq3pmdrv1 output step do
+  (registers are plain memory here, one block shared by all
+  instances). The report gives
+
+    lines      - cache lines touched per step, written and read only,
+                 computed from the member offsets
+    working    - ns, L1D read misses and LLC misses per step when -n
+                 instances (8192) are stepped in random order, the
+                 state does not fit the cache, each step pays for the
+                 lines it touches
+    sharing    - ns per step of one instance while second thread on
+                 another CPU polls the configuration members, as
+                 a view or telemetry reader does (needs 2 CPUs)
+
+  Each measurement is repeated -r times (5) and the fastest run is
+  reported. Miss counts come from perf_event (user space only), "-" is printed
+  when the kernel does not allow them.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_adcavg.h"
+#include "../common/phys_address_access.h"
+
+/* The layout before the hot/cold split */
+typedef struct z3pmdrv1_state_flat_t {
+  uintptr_t regs_base_phys;
+  struct mem_address_map_t *memadrs;
+  uint32_t pwm[Z3PMDRV1_CHAN_COUNT];
+  uint32_t act_pos;
+  uint32_t index_pos;
+  uint32_t index_occur;
+  uint32_t pos_offset;
+  int32_t  curadc_val[Z3PMDRV1_CHAN_COUNT];
+  int32_t  curadc_offs[Z3PMDRV1_CHAN_COUNT];
+  int32_t  curadc_offs_cal[Z3PMDRV1_CHAN_COUNT];
+  uint8_t  hal_sensors;
+  uint16_t curadc_sqn;
+  uint16_t curadc_sqn_last;
+  uint32_t curadc_cumsum[Z3PMDRV1_CHAN_COUNT];
+  uint32_t curadc_cumsum_last[Z3PMDRV1_CHAN_COUNT];
+  int      prof_id;
+  struct mzapo_irq_t *irq;
+  mzapo_sdm_t pwm_sdm[Z3PMDRV1_CHAN_COUNT];
+  struct z3pmdrv1_dtc_t *dtc;
+  struct z3pmdrv1_commis_t *commis;
+} z3pmdrv1_state_flat_t;
+
+/* Members accessed by one step, W written, R read only */
+#define LAYOUT_ACCESS(X) \
+	X(memadrs, 'R') X(pwm, 'W') X(act_pos, 'W') X(index_pos, 'W') \
+	X(index_occur, 'W') X(pos_offset, 'R') X(curadc_val, 'W') \
+	X(curadc_offs, 'R') X(hal_sensors, 'W') X(curadc_sqn, 'W') \
+	X(curadc_sqn_last, 'W') X(curadc_cumsum, 'W') \
+	X(curadc_cumsum_last, 'W') X(pwm_sdm, 'W') X(dtc, 'R') X(commis, 'R')
+
+/*
+ * Transfer (PWM write, IRC, index, ADC read), ADC window average,
+ * position output and PWM duty quantization of one step
+ */
+#define LAYOUT_STEP(st, out) do { \
+	volatile uint32_t *r = (volatile uint32_t *)(st)->memadrs->regs_base_virt; \
+	uint32_t idx, sqn_stat; \
+	int ch; \
+	r[2] = (st)->pwm[0]; r[3] = (st)->pwm[1]; r[4] = (st)->pwm[2]; \
+	(st)->act_pos = r[0]; \
+	idx = r[1]; \
+	if (idx ^ (st)->index_pos) \
+		(st)->index_occur++; \
+	(st)->index_pos = idx; \
+	sqn_stat = r[8]; \
+	(st)->curadc_sqn = sqn_stat & 0xfff; \
+	(st)->hal_sensors = (sqn_stat >> 16) & 7; \
+	for (ch = 0; ch < Z3PMDRV1_CHAN_COUNT; ch++) \
+		(st)->curadc_cumsum[ch] = r[9 + ch]; \
+	z3pmdrv1_adcavg_q16((st)->curadc_cumsum, (st)->curadc_cumsum_last, \
+			    (st)->curadc_offs, (st)->curadc_sqn, \
+			    (st)->curadc_sqn_last, (st)->curadc_val); \
+	(st)->curadc_sqn_last = (st)->curadc_sqn; \
+	for (ch = 0; ch < Z3PMDRV1_CHAN_COUNT; ch++) \
+		(st)->curadc_cumsum_last[ch] = (st)->curadc_cumsum[ch]; \
+	(out) += (st)->act_pos + (st)->pos_offset + ((st)->dtc != NULL) + \
+		 ((st)->commis != NULL); \
+	for (ch = 0; ch < Z3PMDRV1_CHAN_COUNT; ch++) \
+		(st)->pwm[ch] = (uint32_t)mzapo_sdm_quantize(&(st)->pwm_sdm[ch], \
+			2500.3f + (st)->curadc_val[ch] * 1e-6f, 0, \
+			Z3PMDRV1_PWM_DUTY_FULL) | Z3PMDRV1_PWM_ENABLE; \
+} while (0)
+
+#define LAYOUT_NUM  2
+
+static const char *const layout_name[LAYOUT_NUM] = {"flat", "split"};
+
+typedef struct bench_perf_t {
+	int      fd[2];
+	uint64_t val[2];
+} bench_perf_t;
+
+static const uint64_t bench_perf_config[2] = {
+	PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+	PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+};
+
+static uint32_t regs[16] __attribute__((aligned(64)));
+
+/* Register map handle shared by all instances, as the registry does */
+static mem_address_map_t regs_map = {.regs_base_virt = regs};
+
+static volatile int sharing_stop;
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t rnd_state = 12345;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static void perf_start(bench_perf_t *perf)
+{
+	struct perf_event_attr pe;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		memset(&pe, 0, sizeof(pe));
+		pe.size = sizeof(pe);
+		pe.type = PERF_TYPE_HW_CACHE;
+		pe.config = bench_perf_config[i];
+		pe.disabled = 1;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+		perf->fd[i] = syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+		if (perf->fd[i] >= 0) {
+			ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+static void perf_stop(bench_perf_t *perf)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		perf->val[i] = 0;
+		if (perf->fd[i] < 0)
+			continue;
+		ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf->fd[i], &perf->val[i], sizeof(perf->val[i])) !=
+		    sizeof(perf->val[i])) {
+			close(perf->fd[i]);
+			perf->fd[i] = -1;
+			continue;
+		}
+		close(perf->fd[i]);
+	}
+}
+
+static void print_perf(const bench_perf_t *perf, double steps)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (perf->fd[i] >= 0)
+			printf(" %9.3f", perf->val[i] / steps);
+		else
+			printf(" %9s", "-");
+	}
+}
+
+/* Lines of the layout touched by one step */
+static void print_lines(const char *name, size_t size, const size_t *offs,
+			const size_t *len, const char *acc, int count)
+{
+	uint64_t wr = 0, rd = 0;
+	int i;
+	size_t l;
+
+	for (i = 0; i < count; i++) {
+		for (l = offs[i] / 64; l <= (offs[i] + len[i] - 1) / 64; l++) {
+			if (acc[i] == 'W')
+				wr |= 1ull << l;
+			else
+				rd |= 1ull << l;
+		}
+	}
+	rd &= ~wr;
+	printf("%-8s %5zu %7d %7d %7d\n", name, size,
+	       __builtin_popcountll(wr | rd), __builtin_popcountll(wr),
+	       __builtin_popcountll(rd));
+}
+
+#define LAYOUT_OFFS(fld, a)  offsetof(LAYOUT_T, fld),
+#define LAYOUT_LEN(fld, a)   sizeof(((LAYOUT_T *)0)->fld),
+#define LAYOUT_ACC(fld, a)   a,
+
+static void report_lines(void)
+{
+	printf("%-8s %5s %7s %7s %7s\n", "lines", "size", "touched",
+	       "written", "read");
+	{
+  #define LAYOUT_T z3pmdrv1_state_flat_t
+		const size_t offs[] = {LAYOUT_ACCESS(LAYOUT_OFFS)};
+		const size_t len[] = {LAYOUT_ACCESS(LAYOUT_LEN)};
+		const char acc[] = {LAYOUT_ACCESS(LAYOUT_ACC)};
+		print_lines(layout_name[0], sizeof(LAYOUT_T), offs, len, acc,
+			    sizeof(acc));
+  #undef LAYOUT_T
+	}
+	{
+  #define LAYOUT_T z3pmdrv1_state_t
+		const size_t offs[] = {LAYOUT_ACCESS(LAYOUT_OFFS)};
+		const size_t len[] = {LAYOUT_ACCESS(LAYOUT_LEN)};
+		const char acc[] = {LAYOUT_ACCESS(LAYOUT_ACC)};
+		print_lines(layout_name[1], sizeof(LAYOUT_T), offs, len, acc,
+			    sizeof(acc));
+  #undef LAYOUT_T
+	}
+}
+
+#define LAYOUT_INIT(st) do { \
+	int ch; \
+	memset((st), 0, sizeof(*(st))); \
+	(st)->memadrs = &regs_map; \
+	for (ch = 0; ch < Z3PMDRV1_CHAN_COUNT; ch++) { \
+		(st)->curadc_offs[ch] = 2048; \
+		mzapo_sdm_init(&(st)->pwm_sdm[ch], 1); \
+	} \
+} while (0)
+
+/* Advance the registers as the FPGA does between steps */
+static inline void regs_step(void)
+{
+	regs[0] += 3;
+	regs[8] = (regs[8] + 20) & 0xfff;
+	regs[9] += 20 * 2050;
+	regs[10] += 20 * 2040;
+	regs[11] += 20 * 2060;
+}
+
+static void *sharing_reader(void *arg)
+{
+	volatile const uint32_t *cfg = arg;
+	uint32_t sum = 0;
+
+	while (!sharing_stop)
+		sum += cfg[0] + cfg[1] + cfg[2];
+	return (void *)(uintptr_t)sum;
+}
+
+static int pin_cpu(pthread_t th, int cpu)
+{
+	cpu_set_t cpuset;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	return pthread_setaffinity_np(th, sizeof(cpuset), &cpuset);
+}
+
+#define LAYOUT_RUN_WORKING(T, name) do { \
+	T *st; \
+	if (posix_memalign((void **)&st, 64, n * sizeof(*st)) != 0) \
+		return 1; \
+	for (i = 0; i < n; i++) \
+		LAYOUT_INIT(&st[i]); \
+	for (k = 0; k < n; k++) \
+		LAYOUT_STEP(&st[order[k]], out); \
+	for (rep = 0, best = UINT64_MAX; rep < repeats; rep++) { \
+		perf_start(&perf_rep); \
+		t0 = time_ns(); \
+		for (j = 0; j < passes; j++) { \
+			regs_step(); \
+			for (k = 0; k < n; k++) \
+				LAYOUT_STEP(&st[order[k]], out); \
+		} \
+		t1 = time_ns(); \
+		perf_stop(&perf_rep); \
+		if (t1 - t0 < best) { \
+			best = t1 - t0; \
+			perf = perf_rep; \
+		} \
+	} \
+	printf("%-8s %9.2f", name, (double)best / ((double)passes * n)); \
+	print_perf(&perf, (double)passes * n); \
+	printf("\n"); \
+	free(st); \
+} while (0)
+
+#define LAYOUT_RUN_SHARING(T, name) do { \
+	T *st; \
+	pthread_t th; \
+	if (posix_memalign((void **)&st, 64, sizeof(*st)) != 0) \
+		return 1; \
+	LAYOUT_INIT(st); \
+	sharing_stop = 0; \
+	pthread_create(&th, NULL, sharing_reader, (void *)&st->curadc_offs); \
+	pin_cpu(th, 1); \
+	pin_cpu(pthread_self(), 0); \
+	usleep(10000); \
+	for (rep = 0, best = UINT64_MAX; rep < repeats; rep++) { \
+		t0 = time_ns(); \
+		for (j = 0; j < steps; j++) { \
+			regs_step(); \
+			LAYOUT_STEP(st, out); \
+		} \
+		t1 = time_ns(); \
+		if (t1 - t0 < best) \
+			best = t1 - t0; \
+	} \
+	sharing_stop = 1; \
+	pthread_join(th, NULL); \
+	printf("%-8s %9.2f\n", name, (double)best / steps); \
+	free(st); \
+} while (0)
+
+int main(int argc, char *argv[])
+{
+	bench_perf_t perf, perf_rep;
+	uint32_t *order;
+	uint64_t t0, t1, best;
+	long n = 8192;
+	long steps = 10000000;
+	long passes, i, j, k;
+	uint32_t out = 0;
+	int repeats = 5;
+	int opt, rep;
+
+	while ((opt = getopt(argc, argv, "n:s:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = atol(optarg);
+			break;
+		case 's':
+			steps = atol(optarg);
+			break;
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n instances] [-s steps] [-r repeats]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (n < 1)
+		n = 1;
+	if (repeats < 1)
+		repeats = 1;
+	passes = steps / n > 0? steps / n: 1;
+
+	z3pmdrv1_adcavg_init();
+
+	report_lines();
+
+	/* Random visiting order defeats the hardware prefetcher */
+	order = malloc(n * sizeof(*order));
+	if (order == NULL)
+		return 1;
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	for (i = n - 1; i > 0; i--) {
+		uint32_t t;
+
+		j = rnd() % (i + 1);
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	printf("\n%-8s %9s %9s %9s  (%ld instances)\n", "working", "ns/step",
+	       "L1D-miss", "LLC-miss", n);
+	LAYOUT_RUN_WORKING(z3pmdrv1_state_flat_t, layout_name[0]);
+	LAYOUT_RUN_WORKING(z3pmdrv1_state_t, layout_name[1]);
+
+	printf("\n%-8s %9s\n", "sharing", "ns/step");
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+		printf("skipped, single CPU\n");
+	} else {
+		LAYOUT_RUN_SHARING(z3pmdrv1_state_flat_t, layout_name[0]);
+		LAYOUT_RUN_SHARING(z3pmdrv1_state_t, layout_name[1]);
+	}
+
+	free(order);
+	return out == 1? 2: 0;
+}
@@ -0,0 +1,171 @@
+/*******************************************************************
+  Low priority reader of the 3-phase driver loop telemetry published
+  by sfPMSMonZynq3pmdrv1 in POSIX shared memory.
+
+  Build (on target or host):
+    gcc -O2 -Wall -I../simulink/mz_apo-3pmdrv -o z3pmdrv1_tlm_view \
+        z3pmdrv1_tlm_view.c -lrt
+
+  Usage:
+    z3pmdrv1_tlm_view [-n shm_name] [-i interval_s] [-c count]
+
+  Every interval prints the ADC window statistics, PWM register writes
+  issued and elided as unchanged, inner loop thread steps and overruns
+  when the thread is used, PWM periods missed by the interrupt wait
+  of the step when there are any, and histograms of ADC samples per
+  step and of the step period deviation accumulated since the previous
+  report. The process switches itself to
+  SCHED_IDLE so it never competes with the control loop.
+
+  license:  any combination of GPL, LGPL, MPL or BSD licenses
+
+ *******************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "zynq_3pmdrv1_tlm.h"
+
+static void print_hist(const char *title, const uint32_t *cur,
+		       const uint32_t *prev, int size, int center, int bin_ns)
+{
+	uint32_t max = 0;
+	int i;
+
+	for (i = 0; i < size; i++)
+		if (cur[i] - prev[i] > max)
+			max = cur[i] - prev[i];
+	if (!max)
+		return;
+
+	printf("  %s\n", title);
+	for (i = 0; i < size; i++) {
+		uint32_t cnt = cur[i] - prev[i];
+		int bar;
+
+		if (!cnt)
+			continue;
+		bar = (int)((uint64_t)cnt * 50 / max);
+		if (bin_ns)
+			printf("  %+8d us %10u |", (i - center) * bin_ns / 1000, cnt);
+		else
+			printf("  %10d %10u |", i, cnt);
+		while (bar-- > 0)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+static void report(const z3pmdrv1_tlm_t *cur, const z3pmdrv1_tlm_t *prev)
+{
+	uint64_t steps = cur->steps - prev->steps;
+	uint64_t valid = cur->runs_valid - prev->runs_valid;
+	uint64_t over = cur->runs_over - prev->runs_over;
+	uint64_t miss = cur->runs_miss - prev->runs_miss;
+	uint64_t issued = cur->wr_issued - prev->wr_issued;
+	uint64_t elided = cur->wr_elided - prev->wr_elided;
+	uint64_t rtl_steps = cur->rtl_steps - prev->rtl_steps;
+
+	printf("steps %" PRIu64 " valid %" PRIu64 " over %" PRIu64
+	       " missed %" PRIu64 "\n", steps, valid, over, miss);
+	if (valid)
+		printf("  aver ADC samples per step %.2f\n",
+		       (double)(cur->sqn_accum - prev->sqn_accum) / valid);
+	if (over)
+		printf("  aver ADC samples per over-range step %.2f\n",
+		       (double)(cur->sqn_accum_over - prev->sqn_accum_over) / over);
+	if (cur->period_ns && (cur->steps > 1))
+		printf("  period %u ns, deviation min %" PRId64 " max %" PRId64
+		       " ns (whole run), aver |dev| %.0f ns\n", cur->period_ns,
+		       cur->jit_min_ns, cur->jit_max_ns, steps?
+		       (double)(cur->jit_abs_accum_ns - prev->jit_abs_accum_ns) / steps: 0);
+	if (steps)
+		printf("  PWM writes issued %" PRIu64 " elided %" PRIu64
+		       ", elided per step %.2f\n", issued, elided,
+		       (double)elided / steps);
+	if (cur->rtl_steps)
+		printf("  inner loop steps %" PRIu64 " overruns %" PRIu64
+		       " (whole run %" PRIu64 ")\n", rtl_steps,
+		       cur->rtl_overruns - prev->rtl_overruns, cur->rtl_overruns);
+	if (cur->irq_missed)
+		printf("  PWM periods missed %" PRIu64 " (whole run %" PRIu64 ")\n",
+		       cur->irq_missed - prev->irq_missed, cur->irq_missed);
+
+	print_hist("ADC samples per step:", cur->sqn_hist, prev->sqn_hist,
+		   Z3PMDRV1_TLM_SQN_HIST_SIZE, 0, 0);
+	print_hist("step period deviation:", cur->jit_hist, prev->jit_hist,
+		   Z3PMDRV1_TLM_JIT_HIST_SIZE, Z3PMDRV1_TLM_JIT_HIST_SIZE / 2,
+		   cur->jit_bin_ns);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = Z3PMDRV1_TLM_SHM_NAME;
+	struct sched_param schp = {.sched_priority = 0};
+	static z3pmdrv1_tlm_t cur, prev;
+	const z3pmdrv1_tlm_t *tlm;
+	double interval = 1.0;
+	int count = -1;
+	int fd;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:i:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'i':
+			interval = atof(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n shm_name] [-i interval_s]"
+				" [-c count]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	sched_setscheduler(0, SCHED_IDLE, &schp);
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "cannot open shared memory %s\n", name);
+		return 1;
+	}
+	tlm = mmap(NULL, sizeof(*tlm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (tlm == MAP_FAILED) {
+		fprintf(stderr, "cannot map shared memory %s\n", name);
+		return 1;
+	}
+	if ((tlm->magic != Z3PMDRV1_TLM_MAGIC) ||
+	    (tlm->version != Z3PMDRV1_TLM_VERSION)) {
+		fprintf(stderr, "%s: incompatible telemetry layout\n", name);
+		return 1;
+	}
+
+	if (z3pmdrv1_tlm_snapshot(tlm, &prev) < 0)
+		memset(&prev, 0, sizeof(prev));
+
+	while (count--) {
+		usleep(interval * 1e6);
+		if (z3pmdrv1_tlm_snapshot(tlm, &cur) < 0)
+			continue;
+		report(&cur, &prev);
+		prev = cur;
+	}
+
+	return 0;
+}